@@ -0,0 +1,428 @@
+/** @file Main.c
+ * Measure the speed of the CPU-side processing functions, so performance regressions can be tracked between releases.
+ * Each benchmark result is printed on its own line as a JSON object.
+ * @author Adrien RICCIARDI
+ */
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE // The file manager module needs it, it must be defined before any system header is included
+// Include the modules sources to be able to call their private functions
+#include "../Sources/File_Manager.c"
+#include "../Sources/MMS.c"
+#include "../Sources/SMS.c"
+#include <ftw.h>
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** How many times each benchmark is run before measuring it, so caches and branch predictors are warmed. */
+#define BENCHMARK_WARM_UP_REPETITIONS_COUNT 3
+/** How many measures are taken for each benchmark. */
+#define BENCHMARK_REPETITIONS_COUNT 15
+/** The minimum duration of a measure in nanoseconds, the benchmark function is called as many times as needed to reach it. */
+#define BENCHMARK_MINIMUM_MEASURE_DURATION 10000000ULL
+
+/** The size of the data processed by the hexadecimal conversion benchmarks. */
+#define BENCHMARK_HEXADECIMAL_DATA_SIZE 65536
+/** The size of the data processed by the character set conversion benchmarks. */
+#define BENCHMARK_CHARACTER_SET_DATA_SIZE 4096
+/** The amount of characters in a full 7-bit encoded SMS. */
+#define BENCHMARK_SMS_CHARACTERS_COUNT 160
+/** The size of each file attached to the MMS processed by the MMS benchmark. */
+#define BENCHMARK_MMS_ATTACHED_FILE_SIZE 32768
+/** How many files are attached to the MMS processed by the MMS benchmark. */
+#define BENCHMARK_MMS_ATTACHED_FILES_COUNT 4
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** A function to measure.
+ * @param Pointer_Context The benchmark data.
+ */
+typedef void (*TBenchmarkFunction)(void *Pointer_Context);
+
+/** The data used by the hexadecimal conversion benchmarks. */
+typedef struct
+{
+	unsigned char Binary_Buffer[BENCHMARK_HEXADECIMAL_DATA_SIZE];
+	char String_Hexadecimal[BENCHMARK_HEXADECIMAL_DATA_SIZE * 2 + 1];
+} TBenchmarkHexadecimalContext;
+
+/** The data used by the SMS benchmarks. */
+typedef struct
+{
+	unsigned char Compressed_Text[BENCHMARK_SMS_CHARACTERS_COUNT * 7 / 8];
+	char String_Uncompressed_Text[BENCHMARK_SMS_CHARACTERS_COUNT + 1];
+	char String_Work_Text[BENCHMARK_SMS_CHARACTERS_COUNT + 1];
+	char String_Converted_Text[SMS_TEXT_STRING_MAXIMUM_SIZE];
+} TBenchmarkSMSContext;
+
+/** The data used by the character set conversion benchmarks. */
+typedef struct
+{
+	char String_UTF8[BENCHMARK_CHARACTER_SET_DATA_SIZE + 1];
+	unsigned char UTF16_Buffer[BENCHMARK_CHARACTER_SET_DATA_SIZE * 2 + 1]; // Keep room for the terminating zero
+	int UTF16_Buffer_Size;
+	char String_Output[BENCHMARK_CHARACTER_SET_DATA_SIZE * 4 + 1];
+} TBenchmarkCharacterSetContext;
+
+/** The data used by the MMS benchmark. */
+typedef struct
+{
+	char *Pointer_PDU; //!< The PDU is stored in RAM, like when it is downloaded from the phone.
+	size_t PDU_Size;
+	char String_Output_Directory_Path[256];
+} TBenchmarkMMSContext;
+
+/** The data used by the file chunk decoding benchmark. */
+typedef struct
+{
+	char String_Line[FILE_MANAGER_DOWNLOAD_LINE_SIZE]; //!< A "+EFSR" answer line holding the biggest possible chunk.
+	unsigned char Data[FILE_MANAGER_DOWNLOAD_MAXIMUM_CHUNK_SIZE];
+} TBenchmarkFileChunkContext;
+
+/** The data used by the list benchmark. */
+typedef struct
+{
+	int Items_Count;
+} TBenchmarkListContext;
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** Written by the benchmark functions so the compiler can't remove the measured code. */
+static volatile int Benchmark_Sink;
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Get a monotonic timestamp.
+ * @return The current time in nanoseconds.
+ */
+static unsigned long long BenchmarkGetTime(void)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return (unsigned long long) Time.tv_sec * 1000000000ULL + (unsigned long long) Time.tv_nsec;
+}
+
+/** Used by qsort() to sort the measures. */
+static int BenchmarkCompareMeasures(const void *Pointer_Measure_1, const void *Pointer_Measure_2)
+{
+	double Measure_1 = *(const double *) Pointer_Measure_1, Measure_2 = *(const double *) Pointer_Measure_2;
+
+	if (Measure_1 < Measure_2) return -1;
+	if (Measure_1 > Measure_2) return 1;
+	return 0;
+}
+
+/** Measure a function and print the statistics as a JSON object.
+ * @param Pointer_String_Name The benchmark name.
+ * @param Pointer_String_Unit The reported unit, like "ns/byte" or "ns/op".
+ * @param Work_Units_Count How many units (bytes, operations...) are processed by a single function call.
+ * @param Function The function to measure.
+ * @param Pointer_Context The function data.
+ */
+static void BenchmarkRun(char *Pointer_String_Name, char *Pointer_String_Unit, unsigned long long Work_Units_Count, TBenchmarkFunction Function, void *Pointer_Context)
+{
+	double Measures[BENCHMARK_REPETITIONS_COUNT], Mean = 0, Variance = 0, Deviation;
+	unsigned long long Calls_Count = 1, Start_Time, Duration;
+	unsigned long long i;
+	int Repetition;
+
+	// Warm up and find how many calls are needed to get a long enough measure
+	for (Repetition = 0; Repetition < BENCHMARK_WARM_UP_REPETITIONS_COUNT; Repetition++)
+	{
+		while (1)
+		{
+			Start_Time = BenchmarkGetTime();
+			for (i = 0; i < Calls_Count; i++) Function(Pointer_Context);
+			Duration = BenchmarkGetTime() - Start_Time;
+			if (Duration >= BENCHMARK_MINIMUM_MEASURE_DURATION) break;
+			Calls_Count *= 2;
+		}
+	}
+
+	// Take the measures
+	for (Repetition = 0; Repetition < BENCHMARK_REPETITIONS_COUNT; Repetition++)
+	{
+		Start_Time = BenchmarkGetTime();
+		for (i = 0; i < Calls_Count; i++) Function(Pointer_Context);
+		Duration = BenchmarkGetTime() - Start_Time;
+		Measures[Repetition] = (double) Duration / (double) (Calls_Count * Work_Units_Count);
+		Mean += Measures[Repetition];
+	}
+
+	// Compute the statistics
+	Mean /= BENCHMARK_REPETITIONS_COUNT;
+	for (Repetition = 0; Repetition < BENCHMARK_REPETITIONS_COUNT; Repetition++)
+	{
+		Deviation = Measures[Repetition] - Mean;
+		Variance += Deviation * Deviation;
+	}
+	Variance /= BENCHMARK_REPETITIONS_COUNT - 1;
+	qsort(Measures, BENCHMARK_REPETITIONS_COUNT, sizeof(Measures[0]), BenchmarkCompareMeasures);
+
+	printf("{\"benchmark\": \"%s\", \"unit\": \"%s\", \"work_units\": %llu, \"calls_per_repetition\": %llu, \"warm_up_repetitions\": %d, \"repetitions\": %d, \"min\": %.4f, \"median\": %.4f, \"mean\": %.4f, \"max\": %.4f, \"stddev\": %.4f}\n",
+		Pointer_String_Name, Pointer_String_Unit, Work_Units_Count, Calls_Count, BENCHMARK_WARM_UP_REPETITIONS_COUNT, BENCHMARK_REPETITIONS_COUNT,
+		Measures[0], Measures[BENCHMARK_REPETITIONS_COUNT / 2], Mean, Measures[BENCHMARK_REPETITIONS_COUNT - 1], sqrt(Variance));
+	fflush(stdout);
+}
+
+/** Convert the hexadecimal string to binary. */
+static void BenchmarkHexadecimalToBinary(void *Pointer_Context)
+{
+	TBenchmarkHexadecimalContext *Pointer_Hexadecimal_Context = Pointer_Context;
+
+	Benchmark_Sink = ATCommandConvertHexadecimalToBinary(Pointer_Hexadecimal_Context->String_Hexadecimal, Pointer_Hexadecimal_Context->Binary_Buffer, sizeof(Pointer_Hexadecimal_Context->Binary_Buffer));
+}
+
+/** Convert the binary buffer to hexadecimal. */
+static void BenchmarkBinaryToHexadecimal(void *Pointer_Context)
+{
+	TBenchmarkHexadecimalContext *Pointer_Hexadecimal_Context = Pointer_Context;
+
+	Benchmark_Sink = ATCommandConvertBinaryToHexadecimal(Pointer_Hexadecimal_Context->Binary_Buffer, sizeof(Pointer_Hexadecimal_Context->Binary_Buffer), Pointer_Hexadecimal_Context->String_Hexadecimal, sizeof(Pointer_Hexadecimal_Context->String_Hexadecimal));
+}
+
+/** Unpack a full 7-bit encoded SMS. */
+static void BenchmarkSMSUnpack7BitSeptets(void *Pointer_Context)
+{
+	TBenchmarkSMSContext *Pointer_SMS_Context = Pointer_Context;
+
+	Benchmark_Sink = SMSUnpack7BitSeptets(Pointer_SMS_Context->Compressed_Text, sizeof(Pointer_SMS_Context->Compressed_Text), 0, BENCHMARK_SMS_CHARACTERS_COUNT, (unsigned char *) Pointer_SMS_Context->String_Work_Text);
+}
+
+/** Convert a full 7-bit SMS text to UTF-8. */
+static void BenchmarkSMSConvert7BitToUTF8(void *Pointer_Context)
+{
+	TBenchmarkSMSContext *Pointer_SMS_Context = Pointer_Context;
+
+	Benchmark_Sink = SMSConvert7BitToUTF8((unsigned char *) Pointer_SMS_Context->String_Uncompressed_Text, BENCHMARK_SMS_CHARACTERS_COUNT, Pointer_SMS_Context->String_Converted_Text, sizeof(Pointer_SMS_Context->String_Converted_Text));
+}
+
+/** Convert an UTF-16 text to UTF-8. */
+static void BenchmarkUtilityConvertStringUTF16ToUTF8(void *Pointer_Context)
+{
+	TBenchmarkCharacterSetContext *Pointer_Character_Set_Context = Pointer_Context;
+
+	Benchmark_Sink = UtilityConvertString(Pointer_Character_Set_Context->UTF16_Buffer, Pointer_Character_Set_Context->String_Output, UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN, UTILITY_CHARACTER_SET_UTF8, Pointer_Character_Set_Context->UTF16_Buffer_Size, sizeof(Pointer_Character_Set_Context->String_Output));
+}
+
+/** Convert an UTF-8 text to UTF-16. */
+static void BenchmarkUtilityConvertStringUTF8ToUTF16(void *Pointer_Context)
+{
+	TBenchmarkCharacterSetContext *Pointer_Character_Set_Context = Pointer_Context;
+
+	Benchmark_Sink = UtilityConvertString(Pointer_Character_Set_Context->String_UTF8, Pointer_Character_Set_Context->String_Output, UTILITY_CHARACTER_SET_UTF8, UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN, 0, sizeof(Pointer_Character_Set_Context->String_Output));
+}
+
+/** Parse a MMS file and extract its attached files. */
+static void BenchmarkMMSProcessMessage(void *Pointer_Context)
+{
+	TBenchmarkMMSContext *Pointer_MMS_Context = Pointer_Context;
+
+	Benchmark_Sink = MMSProcessMessage((unsigned char *) Pointer_MMS_Context->Pointer_PDU, Pointer_MMS_Context->PDU_Size, Pointer_MMS_Context->String_Output_Directory_Path);
+}
+
+/** Decode a full "+EFSR" file chunk answer line. */
+static void BenchmarkFileManagerDecodeChunkLine(void *Pointer_Context)
+{
+	TBenchmarkFileChunkContext *Pointer_File_Chunk_Context = Pointer_Context;
+
+	Benchmark_Sink = FileManagerDecodeChunkLine(Pointer_File_Chunk_Context->String_Line, Pointer_File_Chunk_Context->Data);
+}
+
+/** Fill a list and free it. */
+static void BenchmarkListAddItemAndClear(void *Pointer_Context)
+{
+	TBenchmarkListContext *Pointer_List_Context = Pointer_Context;
+	TList List;
+	int i;
+
+	ListInitialize(&List);
+	for (i = 0; i < Pointer_List_Context->Items_Count; i++) ListAddItem(&List, malloc(sizeof(int)));
+	Benchmark_Sink = List.Items_Count;
+	ListClear(&List);
+}
+
+/** Remove a file or an empty directory, used by nftw() to remove the temporary directory. */
+static int BenchmarkRemoveFile(const char *Pointer_String_Path, const struct stat *Pointer_Status, int Type_Flag, struct FTW *Pointer_FTW)
+{
+	(void) Pointer_Status;
+	(void) Type_Flag;
+	(void) Pointer_FTW;
+	return remove(Pointer_String_Path);
+}
+
+/** Make sure the file chunk decoder accepts all the answer line forms the phone sends, so the benchmark measures the real decoding.
+ * @param Pointer_File_Chunk_Context The benchmark data, the answer line must contain the biggest possible chunk.
+ * @return -1 if a line was not decoded as expected,
+ * @return 0 on success.
+ */
+static int BenchmarkCheckFileManagerDecodeChunkLine(TBenchmarkFileChunkContext *Pointer_File_Chunk_Context)
+{
+	static char String_Empty_Chunk_Without_Payload[] = "+EFSR: 0, 1, 0", String_Empty_Chunk[] = "+EFSR: 0, 1, 0, \"\"";
+	unsigned char Data[FILE_MANAGER_DOWNLOAD_MAXIMUM_CHUNK_SIZE];
+
+	// An empty chunk can be sent without the payload field
+	if (FileManagerDecodeChunkLine(String_Empty_Chunk_Without_Payload, Data) != 0) return -1;
+	if (FileManagerDecodeChunkLine(String_Empty_Chunk, Data) != 0) return -1;
+
+	// The full chunk must be decoded to the original data
+	if (FileManagerDecodeChunkLine(Pointer_File_Chunk_Context->String_Line, Data) != FILE_MANAGER_DOWNLOAD_MAXIMUM_CHUNK_SIZE) return -1;
+	if (memcmp(Data, Pointer_File_Chunk_Context->Data, sizeof(Data)) != 0) return -1;
+	return 0;
+}
+
+/** Create a MMS PDU with several attached files, using the encoding the phone uses.
+ * @param Pointer_MMS_Context On output, the PDU buffer and size are set. The buffer must be freed by the caller.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int BenchmarkCreateMMSPDU(TBenchmarkMMSContext *Pointer_MMS_Context)
+{
+	static unsigned char Attached_File_Data[BENCHMARK_MMS_ATTACHED_FILE_SIZE];
+	static char String_Phone_Number[] = "+33612345678/TYPE=PLMN", String_Content_Type[] = "image/jpeg";
+	FILE *Pointer_File;
+	char String_File_Name[32];
+	unsigned int Value, Headers_Length;
+	int i;
+
+	Pointer_File = open_memstream(&Pointer_MMS_Context->Pointer_PDU, &Pointer_MMS_Context->PDU_Size);
+	if (Pointer_File == NULL) return -1;
+
+	// Message type (m-retrieve-conf), MMS version 1.0 and date
+	fwrite("\x8C\x84\x8D\x90\x85\x04\x5F\x00\x00\x00", 10, 1, Pointer_File);
+	// From field, the address is present
+	fputc(0x89, Pointer_File);
+	fputc(1 + sizeof(String_Phone_Number), Pointer_File);
+	fputc(0x80, Pointer_File);
+	fwrite(String_Phone_Number, sizeof(String_Phone_Number), 1, Pointer_File);
+	// Content type (application/vnd.wap.multipart.related), followed by the attached files count
+	fwrite("\x84\x01\xB3", 3, 1, Pointer_File);
+	fputc(BENCHMARK_MMS_ATTACHED_FILES_COUNT, Pointer_File);
+
+	// Attached files
+	for (i = 0; i < (int) sizeof(Attached_File_Data); i++) Attached_File_Data[i] = (unsigned char) rand();
+	for (i = 0; i < BENCHMARK_MMS_ATTACHED_FILES_COUNT; i++)
+	{
+		// Headers length (content type, then the Content-Location header) and data length, both are encoded as uintvar
+		sprintf(String_File_Name, "Picture_%d.jpg", i);
+		Headers_Length = sizeof(String_Content_Type) + 1 + strlen(String_File_Name) + 1;
+		fputc(Headers_Length, Pointer_File);
+		Value = BENCHMARK_MMS_ATTACHED_FILE_SIZE;
+		fputc(0x80 | ((Value >> 14) & 0x7F), Pointer_File);
+		fputc(0x80 | ((Value >> 7) & 0x7F), Pointer_File);
+		fputc(Value & 0x7F, Pointer_File);
+
+		fwrite(String_Content_Type, sizeof(String_Content_Type), 1, Pointer_File);
+		fputc(0x8E, Pointer_File);
+		fwrite(String_File_Name, strlen(String_File_Name) + 1, 1, Pointer_File);
+		fwrite(Attached_File_Data, sizeof(Attached_File_Data), 1, Pointer_File);
+	}
+
+	if (fclose(Pointer_File) != 0) return -1; // The buffer and size are updated when the stream is closed
+	return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Entry point
+//-------------------------------------------------------------------------------------------------
+int main(void)
+{
+	static TBenchmarkHexadecimalContext Hexadecimal_Context;
+	static TBenchmarkSMSContext SMS_Context;
+	static TBenchmarkCharacterSetContext Character_Set_Context;
+	static TBenchmarkFileChunkContext File_Chunk_Context;
+	static int List_Sizes[] = { 1000, 4000, 16000 };
+	TBenchmarkMMSContext MMS_Context;
+	TBenchmarkListContext List_Context;
+	char String_Name[64], String_Temporary_Directory[] = "/tmp/b100-benchmark-XXXXXX";
+	unsigned int i, Bits_Count, Byte_Index;
+	int Length;
+	unsigned char Character;
+
+	srand(1234); // Always use the same data to get comparable results
+
+	// Hexadecimal conversions
+	for (i = 0; i < sizeof(Hexadecimal_Context.Binary_Buffer); i++) Hexadecimal_Context.Binary_Buffer[i] = (unsigned char) rand();
+	ATCommandConvertBinaryToHexadecimal(Hexadecimal_Context.Binary_Buffer, sizeof(Hexadecimal_Context.Binary_Buffer), Hexadecimal_Context.String_Hexadecimal, sizeof(Hexadecimal_Context.String_Hexadecimal));
+	BenchmarkRun("ATCommandConvertHexadecimalToBinary", "ns/byte", BENCHMARK_HEXADECIMAL_DATA_SIZE, BenchmarkHexadecimalToBinary, &Hexadecimal_Context);
+	BenchmarkRun("ATCommandConvertBinaryToHexadecimal", "ns/byte", BENCHMARK_HEXADECIMAL_DATA_SIZE, BenchmarkBinaryToHexadecimal, &Hexadecimal_Context);
+
+	// File chunk decoding, use the biggest chunk a "+EFSR" answer line can hold
+	for (i = 0; i < sizeof(File_Chunk_Context.Data); i++) File_Chunk_Context.Data[i] = (unsigned char) rand();
+	Length = snprintf(File_Chunk_Context.String_Line, sizeof(File_Chunk_Context.String_Line), "+EFSR: 1, 0, %d, \"", FILE_MANAGER_DOWNLOAD_MAXIMUM_CHUNK_SIZE);
+	Length += ATCommandConvertBinaryToHexadecimal(File_Chunk_Context.Data, sizeof(File_Chunk_Context.Data), &File_Chunk_Context.String_Line[Length], sizeof(File_Chunk_Context.String_Line) - Length - 1);
+	strcpy(&File_Chunk_Context.String_Line[Length], "\"");
+	if (BenchmarkCheckFileManagerDecodeChunkLine(&File_Chunk_Context) != 0)
+	{
+		LOG("Error : the file chunk decoder did not return the expected data.\n");
+		return EXIT_FAILURE;
+	}
+	BenchmarkRun("FileManagerDecodeChunkLine", "ns/byte", FILE_MANAGER_DOWNLOAD_MAXIMUM_CHUNK_SIZE, BenchmarkFileManagerDecodeChunkLine, &File_Chunk_Context);
+
+	// SMS text, pack random printable characters 7 bits by 7 bits
+	for (i = 0; i < BENCHMARK_SMS_CHARACTERS_COUNT; i++)
+	{
+		Character = (unsigned char) (' ' + rand() % 95);
+		SMS_Context.String_Uncompressed_Text[i] = (char) Character;
+		Bits_Count = i * 7;
+		Byte_Index = Bits_Count / 8;
+		SMS_Context.Compressed_Text[Byte_Index] |= (unsigned char) (Character << (Bits_Count % 8));
+		if ((Bits_Count % 8 > 1) && (Byte_Index + 1 < sizeof(SMS_Context.Compressed_Text))) SMS_Context.Compressed_Text[Byte_Index + 1] |= (unsigned char) (Character >> (8 - Bits_Count % 8));
+	}
+	BenchmarkRun("SMSUnpack7BitSeptets", "ns/byte", BENCHMARK_SMS_CHARACTERS_COUNT, BenchmarkSMSUnpack7BitSeptets, &SMS_Context);
+	BenchmarkRun("SMSConvert7BitToUTF8", "ns/byte", BENCHMARK_SMS_CHARACTERS_COUNT, BenchmarkSMSConvert7BitToUTF8, &SMS_Context);
+
+	// Character set conversions, use a mix of ASCII and accented characters like in real file names and contact names
+	for (i = 0; i < BENCHMARK_CHARACTER_SET_DATA_SIZE; i++)
+	{
+		if ((i % 16 == 15) && (i + 1 < BENCHMARK_CHARACTER_SET_DATA_SIZE))
+		{
+			Character_Set_Context.String_UTF8[i] = (char) 0xC3; // "é"
+			i++;
+			Character_Set_Context.String_UTF8[i] = (char) 0xA9;
+		}
+		else Character_Set_Context.String_UTF8[i] = (char) ('a' + rand() % 26);
+	}
+	Character_Set_Context.UTF16_Buffer_Size = UtilityConvertString(Character_Set_Context.String_UTF8, Character_Set_Context.UTF16_Buffer, UTILITY_CHARACTER_SET_UTF8, UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN, 0, sizeof(Character_Set_Context.UTF16_Buffer));
+	if (Character_Set_Context.UTF16_Buffer_Size < 0)
+	{
+		LOG("Error : could not prepare the character set conversion data.\n");
+		return EXIT_FAILURE;
+	}
+	BenchmarkRun("UtilityConvertString UTF-16 to UTF-8", "ns/byte", Character_Set_Context.UTF16_Buffer_Size, BenchmarkUtilityConvertStringUTF16ToUTF8, &Character_Set_Context);
+	BenchmarkRun("UtilityConvertString UTF-8 to UTF-16", "ns/byte", BENCHMARK_CHARACTER_SET_DATA_SIZE, BenchmarkUtilityConvertStringUTF8ToUTF16, &Character_Set_Context);
+
+	// MMS parsing
+	if (mkdtemp(String_Temporary_Directory) == NULL)
+	{
+		LOG("Error : could not create the temporary directory (%s).\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	snprintf(MMS_Context.String_Output_Directory_Path, sizeof(MMS_Context.String_Output_Directory_Path), "%s", String_Temporary_Directory);
+	if ((BenchmarkCreateMMSPDU(&MMS_Context) != 0) || (MMSProcessMessage((unsigned char *) MMS_Context.Pointer_PDU, MMS_Context.PDU_Size, MMS_Context.String_Output_Directory_Path) != 0))
+	{
+		LOG("Error : could not prepare the MMS processing data.\n");
+		return EXIT_FAILURE;
+	}
+	BenchmarkRun("MMSProcessMessage", "ns/byte", (unsigned long long) MMS_Context.PDU_Size, BenchmarkMMSProcessMessage, &MMS_Context);
+	free(MMS_Context.Pointer_PDU);
+	nftw(String_Temporary_Directory, BenchmarkRemoveFile, 16, FTW_DEPTH | FTW_PHYS);
+
+	// Lists
+	for (i = 0; i < UTILITY_ARRAY_SIZE(List_Sizes); i++)
+	{
+		List_Context.Items_Count = List_Sizes[i];
+		snprintf(String_Name, sizeof(String_Name), "ListAddItem and ListClear (%d items)", List_Sizes[i]);
+		BenchmarkRun(String_Name, "ns/op", (unsigned long long) List_Sizes[i], BenchmarkListAddItemAndClear, &List_Context);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,899 @@
+/** @file Main.c
+ * Emulate the serial port interface of a CAT B100 phone through a pseudo-terminal, so b100-tools can be run and benchmarked without a real phone.
+ * @author Adrien RICCIARDI
+ */
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+#include <AT_Command.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <Log.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <Utility.h>
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** Allow to turn on or off debug messages. */
+#define EMULATOR_IS_DEBUG_ENABLED 0
+
+/** The maximum length of a received command line (a file chunk sent by AT+EFSW can be quite big). */
+#define EMULATOR_MAXIMUM_COMMAND_LENGTH 65536
+
+/** The biggest file read chunk size, so a chunk encoded in hexadecimal fits in an answer line. */
+#define EMULATOR_MAXIMUM_READ_CHUNK_SIZE 16384
+
+/** How many MMS storage location and device combinations can be configured. */
+#define EMULATOR_MAXIMUM_MMS_STORAGES_COUNT 10
+
+/** The size in bytes of a record in a MMS database file. */
+#define EMULATOR_MMS_DATABASE_RECORD_SIZE 136
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** A SMS storage slot. */
+typedef struct
+{
+	int Storage_Location; //!< The message storage location reported by AT+EMGR, it is set to 0 if the slot is empty.
+	char *Pointer_String_PDU; //!< The hexadecimal PDU of the message.
+} TEmulatorSMSSlot;
+
+/** A phone book entry. */
+typedef struct
+{
+	char *Pointer_String_Number; //!< Set to NULL if the entry is empty.
+	char *Pointer_String_Name; //!< The name in UTF-8.
+} TEmulatorPhoneBookEntry;
+
+/** A MMS storage location and device combination, as reported by AT+EMMSFS. */
+typedef struct
+{
+	int Storage_Location;
+	int Storage_Device;
+	char String_Payload_Directory[256]; //!< The phone path (UTF-8) of the directory containing the MMS files.
+	char String_Database_File[256]; //!< The phone path (UTF-8) of the MMS database file.
+} TEmulatorMMSStorage;
+
+/** A command handler.
+ * @param Pointer_String_Arguments The command characters following the command prefix.
+ * @return -1 to answer "ERROR",
+ * @return 0 to answer "OK",
+ * @return 1 if the handler already sent the final result code.
+ */
+typedef int (*TEmulatorCommandHandler)(char *Pointer_String_Arguments);
+
+/** Associate a command prefix to its handler. */
+typedef struct
+{
+	char *Pointer_String_Prefix;
+	TEmulatorCommandHandler Handler;
+} TEmulatorCommand;
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The pseudo-terminal master side, the emulated phone talks through it. */
+static int Emulator_Master_File_Descriptor;
+
+/** The local directory whose subdirectories with a single letter name are served as the phone drives. */
+static char *Pointer_String_Emulator_Root_Directory = ".";
+
+/** The emulated line rate in bits per second, 0 means that the pseudo-terminal speed is not limited. */
+static unsigned int Emulator_Line_Rate = 0;
+
+/** The time to wait in milliseconds before answering each command. */
+static unsigned int Emulator_Command_Latency = 0;
+
+/** The maximum amount of file bytes returned by each AT+EFSR answer line. */
+static unsigned int Emulator_Read_Chunk_Size = 200;
+
+/** The maximum amount of hexadecimal characters accepted by each AT+EFSW chunk command. */
+static unsigned int Emulator_Write_Chunk_Size = 1024;
+
+/** Tell whether the received commands are echoed. */
+static int Emulator_Is_Echo_Enabled = 1;
+
+/** The number of the received command that is ignored to simulate a communication glitch (the first command is 1), or 0 to answer all commands. */
+static unsigned int Emulator_Ignored_Command_Number = 0;
+/** How many commands have been received so far. */
+static unsigned int Emulator_Received_Commands_Count = 0;
+
+/** Tell whether the file manager has been enabled by AT+ESUO=3. */
+static int Emulator_Is_File_Manager_Enabled = 0;
+
+/** Tell whether the first information line of the current answer has been sent. */
+static int Emulator_Is_Answer_Started = 0;
+
+/** The file being written by AT+EFSW. */
+static int Emulator_Written_File_Descriptor = -1;
+
+/** All SMS storage slots, the first slot is the message 1. */
+static TEmulatorSMSSlot *Pointer_Emulator_SMS_Slots = NULL;
+static int Emulator_SMS_Slots_Count = 0;
+/** How many SMS the storage can hold. */
+static int Emulator_SMS_Capacity = 450;
+
+/** All phone book entries, the first entry is the index 1. */
+static TEmulatorPhoneBookEntry *Pointer_Emulator_Phone_Book_Entries = NULL;
+static int Emulator_Phone_Book_Entries_Count = 0;
+
+/** The amount of entries the emulated phone book can store. */
+static int Emulator_Phone_Book_Capacity = 500;
+
+/** The configured MMS storages. */
+static TEmulatorMMSStorage Emulator_MMS_Storages[EMULATOR_MAXIMUM_MMS_STORAGES_COUNT];
+static int Emulator_MMS_Storages_Count = 0;
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Wait for the specified amount of nanoseconds.
+ * @param Nanoseconds How long to wait.
+ */
+static void EmulatorSleep(unsigned long long Nanoseconds)
+{
+	struct timespec Time;
+
+	Time.tv_sec = Nanoseconds / 1000000000ULL;
+	Time.tv_nsec = Nanoseconds % 1000000000ULL;
+	while ((nanosleep(&Time, &Time) != 0) && (errno == EINTR));
+}
+
+/** Send data to the tool, taking the emulated line rate into account.
+ * @param Pointer_Buffer The data to send.
+ * @param Size How many bytes to send.
+ */
+static void EmulatorWrite(void *Pointer_Buffer, size_t Size)
+{
+	unsigned char *Pointer_Data = Pointer_Buffer;
+	ssize_t Written_Bytes_Count;
+
+	while (Size > 0)
+	{
+		Written_Bytes_Count = write(Emulator_Master_File_Descriptor, Pointer_Data, Size);
+		if (Written_Bytes_Count < 0)
+		{
+			if (errno == EINTR) continue;
+			LOG("Error : failed to write to the pseudo-terminal (%s).\n", strerror(errno));
+			return;
+		}
+
+		// A byte takes 10 bits on an 8N1 serial line
+		if (Emulator_Line_Rate > 0) EmulatorSleep(Written_Bytes_Count * 10ULL * 1000000000ULL / Emulator_Line_Rate);
+
+		Pointer_Data += Written_Bytes_Count;
+		Size -= Written_Bytes_Count;
+	}
+}
+
+/** Send an answer information line, preceded by the CRLF sequence that starts the answer if this is the first line.
+ * @param Pointer_String_Format The line format, like printf().
+ */
+static void EmulatorSendInformation(char *Pointer_String_Format, ...)
+{
+	static char String_Line[EMULATOR_MAXIMUM_COMMAND_LENGTH];
+	va_list Arguments_List;
+	int Length;
+
+	if (!Emulator_Is_Answer_Started)
+	{
+		EmulatorWrite("\r\n", 2);
+		Emulator_Is_Answer_Started = 1;
+	}
+
+	va_start(Arguments_List, Pointer_String_Format);
+	Length = vsnprintf(String_Line, sizeof(String_Line) - 2, Pointer_String_Format, Arguments_List);
+	va_end(Arguments_List);
+	if (Length < 0) return;
+	if (Length > (int) sizeof(String_Line) - 3) Length = sizeof(String_Line) - 3;
+
+	String_Line[Length] = '\r';
+	String_Line[Length + 1] = '\n';
+	EmulatorWrite(String_Line, Length + 2);
+}
+
+/** Send the final result code that ends an answer.
+ * @param Pointer_String_Result The result code, like "OK" or "ERROR".
+ */
+static void EmulatorSendResult(char *Pointer_String_Result)
+{
+	EmulatorWrite("\r\n", 2);
+	EmulatorWrite(Pointer_String_Result, strlen(Pointer_String_Result));
+	EmulatorWrite("\r\n", 2);
+}
+
+/** Convert an UTF-8 string to the hexadecimal UTF-16 big endian representation the phone uses.
+ * @param Pointer_String_UTF8 The string to convert.
+ * @param Pointer_String_Hexadecimal On output, contain the converted string.
+ * @param String_Size The size of the output string.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int EmulatorConvertUTF8ToHexadecimal(char *Pointer_String_UTF8, char *Pointer_String_Hexadecimal, unsigned int String_Size)
+{
+	unsigned char Buffer[1024];
+	int Size;
+
+	// An empty string can't be converted by iconv
+	if (Pointer_String_UTF8[0] == 0)
+	{
+		Pointer_String_Hexadecimal[0] = 0;
+		return 0;
+	}
+
+	Size = UtilityConvertString(Pointer_String_UTF8, Buffer, UTILITY_CHARACTER_SET_UTF8, UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN, 0, sizeof(Buffer));
+	if (Size < 0) return -1;
+	if (ATCommandConvertBinaryToHexadecimal(Buffer, Size, Pointer_String_Hexadecimal, String_Size) < 0) return -1;
+	return 0;
+}
+
+/** Convert a double-quoted hexadecimal UTF-16 phone path to the corresponding local path.
+ * @param Pointer_String_Argument The command argument starting with the double-quoted path.
+ * @param Pointer_String_Local_Path On output, contain the local path.
+ * @param Local_Path_Size The size of the local path string.
+ * @return -1 if the path is invalid,
+ * @return 0 on success.
+ */
+static int EmulatorGetLocalPath(char *Pointer_String_Argument, char *Pointer_String_Local_Path, size_t Local_Path_Size)
+{
+	char String_Phone_Path[1024], *Pointer_String_Path_End, *Pointer_Character;
+	unsigned char Buffer[1024];
+	int Size;
+
+	// Extract the hexadecimal path
+	if (*Pointer_String_Argument != '"') return -1;
+	Pointer_String_Argument++;
+	Pointer_String_Path_End = strchr(Pointer_String_Argument, '"');
+	if (Pointer_String_Path_End == NULL) return -1;
+
+	// Convert it to UTF-8
+	Size = ATCommandConvertHexadecimalCharactersToBinary(Pointer_String_Argument, (unsigned int) (Pointer_String_Path_End - Pointer_String_Argument), Buffer, sizeof(Buffer), NULL);
+	if (Size <= 0) return -1;
+	if (UtilityConvertString(Buffer, String_Phone_Path, UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN, UTILITY_CHARACTER_SET_UTF8, Size, sizeof(String_Phone_Path)) < 0) return -1;
+
+	// The path must start with a drive letter, like "C:\"
+	if ((String_Phone_Path[0] == 0) || (String_Phone_Path[1] != ':')) return -1;
+	String_Phone_Path[1] = '/';
+	for (Pointer_Character = String_Phone_Path; *Pointer_Character != 0; Pointer_Character++)
+	{
+		if (*Pointer_Character == '\\') *Pointer_Character = '/';
+	}
+
+	if (snprintf(Pointer_String_Local_Path, Local_Path_Size, "%s/%s", Pointer_String_Emulator_Root_Directory, String_Phone_Path) >= (int) Local_Path_Size) return -1;
+	LOG_DEBUG(EMULATOR_IS_DEBUG_ENABLED, "Phone path \"%s\" is served from \"%s\".\n", String_Phone_Path, Pointer_String_Local_Path);
+	return 0;
+}
+
+/** Read a whole text file line by line.
+ * @param Pointer_String_File_Name The file to read.
+ * @param Line_Callback Called for each line, the line terminating characters are removed.
+ * @return -1 if the file could not be read,
+ * @return 0 on success.
+ */
+static int EmulatorReadTextFile(char *Pointer_String_File_Name, int (*Line_Callback)(char *Pointer_String_Line))
+{
+	FILE *Pointer_File;
+	char *Pointer_String_Line = NULL;
+	size_t Line_Buffer_Size = 0;
+	ssize_t Length;
+	int Return_Value = -1;
+
+	Pointer_File = fopen(Pointer_String_File_Name, "r");
+	if (Pointer_File == NULL)
+	{
+		LOG("Error : could not open the file \"%s\" (%s).\n", Pointer_String_File_Name, strerror(errno));
+		return -1;
+	}
+
+	while ((Length = getline(&Pointer_String_Line, &Line_Buffer_Size, Pointer_File)) >= 0)
+	{
+		while ((Length > 0) && ((Pointer_String_Line[Length - 1] == '\n') || (Pointer_String_Line[Length - 1] == '\r'))) Length--;
+		Pointer_String_Line[Length] = 0;
+		if (Line_Callback(Pointer_String_Line) != 0) goto Exit;
+	}
+
+	// Everything went fine
+	Return_Value = 0;
+
+Exit:
+	free(Pointer_String_Line);
+	fclose(Pointer_File);
+	return Return_Value;
+}
+
+/** Add a SMS slot from a line of the SMS file ("<storage location> <hexadecimal PDU>", or "-" for an empty slot).
+ * @param Pointer_String_Line The line to parse.
+ * @return -1 if the line is malformed,
+ * @return 0 on success.
+ */
+static int EmulatorAddSMSSlot(char *Pointer_String_Line)
+{
+	TEmulatorSMSSlot *Pointer_Slot;
+	int Storage_Location, PDU_Offset;
+
+	// Ignore comments
+	if ((Pointer_String_Line[0] == 0) || (Pointer_String_Line[0] == '#')) return 0;
+
+	Pointer_Emulator_SMS_Slots = realloc(Pointer_Emulator_SMS_Slots, (Emulator_SMS_Slots_Count + 1) * sizeof(TEmulatorSMSSlot));
+	if (Pointer_Emulator_SMS_Slots == NULL) return -1;
+	Pointer_Slot = &Pointer_Emulator_SMS_Slots[Emulator_SMS_Slots_Count];
+	Pointer_Slot->Storage_Location = 0;
+	Pointer_Slot->Pointer_String_PDU = NULL;
+	Emulator_SMS_Slots_Count++;
+
+	if (strcmp(Pointer_String_Line, "-") == 0) return 0;
+	if (sscanf(Pointer_String_Line, "%d %n", &Storage_Location, &PDU_Offset) != 1)
+	{
+		LOG("Error : malformed SMS line \"%s\".\n", Pointer_String_Line);
+		return -1;
+	}
+	Pointer_Slot->Storage_Location = Storage_Location;
+	Pointer_Slot->Pointer_String_PDU = strdup(&Pointer_String_Line[PDU_Offset]);
+	return 0;
+}
+
+/** Add a phone book entry from a line of the phone book file ("<number><tab><name>", or an empty line for an empty entry).
+ * @param Pointer_String_Line The line to parse.
+ * @return -1 if the line is malformed,
+ * @return 0 on success.
+ */
+static int EmulatorAddPhoneBookEntry(char *Pointer_String_Line)
+{
+	TEmulatorPhoneBookEntry *Pointer_Entry;
+	char *Pointer_String_Name;
+
+	// Ignore comments
+	if (Pointer_String_Line[0] == '#') return 0;
+
+	Pointer_Emulator_Phone_Book_Entries = realloc(Pointer_Emulator_Phone_Book_Entries, (Emulator_Phone_Book_Entries_Count + 1) * sizeof(TEmulatorPhoneBookEntry));
+	if (Pointer_Emulator_Phone_Book_Entries == NULL) return -1;
+	Pointer_Entry = &Pointer_Emulator_Phone_Book_Entries[Emulator_Phone_Book_Entries_Count];
+	Pointer_Entry->Pointer_String_Number = NULL;
+	Pointer_Entry->Pointer_String_Name = NULL;
+	Emulator_Phone_Book_Entries_Count++;
+
+	if (Pointer_String_Line[0] == 0) return 0;
+	Pointer_String_Name = strchr(Pointer_String_Line, '\t');
+	if (Pointer_String_Name == NULL)
+	{
+		LOG("Error : malformed phone book line \"%s\", the number and the name must be separated by a tab.\n", Pointer_String_Line);
+		return -1;
+	}
+	*Pointer_String_Name = 0;
+	Pointer_Entry->Pointer_String_Number = strdup(Pointer_String_Line);
+	Pointer_Entry->Pointer_String_Name = strdup(Pointer_String_Name + 1);
+	return 0;
+}
+
+/** AT : check that the phone is responding. */
+static int EmulatorHandleAttention(char *Pointer_String_Arguments)
+{
+	if (Pointer_String_Arguments[0] != 0) return -1;
+	return 0;
+}
+
+/** ATE : enable or disable the command echo. */
+static int EmulatorHandleEcho(char *Pointer_String_Arguments)
+{
+	if (strcmp(Pointer_String_Arguments, "0") == 0) Emulator_Is_Echo_Enabled = 0;
+	else if ((strcmp(Pointer_String_Arguments, "1") == 0) || (Pointer_String_Arguments[0] == 0)) Emulator_Is_Echo_Enabled = 1;
+	else return -1;
+	return 0;
+}
+
+/** AT+ESUO : enable or disable the file manager. */
+static int EmulatorHandleFileManagerMode(char *Pointer_String_Arguments)
+{
+	if (strcmp(Pointer_String_Arguments, "=3") == 0) Emulator_Is_File_Manager_Enabled = 1;
+	else if (strcmp(Pointer_String_Arguments, "=4") == 0)
+	{
+		Emulator_Is_File_Manager_Enabled = 0;
+
+		// Leaving the file manager closes the file being written if any
+		if (Emulator_Written_File_Descriptor != -1)
+		{
+			close(Emulator_Written_File_Descriptor);
+			Emulator_Written_File_Descriptor = -1;
+		}
+	}
+	else return -1;
+	return 0;
+}
+
+/** AT+EFSL : list the drives or the content of a directory. */
+static int EmulatorHandleFileList(char *Pointer_String_Arguments)
+{
+	struct dirent **Pointer_Entries;
+	struct stat Status;
+	char String_Local_Path[4096], String_Entry_Path[4096 + 256], String_Hexadecimal[1024], String_Drive[3];
+	int Entries_Count, i, Return_Value = -1;
+
+	if (!Emulator_Is_File_Manager_Enabled) return -1;
+
+	// List the root directories named by a single letter
+	if (Pointer_String_Arguments[0] == 0)
+	{
+		Entries_Count = scandir(Pointer_String_Emulator_Root_Directory, &Pointer_Entries, NULL, alphasort);
+		if (Entries_Count < 0) return -1;
+		for (i = 0; i < Entries_Count; i++)
+		{
+			if ((strlen(Pointer_Entries[i]->d_name) == 1) && isalpha((unsigned char) Pointer_Entries[i]->d_name[0]) && (snprintf(String_Entry_Path, sizeof(String_Entry_Path), "%s/%s", Pointer_String_Emulator_Root_Directory, Pointer_Entries[i]->d_name) > 0) && (stat(String_Entry_Path, &Status) == 0) && S_ISDIR(Status.st_mode))
+			{
+				String_Drive[0] = Pointer_Entries[i]->d_name[0];
+				String_Drive[1] = ':';
+				String_Drive[2] = 0;
+				if (EmulatorConvertUTF8ToHexadecimal(String_Drive, String_Hexadecimal, sizeof(String_Hexadecimal)) == 0) EmulatorSendInformation("+EFSL: \"%s\"", String_Hexadecimal);
+			}
+			free(Pointer_Entries[i]);
+		}
+		free(Pointer_Entries);
+		return 0;
+	}
+
+	// List a directory content
+	if (Pointer_String_Arguments[0] != '=') return -1;
+	if (EmulatorGetLocalPath(&Pointer_String_Arguments[1], String_Local_Path, sizeof(String_Local_Path)) != 0) return -1;
+	Entries_Count = scandir(String_Local_Path, &Pointer_Entries, NULL, alphasort);
+	if (Entries_Count < 0) return -1;
+	for (i = 0; i < Entries_Count; i++)
+	{
+		snprintf(String_Entry_Path, sizeof(String_Entry_Path), "%s/%s", String_Local_Path, Pointer_Entries[i]->d_name);
+		if ((stat(String_Entry_Path, &Status) != 0) || (EmulatorConvertUTF8ToHexadecimal(Pointer_Entries[i]->d_name, String_Hexadecimal, sizeof(String_Hexadecimal)) != 0)) goto Exit;
+
+		// Directories have the 0x10 attribute, regular files the 0x20 archive attribute
+		if (S_ISDIR(Status.st_mode)) EmulatorSendInformation("+EFSL: \"%s\", 0, %d", String_Hexadecimal, 0x10);
+		else EmulatorSendInformation("+EFSL: \"%s\", %u, %d", String_Hexadecimal, (unsigned int) Status.st_size, 0x20);
+	}
+
+	// Everything went fine
+	Return_Value = 0;
+
+Exit:
+	for (i = 0; i < Entries_Count; i++) free(Pointer_Entries[i]);
+	free(Pointer_Entries);
+	return Return_Value;
+}
+
+/** AT+EFSR : read a file content. */
+static int EmulatorHandleFileRead(char *Pointer_String_Arguments)
+{
+	static unsigned char Buffer[EMULATOR_MAXIMUM_READ_CHUNK_SIZE];
+	static char String_Hexadecimal[sizeof(Buffer) * 2 + 1];
+	char String_Local_Path[4096];
+	int File_Descriptor, Is_Last_Chunk;
+	ssize_t Size;
+	off_t Offset = 0, File_Size;
+	struct stat Status;
+
+	if (!Emulator_Is_File_Manager_Enabled) return -1;
+	if (Pointer_String_Arguments[0] != '=') return -1;
+	if (EmulatorGetLocalPath(&Pointer_String_Arguments[1], String_Local_Path, sizeof(String_Local_Path)) != 0) return -1;
+
+	File_Descriptor = open(String_Local_Path, O_RDONLY);
+	if (File_Descriptor == -1) return -1;
+	if ((fstat(File_Descriptor, &Status) != 0) || !S_ISREG(Status.st_mode))
+	{
+		close(File_Descriptor);
+		return -1;
+	}
+	File_Size = Status.st_size;
+
+	// Send the file content by chunks, an empty file is sent as an empty chunk
+	do
+	{
+		Size = read(File_Descriptor, Buffer, Emulator_Read_Chunk_Size);
+		if (Size < 0) break;
+		ATCommandConvertBinaryToHexadecimal(Buffer, (unsigned int) Size, String_Hexadecimal, sizeof(String_Hexadecimal));
+		Is_Last_Chunk = (Offset + Size >= File_Size);
+		EmulatorSendInformation("+EFSR: %d, %u, %d, \"%s\"", !Is_Last_Chunk, (unsigned int) Offset, (int) Size, String_Hexadecimal);
+		Offset += Size;
+	} while (!Is_Last_Chunk);
+
+	close(File_Descriptor);
+	return 0;
+}
+
+/** AT+EFSW : write a file. */
+static int EmulatorHandleFileWrite(char *Pointer_String_Arguments)
+{
+	static unsigned char Buffer[EMULATOR_MAXIMUM_COMMAND_LENGTH / 2];
+	char String_Local_Path[4096], *Pointer_String_Payload, *Pointer_String_Payload_End;
+	int Is_End_Of_File, Bytes_Count, Size;
+
+	if (!Emulator_Is_File_Manager_Enabled) return -1;
+
+	// Tell the maximum chunk size (in hexadecimal characters)
+	if (strcmp(Pointer_String_Arguments, "?") == 0)
+	{
+		EmulatorSendInformation("+EFSW: %u", Emulator_Write_Chunk_Size);
+		return 0;
+	}
+
+	// Create the file
+	if (strncmp(Pointer_String_Arguments, "=0,", 3) == 0)
+	{
+		if (EmulatorGetLocalPath(&Pointer_String_Arguments[3], String_Local_Path, sizeof(String_Local_Path)) != 0) return -1;
+		if (Emulator_Written_File_Descriptor != -1) close(Emulator_Written_File_Descriptor);
+		Emulator_Written_File_Descriptor = open(String_Local_Path, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+		if (Emulator_Written_File_Descriptor == -1) return -1;
+		return 0;
+	}
+
+	// Close the file
+	if (strcmp(Pointer_String_Arguments, "=1") == 0)
+	{
+		if (Emulator_Written_File_Descriptor == -1) return -1;
+		close(Emulator_Written_File_Descriptor);
+		Emulator_Written_File_Descriptor = -1;
+		return 0;
+	}
+
+	// Append a chunk to the file
+	if (strncmp(Pointer_String_Arguments, "=2,", 3) != 0) return -1;
+	if (Emulator_Written_File_Descriptor == -1) return -1;
+	if (sscanf(&Pointer_String_Arguments[3], "%d,%d,", &Is_End_Of_File, &Bytes_Count) != 2) return -1;
+	Pointer_String_Payload = strchr(Pointer_String_Arguments, '"');
+	if (Pointer_String_Payload == NULL) return -1;
+	Pointer_String_Payload++;
+	Pointer_String_Payload_End = strchr(Pointer_String_Payload, '"');
+	if ((Pointer_String_Payload_End == NULL) || (Pointer_String_Payload_End - Pointer_String_Payload > Emulator_Write_Chunk_Size)) return -1;
+	Size = ATCommandConvertHexadecimalCharactersToBinary(Pointer_String_Payload, (unsigned int) (Pointer_String_Payload_End - Pointer_String_Payload), Buffer, sizeof(Buffer), NULL);
+	if ((Size < 0) || (Size != Bytes_Count)) return -1;
+	if (write(Emulator_Written_File_Descriptor, Buffer, Size) != Size) return -1;
+	return 0;
+}
+
+/** AT+EMGR : read a SMS. */
+static int EmulatorHandleSMSRead(char *Pointer_String_Arguments)
+{
+	TEmulatorSMSSlot *Pointer_Slot;
+	int Index;
+
+	if (sscanf(Pointer_String_Arguments, "=%d", &Index) != 1) return -1;
+	if ((Index < 1) || (Index > Emulator_SMS_Slots_Count) || (Pointer_Emulator_SMS_Slots[Index - 1].Storage_Location == 0))
+	{
+		EmulatorSendResult("+CMS ERROR: 321");
+		return 1;
+	}
+	Pointer_Slot = &Pointer_Emulator_SMS_Slots[Index - 1];
+
+	EmulatorSendInformation("+EMGR: %d, 0, %u", Pointer_Slot->Storage_Location, (unsigned int) strlen(Pointer_Slot->Pointer_String_PDU) / 2);
+	EmulatorSendInformation("%s", Pointer_Slot->Pointer_String_PDU);
+	return 0;
+}
+
+/** AT+CPMS : tell the SMS storage occupancy, the same storage is used for reading, writing and receiving messages. */
+static int EmulatorHandleSMSStorageOccupancy(char *Pointer_String_Arguments)
+{
+	int Used_Slots_Count = 0, i;
+
+	if (strcmp(Pointer_String_Arguments, "?") != 0) return -1;
+
+	for (i = 0; i < Emulator_SMS_Slots_Count; i++)
+	{
+		if (Pointer_Emulator_SMS_Slots[i].Storage_Location != 0) Used_Slots_Count++;
+	}
+	EmulatorSendInformation("+CPMS: \"ME\",%d,%d,\"ME\",%d,%d,\"ME\",%d,%d", Used_Slots_Count, Emulator_SMS_Capacity, Used_Slots_Count, Emulator_SMS_Capacity, Used_Slots_Count, Emulator_SMS_Capacity);
+	return 0;
+}
+
+/** AT+CPBS, AT+CSCS : only the phone internal phone book and the UCS2 character set are emulated, so these commands have no effect. */
+static int EmulatorHandleAlwaysSuccessful(char *Pointer_String_Arguments)
+{
+	(void) Pointer_String_Arguments;
+	return 0;
+}
+
+/** AT+CPBR : read a range of phone book entries. */
+static int EmulatorHandlePhoneBookRead(char *Pointer_String_Arguments)
+{
+	TEmulatorPhoneBookEntry *Pointer_Entry;
+	char String_Hexadecimal[1024];
+	int First_Index, Last_Index, i;
+
+	// Tell the indexes range
+	if (strcmp(Pointer_String_Arguments, "=?") == 0)
+	{
+		EmulatorSendInformation("+CPBR: (1-%d),40,14", Emulator_Phone_Book_Capacity);
+		return 0;
+	}
+
+	// Read the entries, the range is optional
+	i = sscanf(Pointer_String_Arguments, "=%d,%d", &First_Index, &Last_Index);
+	if (i < 1) return -1;
+	if (i == 1) Last_Index = First_Index;
+	if ((First_Index < 1) || (Last_Index > Emulator_Phone_Book_Capacity) || (First_Index > Last_Index)) return -1;
+
+	for (i = First_Index; (i <= Last_Index) && (i <= Emulator_Phone_Book_Entries_Count); i++)
+	{
+		Pointer_Entry = &Pointer_Emulator_Phone_Book_Entries[i - 1];
+		if (Pointer_Entry->Pointer_String_Number == NULL) continue;
+		if (EmulatorConvertUTF8ToHexadecimal(Pointer_Entry->Pointer_String_Name, String_Hexadecimal, sizeof(String_Hexadecimal)) != 0) return -1;
+		EmulatorSendInformation("+CPBR: %d,\"%s\",%d,\"%s\"", i, Pointer_Entry->Pointer_String_Number, Pointer_Entry->Pointer_String_Number[0] == '+' ? 145 : 129, String_Hexadecimal);
+	}
+	return 0;
+}
+
+/** AT+EMMSFS : tell how many MMS are stored in a storage location and device combination. */
+static int EmulatorHandleMMSStorageInformation(char *Pointer_String_Arguments)
+{
+	TEmulatorMMSStorage *Pointer_Storage;
+	char String_Local_Path[4096], String_Payload_Directory[1024], String_Database_File[1024], String_Argument[sizeof(String_Database_File) + 2];
+	int Storage_Location, Storage_Device, i;
+	struct stat Status;
+
+	if (sscanf(Pointer_String_Arguments, "=%d,%d", &Storage_Location, &Storage_Device) != 2) return -1;
+
+	for (i = 0; i < Emulator_MMS_Storages_Count; i++)
+	{
+		Pointer_Storage = &Emulator_MMS_Storages[i];
+		if ((Pointer_Storage->Storage_Location != Storage_Location) || (Pointer_Storage->Storage_Device != Storage_Device)) continue;
+
+		// The messages count is determined from the database size
+		if ((EmulatorConvertUTF8ToHexadecimal(Pointer_Storage->String_Payload_Directory, String_Payload_Directory, sizeof(String_Payload_Directory)) != 0) || (EmulatorConvertUTF8ToHexadecimal(Pointer_Storage->String_Database_File, String_Database_File, sizeof(String_Database_File)) != 0)) return -1;
+		snprintf(String_Argument, sizeof(String_Argument), "\"%s\"", String_Database_File);
+		if ((EmulatorGetLocalPath(String_Argument, String_Local_Path, sizeof(String_Local_Path)) != 0) || (stat(String_Local_Path, &Status) != 0)) return -1;
+
+		EmulatorSendInformation("+EMMSFS: 0, %d, 0, \"%s\", \"%s\"", (int) (Status.st_size / EMULATOR_MMS_DATABASE_RECORD_SIZE), String_Payload_Directory, String_Database_File);
+		return 0;
+	}
+
+	EmulatorSendInformation("+EMMSFS: 0, 0, 0, \"\", \"\"");
+	return 0;
+}
+
+/** Execute a received command line and send its answer.
+ * @param Pointer_String_Command The command, without the terminating carriage return.
+ */
+static void EmulatorExecuteCommand(char *Pointer_String_Command)
+{
+	static TEmulatorCommand Commands[] =
+	{
+		// Longer prefixes must come first
+		{ "AT+ESUO", EmulatorHandleFileManagerMode },
+		{ "AT+EFSL", EmulatorHandleFileList },
+		{ "AT+EFSR", EmulatorHandleFileRead },
+		{ "AT+EFSW", EmulatorHandleFileWrite },
+		{ "AT+EMGR", EmulatorHandleSMSRead },
+		{ "AT+CPMS", EmulatorHandleSMSStorageOccupancy },
+		{ "AT+CPBS", EmulatorHandleAlwaysSuccessful },
+		{ "AT+CSCS", EmulatorHandleAlwaysSuccessful },
+		{ "AT+CPBR", EmulatorHandlePhoneBookRead },
+		{ "AT+EMMSFS", EmulatorHandleMMSStorageInformation },
+		{ "ATE", EmulatorHandleEcho },
+		{ "AT", EmulatorHandleAttention }
+	};
+	size_t i, Length;
+	int Result = -1;
+
+	LOG_DEBUG(EMULATOR_IS_DEBUG_ENABLED, "Received command \"%.80s\".\n", Pointer_String_Command);
+
+	// Simulate a phone that does not answer
+	Emulator_Received_Commands_Count++;
+	if (Emulator_Received_Commands_Count == Emulator_Ignored_Command_Number)
+	{
+		LOG("Ignoring the command %u \"%.80s\".\n", Emulator_Received_Commands_Count, Pointer_String_Command);
+		return;
+	}
+
+	// Echo the command the same way it was received
+	if (Emulator_Is_Echo_Enabled)
+	{
+		EmulatorWrite(Pointer_String_Command, strlen(Pointer_String_Command));
+		EmulatorWrite("\r", 1);
+	}
+
+	// Simulate the phone processing time
+	if (Emulator_Command_Latency > 0) EmulatorSleep(Emulator_Command_Latency * 1000000ULL);
+
+	// Find the command handler
+	Emulator_Is_Answer_Started = 0;
+	for (i = 0; i < UTILITY_ARRAY_SIZE(Commands); i++)
+	{
+		Length = strlen(Commands[i].Pointer_String_Prefix);
+		if (strncasecmp(Pointer_String_Command, Commands[i].Pointer_String_Prefix, Length) == 0)
+		{
+			Result = Commands[i].Handler(&Pointer_String_Command[Length]);
+			break;
+		}
+	}
+
+	// Send the final result code
+	if (Result == 0) EmulatorSendResult("OK");
+	else if (Result < 0) EmulatorSendResult("ERROR");
+}
+
+/** Display the usage message.
+ * @param Pointer_String_Program_Name The program name as invoked by the user.
+ */
+static void EmulatorDisplayUsage(char *Pointer_String_Program_Name)
+{
+	printf("Usage : %s [options]\n"
+		"Options :\n"
+		"  -r <directory>  Serve the subdirectories of this directory that have a single letter name as the phone drives (default is the current directory).\n"
+		"  -s <file>       SMS storage, one slot per line : \"<storage location> <hexadecimal PDU>\" or \"-\" for an empty slot.\n"
+		"  -p <file>       Phone book, one entry per line : \"<number><tab><name>\" or an empty line for an empty entry.\n"
+		"  -n <count>      Phone book capacity (default is 500).\n"
+		"  -t <count>      SMS storage capacity (default is 450).\n"
+		"  -m <location>,<device>,<payload directory>,<database file>  Add a MMS storage (phone paths, like C:\\@mms\\inbox), can be repeated.\n"
+		"  -b <bits/s>     Emulated line rate (default is unlimited).\n"
+		"  -l <ms>         Latency added before answering each command (default is 0).\n"
+		"  -c <bytes>      File read chunk size (default is 200).\n"
+		"  -w <characters> File write chunk size in hexadecimal characters (default is 1024).\n"
+		"  -e              Disable the command echo at startup.\n"
+		"  -g <number>     Ignore the command with this number (the first received command is 1) to simulate a communication glitch.\n", Pointer_String_Program_Name);
+}
+
+//-------------------------------------------------------------------------------------------------
+// Entry point
+//-------------------------------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	static char String_Command[EMULATOR_MAXIMUM_COMMAND_LENGTH];
+	unsigned char Buffer[4096];
+	int Option, Slave_File_Descriptor, Command_Length = 0, Is_Command_Too_Long = 0;
+	char *Pointer_String_Slave_Name;
+	ssize_t Bytes_Count, i;
+	TEmulatorMMSStorage *Pointer_Storage;
+	struct termios Terminal_Attributes;
+
+	// Parse the command line
+	while ((Option = getopt(argc, argv, "r:s:p:n:t:m:b:l:c:w:eg:h")) != -1)
+	{
+		switch (Option)
+		{
+			case 'r':
+				Pointer_String_Emulator_Root_Directory = optarg;
+				break;
+
+			case 's':
+				if (EmulatorReadTextFile(optarg, EmulatorAddSMSSlot) != 0) return EXIT_FAILURE;
+				break;
+
+			case 'p':
+				if (EmulatorReadTextFile(optarg, EmulatorAddPhoneBookEntry) != 0) return EXIT_FAILURE;
+				break;
+
+			case 'n':
+				Emulator_Phone_Book_Capacity = atoi(optarg);
+				break;
+
+			case 't':
+				Emulator_SMS_Capacity = atoi(optarg);
+				break;
+
+			case 'm':
+				if (Emulator_MMS_Storages_Count >= EMULATOR_MAXIMUM_MMS_STORAGES_COUNT)
+				{
+					LOG("Error : no more than %d MMS storages can be configured.\n", EMULATOR_MAXIMUM_MMS_STORAGES_COUNT);
+					return EXIT_FAILURE;
+				}
+				Pointer_Storage = &Emulator_MMS_Storages[Emulator_MMS_Storages_Count];
+				if (sscanf(optarg, "%d,%d,%255[^,],%255s", &Pointer_Storage->Storage_Location, &Pointer_Storage->Storage_Device, Pointer_Storage->String_Payload_Directory, Pointer_Storage->String_Database_File) != 4)
+				{
+					LOG("Error : malformed MMS storage \"%s\".\n", optarg);
+					return EXIT_FAILURE;
+				}
+				Emulator_MMS_Storages_Count++;
+				break;
+
+			case 'b':
+				Emulator_Line_Rate = (unsigned int) strtoul(optarg, NULL, 10);
+				break;
+
+			case 'l':
+				Emulator_Command_Latency = (unsigned int) strtoul(optarg, NULL, 10);
+				break;
+
+			case 'c':
+				Emulator_Read_Chunk_Size = (unsigned int) strtoul(optarg, NULL, 10);
+				if ((Emulator_Read_Chunk_Size == 0) || (Emulator_Read_Chunk_Size > EMULATOR_MAXIMUM_READ_CHUNK_SIZE))
+				{
+					LOG("Error : the file read chunk size must be in range [1, %d].\n", EMULATOR_MAXIMUM_READ_CHUNK_SIZE);
+					return EXIT_FAILURE;
+				}
+				break;
+
+			case 'w':
+				Emulator_Write_Chunk_Size = (unsigned int) strtoul(optarg, NULL, 10);
+				if ((Emulator_Write_Chunk_Size < 2) || (Emulator_Write_Chunk_Size > EMULATOR_MAXIMUM_COMMAND_LENGTH / 2))
+				{
+					LOG("Error : the file write chunk size must be in range [2, %d].\n", EMULATOR_MAXIMUM_COMMAND_LENGTH / 2);
+					return EXIT_FAILURE;
+				}
+				break;
+
+			case 'e':
+				Emulator_Is_Echo_Enabled = 0;
+				break;
+
+			case 'g':
+				Emulator_Ignored_Command_Number = (unsigned int) strtoul(optarg, NULL, 10);
+				break;
+
+			default:
+				EmulatorDisplayUsage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	// Create the pseudo-terminal
+	Emulator_Master_File_Descriptor = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((Emulator_Master_File_Descriptor == -1) || (grantpt(Emulator_Master_File_Descriptor) != 0) || (unlockpt(Emulator_Master_File_Descriptor) != 0))
+	{
+		LOG("Error : could not create the pseudo-terminal (%s).\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	Pointer_String_Slave_Name = ptsname(Emulator_Master_File_Descriptor);
+	if (Pointer_String_Slave_Name == NULL)
+	{
+		LOG("Error : could not retrieve the pseudo-terminal name (%s).\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	// Keep the slave side opened, so the emulator keeps running when b100-tools exits, and configure it like a raw serial port
+	Slave_File_Descriptor = open(Pointer_String_Slave_Name, O_RDWR | O_NOCTTY);
+	if (Slave_File_Descriptor == -1)
+	{
+		LOG("Error : could not open the pseudo-terminal slave side (%s).\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	tcgetattr(Slave_File_Descriptor, &Terminal_Attributes);
+	cfmakeraw(&Terminal_Attributes);
+	tcsetattr(Slave_File_Descriptor, TCSANOW, &Terminal_Attributes);
+
+	printf("Emulated phone serial port : %s\n", Pointer_String_Slave_Name);
+	fflush(stdout);
+
+	// Process the received commands
+	while (1)
+	{
+		Bytes_Count = read(Emulator_Master_File_Descriptor, Buffer, sizeof(Buffer));
+		if (Bytes_Count < 0)
+		{
+			if (errno == EINTR) continue;
+			LOG("Error : failed to read from the pseudo-terminal (%s).\n", strerror(errno));
+			break;
+		}
+
+		for (i = 0; i < Bytes_Count; i++)
+		{
+			// Commands are terminated by a carriage return
+			if (Buffer[i] == '\r')
+			{
+				String_Command[Command_Length] = 0;
+				if (Is_Command_Too_Long)
+				{
+					EmulatorSendResult("ERROR");
+					Is_Command_Too_Long = 0;
+				}
+				else if (Command_Length > 0) EmulatorExecuteCommand(String_Command);
+				Command_Length = 0;
+			}
+			else if (Buffer[i] != '\n')
+			{
+				if (Command_Length < (int) sizeof(String_Command) - 1)
+				{
+					String_Command[Command_Length] = Buffer[i];
+					Command_Length++;
+				}
+				else Is_Command_Too_Long = 1;
+			}
+		}
+	}
+
+	close(Slave_File_Descriptor);
+	close(Emulator_Master_File_Descriptor);
+	return EXIT_FAILURE;
+}
@@ -6,14 +6,18 @@
 #define H_AT_COMMAND_H
 
 #include <Serial_Port.h>
+#include <stdio.h>
 
 //-------------------------------------------------------------------------------------------------
 // Functions
 //-------------------------------------------------------------------------------------------------
 /** Read a command answer line from the serial port up to the terminating CRLF sequence, or until the string length is reached.
- * @param Serial_Port_ID The serial port to read line from.
+ * @param Serial_Port_ID The serial port to read line from. All the bytes already received by this serial port are buffered, so the serial port must be read only through the AT command functions.
  * @param Pointer_String_Answer On output, contain the received answer.
  * @param Maximum_Length The size of the answer string buffer. This value must include the room for the string terminating zero.
+ * @return -6 if the last sent command did not receive its final result code in time (only the control commands, which have a short answer, have such a deadline),
+ * @return -5 if the line was not completely received in time (the transfer commands like AT+EFSR have a longer line timeout than the control commands),
+ * @return -4 if the serial port could not be read or if the program is being interrupted (see ATCommandSetInterruptionRequest()),
  * @return -3 if the provided string has not enough space to store the answer,
  * @return -2 if the read line is AT "ERROR<CRLF>",
  * @return -1 if the provided maximum length is too small,
@@ -21,14 +25,58 @@
  */
 int ATCommandReceiveAnswerLine(TSerialPortID Serial_Port_ID, char *Pointer_String_Answer, unsigned int Maximum_Length);
 
-/** Send the command, append the terminating character CR at its end and discard the command echoing.
+/** Send the command, append the terminating character CR at its end and discard the command echoing (if the echo has been disabled by ATCommandEnableLeanLinkProfile(), the function returns without waiting for the phone).
  * @param Serial_Port_ID The serial port to send the command to.
  * @param Pointer_String_Command The command to send, it must be a zero-terminated string without the final CRLF sequence (it is automatically appended by this function).
+ * @return -2 if the command echo was not received in time,
  * @return -1 if an error occurred,
  * @return 0 on success.
+ * @note This function starts the deadlines used by ATCommandReceiveAnswerLine() to receive the command answer.
  */
 int ATCommandSendCommand(TSerialPortID Serial_Port_ID, char *Pointer_String_Command);
 
+/** Disable the command echo (ATE0), so the phone does not send back each command (like the file chunks sent by AT+EFSW) and ATCommandSendCommand() returns as soon as the command is sent. The echo setting found on the phone is remembered to be restored later.
+ * @param Serial_Port_ID The serial port the phone is connected to.
+ * @return -1 if the serial port could not be accessed,
+ * @return 0 on success, even if the phone refused to disable the echo (the echo is kept in this case).
+ * @note No file manager session must be opened when calling this function.
+ */
+int ATCommandEnableLeanLinkProfile(TSerialPortID Serial_Port_ID);
+
+/** Restore the echo setting that was found by ATCommandEnableLeanLinkProfile(). Nothing is done if the echo was not disabled.
+ * @param Serial_Port_ID The serial port the phone is connected to.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ * @note No file manager session must be opened when calling this function.
+ */
+int ATCommandRestoreLinkProfile(TSerialPortID Serial_Port_ID);
+
+/** Bring the AT communication back after an error (a timeout, an interrupted file transfer...) : all the data the phone is still sending are discarded, then the phone is probed with the "AT" command until it answers.
+ * @param Serial_Port_ID The serial port the phone is connected to.
+ * @return -1 if the phone did not answer,
+ * @return 0 if the phone is ready to receive new commands.
+ * @note The phone mode is not changed, the caller must leave the file manager mode if needed.
+ */
+int ATCommandRecoverLink(TSerialPortID Serial_Port_ID);
+
+/** Abort the operation in progress as soon as it needs the phone : when the interruption is requested, ATCommandSendCommand() does not send anything and fails, and ATCommandReceiveAnswerLine() fails instead of waiting for more data.
+ * @param Is_Interruption_Requested Set to 1 to make the communication with the phone fail, set to 0 to allow it again (to restore the phone settings before exiting, for instance).
+ * @note This function can be called from a signal handler.
+ */
+void ATCommandSetInterruptionRequest(int Is_Interruption_Requested);
+
+/** Convert hexadecimal characters to their binary representation, making sure that all characters are valid.
+ * @param Pointer_Hexadecimal_Characters The characters to convert. They do not need to be zero-terminated.
+ * @param Characters_Count How many characters to convert.
+ * @param Pointer_Output_Buffer On output, will contain the binary representation of the hexadecimal characters.
+ * @param Output_Buffer_Size The maximum size of the output buffer.
+ * @param Pointer_Invalid_Character_Offset On output, contain the offset of the first character that could not be converted (a non-hexadecimal character, the last character of an odd amount of characters or the first character that does not fit in the output buffer). It is set to Characters_Count on success. This parameter can be NULL.
+ * @return -1 if a character could not be converted,
+ * @return 0 or a positive number corresponding to the output binary data size in bytes.
+ * @note The fastest decoder supported by the processor (AVX2, SSE2 or a portable look-up table) is automatically selected.
+ */
+int ATCommandConvertHexadecimalCharactersToBinary(char *Pointer_Hexadecimal_Characters, unsigned int Characters_Count, unsigned char *Pointer_Output_Buffer, unsigned int Output_Buffer_Size, unsigned int *Pointer_Invalid_Character_Offset);
+
 /** Convert a string containing alphanumerical characters to their binary representation.
  * @param Pointer_String_Hexadecimal The hexadecimal string to convert.
  * @param Pointer_Output_Buffer On output, will contain the binary representation of the hexadecimal string.
@@ -41,8 +89,16 @@ int ATCommandConvertHexadecimalToBinary(char *Pointer_String_Hexadecimal, unsign
 /** Convert each byte of a binary stream to two-byte hexadecimal characters.
  * @param Pointer_Buffer The buffer containing the binary data.
  * @param Buffer_Size How many bytes to convert.
- * @param Pointer_String_Hexadecimal On output, contain the data converted to hexadecimal. Make sure to provide enough room in this buffer as each input byte will be encoded as two bytes.
+ * @param Pointer_String_Hexadecimal On output, contain the data converted to hexadecimal followed by a terminating zero.
+ * @param String_Size The size in bytes of the output string buffer. Each input byte is encoded as two characters and one more byte is needed for the terminating zero.
+ * @return -1 if the output string buffer is too small,
+ * @return 0 or a positive number corresponding to the amount of written characters (the terminating zero is not counted).
+ */
+int ATCommandConvertBinaryToHexadecimal(unsigned char *Pointer_Buffer, unsigned int Buffer_Size, char *Pointer_String_Hexadecimal, unsigned int String_Size);
+
+/** Display the statistics gathered for each command verb (like "+EFSR" or "+CPBR") since the program start : commands count, sent and received bytes, and a latency histogram.
+ * @param Pointer_File Where to write the statistics (it can be stdout).
  */
-void ATCommandConvertBinaryToHexadecimal(unsigned char *Pointer_Buffer, unsigned int Buffer_Size, char *Pointer_String_Hexadecimal);
+void ATCommandDisplayStatistics(FILE *Pointer_File);
 
 #endif
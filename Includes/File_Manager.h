@@ -7,6 +7,8 @@
 
 #include <List.h>
 #include <Serial_Port.h>
+#include <stddef.h>
+#include <stdio.h>
 
 //-------------------------------------------------------------------------------------------------
 // Constants and macros
@@ -22,6 +24,11 @@
 /** Tell whether a file item has the "read only" flag set. */
 #define FILE_MANAGER_ATTRIBUTE_IS_READ_ONLY(Pointer_File_List_Item) (Pointer_File_List_Item->Flags & 0x01)
 
+/** FileManagerDownloadDirectory() flag : download only the files that are new or that changed since the previous download. A manifest file is kept in each output directory to remember the downloaded files. */
+#define FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_MIRROR 0x01
+/** FileManagerDownloadDirectory() flag : when mirroring, also remove the previously downloaded files and directories that do not exist anymore on the phone. */
+#define FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_PRUNE 0x02
+
 //-------------------------------------------------------------------------------------------------
 // Types
 //-------------------------------------------------------------------------------------------------
@@ -33,9 +40,65 @@ typedef struct TFileManagerFileListItem
 	int Flags; //!< The flags byte looks like a lot the FAT file system "file attribute" field (offset 0x0B in a FAT directory entry).
 } TFileManagerFileListItem;
 
+/** The threads and buffers used to download files, its content is private. */
+typedef struct TFileManagerDownloadPipeline TFileManagerDownloadPipeline;
+
+/** An access to the phone file manager. The file manager is enabled once when the session is opened, then any amount of file operations can be done, then the file manager is disabled when the session is closed. */
+typedef struct
+{
+	TSerialPortID Serial_Port_ID; //!< The serial port the phone is connected to.
+	int Is_Opened; //!< Tell whether the file manager has been enabled and must be disabled when closing the session.
+	TFileManagerDownloadPipeline *Pointer_Download_Pipeline; //!< Created by the first download and reused by the next ones until the session is closed, NULL if no pipeline is running.
+} TFileManagerSession;
+
+/** All destinations a downloaded file content can be written to. */
+typedef enum
+{
+	FILE_MANAGER_SINK_TYPE_FILE_DESCRIPTOR, //!< Write the data to an already opened file.
+	FILE_MANAGER_SINK_TYPE_MEMORY, //!< Store the data in a memory buffer that grows as needed.
+	FILE_MANAGER_SINK_TYPE_CALLBACK //!< Give each received chunk to a caller function.
+} TFileManagerSinkType;
+
+/** Called by a callback sink each time a file chunk has been received.
+ * @param Pointer_Callback_Context The context provided when the sink was initialized.
+ * @param Pointer_Data The chunk data, it is valid only during the call.
+ * @param Size The chunk size in bytes.
+ * @return -1 to abort the download,
+ * @return 0 to continue the download.
+ */
+typedef int (*TFileManagerSinkCallback)(void *Pointer_Callback_Context, unsigned char *Pointer_Data, unsigned int Size);
+
+/** Where FileManagerDownloadFileToSink() writes the downloaded file content. Use the FileManagerInitialize*Sink() functions to create a sink. */
+typedef struct
+{
+	TFileManagerSinkType Type; //!< Tell which of the following fields are used.
+	int File_Descriptor; //!< File descriptor sink : the data is written at the current file offset, in large blocks that are all written when the download ends.
+	unsigned char *Pointer_Buffer; //!< Memory sink : the downloaded file content. File descriptor sink : the block being filled. The buffer is kept from a download to the next one and is freed by FileManagerReleaseSink().
+	size_t Buffer_Size; //!< Memory and file descriptor sinks : the allocated buffer size in bytes.
+	size_t Data_Size; //!< Memory sink : the size in bytes of the last downloaded file. File descriptor sink : the amount of bytes waiting in the block.
+	TFileManagerSinkCallback Callback; //!< Callback sink : the function to call for each chunk.
+	void *Pointer_Callback_Context; //!< Callback sink : given as-is to the callback.
+} TFileManagerSink;
+
 //-------------------------------------------------------------------------------------------------
 // Functions
 //-------------------------------------------------------------------------------------------------
+/** Enable the phone file manager, which is needed by all other file manager functions. While the session is opened, SIGINT does not terminate the program anymore but aborts the current file operation, so the session can always be closed.
+ * @param Serial_Port_ID The serial port the phone is connected to.
+ * @param Pointer_Session On output, contain the opened session.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ * @note Other AT commands (SMS, phone book...) should not be sent while a session is opened.
+ */
+int FileManagerOpenSession(TSerialPortID Serial_Port_ID, TFileManagerSession *Pointer_Session);
+
+/** Disable the phone file manager. This must be done before exiting the program, otherwise the phone AT communication is stuck until the phone is rebooted. If the phone does not answer, the communication is recovered with ATCommandRecoverLink() before disabling the file manager again.
+ * @param Pointer_Session The session to close. Nothing is done if the session is not opened.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+int FileManagerCloseSession(TFileManagerSession *Pointer_Session);
+
 /** Append a new item made of the provided file information to the end of the list.
  * @param Pointer_List The list to add an item to the tail. This list must have been previously initialized.
  * @param Pointer_String_File_Name The file name string content will be copied to the newly added list item.
@@ -45,53 +108,97 @@ typedef struct TFileManagerFileListItem
 void FileManagerListAddFile(TList *Pointer_List, char *Pointer_String_File_Name, unsigned File_Size, int Flags);
 
 /** Find all available drives (C:, D: and so on).
- * @param Serial_Port_ID The serial port the phone is connected to.
+ * @param Pointer_Session An opened file manager session.
  * @param Pointer_List On output, contain the list of the drives. This variable must not contain a valid list already, otherwise this will create a memory leak.
  * @return -1 if an error occurred,
  * @return 0 on success.
  */
-int FileManagerListDrives(TSerialPortID Serial_Port_ID, TList *Pointer_List);
+int FileManagerListDrives(TFileManagerSession *Pointer_Session, TList *Pointer_List);
 
 /** Create a list containing all files and subdirectories in a specified directory, like ls. This function is not recursive and does not list the content of the subdirectories.
- * @param Serial_Port_ID The serial port the phone is connected to.
+ * @param Pointer_Session An opened file manager session.
  * @param Pointer_String_Absolute_Path The path of the directory to list. The path must be absolute, directory separators are \ like on Windows.
  * @param Pointer_List On output, contain the list of the files. This variable must not contain a valid list already, otherwise this will create a memory leak.
+ * @return -2 if the phone did not answer in time or if the serial port could not be accessed,
  * @return -1 if an error occurred,
  * @return 0 on success.
  */
-int FileManagerListDirectory(TSerialPortID Serial_Port_ID, char *Pointer_String_Absolute_Path, TList *Pointer_List);
+int FileManagerListDirectory(TFileManagerSession *Pointer_Session, char *Pointer_String_Absolute_Path, TList *Pointer_List);
 
 /** Fancy displaying of a list of files, designed to look like the DOS "dir" command.
  * @param Pointer_List The list to display on the screen.
  */
 void FileManagerDisplayDirectoryListing(TList *Pointer_List);
 
+/** Create a sink that writes the downloaded data to a file.
+ * @param Pointer_Sink On output, contain the initialized sink.
+ * @param File_Descriptor An already opened file, it is not closed by the file manager.
+ */
+void FileManagerInitializeFileDescriptorSink(TFileManagerSink *Pointer_Sink, int File_Descriptor);
+
+/** Create a sink that stores the downloaded data in RAM. The same sink can be used for many downloads, so the buffer is allocated only a few times.
+ * @param Pointer_Sink On output, contain the initialized sink. The buffer is allocated on the first download.
+ */
+void FileManagerInitializeMemorySink(TFileManagerSink *Pointer_Sink);
+
+/** Create a sink that gives each received chunk to a function.
+ * @param Pointer_Sink On output, contain the initialized sink.
+ * @param Callback The function to call each time a chunk is received.
+ * @param Pointer_Callback_Context Any data needed by the callback.
+ */
+void FileManagerInitializeCallbackSink(TFileManagerSink *Pointer_Sink, TFileManagerSinkCallback Callback, void *Pointer_Callback_Context);
+
+/** Free the resources allocated by a sink. The sink can be used again after that.
+ * @param Pointer_Sink The sink to release.
+ */
+void FileManagerReleaseSink(TFileManagerSink *Pointer_Sink);
+
+/** Retrieve a file content from the phone and give it to a sink.
+ * @param Pointer_Session An opened file manager session.
+ * @param Pointer_String_Absolute_Phone_Path The file path and name. This must be the absolute path starting from the drive, directory separators are \ like on Windows.
+ * @param Pointer_Sink Where to write the file content. A memory sink previous content is replaced by the file content.
+ * @return -2 if the phone did not answer in time or if the serial port could not be accessed,
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ * @note The serial port is drained and the chunks are decoded by internal threads, the sink is always written (and its callback called) from the calling thread.
+ */
+int FileManagerDownloadFileToSink(TFileManagerSession *Pointer_Session, char *Pointer_String_Absolute_Phone_Path, TFileManagerSink *Pointer_Sink);
+
 /** Retrieve a file content from the phone.
- * @param Serial_Port_ID The serial port the phone is connected to.
+ * @param Pointer_Session An opened file manager session.
  * @param Pointer_String_Absolute_Phone_Path The file path and name. This must be the absolute path starting from the drive, directory separators are \ like on Windows.
  * @param Pointer_String_Destination_PC_Path The file path and name that will be created on the local PC.
+ * @return -2 if the phone did not answer in time or if the serial port could not be accessed,
  * @return -1 if an error occurred,
  * @return 0 on success.
  */
-int FileManagerDownloadFile(TSerialPortID Serial_Port_ID, char *Pointer_String_Absolute_Phone_Path, char *Pointer_String_Destination_PC_Path);
+int FileManagerDownloadFile(TFileManagerSession *Pointer_Session, char *Pointer_String_Absolute_Phone_Path, char *Pointer_String_Destination_PC_Path);
 
 /** Retrieve a directory files and all the subdirectories it contains, recreating the same directories tree on output.
- * @param Serial_Port_ID The serial port the phone is connected to.
+ * @param Pointer_Session An opened file manager session.
  * @param Pointer_String_Absolute_Phone_Path The directory path. This must be the absolute path starting from the drive, directory separators are \ like on Windows.
  * @param Pointer_String_Destination_PC_Path The directory path that will be created on the local PC.
+ * @param Flags A combination of FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_* values, or 0 to download all files.
  * @return -1 if an error occurred,
  * @return 0 on success.
+ * @note The phone does not provide the files modification time, so a mirrored file is considered unchanged when its size and attributes did not change and the local file still has the same size.
+ * @note If a directory listing or a file download fails, the communication with the phone is recovered and the download resumes from the failed operation, up to a few times.
  */
-int FileManagerDownloadDirectory(TSerialPortID Serial_Port_ID, char *Pointer_String_Absolute_Phone_Path, char *Pointer_String_Destination_PC_Path);
+int FileManagerDownloadDirectory(TFileManagerSession *Pointer_Session, char *Pointer_String_Absolute_Phone_Path, char *Pointer_String_Destination_PC_Path, int Flags);
 
 /** Send a file from the PC to the phone.
- * @param Serial_Port_ID The serial port the phone is connected to.
+ * @param Pointer_Session An opened file manager session.
  * @param Pointer_String_Source_PC_Path The file to send, located on the PC.
  * @param Pointer_String_Absolute_Phone_Path The full path and name of the file to create on the phone. Directory separators are \ like on Windows.
  * @return -1 if an error occurred,
  * @return 0 on success.
  * @note If the file is already existing on the phone, its content will be overwritten.
  */
-int FileManagerSendFile(TSerialPortID Serial_Port_ID, char *Pointer_String_Source_PC_Path, char *Pointer_String_Absolute_Phone_Path);
+int FileManagerSendFile(TFileManagerSession *Pointer_Session, char *Pointer_String_Source_PC_Path, char *Pointer_String_Absolute_Phone_Path);
+
+/** Display the statistics of all file downloads done since the program started. The time the link reader spent waiting for a free buffer tells how long the link was not drained because the sink was too slow.
+ * @param Pointer_File Where to write the statistics.
+ */
+void FileManagerDisplayStatistics(FILE *Pointer_File);
 
 #endif
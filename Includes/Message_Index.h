@@ -0,0 +1,78 @@
+/** @file Message_Index.h
+ * Remember which messages have already been exported by a previous run, so only the new or changed messages are retrieved again.
+ * The index is a text file holding one fingerprint per message key. The key identifies where the message is stored on the phone (a SMS record number, a MMS file path...) and the fingerprint tells whether the content stored there changed.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_MESSAGE_INDEX_H
+#define H_MESSAGE_INDEX_H
+
+#include <stddef.h>
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** A message known by the index, its content is private. */
+typedef struct TMessageIndexEntry TMessageIndexEntry;
+
+/** A slot of the index hash table, its content is private. */
+typedef struct TMessageIndexSlot TMessageIndexSlot;
+
+/** A loaded message index. */
+typedef struct
+{
+	char String_File_Path[256]; //!< The file the index is loaded from and saved to.
+	TMessageIndexEntry *Pointer_Entries; //!< All known messages, in the order they have been added, so the saved index keeps the same order.
+	int Entries_Count; //!< How many entries are stored in the entries table.
+	int Allocated_Entries_Count; //!< How many entries the entries table can hold before it needs to grow.
+	TMessageIndexSlot *Pointer_Slots; //!< Find an entry from its key.
+	unsigned int Slots_Count; //!< The hash table size, it is always a power of two.
+	int Is_Loaded; //!< Tell whether the index file existed when the index was loaded.
+} TMessageIndex;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Load an index file. A missing file results in an empty index.
+ * @param Pointer_Index The index to load.
+ * @param Pointer_String_File_Path The index file path.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+int MessageIndexLoad(TMessageIndex *Pointer_Index, char *Pointer_String_File_Path);
+
+/** Record the current fingerprint of a message and tell whether the message changed since the index was saved.
+ * @param Pointer_Index The index.
+ * @param Pointer_String_Key The message key.
+ * @param Fingerprint The message current fingerprint.
+ * @return -1 if an error occurred,
+ * @return 0 if the message is new or changed,
+ * @return 1 if the message has already been exported with the same fingerprint.
+ */
+int MessageIndexUpdateEntry(TMessageIndex *Pointer_Index, char *Pointer_String_Key, unsigned long long Fingerprint);
+
+/** Forget a message whose export failed, so the next run retrieves it again.
+ * @param Pointer_Index The index.
+ * @param Pointer_String_Key The message key. Nothing is done if the key is not in the index.
+ */
+void MessageIndexDiscardEntry(TMessageIndex *Pointer_Index, char *Pointer_String_Key);
+
+/** Write the index file. Only the messages that have been updated since the index was loaded are kept, so the messages removed from the phone are forgotten.
+ * @param Pointer_Index The index.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+int MessageIndexSave(TMessageIndex *Pointer_Index);
+
+/** Free all resources allocated by an index.
+ * @param Pointer_Index The index.
+ */
+void MessageIndexRelease(TMessageIndex *Pointer_Index);
+
+/** Compute the fingerprint of some message content.
+ * @param Pointer_Data The content.
+ * @param Size The content size in bytes.
+ * @return The 64-bit FNV-1a hash of the content.
+ */
+unsigned long long MessageIndexComputeFingerprint(const void *Pointer_Data, size_t Size);
+
+#endif
@@ -0,0 +1,77 @@
+/** @file Queue.h
+ * A bounded first-in first-out queue of pointers that can be shared by several threads. Pushing to a full queue and popping from an empty queue block the calling thread, the time spent waiting is measured to tell which side of the queue is the bottleneck.
+ * @author Adrien RICCIARDI
+ */
+#ifndef H_QUEUE_H
+#define H_QUEUE_H
+
+#include <pthread.h>
+
+//-------------------------------------------------------------------------------------------------
+// Types
+//-------------------------------------------------------------------------------------------------
+/** A bounded queue. */
+typedef struct
+{
+	void **Pointer_Items; //!< The circular buffer holding the queued items.
+	unsigned int Capacity; //!< How many items the queue can hold.
+	unsigned int Read_Index; //!< The oldest item location.
+	unsigned int Items_Count; //!< How many items are currently queued.
+	int Is_Closed; //!< Tell whether no more item can be pushed.
+	pthread_mutex_t Mutex;
+	pthread_cond_t Condition_Not_Empty;
+	pthread_cond_t Condition_Not_Full;
+	unsigned long long Push_Waits_Count; //!< How many times a push had to wait for the queue not to be full.
+	unsigned long long Push_Wait_Time; //!< The total time in nanoseconds spent waiting for the queue not to be full.
+	unsigned long long Pop_Waits_Count; //!< How many times a pop had to wait for the queue not to be empty.
+	unsigned long long Pop_Wait_Time; //!< The total time in nanoseconds spent waiting for the queue not to be empty.
+	unsigned int Maximum_Items_Count; //!< The highest amount of items that have been queued at the same time.
+} TQueue;
+
+//-------------------------------------------------------------------------------------------------
+// Functions
+//-------------------------------------------------------------------------------------------------
+/** Create an empty queue.
+ * @param Pointer_Queue The queue to initialize.
+ * @param Capacity How many items the queue can hold.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+int QueueInitialize(TQueue *Pointer_Queue, unsigned int Capacity);
+
+/** Free all resources allocated by a queue. No thread must use the queue anymore. The queued items are not freed.
+ * @param Pointer_Queue The queue to release.
+ */
+void QueueRelease(TQueue *Pointer_Queue);
+
+/** Append an item to the queue, waiting for some room if the queue is full.
+ * @param Pointer_Queue The queue.
+ * @param Pointer_Item The item to append.
+ * @return -1 if the queue has been closed (the item is not appended),
+ * @return 0 on success.
+ */
+int QueuePush(TQueue *Pointer_Queue, void *Pointer_Item);
+
+/** Remove the oldest item from the queue, waiting for an item if the queue is empty.
+ * @param Pointer_Queue The queue.
+ * @return NULL if the queue has been closed and is empty,
+ * @return The oldest item on success.
+ */
+void *QueuePop(TQueue *Pointer_Queue);
+
+/** Remove the oldest item from the queue, waiting for an item at most the specified time if the queue is empty.
+ * @param Pointer_Queue The queue.
+ * @param Timeout How long to wait for an item, in milliseconds.
+ * @param Pointer_Pointer_Item On output, contain the oldest item.
+ * @return -2 if no item has been queued before the timeout expired,
+ * @return -1 if the queue has been closed and is empty,
+ * @return 0 on success.
+ */
+int QueueTimedPop(TQueue *Pointer_Queue, unsigned int Timeout, void **Pointer_Pointer_Item);
+
+/** Tell that no more item will be pushed. The threads waiting to push are woken up and fail, the threads waiting to pop get the remaining items, then NULL.
+ * @param Pointer_Queue The queue.
+ */
+void QueueClose(TQueue *Pointer_Queue);
+
+#endif
@@ -12,9 +12,10 @@
 //-------------------------------------------------------------------------------------------------
 /** Download all SMS from the phone, then write them into the appropriate output files.
  * @param Serial_Port_ID The phone serial port.
+ * @param Is_Incremental_Mode_Enabled Set to 1 to retrieve only the messages that are new or changed since the previous run (they are appended to the previous output), set to 0 to retrieve all messages.
  * @return -1 if an error occurred,
  * @return 0 on success.
  */
-int SMSDownloadAll(TSerialPortID Serial_Port_ID);
+int SMSDownloadAll(TSerialPortID Serial_Port_ID, int Is_Incremental_Mode_Enabled);
 
 #endif
@@ -37,15 +37,24 @@ typedef enum
  */
 int UtilityCreateDirectory(char *Pointer_Directory_Name);
 
+/** Remove a directory and all the files and subdirectories it contains, like "rm -r".
+ * @param Pointer_Directory_Name The directory to remove.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ * @note Symbolic links are removed, not the files they point to.
+ */
+int UtilityRemoveDirectory(char *Pointer_Directory_Name);
+
 /** Convert a string from a character set to another.
  * @param Pointer_String_Source The string to convert.
  * @param Pointer_String_Destination On output, contain the converted string.
  * @param Source_Character_Set The source character set to convert from.
  * @param Destination_Character_Set The destination character set to convert to.
  * @param Source_String_Size The source string size in bytes (not in characters). If set to 0, the string length will be automatically determined, make sure that the string does not contain NULL bytes in the middle of the data.
- * @param Destination_String_Size The maximum size in bytes of the output string. Make sure to have one additional byte of room for the terminating zero.
+ * @param Destination_String_Size The size in bytes of the output buffer, including the terminating zero.
  * @return -1 if an error occurs,
  * @return A positive number on success, it indicates the destination string size in bytes.
+ * @note The conversions between UTF-8 and UTF-16 and from Windows-1252 are done without iconv, only the conversions to Windows-1252 use iconv.
  */
 int UtilityConvertString(void *Pointer_String_Source, void *Pointer_String_Destination, TUtilityCharacterSet Source_Character_Set, TUtilityCharacterSet Destination_Character_Set, size_t Source_String_Size, size_t Destination_String_Size);
 
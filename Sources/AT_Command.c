@@ -3,26 +3,573 @@
  * @author Adrien RICCIARDI
  */
 #include <AT_Command.h>
+#include <errno.h>
+#include <Log.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <Utility.h>
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+#endif
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** Allow to turn on or off debug messages. */
+#define AT_COMMAND_IS_DEBUG_ENABLED 0
+
+/** The size in bytes of a serial port reception buffer. */
+#define AT_COMMAND_RECEPTION_BUFFER_SIZE 4096
+
+/** Tell whether the SSE2 and AVX2 hexadecimal decoders can be built for the target architecture. */
+#if defined(__x86_64__) || defined(__i386__)
+	#define AT_COMMAND_IS_X86_SIMD_AVAILABLE 1
+#else
+	#define AT_COMMAND_IS_X86_SIMD_AVAILABLE 0
+#endif
+
+/** How many different serial ports can be simultaneously used with the AT commands. */
+#define AT_COMMAND_MAXIMUM_SERIAL_PORTS_COUNT 4
+
+/** How many different command verbs can have statistics. */
+#define AT_COMMAND_MAXIMUM_STATISTICS_VERBS_COUNT 32
+/** The amount of power-of-two latency ranges of the histogram, the last one counts all latencies above 2^30 microseconds. */
+#define AT_COMMAND_LATENCY_HISTOGRAM_BUCKETS_COUNT 32
+
+/** How long to wait for each answer line of a control command (a command with a short answer), in milliseconds. */
+#define AT_COMMAND_CONTROL_LINE_TIMEOUT 5000
+/** How long a control command can take from its sending to its final result code, in milliseconds. */
+#define AT_COMMAND_CONTROL_COMMAND_TIMEOUT 15000
+/** How long the phone must stay silent for the link recovery to consider that all pending data have been received, in milliseconds. */
+#define AT_COMMAND_RECOVERY_QUIET_TIME 500
+/** The maximum duration of the pending data discarding done by the link recovery, in milliseconds. The phone can take a long time to send the end of a file that was being read. */
+#define AT_COMMAND_RECOVERY_DRAIN_TIMEOUT 60000
+/** How many times the link recovery probes the phone before giving up. */
+#define AT_COMMAND_RECOVERY_PROBES_COUNT 3
+
+/** How long to wait for each answer line of a transfer command (a command that can return a large amount of lines, like a file read). The whole command duration is not limited because it depends on the transferred data size. */
+#define AT_COMMAND_TRANSFER_LINE_TIMEOUT 10000
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** Accumulate the statistics of all the commands sharing the same verb (the command characters following "AT", up to the parameters). */
+typedef struct
+{
+	char String_Verb[16];
+	unsigned long long Commands_Count;
+	unsigned long long Completed_Commands_Count; //!< How many commands have been answered by a final result code, the latency is known only for these commands.
+	unsigned long long Sent_Bytes_Count;
+	unsigned long long Received_Bytes_Count; //!< All the bytes received while the command was waiting for its final result code, including the echo.
+	unsigned long long Total_Latency; //!< In nanoseconds.
+	unsigned long long Minimum_Latency; //!< In nanoseconds.
+	unsigned long long Maximum_Latency; //!< In nanoseconds.
+	unsigned long long Latency_Histogram[AT_COMMAND_LATENCY_HISTOGRAM_BUCKETS_COUNT]; //!< The bucket N counts the latencies in range [2^N, 2^(N+1)[ microseconds, the bucket 0 also counts the latencies under one microsecond.
+} TATCommandStatistics;
+
+/** Hold all the received bytes that have not been consumed yet by the AT command functions of a serial port. This is a linear buffer : it is filled from its beginning only when all its bytes have been consumed. */
+typedef struct
+{
+	TSerialPortID Serial_Port_ID; //!< The serial port this buffer is bound to.
+	unsigned char Buffer[AT_COMMAND_RECEPTION_BUFFER_SIZE];
+	unsigned int Read_Index; //!< The next byte to consume.
+	unsigned int Write_Index; //!< The end of the received bytes.
+	TATCommandStatistics *Pointer_Pending_Command_Statistics; //!< The statistics of the command waiting for its final result code, or NULL if there is no such command.
+	unsigned long long Pending_Command_Start_Time; //!< When the pending command was sent, in nanoseconds.
+	unsigned long long Pending_Command_Deadline; //!< When the pending command must have received its final result code, in nanoseconds. It is 0 if there is no pending command or if its duration is not limited.
+	unsigned int Line_Timeout; //!< How long to wait for each answer line of the last sent command, in milliseconds.
+	int Is_Answer_Pending; //!< Tell whether the final result code of the last sent command has not been received yet.
+	int Is_Echo_Enabled; //!< Tell whether the phone echoes the commands, the echo is then discarded when the command is sent.
+	int Is_Answer_Start_Pending; //!< When the echo is disabled, tell that the CRLF sequence starting the answer of the last sent command has not been consumed yet.
+	int Is_Lean_Link_Profile_Enabled; //!< Tell whether the echo has been disabled by ATCommandEnableLeanLinkProfile().
+	int Was_Echo_Enabled; //!< The echo setting found by ATCommandEnableLeanLinkProfile(), it is restored by ATCommandRestoreLinkProfile().
+} TATCommandReceptionBuffer;
+
+/** A function able to convert hexadecimal characters to binary.
+ * @param Pointer_Hexadecimal_Characters The characters to convert.
+ * @param Characters_Count How many characters to convert, this value must be even.
+ * @param Pointer_Output_Buffer On output, contain the converted bytes. The buffer must be able to store half the characters count.
+ * @return The amount of characters that have been successfully converted. It is equal to Characters_Count if all characters are valid, otherwise this is the offset of the first invalid character.
+ */
+typedef unsigned int (*TATCommandHexadecimalDecoder)(const unsigned char *Pointer_Hexadecimal_Characters, unsigned int Characters_Count, unsigned char *Pointer_Output_Buffer);
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** The reception buffers of all serial ports used so far. */
+static TATCommandReceptionBuffer AT_Command_Reception_Buffers[AT_COMMAND_MAXIMUM_SERIAL_PORTS_COUNT];
+/** How many entries of the reception buffers table are in use. */
+static int AT_Command_Reception_Buffers_Count = 0;
+
+/** The statistics of all the command verbs sent so far. */
+static TATCommandStatistics AT_Command_Statistics[AT_COMMAND_MAXIMUM_STATISTICS_VERBS_COUNT];
+/** How many entries of the statistics table are in use. */
+static int AT_Command_Statistics_Count = 0;
+
+/** Set when the user asked to stop the program, so the operation in progress is not given any more data from the phone. */
+static volatile sig_atomic_t AT_Command_Is_Interruption_Requested = 0;
+
+/** The verbs of the commands that use the transfer timeouts, all other commands use the control timeouts. */
+static const char *AT_Command_Transfer_Verbs[] =
+{
+	"+EFSR", // Read a file
+	"+EFSL", // List a directory
+	"+CPBR" // Read a range of phone book entries
+};
+
+/** Convert an ASCII character to its hexadecimal nibble value, or to -1 if this is not an hexadecimal character. */
+static const signed char AT_Command_Hexadecimal_Nibble_Values[256] =
+{
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+/** The two hexadecimal characters representing each byte value, the characters of a byte start at offset 2 * byte value. */
+static const char AT_Command_Hexadecimal_Byte_Characters[] =
+	"000102030405060708090A0B0C0D0E0F"
+	"101112131415161718191A1B1C1D1E1F"
+	"202122232425262728292A2B2C2D2E2F"
+	"303132333435363738393A3B3C3D3E3F"
+	"404142434445464748494A4B4C4D4E4F"
+	"505152535455565758595A5B5C5D5E5F"
+	"606162636465666768696A6B6C6D6E6F"
+	"707172737475767778797A7B7C7D7E7F"
+	"808182838485868788898A8B8C8D8E8F"
+	"909192939495969798999A9B9C9D9E9F"
+	"A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+	"B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+	"C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+	"D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+	"E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+	"F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
 
 //-------------------------------------------------------------------------------------------------
 // Private functions
 //-------------------------------------------------------------------------------------------------
-/** TODO */
-static int ATCommandGetHexadecimalNibbleBinaryValue(char Hexadecimal_Nibble)
+/** Find the reception buffer bound to a serial port, binding a new buffer if this serial port is used for the first time.
+ * @param Serial_Port_ID The serial port.
+ * @return NULL if there is no more reception buffer available,
+ * @return A valid pointer on success.
+ */
+static TATCommandReceptionBuffer *ATCommandGetReceptionBuffer(TSerialPortID Serial_Port_ID)
 {
-	// Convert any hexadecimal letters to uppercase
-	if ((Hexadecimal_Nibble >= 'a') && (Hexadecimal_Nibble <= 'f')) Hexadecimal_Nibble -= 32;
+	TATCommandReceptionBuffer *Pointer_Reception_Buffer;
+	int i;
 
-	// Convert digits
-	if ((Hexadecimal_Nibble >= '0') && (Hexadecimal_Nibble <= '9')) return Hexadecimal_Nibble - '0';
+	// Is this serial port already known ?
+	for (i = 0; i < AT_Command_Reception_Buffers_Count; i++)
+	{
+		if (AT_Command_Reception_Buffers[i].Serial_Port_ID == Serial_Port_ID) return &AT_Command_Reception_Buffers[i];
+	}
 
-	// Convert letters
-	if ((Hexadecimal_Nibble >= 'A') && (Hexadecimal_Nibble <= 'F')) return Hexadecimal_Nibble - 'A' + 10;
+	// Bind a new buffer to this serial port
+	if (AT_Command_Reception_Buffers_Count >= AT_COMMAND_MAXIMUM_SERIAL_PORTS_COUNT)
+	{
+		LOG("Error : no more reception buffer is available for the serial port %d.\n", (int) Serial_Port_ID);
+		return NULL;
+	}
+	Pointer_Reception_Buffer = &AT_Command_Reception_Buffers[AT_Command_Reception_Buffers_Count];
+	AT_Command_Reception_Buffers_Count++;
+	Pointer_Reception_Buffer->Serial_Port_ID = Serial_Port_ID;
+	Pointer_Reception_Buffer->Read_Index = 0;
+	Pointer_Reception_Buffer->Write_Index = 0;
+	Pointer_Reception_Buffer->Pointer_Pending_Command_Statistics = NULL;
+	Pointer_Reception_Buffer->Pending_Command_Deadline = 0;
+	Pointer_Reception_Buffer->Line_Timeout = AT_COMMAND_CONTROL_LINE_TIMEOUT;
+	Pointer_Reception_Buffer->Is_Answer_Pending = 0;
+	Pointer_Reception_Buffer->Is_Echo_Enabled = 1; // This is the phone default setting
+	Pointer_Reception_Buffer->Is_Answer_Start_Pending = 0;
+	Pointer_Reception_Buffer->Is_Lean_Link_Profile_Enabled = 0;
+	Pointer_Reception_Buffer->Was_Echo_Enabled = 1;
 
-	// This is an invalid hexadecimal character
-	return -1;
+	// Forget the data received before the program started using this serial port, they can only be the leftovers of an interrupted previous program run
+	tcflush(Serial_Port_ID, TCIFLUSH);
+
+	return Pointer_Reception_Buffer;
+}
+
+/** Get a monotonic timestamp.
+ * @return The current time in nanoseconds.
+ */
+static unsigned long long ATCommandGetTime(void)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return (unsigned long long) Time.tv_sec * 1000000000ULL + (unsigned long long) Time.tv_nsec;
+}
+
+/** Extract the verb of a command, it is made of the characters following "AT", up to the parameters or the read and test command suffixes.
+ * @param Pointer_String_Command The command, starting with "AT".
+ * @param Pointer_String_Verb On output, contain the verb. It is truncated if it does not fit in the string.
+ * @param String_Size The size of the verb string, including the terminating zero.
+ */
+static void ATCommandGetVerb(char *Pointer_String_Command, char *Pointer_String_Verb, unsigned int String_Size)
+{
+	unsigned int Length = 0;
+
+	if (strncmp(Pointer_String_Command, "AT", 2) == 0) Pointer_String_Command += 2;
+	while ((Pointer_String_Command[Length] != 0) && (Pointer_String_Command[Length] != '=') && (Pointer_String_Command[Length] != '?') && (Length < String_Size - 1))
+	{
+		Pointer_String_Verb[Length] = Pointer_String_Command[Length];
+		Length++;
+	}
+	Pointer_String_Verb[Length] = 0;
+}
+
+/** Tell whether an answer line is a final result code, which terminates the command answer.
+ * @param Pointer_String_Answer The answer line.
+ * @return 1 if the line is a final result code,
+ * @return 0 if the line is an information line.
+ */
+static int ATCommandIsFinalResultCode(char *Pointer_String_Answer)
+{
+	if ((strcmp(Pointer_String_Answer, "OK") == 0) || (strcmp(Pointer_String_Answer, "ERROR") == 0) || (strncmp(Pointer_String_Answer, "+CMS ERROR:", 11) == 0) || (strncmp(Pointer_String_Answer, "+CME ERROR:", 11) == 0)) return 1;
+	return 0;
+}
+
+/** Find the statistics of a command verb, creating them if the verb is used for the first time.
+ * @param Pointer_String_Command The command, starting with "AT".
+ * @return NULL if there is no more room for a new verb,
+ * @return A valid pointer on success.
+ */
+static TATCommandStatistics *ATCommandGetStatistics(char *Pointer_String_Command)
+{
+	TATCommandStatistics *Pointer_Statistics;
+	char String_Verb[sizeof(Pointer_Statistics->String_Verb)];
+	int i;
+
+	ATCommandGetVerb(Pointer_String_Command, String_Verb, sizeof(String_Verb));
+
+	// Is this verb already known ?
+	for (i = 0; i < AT_Command_Statistics_Count; i++)
+	{
+		if (strcmp(AT_Command_Statistics[i].String_Verb, String_Verb) == 0) return &AT_Command_Statistics[i];
+	}
+
+	// Add the new verb
+	if (AT_Command_Statistics_Count >= AT_COMMAND_MAXIMUM_STATISTICS_VERBS_COUNT) return NULL;
+	Pointer_Statistics = &AT_Command_Statistics[AT_Command_Statistics_Count];
+	AT_Command_Statistics_Count++;
+	memset(Pointer_Statistics, 0, sizeof(TATCommandStatistics));
+	strcpy(Pointer_Statistics->String_Verb, String_Verb);
+	Pointer_Statistics->Minimum_Latency = ~0ULL;
+
+	return Pointer_Statistics;
+}
+
+/** Account the latency of the pending command of a serial port if the provided answer line is a final result code.
+ * @param Pointer_Reception_Buffer The serial port reception buffer.
+ * @param Pointer_String_Answer The received answer line.
+ */
+static void ATCommandUpdatePendingCommandStatistics(TATCommandReceptionBuffer *Pointer_Reception_Buffer, char *Pointer_String_Answer)
+{
+	TATCommandStatistics *Pointer_Statistics;
+	unsigned long long Latency, Microseconds;
+	int Bucket_Index = 0;
+
+	// Is a command waiting for its final result code ?
+	Pointer_Statistics = Pointer_Reception_Buffer->Pointer_Pending_Command_Statistics;
+	if (Pointer_Statistics == NULL) return;
+	if (!ATCommandIsFinalResultCode(Pointer_String_Answer)) return;
+
+	// Update the latency statistics
+	Latency = ATCommandGetTime() - Pointer_Reception_Buffer->Pending_Command_Start_Time;
+	Pointer_Statistics->Completed_Commands_Count++;
+	Pointer_Statistics->Total_Latency += Latency;
+	if (Latency < Pointer_Statistics->Minimum_Latency) Pointer_Statistics->Minimum_Latency = Latency;
+	if (Latency > Pointer_Statistics->Maximum_Latency) Pointer_Statistics->Maximum_Latency = Latency;
+	Microseconds = Latency / 1000;
+	while ((Microseconds > 1) && (Bucket_Index < AT_COMMAND_LATENCY_HISTOGRAM_BUCKETS_COUNT - 1))
+	{
+		Microseconds >>= 1;
+		Bucket_Index++;
+	}
+	Pointer_Statistics->Latency_Histogram[Bucket_Index]++;
+
+	Pointer_Reception_Buffer->Pointer_Pending_Command_Statistics = NULL;
+}
+
+/** Make sure that the reception buffer contains at least one byte, waiting for the serial port to receive data if the buffer is empty. All the bytes already received by the serial port are retrieved at once.
+ * @param Pointer_Reception_Buffer The reception buffer to fill.
+ * @param Line_Deadline When the line being received must be complete, in nanoseconds. The pending command deadline is also taken into account.
+ * @return -3 if the pending command deadline expired,
+ * @return -2 if the line deadline expired,
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ * @note The Linux serial port library uses the device file descriptor as serial port ID, so poll() and read() can be directly called on it.
+ */
+static int ATCommandFillReceptionBuffer(TATCommandReceptionBuffer *Pointer_Reception_Buffer, unsigned long long Line_Deadline)
+{
+	ssize_t Read_Bytes_Count;
+	struct pollfd Poll_Descriptor;
+	unsigned long long Deadline, Current_Time;
+	int Result, Is_Command_Deadline = 0;
+
+	// Nothing to do if the buffer still contains data
+	if (Pointer_Reception_Buffer->Read_Index != Pointer_Reception_Buffer->Write_Index) return 0;
+
+	// Do not wait for the phone if the program is being stopped
+	if (AT_Command_Is_Interruption_Requested)
+	{
+		LOG("Error : the program is being interrupted, no more data are received from the phone.\n");
+		return -1;
+	}
+
+	// The buffer is empty, restart from its beginning
+	Pointer_Reception_Buffer->Read_Index = 0;
+	Pointer_Reception_Buffer->Write_Index = 0;
+
+	// Wait for data until the closest deadline
+	Deadline = Line_Deadline;
+	if ((Pointer_Reception_Buffer->Pending_Command_Deadline != 0) && (Pointer_Reception_Buffer->Pending_Command_Deadline <= Deadline))
+	{
+		Deadline = Pointer_Reception_Buffer->Pending_Command_Deadline;
+		Is_Command_Deadline = 1;
+	}
+	Poll_Descriptor.fd = Pointer_Reception_Buffer->Serial_Port_ID;
+	Poll_Descriptor.events = POLLIN;
+	while (1)
+	{
+		Current_Time = ATCommandGetTime();
+		if (Current_Time >= Deadline) return Is_Command_Deadline ? -3 : -2;
+
+		Result = poll(&Poll_Descriptor, 1, (int) ((Deadline - Current_Time + 999999ULL) / 1000000ULL)); // Round the timeout up to the next millisecond to avoid spinning when less than one millisecond is remaining
+		if (Result > 0) break;
+		if (Result < 0) // This includes an interruption by a signal, so the user can abort the wait
+		{
+			LOG("Error : failed to wait for serial port data (%s).\n", strerror(errno));
+			return -1;
+		}
+	}
+
+	// Retrieve at least one byte, the system call returns all the bytes that are already available up to the requested size
+	Read_Bytes_Count = read(Pointer_Reception_Buffer->Serial_Port_ID, Pointer_Reception_Buffer->Buffer, sizeof(Pointer_Reception_Buffer->Buffer));
+	if (Read_Bytes_Count < 0)
+	{
+		LOG("Error : failed to read from the serial port (%s).\n", strerror(errno));
+		return -1;
+	}
+	if (Read_Bytes_Count == 0)
+	{
+		LOG("Error : the serial port has been closed by the remote side.\n");
+		return -1;
+	}
+	Pointer_Reception_Buffer->Write_Index += (unsigned int) Read_Bytes_Count;
+	if (Pointer_Reception_Buffer->Pointer_Pending_Command_Statistics != NULL) Pointer_Reception_Buffer->Pointer_Pending_Command_Statistics->Received_Bytes_Count += (unsigned long long) Read_Bytes_Count;
+
+	return 0;
+}
+
+/** Consume all the received bytes up to the next line feed character (included).
+ * @param Pointer_Reception_Buffer The reception buffer.
+ * @param Pointer_Discarded_Bytes_Count On output, contain how many bytes have been consumed. This parameter can be NULL.
+ * @return See ATCommandFillReceptionBuffer() for the negative values,
+ * @return 0 on success.
+ */
+static int ATCommandDiscardLine(TATCommandReceptionBuffer *Pointer_Reception_Buffer, unsigned int *Pointer_Discarded_Bytes_Count)
+{
+	unsigned int Bytes_Count, Discarded_Bytes_Count = 0;
+	unsigned char *Pointer_Received_Data, *Pointer_End_Of_Line;
+	unsigned long long Line_Deadline;
+	int Result;
+
+	Line_Deadline = ATCommandGetTime() + Pointer_Reception_Buffer->Line_Timeout * 1000000ULL;
+	while (1)
+	{
+		Result = ATCommandFillReceptionBuffer(Pointer_Reception_Buffer, Line_Deadline);
+		if (Result != 0) return Result;
+
+		Pointer_Received_Data = &Pointer_Reception_Buffer->Buffer[Pointer_Reception_Buffer->Read_Index];
+		Bytes_Count = Pointer_Reception_Buffer->Write_Index - Pointer_Reception_Buffer->Read_Index;
+		Pointer_End_Of_Line = memchr(Pointer_Received_Data, '\n', Bytes_Count);
+		if (Pointer_End_Of_Line != NULL) Bytes_Count = (unsigned int) (Pointer_End_Of_Line - Pointer_Received_Data) + 1;
+		Pointer_Reception_Buffer->Read_Index += Bytes_Count;
+		Discarded_Bytes_Count += Bytes_Count;
+		if (Pointer_End_Of_Line != NULL) break;
+	}
+
+	if (Pointer_Discarded_Bytes_Count != NULL) *Pointer_Discarded_Bytes_Count = Discarded_Bytes_Count;
+	return 0;
+}
+
+/** Discard all the data received by a serial port until the phone stops sending data.
+ * @param Pointer_Reception_Buffer The reception buffer of the serial port.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int ATCommandDrainReceivedData(TATCommandReceptionBuffer *Pointer_Reception_Buffer)
+{
+	struct pollfd Poll_Descriptor;
+	unsigned long long Deadline;
+	unsigned long long Discarded_Bytes_Count;
+	ssize_t Read_Bytes_Count;
+	int Result;
+
+	// Forget the buffered data
+	Discarded_Bytes_Count = Pointer_Reception_Buffer->Write_Index - Pointer_Reception_Buffer->Read_Index;
+	Pointer_Reception_Buffer->Read_Index = 0;
+	Pointer_Reception_Buffer->Write_Index = 0;
+
+	// Discard the received data until the phone stays silent long enough, the reception buffer is used as scratch area
+	Poll_Descriptor.fd = Pointer_Reception_Buffer->Serial_Port_ID;
+	Poll_Descriptor.events = POLLIN;
+	Deadline = ATCommandGetTime() + AT_COMMAND_RECOVERY_DRAIN_TIMEOUT * 1000000ULL;
+	while (1)
+	{
+		Result = poll(&Poll_Descriptor, 1, AT_COMMAND_RECOVERY_QUIET_TIME);
+		if (Result == 0) break;
+		if (Result < 0)
+		{
+			LOG("Error : failed to wait for serial port data (%s).\n", strerror(errno));
+			return -1;
+		}
+
+		Read_Bytes_Count = read(Pointer_Reception_Buffer->Serial_Port_ID, Pointer_Reception_Buffer->Buffer, sizeof(Pointer_Reception_Buffer->Buffer));
+		if (Read_Bytes_Count <= 0)
+		{
+			LOG("Error : failed to read from the serial port (%s).\n", Read_Bytes_Count < 0 ? strerror(errno) : "the serial port has been closed by the remote side");
+			return -1;
+		}
+		Discarded_Bytes_Count += (unsigned long long) Read_Bytes_Count;
+
+		// Probe the phone anyway if it does not stop sending data
+		if (ATCommandGetTime() >= Deadline)
+		{
+			LOG("Warning : the phone is still sending data after %d ms, trying to communicate anyway.\n", AT_COMMAND_RECOVERY_DRAIN_TIMEOUT);
+			break;
+		}
+	}
+	LOG_DEBUG(AT_COMMAND_IS_DEBUG_ENABLED, "Discarded %llu pending bytes.\n", Discarded_Bytes_Count);
+
+	return 0;
+}
+
+/** Portable hexadecimal decoder using a look-up table. See TATCommandHexadecimalDecoder for the description. */
+static unsigned int ATCommandDecodeHexadecimalScalar(const unsigned char *Pointer_Hexadecimal_Characters, unsigned int Characters_Count, unsigned char *Pointer_Output_Buffer)
+{
+	unsigned int i;
+	int High_Nibble, Low_Nibble;
+
+	for (i = 0; i < Characters_Count; i += 2)
+	{
+		High_Nibble = AT_Command_Hexadecimal_Nibble_Values[Pointer_Hexadecimal_Characters[i]];
+		Low_Nibble = AT_Command_Hexadecimal_Nibble_Values[Pointer_Hexadecimal_Characters[i + 1]];
+
+		// Invalid characters have a negative value, so testing both nibbles at once is enough to detect an error
+		if ((High_Nibble | Low_Nibble) < 0)
+		{
+			if (High_Nibble < 0) return i;
+			return i + 1;
+		}
+
+		*Pointer_Output_Buffer = (unsigned char) ((High_Nibble << 4) | Low_Nibble);
+		Pointer_Output_Buffer++;
+	}
+
+	return Characters_Count;
+}
+
+#if AT_COMMAND_IS_X86_SIMD_AVAILABLE
+	/** Convert 16 hexadecimal characters at a time with SSE2 instructions. See TATCommandHexadecimalDecoder for the description. */
+	__attribute__((target("sse2"))) static unsigned int ATCommandDecodeHexadecimalSSE2(const unsigned char *Pointer_Hexadecimal_Characters, unsigned int Characters_Count, unsigned char *Pointer_Output_Buffer)
+	{
+		unsigned int i;
+		__m128i Characters, Lowercase_Characters, Is_Digit, Is_Letter, Nibbles, Bytes;
+
+		for (i = 0; i + 16 <= Characters_Count; i += 16)
+		{
+			Characters = _mm_loadu_si128((const __m128i *) &Pointer_Hexadecimal_Characters[i]);
+
+			// Classify the characters, bytes greater than 127 are negative for the signed comparisons, so they are never matched
+			Is_Digit = _mm_and_si128(_mm_cmpgt_epi8(Characters, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(Characters, _mm_set1_epi8('9' + 1)));
+			Lowercase_Characters = _mm_or_si128(Characters, _mm_set1_epi8(0x20));
+			Is_Letter = _mm_and_si128(_mm_cmpgt_epi8(Lowercase_Characters, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(Lowercase_Characters, _mm_set1_epi8('f' + 1)));
+
+			// Let the scalar code find the exact location of an invalid character
+			if (_mm_movemask_epi8(_mm_or_si128(Is_Digit, Is_Letter)) != 0xFFFF) break;
+
+			// Convert the characters to nibbles
+			Nibbles = _mm_or_si128(_mm_and_si128(Is_Digit, _mm_sub_epi8(Characters, _mm_set1_epi8('0'))), _mm_and_si128(Is_Letter, _mm_sub_epi8(Lowercase_Characters, _mm_set1_epi8('a' - 10))));
+
+			// Each 16-bit word holds the high nibble in its least significant byte and the low nibble in its most significant byte, merge them and pack the resulting bytes
+			Bytes = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(Nibbles, _mm_set1_epi16(0x00FF)), 4), _mm_srli_epi16(Nibbles, 8));
+			_mm_storel_epi64((__m128i *) &Pointer_Output_Buffer[i / 2], _mm_packus_epi16(Bytes, Bytes));
+		}
+
+		// Convert the remaining characters
+		return i + ATCommandDecodeHexadecimalScalar(&Pointer_Hexadecimal_Characters[i], Characters_Count - i, &Pointer_Output_Buffer[i / 2]);
+	}
+
+	/** Convert 32 hexadecimal characters at a time with AVX2 instructions. See TATCommandHexadecimalDecoder for the description. */
+	__attribute__((target("avx2"))) static unsigned int ATCommandDecodeHexadecimalAVX2(const unsigned char *Pointer_Hexadecimal_Characters, unsigned int Characters_Count, unsigned char *Pointer_Output_Buffer)
+	{
+		unsigned int i;
+		__m256i Characters, Lowercase_Characters, Is_Digit, Is_Letter, Nibbles, Bytes;
+
+		for (i = 0; i + 32 <= Characters_Count; i += 32)
+		{
+			Characters = _mm256_loadu_si256((const __m256i *) &Pointer_Hexadecimal_Characters[i]);
+
+			// Classify the characters, bytes greater than 127 are negative for the signed comparisons, so they are never matched
+			Is_Digit = _mm256_andnot_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8('0'), Characters), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), Characters));
+			Lowercase_Characters = _mm256_or_si256(Characters, _mm256_set1_epi8(0x20));
+			Is_Letter = _mm256_andnot_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8('a'), Lowercase_Characters), _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), Lowercase_Characters));
+
+			// Let the scalar code find the exact location of an invalid character
+			if ((unsigned int) _mm256_movemask_epi8(_mm256_or_si256(Is_Digit, Is_Letter)) != 0xFFFFFFFF) break;
+
+			// Convert the characters to nibbles
+			Nibbles = _mm256_or_si256(_mm256_and_si256(Is_Digit, _mm256_sub_epi8(Characters, _mm256_set1_epi8('0'))), _mm256_and_si256(Is_Letter, _mm256_sub_epi8(Lowercase_Characters, _mm256_set1_epi8('a' - 10))));
+
+			// Merge the nibbles like the SSE2 version, the packing instruction works on each 128-bit lane, so gather both lanes results in the low 128 bits
+			Bytes = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(Nibbles, _mm256_set1_epi16(0x00FF)), 4), _mm256_srli_epi16(Nibbles, 8));
+			Bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(Bytes, Bytes), 0xD8);
+			_mm_storeu_si128((__m128i *) &Pointer_Output_Buffer[i / 2], _mm256_castsi256_si128(Bytes));
+		}
+
+		// Convert the remaining characters
+		return i + ATCommandDecodeHexadecimalSSE2(&Pointer_Hexadecimal_Characters[i], Characters_Count - i, &Pointer_Output_Buffer[i / 2]);
+	}
+#endif
+
+/** Select the fastest hexadecimal decoder supported by the processor on first use, then forward the call to it. See TATCommandHexadecimalDecoder for the description. */
+static unsigned int ATCommandDecodeHexadecimalFirstCall(const unsigned char *Pointer_Hexadecimal_Characters, unsigned int Characters_Count, unsigned char *Pointer_Output_Buffer);
+
+/** The hexadecimal decoder to use. */
+static TATCommandHexadecimalDecoder ATCommandDecodeHexadecimal = ATCommandDecodeHexadecimalFirstCall;
+
+static unsigned int ATCommandDecodeHexadecimalFirstCall(const unsigned char *Pointer_Hexadecimal_Characters, unsigned int Characters_Count, unsigned char *Pointer_Output_Buffer)
+{
+	TATCommandHexadecimalDecoder Decoder = ATCommandDecodeHexadecimalScalar;
+
+	#if AT_COMMAND_IS_X86_SIMD_AVAILABLE
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) Decoder = ATCommandDecodeHexadecimalAVX2;
+		else if (__builtin_cpu_supports("sse2")) Decoder = ATCommandDecodeHexadecimalSSE2;
+	#endif
+	ATCommandDecodeHexadecimal = Decoder;
+
+	return Decoder(Pointer_Hexadecimal_Characters, Characters_Count, Pointer_Output_Buffer);
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -30,24 +577,71 @@ static int ATCommandGetHexadecimalNibbleBinaryValue(char Hexadecimal_Nibble)
 //-------------------------------------------------------------------------------------------------
 int ATCommandReceiveAnswerLine(TSerialPortID Serial_Port_ID, char *Pointer_String_Answer, unsigned int Maximum_Length)
 {
-	unsigned int i;
-	char Character;
+	TATCommandReceptionBuffer *Pointer_Reception_Buffer;
+	unsigned int Length = 0, Bytes_Count;
+	unsigned char *Pointer_Received_Data, *Pointer_End_Of_Line;
+	unsigned long long Line_Deadline;
+	int Result;
 
 	// Make sure there is at least the room to store one character followed by the terminating zero.
 	if (Maximum_Length <= 2) return -1;
 
+	Pointer_Reception_Buffer = ATCommandGetReceptionBuffer(Serial_Port_ID);
+	if (Pointer_Reception_Buffer == NULL) return -4;
+
+	// Skip the CRLF sequence starting the answer if the command has been sent without echo
+	if (Pointer_Reception_Buffer->Is_Answer_Start_Pending)
+	{
+		Result = ATCommandDiscardLine(Pointer_Reception_Buffer, NULL);
+		if (Result != 0) goto Exit_Reception_Error;
+		Pointer_Reception_Buffer->Is_Answer_Start_Pending = 0;
+	}
+
 	// Read as much characters as allowed
+	Line_Deadline = ATCommandGetTime() + Pointer_Reception_Buffer->Line_Timeout * 1000000ULL;
 	Maximum_Length--; // Keep one byte for the terminating zero
-	for (i = 0; i < Maximum_Length; i++)
+	while (1)
 	{
-		// Wait for next byte to be received
-		Character = SerialPortReadByte(Serial_Port_ID);
+		// Wait for more bytes to be received if all buffered ones have been consumed
+		Result = ATCommandFillReceptionBuffer(Pointer_Reception_Buffer, Line_Deadline);
+		if (Result != 0) goto Exit_Reception_Error;
+
+		// Search for the end of the line in the buffered data
+		Pointer_Received_Data = &Pointer_Reception_Buffer->Buffer[Pointer_Reception_Buffer->Read_Index];
+		Bytes_Count = Pointer_Reception_Buffer->Write_Index - Pointer_Reception_Buffer->Read_Index;
+		Pointer_End_Of_Line = memchr(Pointer_Received_Data, '\n', Bytes_Count);
+		if (Pointer_End_Of_Line != NULL) Bytes_Count = (unsigned int) (Pointer_End_Of_Line - Pointer_Received_Data); // Do not copy the line feed character
+
+		// Append the regular characters to the string
+		if (Bytes_Count > Maximum_Length - Length)
+		{
+			// There is not enough room in the string buffer, consume all the characters that fit in it like a regular string
+			Bytes_Count = Maximum_Length - Length;
+			memcpy(&Pointer_String_Answer[Length], Pointer_Received_Data, Bytes_Count);
+			Pointer_Reception_Buffer->Read_Index += Bytes_Count;
+			return -3;
+		}
+		memcpy(&Pointer_String_Answer[Length], Pointer_Received_Data, Bytes_Count);
+		Length += Bytes_Count;
+		Pointer_Reception_Buffer->Read_Index += Bytes_Count;
+
+		// Go on receiving characters if the line is not complete yet
+		if (Pointer_End_Of_Line == NULL) continue;
+		Pointer_Reception_Buffer->Read_Index++; // Consume the line feed character
 
 		// Is the end of the string reached ?
-		if ((Character == '\n') && (i > 0) && (Pointer_String_Answer[i - 1] == '\r'))
+		if ((Length > 0) && (Pointer_String_Answer[Length - 1] == '\r'))
 		{
 			// Terminate the string
-			Pointer_String_Answer[i - 1] = 0;
+			Pointer_String_Answer[Length - 1] = 0;
+
+			// Is this the final result code of the pending command ?
+			ATCommandUpdatePendingCommandStatistics(Pointer_Reception_Buffer, Pointer_String_Answer);
+			if (ATCommandIsFinalResultCode(Pointer_String_Answer))
+			{
+				Pointer_Reception_Buffer->Pending_Command_Deadline = 0;
+				Pointer_Reception_Buffer->Is_Answer_Pending = 0;
+			}
 
 			// Is this the standard error string ?
 			if ((Maximum_Length >= 6) && (strcmp(Pointer_String_Answer, "ERROR") == 0)) return -2;
@@ -56,73 +650,286 @@ int ATCommandReceiveAnswerLine(TSerialPortID Serial_Port_ID, char *Pointer_Strin
 			return 0;
 		}
 
-		// This is a regular character, append it to the string
-		Pointer_String_Answer[i] = Character;
+		// The line feed is not preceded by a carriage return, so this is a regular character, append it to the string
+		if (Length >= Maximum_Length) return -3;
+		Pointer_String_Answer[Length] = '\n';
+		Length++;
 	}
 
-	// There was not enough room in the string buffer
-	return -3;
+Exit_Reception_Error:
+	if (Result == -2)
+	{
+		LOG("Error : the phone did not send a complete answer line within %u ms.\n", Pointer_Reception_Buffer->Line_Timeout);
+		return -5;
+	}
+	if (Result == -3)
+	{
+		LOG("Error : the phone did not finish answering the command in time.\n");
+		Pointer_Reception_Buffer->Pending_Command_Deadline = 0; // Report the expired deadline only once, so the caller can try to recover the communication
+		return -6;
+	}
+	return -4;
 }
 
 int ATCommandSendCommand(TSerialPortID Serial_Port_ID, char *Pointer_String_Command)
 {
-	unsigned int Length;
+	TATCommandReceptionBuffer *Pointer_Reception_Buffer;
+	unsigned int Length, i;
+	char String_Verb[16];
+	int Result;
 
-	// Send the command
+	Pointer_Reception_Buffer = ATCommandGetReceptionBuffer(Serial_Port_ID);
+	if (Pointer_Reception_Buffer == NULL) return -1;
+
+	// Do not start a new command if the program is being stopped
+	if (AT_Command_Is_Interruption_Requested)
+	{
+		LOG("Error : the program is being interrupted, no more commands are sent to the phone.\n");
+		return -1;
+	}
+
+	// The answer of the previous command has not been completely received (its operation was interrupted or timed out), discard the answer end so it is not mistaken for the answer of this command
+	if (Pointer_Reception_Buffer->Is_Answer_Pending)
+	{
+		LOG_DEBUG(AT_COMMAND_IS_DEBUG_ENABLED, "The previous command answer is incomplete, discarding it.\n");
+		if (ATCommandDrainReceivedData(Pointer_Reception_Buffer) != 0) return -1;
+		Pointer_Reception_Buffer->Is_Answer_Start_Pending = 0;
+	}
+
+	// Start measuring the command, a previous command that did not receive its final result code is not accounted in the latency statistics
 	Length = (unsigned int) strlen(Pointer_String_Command);
+	Pointer_Reception_Buffer->Pointer_Pending_Command_Statistics = ATCommandGetStatistics(Pointer_String_Command);
+	if (Pointer_Reception_Buffer->Pointer_Pending_Command_Statistics != NULL)
+	{
+		Pointer_Reception_Buffer->Pointer_Pending_Command_Statistics->Commands_Count++;
+		Pointer_Reception_Buffer->Pointer_Pending_Command_Statistics->Sent_Bytes_Count += Length + 1; // Take the terminating character into account
+	}
+	Pointer_Reception_Buffer->Pending_Command_Start_Time = ATCommandGetTime();
+
+	// Select the timeouts matching the expected answer size
+	ATCommandGetVerb(Pointer_String_Command, String_Verb, sizeof(String_Verb));
+	Pointer_Reception_Buffer->Line_Timeout = AT_COMMAND_CONTROL_LINE_TIMEOUT;
+	Pointer_Reception_Buffer->Pending_Command_Deadline = Pointer_Reception_Buffer->Pending_Command_Start_Time + AT_COMMAND_CONTROL_COMMAND_TIMEOUT * 1000000ULL;
+	for (i = 0; i < UTILITY_ARRAY_SIZE(AT_Command_Transfer_Verbs); i++)
+	{
+		if (strcmp(String_Verb, AT_Command_Transfer_Verbs[i]) == 0)
+		{
+			Pointer_Reception_Buffer->Line_Timeout = AT_COMMAND_TRANSFER_LINE_TIMEOUT;
+			Pointer_Reception_Buffer->Pending_Command_Deadline = 0;
+			break;
+		}
+	}
+
+	// Send the command
 	SerialPortWriteBuffer(Serial_Port_ID, Pointer_String_Command, Length);
 
 	// Send the terminating character (this is not the CRLF terminating sequence here, only CR character is sent)
 	SerialPortWriteByte(Serial_Port_ID, '\r');
+	Pointer_Reception_Buffer->Is_Answer_Pending = 1;
 
-	// Discard the command echoing
-	while (SerialPortReadByte(Serial_Port_ID) != '\n') ;
+	// Without echo, there is nothing to wait for, the CRLF sequence starting the answer will be skipped by the first answer line reception
+	if (!Pointer_Reception_Buffer->Is_Echo_Enabled)
+	{
+		Pointer_Reception_Buffer->Is_Answer_Start_Pending = 1;
+		return 0;
+	}
+
+	// Discard the command echoing, which is followed by the CRLF sequence starting the answer
+	Result = ATCommandDiscardLine(Pointer_Reception_Buffer, NULL);
+	if (Result == -1) return -1;
+	if (Result < 0)
+	{
+		LOG("Error : the phone did not echo the command within %u ms.\n", Pointer_Reception_Buffer->Line_Timeout);
+		return -2;
+	}
 
 	return 0;
 }
 
-int ATCommandConvertHexadecimalToBinary(char *Pointer_String_Hexadecimal, unsigned char *Pointer_Output_Buffer, unsigned int Output_Buffer_Size)
+int ATCommandEnableLeanLinkProfile(TSerialPortID Serial_Port_ID)
 {
-	unsigned char Byte;
-	unsigned int Converted_Data_Size = 0;
+	TATCommandReceptionBuffer *Pointer_Reception_Buffer;
+	unsigned int Discarded_Bytes_Count;
+	char String_Answer[64];
+	int Result;
+
+	Pointer_Reception_Buffer = ATCommandGetReceptionBuffer(Serial_Port_ID);
+	if (Pointer_Reception_Buffer == NULL) return -1;
+	if (Pointer_Reception_Buffer->Is_Lean_Link_Profile_Enabled) return 0;
 
-	// Make sure the string size is a multiple of 2, so all hexadecimal bytes are complete
-	if ((strlen(Pointer_String_Hexadecimal) % 2) != 0) return -1;
+	// Send the command without waiting for an echo, because the phone current echo setting is unknown (a previous program run may have been interrupted before restoring it)
+	Pointer_Reception_Buffer->Is_Echo_Enabled = 0;
+	if (ATCommandSendCommand(Serial_Port_ID, "ATE0") != 0) return -1;
 
-	// Convert all characters to their binary representation
-	while ((*Pointer_String_Hexadecimal != 0) && (Converted_Data_Size < Output_Buffer_Size))
+	// The first line is "ATE0<CR><CR><LF>" if the echo was enabled when the phone received the command, or only "<CR><LF>" if it was already disabled
+	if (ATCommandDiscardLine(Pointer_Reception_Buffer, &Discarded_Bytes_Count) != 0)
 	{
-		// Convert both hexadecimal nibbles to form a complete byte
-		Byte = (ATCommandGetHexadecimalNibbleBinaryValue(*Pointer_String_Hexadecimal) << 4) & 0xF0;
-		Pointer_String_Hexadecimal++;
-		Byte |= ATCommandGetHexadecimalNibbleBinaryValue(*Pointer_String_Hexadecimal) & 0x0F;
-		Pointer_String_Hexadecimal++;
+		LOG("Error : the phone did not answer the command that disables the echo.\n");
+		Pointer_Reception_Buffer->Is_Echo_Enabled = 1;
+		return -1;
+	}
+	Pointer_Reception_Buffer->Is_Answer_Start_Pending = 0;
+	Pointer_Reception_Buffer->Was_Echo_Enabled = Discarded_Bytes_Count > 2;
 
-		// Store the byte to the destination buffer
-		*Pointer_Output_Buffer = Byte;
-		Pointer_Output_Buffer++;
-		Converted_Data_Size++;
+	// Keep the previous setting if the phone refuses the command
+	Result = ATCommandReceiveAnswerLine(Serial_Port_ID, String_Answer, sizeof(String_Answer));
+	if ((Result == -4) || (Result == -5) || (Result == -6)) return -1;
+	if ((Result != 0) || (strcmp(String_Answer, "OK") != 0))
+	{
+		LOG_DEBUG(AT_COMMAND_IS_DEBUG_ENABLED, "The phone refused to disable the command echo (answer : \"%s\"), keeping the echo.\n", Result == -2 ? "ERROR" : String_Answer);
+		Pointer_Reception_Buffer->Is_Echo_Enabled = Pointer_Reception_Buffer->Was_Echo_Enabled;
+		return 0;
 	}
 
-	// Stop if there no more room in the output buffer
-	if (Converted_Data_Size >= Output_Buffer_Size) return -1;
+	LOG_DEBUG(AT_COMMAND_IS_DEBUG_ENABLED, "Command echo disabled (it was %s).\n", Pointer_Reception_Buffer->Was_Echo_Enabled ? "enabled" : "already disabled");
+	Pointer_Reception_Buffer->Is_Lean_Link_Profile_Enabled = 1;
+	return 0;
+}
+
+int ATCommandRestoreLinkProfile(TSerialPortID Serial_Port_ID)
+{
+	TATCommandReceptionBuffer *Pointer_Reception_Buffer;
+	char String_Answer[64];
+
+	Pointer_Reception_Buffer = ATCommandGetReceptionBuffer(Serial_Port_ID);
+	if (Pointer_Reception_Buffer == NULL) return -1;
+	if (!Pointer_Reception_Buffer->Is_Lean_Link_Profile_Enabled) return 0;
 
-	return (int) Converted_Data_Size;
+	// Nothing to do if the echo was already disabled before the program started
+	if (Pointer_Reception_Buffer->Was_Echo_Enabled)
+	{
+		// The phone does not echo this command, the echo is enabled only after the command has been executed (on failure, the profile is kept enabled so the restoring can be tried again)
+		if (ATCommandSendCommand(Serial_Port_ID, "ATE1") != 0) return -1;
+		if ((ATCommandReceiveAnswerLine(Serial_Port_ID, String_Answer, sizeof(String_Answer)) != 0) || (strcmp(String_Answer, "OK") != 0))
+		{
+			LOG("Error : failed to enable the command echo again.\n");
+			return -1;
+		}
+		Pointer_Reception_Buffer->Is_Echo_Enabled = 1;
+	}
+	Pointer_Reception_Buffer->Is_Lean_Link_Profile_Enabled = 0;
+
+	return 0;
 }
 
-void ATCommandConvertBinaryToHexadecimal(unsigned char *Pointer_Buffer, unsigned int Buffer_Size, char *Pointer_String_Hexadecimal)
+int ATCommandRecoverLink(TSerialPortID Serial_Port_ID)
 {
-	char String_Temporary[4];
+	TATCommandReceptionBuffer *Pointer_Reception_Buffer;
+	char String_Answer[1024];
+	int i, Result;
+
+	Pointer_Reception_Buffer = ATCommandGetReceptionBuffer(Serial_Port_ID);
+	if (Pointer_Reception_Buffer == NULL) return -1;
+
+	// The interrupted command will never be completed
+	Pointer_Reception_Buffer->Pointer_Pending_Command_Statistics = NULL;
+	Pointer_Reception_Buffer->Pending_Command_Deadline = 0;
+	Pointer_Reception_Buffer->Is_Answer_Start_Pending = 0;
+
+	for (i = 0; i < AT_COMMAND_RECOVERY_PROBES_COUNT; i++)
+	{
+		// Discard the interrupted command answer or the late answer of the previous probe
+		if (ATCommandDrainReceivedData(Pointer_Reception_Buffer) != 0) return -1;
+		Pointer_Reception_Buffer->Is_Answer_Pending = 0;
+
+		// Send the simplest command, a line is always discarded before its answer (the echo or the CRLF sequence starting the answer), so this works whatever the phone echo setting is
+		Result = ATCommandSendCommand(Serial_Port_ID, "AT");
+		if (Result == -1) return -1;
+		if (Result != 0) continue;
+
+		// Wait for "OK", any other line is a leftover of the interrupted command
+		while (1)
+		{
+			Result = ATCommandReceiveAnswerLine(Serial_Port_ID, String_Answer, sizeof(String_Answer));
+			if ((Result == 0) && (strcmp(String_Answer, "OK") == 0)) break;
+			if ((Result != 0) && (Result != -2) && (Result != -3)) break;
+		}
+		if (Result == -4) return -1;
+		if (Result == 0)
+		{
+			LOG_DEBUG(AT_COMMAND_IS_DEBUG_ENABLED, "The phone answered the probe command %d.\n", i + 1);
+			return 0;
+		}
+	}
 
-	// Make sure the string is empty
+	LOG("Error : the phone did not answer after %d attempts.\n", AT_COMMAND_RECOVERY_PROBES_COUNT);
+	return -1;
+}
+
+int ATCommandConvertHexadecimalCharactersToBinary(char *Pointer_Hexadecimal_Characters, unsigned int Characters_Count, unsigned char *Pointer_Output_Buffer, unsigned int Output_Buffer_Size, unsigned int *Pointer_Invalid_Character_Offset)
+{
+	unsigned int Converted_Characters_Count, Convertible_Characters_Count;
+
+	// Convert no more characters than the output buffer can store, an odd characters count would lead to an incomplete byte
+	Convertible_Characters_Count = Characters_Count & ~1U;
+	if (Convertible_Characters_Count / 2 > Output_Buffer_Size) Convertible_Characters_Count = Output_Buffer_Size * 2;
+
+	// Convert and validate all characters to their binary representation
+	Converted_Characters_Count = ATCommandDecodeHexadecimal((const unsigned char *) Pointer_Hexadecimal_Characters, Convertible_Characters_Count, Pointer_Output_Buffer);
+	if (Pointer_Invalid_Character_Offset != NULL) *Pointer_Invalid_Character_Offset = Converted_Characters_Count;
+	if (Converted_Characters_Count != Characters_Count) return -1;
+
+	return (int) (Converted_Characters_Count / 2);
+}
+
+int ATCommandConvertHexadecimalToBinary(char *Pointer_String_Hexadecimal, unsigned char *Pointer_Output_Buffer, unsigned int Output_Buffer_Size)
+{
+	return ATCommandConvertHexadecimalCharactersToBinary(Pointer_String_Hexadecimal, (unsigned int) strlen(Pointer_String_Hexadecimal), Pointer_Output_Buffer, Output_Buffer_Size, NULL);
+}
+
+int ATCommandConvertBinaryToHexadecimal(unsigned char *Pointer_Buffer, unsigned int Buffer_Size, char *Pointer_String_Hexadecimal, unsigned int String_Size)
+{
+	unsigned int i;
+
+	// Make sure there is enough room for all characters and the terminating zero
+	if ((String_Size == 0) || (Buffer_Size > (String_Size - 1) / 2)) return -1;
+
+	// Convert one byte at a time through the look-up table
+	for (i = 0; i < Buffer_Size; i++)
+	{
+		memcpy(Pointer_String_Hexadecimal, &AT_Command_Hexadecimal_Byte_Characters[Pointer_Buffer[i] * 2], 2);
+		Pointer_String_Hexadecimal += 2;
+	}
 	*Pointer_String_Hexadecimal = 0;
 
-	// Convert one byte at a time
-	while (Buffer_Size > 0)
+	return (int) (Buffer_Size * 2);
+}
+
+void ATCommandSetInterruptionRequest(int Is_Interruption_Requested)
+{
+	AT_Command_Is_Interruption_Requested = Is_Interruption_Requested;
+}
+
+void ATCommandDisplayStatistics(FILE *Pointer_File)
+{
+	TATCommandStatistics *Pointer_Statistics;
+	unsigned long long Total_Latency = 0;
+	int i, j;
+
+	// Sum all latencies to tell the share of each verb
+	for (i = 0; i < AT_Command_Statistics_Count; i++) Total_Latency += AT_Command_Statistics[i].Total_Latency;
+
+	fprintf(Pointer_File, "AT command statistics (latencies are measured from the command sending to its final result code) :\n");
+	fprintf(Pointer_File, "%-12s %10s %10s %14s %14s %14s %7s %12s %12s %12s\n", "Verb", "Count", "Completed", "Sent bytes", "Received bytes", "Total time ms", "Share", "Mean ms", "Minimum ms", "Maximum ms");
+	for (i = 0; i < AT_Command_Statistics_Count; i++)
 	{
-		sprintf(String_Temporary, "%02X", *Pointer_Buffer);
-		strcat(Pointer_String_Hexadecimal, String_Temporary);
-		Pointer_Buffer++;
-		Buffer_Size--;
+		Pointer_Statistics = &AT_Command_Statistics[i];
+		fprintf(Pointer_File, "%-12s %10llu %10llu %14llu %14llu %14.3f %6.1f%% ", Pointer_Statistics->String_Verb[0] == 0 ? "AT" : Pointer_Statistics->String_Verb, Pointer_Statistics->Commands_Count, Pointer_Statistics->Completed_Commands_Count,
+			Pointer_Statistics->Sent_Bytes_Count, Pointer_Statistics->Received_Bytes_Count, Pointer_Statistics->Total_Latency / 1e6, Total_Latency > 0 ? 100.0 * Pointer_Statistics->Total_Latency / Total_Latency : 0.0);
+		if (Pointer_Statistics->Completed_Commands_Count == 0)
+		{
+			fprintf(Pointer_File, "%12s %12s %12s\n", "-", "-", "-");
+			continue;
+		}
+		fprintf(Pointer_File, "%12.3f %12.3f %12.3f\n", Pointer_Statistics->Total_Latency / 1e6 / Pointer_Statistics->Completed_Commands_Count, Pointer_Statistics->Minimum_Latency / 1e6, Pointer_Statistics->Maximum_Latency / 1e6);
+
+		// Display the non-empty latency ranges
+		for (j = 0; j < AT_COMMAND_LATENCY_HISTOGRAM_BUCKETS_COUNT; j++)
+		{
+			if (Pointer_Statistics->Latency_Histogram[j] == 0) continue;
+			if (j == 0) fprintf(Pointer_File, "    [0 us, 2 us[ : %llu\n", Pointer_Statistics->Latency_Histogram[j]);
+			else if (j == AT_COMMAND_LATENCY_HISTOGRAM_BUCKETS_COUNT - 1) fprintf(Pointer_File, "    [%llu us, +inf[ : %llu\n", 1ULL << j, Pointer_Statistics->Latency_Histogram[j]);
+			else fprintf(Pointer_File, "    [%llu us, %llu us[ : %llu\n", 1ULL << j, 1ULL << (j + 1), Pointer_Statistics->Latency_Histogram[j]);
+		}
 	}
 }
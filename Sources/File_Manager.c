@@ -2,17 +2,24 @@
  * See File_Manager.h for description.
  * @author Adrien RICCIARDI
  */
+#define _GNU_SOURCE // For pthread_timedjoin_np()
 #include <assert.h>
 #include <AT_Command.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <File_Manager.h>
 #include <Log.h>
+#include <pthread.h>
+#include <Queue.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 #include <Utility.h>
 
@@ -22,9 +29,1030 @@
 /** Allow to turn on or off debug messages. */
 #define FILE_MANAGER_IS_DEBUG_ENABLED 0
 
+/** The initial buffer size of a memory sink, it is doubled each time more room is needed. */
+#define FILE_MANAGER_MEMORY_SINK_INITIAL_SIZE 4096
+
+/** A file descriptor sink gathers the downloaded chunks in a block of this size, so the file is written with a few large writes instead of one write per chunk. */
+#define FILE_MANAGER_FILE_DESCRIPTOR_SINK_BLOCK_SIZE 65536
+
+/** The file that lists the files downloaded to a directory by the mirror operations. */
+#define FILE_MANAGER_MANIFEST_FILE_NAME ".b100-tools-manifest"
+/** The manifest index hash table initial slots count, it must be a power of two. */
+#define FILE_MANAGER_MANIFEST_INDEX_INITIAL_SLOTS_COUNT 64
+
+/** The maximum length of the "AT+EFSW=2" command part that is not the chunk payload (the command header and the closing double quote) and the terminating zero. */
+#define FILE_MANAGER_CHUNK_COMMAND_HEADER_MAXIMUM_SIZE 64
+
+/** Do not trust a chunk size bigger than this value, this avoids allocating huge buffers if the phone sends a garbled answer. */
+#define FILE_MANAGER_MAXIMUM_CHUNK_SIZE (1024 * 1024)
+
+/** How many times the communication with the phone is recovered to retry a failed operation of a directory download. */
+#define FILE_MANAGER_MAXIMUM_RECOVERY_ATTEMPTS_COUNT 3
+
+/** The biggest file chunk that can be received in a single "+EFSR" answer line. */
+#define FILE_MANAGER_DOWNLOAD_MAXIMUM_CHUNK_SIZE 4096
+/** The size of a received "+EFSR" answer line, each byte is encoded by two hexadecimal characters and there is some room for the answer header. */
+#define FILE_MANAGER_DOWNLOAD_LINE_SIZE (FILE_MANAGER_DOWNLOAD_MAXIMUM_CHUNK_SIZE * 2 + 64)
+/** How many answer lines can go through the download pipeline at the same time. The link reader is held back when all of them are in use. */
+#define FILE_MANAGER_DOWNLOAD_PIPELINE_ITEMS_COUNT 16
+/** How often in milliseconds the download pipeline writer checks for a user interruption while it waits for data. */
+#define FILE_MANAGER_DOWNLOAD_INTERRUPTION_CHECK_PERIOD 100
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** A file or directory downloaded by a previous mirror operation. */
+typedef struct
+{
+	TFileManagerFileListItem File; //!< The file information as listed by the phone when it was downloaded.
+	long long Last_Seen_Time; //!< The Unix time of the last mirror operation that found the file on the phone.
+	int Is_Found; //!< Tell whether the current mirror operation found the file on the phone.
+} TFileManagerManifestEntry;
+
+/** A slot of the manifest index hash table. */
+typedef struct
+{
+	unsigned int Hash; //!< The full file name hash, it allows to skip most of the string comparisons.
+	TFileManagerManifestEntry *Pointer_Entry; //!< The indexed entry, NULL if the slot is free.
+} TFileManagerManifestIndexSlot;
+
+/** Find the manifest entries from their file name, so checking each listed file does not need to scan the whole manifest. */
+typedef struct
+{
+	TFileManagerManifestIndexSlot *Pointer_Slots; //!< The hash table, using linear probing.
+	unsigned int Slots_Count; //!< The hash table size, it is always a power of two.
+	unsigned int Entries_Count; //!< How many entries are indexed, the table is grown to keep it at most half full.
+} TFileManagerManifestIndex;
+
+/** An answer line going through the download pipeline. The same item is filled by the link reader, then by the decoder, then it is written to the sink and recycled. */
+typedef struct
+{
+	char String_Line[FILE_MANAGER_DOWNLOAD_LINE_SIZE]; //!< The answer line received from the phone.
+	int Result; //!< The ATCommandReceiveAnswerLine() result, or -1 if the line could not be decoded.
+	int Is_Last; //!< Tell whether this is the last line of the download (the final "OK" or an error).
+	unsigned char Data[FILE_MANAGER_DOWNLOAD_MAXIMUM_CHUNK_SIZE]; //!< The decoded file chunk.
+	int Data_Size; //!< The decoded file chunk size in bytes, it is zero if the line does not contain file data.
+} TFileManagerDownloadItem;
+
+/** The stages of a file download are linked by these queues. The stages are started by the first download of a session and wait for the next download until the session is closed. */
+struct TFileManagerDownloadPipeline
+{
+	TSerialPortID Serial_Port_ID; //!< The link the reader drains.
+	TFileManagerDownloadItem *Pointer_Items; //!< All items, they are allocated once and recycled through the pipeline.
+	TQueue Queue_Download_Requests; //!< Tell the link reader that a download command has been sent, so it can drain the answer.
+	TQueue Queue_Free_Items; //!< The items the link reader can fill.
+	TQueue Queue_Received_Lines; //!< The items waiting to be decoded.
+	TQueue Queue_Decoded_Chunks; //!< The items waiting to be written to the sink.
+	pthread_t Reader_Thread;
+	pthread_t Decoder_Thread;
+	int Is_Reader_Started; //!< Tell whether the reader thread must be joined.
+	int Is_Decoder_Started; //!< Tell whether the decoder thread must be joined.
+	int Queues_Count; //!< How many queues have been initialized, they are initialized in the order of the structure fields.
+};
+
+/** Tell how the download pipeline behaved, the waiting times show which stage is the bottleneck. */
+typedef struct
+{
+	unsigned long long Downloads_Count;
+	unsigned long long Chunks_Count;
+	unsigned long long Bytes_Count;
+	unsigned long long Reader_Stalls_Count; //!< How many times the link reader had to wait for the writer to release an item.
+	unsigned long long Reader_Stall_Time; //!< The total time in nanoseconds the link was not drained because the pipeline was full.
+	unsigned long long Writer_Waits_Count; //!< How many times the writer had to wait for a decoded chunk.
+	unsigned long long Writer_Wait_Time; //!< The total time in nanoseconds the writer waited for data.
+	unsigned int Maximum_Pending_Chunks_Count; //!< The highest amount of decoded chunks waiting to be written.
+} TFileManagerDownloadStatistics;
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** Set by the SIGINT handler when the user asks to stop the program while a session is opened. */
+static volatile sig_atomic_t File_Manager_Is_Interruption_Requested = 0;
+
+/** The SIGINT handler that was installed before the session was opened, it is restored when the session is closed. */
+static struct sigaction File_Manager_Previous_Signal_Action;
+
+/** Accumulate the statistics of all downloads. */
+static TFileManagerDownloadStatistics File_Manager_Download_Statistics;
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Record the user request to stop the program, so the current operation can be aborted and the file manager session properly closed.
+ * @param Signal_Number The received signal (only SIGINT is handled).
+ */
+static void FileManagerHandleInterruptionSignal(int Signal_Number)
+{
+	(void) Signal_Number;
+	File_Manager_Is_Interruption_Requested = 1;
+}
+
+/** Tell whether the user asked to stop the program, displaying an error message if this is the case.
+ * @return 0 if the current operation can go on,
+ * @return 1 if the current operation must be aborted.
+ */
+static int FileManagerIsInterrupted(void)
+{
+	if (!File_Manager_Is_Interruption_Requested) return 0;
+
+	LOG("Error : the operation has been interrupted by the user.\n");
+	return 1;
+}
+
+/** Tell whether a failed answer reception comes from the link rather than from the phone, so recovering the communication can make the operation succeed.
+ * @param AT_Command_Result The value returned by ATCommandReceiveAnswerLine().
+ * @return 0 if the answer was received or if the phone reported an error,
+ * @return 1 if the phone did not answer in time or if the serial port could not be read.
+ */
+static inline int FileManagerIsLinkError(int AT_Command_Result)
+{
+	return (AT_Command_Result == -4) || (AT_Command_Result == -5) || (AT_Command_Result == -6);
+}
+
+/** Write the data waiting in a file descriptor sink block to the file. Nothing is done for the other sink types.
+ * @param Pointer_Sink The sink.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int FileManagerFlushSink(TFileManagerSink *Pointer_Sink)
+{
+	if ((Pointer_Sink->Type != FILE_MANAGER_SINK_TYPE_FILE_DESCRIPTOR) || (Pointer_Sink->Data_Size == 0)) return 0;
+
+	if (write(Pointer_Sink->File_Descriptor, Pointer_Sink->Pointer_Buffer, Pointer_Sink->Data_Size) != (ssize_t) Pointer_Sink->Data_Size)
+	{
+		LOG("Error : could not write the file chunk payload to the output file (%s).\n", strerror(errno));
+		Pointer_Sink->Data_Size = 0;
+		return -1;
+	}
+	Pointer_Sink->Data_Size = 0;
+	return 0;
+}
+
+/** Give a received file chunk to a sink.
+ * @param Pointer_Sink The sink to write to.
+ * @param Pointer_Data The chunk data.
+ * @param Size The chunk size in bytes.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int FileManagerWriteToSink(TFileManagerSink *Pointer_Sink, unsigned char *Pointer_Data, unsigned int Size)
+{
+	unsigned char *Pointer_Buffer;
+	size_t Buffer_Size;
+
+	switch (Pointer_Sink->Type)
+	{
+		case FILE_MANAGER_SINK_TYPE_FILE_DESCRIPTOR:
+			// Allocate the block on first use
+			if (Pointer_Sink->Pointer_Buffer == NULL)
+			{
+				Pointer_Sink->Pointer_Buffer = malloc(FILE_MANAGER_FILE_DESCRIPTOR_SINK_BLOCK_SIZE);
+				if (Pointer_Sink->Pointer_Buffer == NULL)
+				{
+					LOG("Error : could not allocate the output file block.\n");
+					return -1;
+				}
+				Pointer_Sink->Buffer_Size = FILE_MANAGER_FILE_DESCRIPTOR_SINK_BLOCK_SIZE;
+			}
+
+			// Write the block when it is full
+			if ((Pointer_Sink->Data_Size + Size > Pointer_Sink->Buffer_Size) && (FileManagerFlushSink(Pointer_Sink) != 0)) return -1;
+
+			// Data bigger than the block is written as-is
+			if (Size >= Pointer_Sink->Buffer_Size)
+			{
+				if (write(Pointer_Sink->File_Descriptor, Pointer_Data, Size) != (ssize_t) Size)
+				{
+					LOG("Error : could not write the file chunk payload to the output file (%s).\n", strerror(errno));
+					return -1;
+				}
+				return 0;
+			}
+			memcpy(&Pointer_Sink->Pointer_Buffer[Pointer_Sink->Data_Size], Pointer_Data, Size);
+			Pointer_Sink->Data_Size += Size;
+			return 0;
+
+		case FILE_MANAGER_SINK_TYPE_MEMORY:
+			// Grow the buffer if needed, doubling its size keeps the amount of reallocations low even for big files
+			if (Pointer_Sink->Data_Size + Size > Pointer_Sink->Buffer_Size)
+			{
+				Buffer_Size = Pointer_Sink->Buffer_Size;
+				if (Buffer_Size == 0) Buffer_Size = FILE_MANAGER_MEMORY_SINK_INITIAL_SIZE;
+				while (Pointer_Sink->Data_Size + Size > Buffer_Size) Buffer_Size *= 2;
+
+				Pointer_Buffer = realloc(Pointer_Sink->Pointer_Buffer, Buffer_Size);
+				if (Pointer_Buffer == NULL)
+				{
+					LOG("Error : could not allocate %zu bytes to store the downloaded file.\n", Buffer_Size);
+					return -1;
+				}
+				Pointer_Sink->Pointer_Buffer = Pointer_Buffer;
+				Pointer_Sink->Buffer_Size = Buffer_Size;
+			}
+
+			memcpy(&Pointer_Sink->Pointer_Buffer[Pointer_Sink->Data_Size], Pointer_Data, Size);
+			Pointer_Sink->Data_Size += Size;
+			return 0;
+
+		case FILE_MANAGER_SINK_TYPE_CALLBACK:
+			if (Pointer_Sink->Callback(Pointer_Sink->Pointer_Callback_Context, Pointer_Data, Size) != 0)
+			{
+				LOG("Error : the download callback failed to process the file chunk.\n");
+				return -1;
+			}
+			return 0;
+
+		default:
+			LOG("Error : unknown sink type %d.\n", Pointer_Sink->Type);
+			return -1;
+	}
+}
+
+/** Load the manifest of a mirrored directory.
+ * @param Pointer_String_Directory_Path The local directory.
+ * @param Pointer_List On output, contain a TFileManagerManifestEntry item for each file and directory found by the previous mirror operations. The list is empty if the directory has never been mirrored.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int FileManagerLoadManifest(char *Pointer_String_Directory_Path, TList *Pointer_List)
+{
+	char String_Manifest_Path[512], String_Line[512];
+	FILE *Pointer_File;
+	TFileManagerManifestEntry *Pointer_Manifest_Entry;
+	unsigned int File_Size;
+	int Flags, Name_Index;
+	size_t Name_Length;
+	long long Last_Seen_Time;
+
+	// Try to open the manifest
+	snprintf(String_Manifest_Path, sizeof(String_Manifest_Path), "%s/" FILE_MANAGER_MANIFEST_FILE_NAME, Pointer_String_Directory_Path);
+	Pointer_File = fopen(String_Manifest_Path, "r");
+	if (Pointer_File == NULL)
+	{
+		if (errno == ENOENT) return 0; // The directory has never been mirrored
+		LOG("Error : could not open the manifest file \"%s\" (%s).\n", String_Manifest_Path, strerror(errno));
+		return -1;
+	}
+
+	// Each line is "<size> <flags> <last seen time> <name>", the name is stored last because it can contain spaces
+	while (fgets(String_Line, sizeof(String_Line), Pointer_File) != NULL)
+	{
+		String_Line[strcspn(String_Line, "\n")] = 0;
+		if ((sscanf(String_Line, "%u %d %lld%n", &File_Size, &Flags, &Last_Seen_Time, &Name_Index) != 3) || (String_Line[Name_Index] != ' ')) Name_Length = 0; // The scanf() 'n' modifier does not increase the count returned by the function
+		else
+		{
+			// Skip only the separating space, the name can start with spaces
+			Name_Index++;
+			Name_Length = strlen(&String_Line[Name_Index]);
+		}
+		if ((Name_Length == 0) || (Name_Length >= sizeof(Pointer_Manifest_Entry->File.String_File_Name)))
+		{
+			LOG("Warning : ignoring the invalid line \"%s\" of the manifest file \"%s\".\n", String_Line, String_Manifest_Path);
+			continue;
+		}
+
+		Pointer_Manifest_Entry = malloc(sizeof(TFileManagerManifestEntry));
+		if (Pointer_Manifest_Entry == NULL)
+		{
+			LOG("Error : could not allocate a manifest entry.\n");
+			fclose(Pointer_File);
+			return -1;
+		}
+		memcpy(Pointer_Manifest_Entry->File.String_File_Name, &String_Line[Name_Index], Name_Length + 1); // Copy the terminating zero too
+		Pointer_Manifest_Entry->File.File_Size = File_Size;
+		Pointer_Manifest_Entry->File.Flags = Flags;
+		Pointer_Manifest_Entry->Last_Seen_Time = Last_Seen_Time;
+		Pointer_Manifest_Entry->Is_Found = 0;
+		ListAddItem(Pointer_List, Pointer_Manifest_Entry);
+	}
+
+	fclose(Pointer_File);
+	return 0;
+}
+
+/** Write the manifest of a mirrored directory. The manifest is written to a temporary file that replaces the previous manifest, so an interrupted write can't lose it.
+ * @param Pointer_String_Directory_Path The local directory.
+ * @param Pointer_List The TFileManagerManifestEntry items to store.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int FileManagerSaveManifest(char *Pointer_String_Directory_Path, TList *Pointer_List)
+{
+	char String_Manifest_Path[512], String_Temporary_Path[520];
+	FILE *Pointer_File;
+	TListItem *Pointer_Item;
+	TFileManagerManifestEntry *Pointer_Manifest_Entry;
+	int Return_Value = -1;
+
+	snprintf(String_Manifest_Path, sizeof(String_Manifest_Path), "%s/" FILE_MANAGER_MANIFEST_FILE_NAME, Pointer_String_Directory_Path);
+	snprintf(String_Temporary_Path, sizeof(String_Temporary_Path), "%s.tmp", String_Manifest_Path);
+	Pointer_File = fopen(String_Temporary_Path, "w");
+	if (Pointer_File == NULL)
+	{
+		LOG("Error : could not create the manifest file \"%s\" (%s).\n", String_Temporary_Path, strerror(errno));
+		return -1;
+	}
+
+	// Write all entries
+	Pointer_Item = Pointer_List->Pointer_Head;
+	while (Pointer_Item != NULL)
+	{
+		Pointer_Manifest_Entry = Pointer_Item->Pointer_Data;
+		if (fprintf(Pointer_File, "%u %d %lld %s\n", Pointer_Manifest_Entry->File.File_Size, Pointer_Manifest_Entry->File.Flags, Pointer_Manifest_Entry->Last_Seen_Time, Pointer_Manifest_Entry->File.String_File_Name) < 0)
+		{
+			LOG("Error : could not write to the manifest file \"%s\" (%s).\n", String_Temporary_Path, strerror(errno));
+			goto Exit;
+		}
+		Pointer_Item = Pointer_Item->Pointer_Next_Item;
+	}
+
+	// Everything went fine
+	Return_Value = 0;
+
+Exit:
+	if (fclose(Pointer_File) != 0) Return_Value = -1;
+	if (Return_Value == 0)
+	{
+		if (rename(String_Temporary_Path, String_Manifest_Path) != 0)
+		{
+			LOG("Error : could not replace the manifest file \"%s\" (%s).\n", String_Manifest_Path, strerror(errno));
+			Return_Value = -1;
+		}
+	}
+	else unlink(String_Temporary_Path);
+	return Return_Value;
+}
+
+/** Compute the FNV-1a hash of a file name.
+ * @param Pointer_String_File_Name The file name.
+ * @return The file name hash.
+ */
+static unsigned int FileManagerHashFileName(char *Pointer_String_File_Name)
+{
+	unsigned int Hash = 2166136261U;
+
+	while (*Pointer_String_File_Name != 0)
+	{
+		Hash ^= (unsigned char) *Pointer_String_File_Name;
+		Hash *= 16777619U;
+		Pointer_String_File_Name++;
+	}
+	return Hash;
+}
+
+/** Find the hash table slot of a file name, using linear probing.
+ * @param Pointer_Index The manifest index, its hash table must be allocated.
+ * @param Pointer_String_File_Name The file name, without its path.
+ * @param Hash The file name hash.
+ * @return The slot referencing the file entry, or the free slot where the file entry must be stored if the file is not indexed.
+ */
+static TFileManagerManifestIndexSlot *FileManagerFindManifestIndexSlot(TFileManagerManifestIndex *Pointer_Index, char *Pointer_String_File_Name, unsigned int Hash)
+{
+	unsigned int Slot_Index;
+	TFileManagerManifestIndexSlot *Pointer_Slot;
+
+	Slot_Index = Hash & (Pointer_Index->Slots_Count - 1);
+	while (1)
+	{
+		Pointer_Slot = &Pointer_Index->Pointer_Slots[Slot_Index];
+		if (Pointer_Slot->Pointer_Entry == NULL) return Pointer_Slot;
+		if ((Pointer_Slot->Hash == Hash) && (strcmp(Pointer_Slot->Pointer_Entry->File.String_File_Name, Pointer_String_File_Name) == 0)) return Pointer_Slot;
+		Slot_Index = (Slot_Index + 1) & (Pointer_Index->Slots_Count - 1);
+	}
+}
+
+/** Add a manifest entry to the index, growing the hash table if needed. An entry whose file name is already indexed is ignored, so the first one is always found.
+ * @param Pointer_Index The manifest index.
+ * @param Pointer_Manifest_Entry The entry to index, it must stay allocated as long as the index is used.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int FileManagerAddManifestIndexEntry(TFileManagerManifestIndex *Pointer_Index, TFileManagerManifestEntry *Pointer_Manifest_Entry)
+{
+	TFileManagerManifestIndexSlot *Pointer_Slots, *Pointer_Slot;
+	unsigned int Slots_Count, Hash, i;
+
+	// Keep the hash table at most half full, so the probing sequences stay short
+	if ((Pointer_Index->Entries_Count + 1) * 2 > Pointer_Index->Slots_Count)
+	{
+		if (Pointer_Index->Slots_Count == 0) Slots_Count = FILE_MANAGER_MANIFEST_INDEX_INITIAL_SLOTS_COUNT;
+		else Slots_Count = Pointer_Index->Slots_Count * 2;
+		Pointer_Slots = calloc(Slots_Count, sizeof(TFileManagerManifestIndexSlot));
+		if (Pointer_Slots == NULL)
+		{
+			LOG("Error : could not allocate the manifest index hash table.\n");
+			return -1;
+		}
+
+		// Move the indexed entries to the new table
+		for (i = 0; i < Pointer_Index->Slots_Count; i++)
+		{
+			if (Pointer_Index->Pointer_Slots[i].Pointer_Entry == NULL) continue;
+			Pointer_Slot = &Pointer_Slots[Pointer_Index->Pointer_Slots[i].Hash & (Slots_Count - 1)];
+			while (Pointer_Slot->Pointer_Entry != NULL)
+			{
+				Pointer_Slot++;
+				if (Pointer_Slot == &Pointer_Slots[Slots_Count]) Pointer_Slot = Pointer_Slots;
+			}
+			*Pointer_Slot = Pointer_Index->Pointer_Slots[i];
+		}
+		free(Pointer_Index->Pointer_Slots);
+		Pointer_Index->Pointer_Slots = Pointer_Slots;
+		Pointer_Index->Slots_Count = Slots_Count;
+	}
+
+	Hash = FileManagerHashFileName(Pointer_Manifest_Entry->File.String_File_Name);
+	Pointer_Slot = FileManagerFindManifestIndexSlot(Pointer_Index, Pointer_Manifest_Entry->File.String_File_Name, Hash);
+	if (Pointer_Slot->Pointer_Entry != NULL)
+	{
+		LOG("Warning : the file \"%s\" is listed several times in the manifest, only its first entry is used.\n", Pointer_Manifest_Entry->File.String_File_Name);
+		return 0;
+	}
+	Pointer_Slot->Hash = Hash;
+	Pointer_Slot->Pointer_Entry = Pointer_Manifest_Entry;
+	Pointer_Index->Entries_Count++;
+
+	return 0;
+}
+
+/** Index all entries of a manifest.
+ * @param Pointer_Index On output, contain the index of the manifest entries.
+ * @param Pointer_List The manifest entries, they must stay allocated as long as the index is used.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int FileManagerCreateManifestIndex(TFileManagerManifestIndex *Pointer_Index, TList *Pointer_List)
+{
+	TListItem *Pointer_Item;
+
+	Pointer_Item = Pointer_List->Pointer_Head;
+	while (Pointer_Item != NULL)
+	{
+		if (FileManagerAddManifestIndexEntry(Pointer_Index, Pointer_Item->Pointer_Data) != 0) return -1;
+		Pointer_Item = Pointer_Item->Pointer_Next_Item;
+	}
+
+	return 0;
+}
+
+/** Free the manifest index hash table, the indexed entries are not freed. The index is empty after that.
+ * @param Pointer_Index The manifest index.
+ */
+static void FileManagerReleaseManifestIndex(TFileManagerManifestIndex *Pointer_Index)
+{
+	free(Pointer_Index->Pointer_Slots);
+	Pointer_Index->Pointer_Slots = NULL;
+	Pointer_Index->Slots_Count = 0;
+	Pointer_Index->Entries_Count = 0;
+}
+
+/** Search a file in a manifest.
+ * @param Pointer_Index The manifest index.
+ * @param Pointer_String_File_Name The file name, without its path.
+ * @return NULL if the file is not in the manifest,
+ * @return The file manifest entry if it was found.
+ */
+static TFileManagerManifestEntry *FileManagerFindManifestEntry(TFileManagerManifestIndex *Pointer_Index, char *Pointer_String_File_Name)
+{
+	if (Pointer_Index->Entries_Count == 0) return NULL; // The hash table is not allocated yet
+	return FileManagerFindManifestIndexSlot(Pointer_Index, Pointer_String_File_Name, FileManagerHashFileName(Pointer_String_File_Name))->Pointer_Entry;
+}
+
+/** Tell whether a file has already been downloaded by a previous mirror operation and did not change since.
+ * @param Pointer_Manifest_Entry The file manifest entry, it can be NULL if the file is not in the manifest.
+ * @param Pointer_File_List_Item The file as listed by the phone.
+ * @param Pointer_String_Local_File_Path The local copy of the file.
+ * @return 0 if the file must be downloaded,
+ * @return 1 if the local copy is up to date.
+ */
+static int FileManagerIsMirroredFileUnchanged(TFileManagerManifestEntry *Pointer_Manifest_Entry, TFileManagerFileListItem *Pointer_File_List_Item, char *Pointer_String_Local_File_Path)
+{
+	struct stat Status;
+
+	if (Pointer_Manifest_Entry == NULL) return 0;
+
+	// The phone does not provide the modification time, so rely on the size and the attributes
+	if ((Pointer_Manifest_Entry->File.File_Size != Pointer_File_List_Item->File_Size) || (Pointer_Manifest_Entry->File.Flags != Pointer_File_List_Item->Flags)) return 0;
+
+	// Make sure the local copy has not been removed or modified
+	if (stat(Pointer_String_Local_File_Path, &Status) != 0) return 0;
+	if (!S_ISREG(Status.st_mode) || (Status.st_size != (off_t) Pointer_File_List_Item->File_Size)) return 0;
+
+	return 1;
+}
+
+/** Parse a decimal number of a "+EFSR" answer line header, followed by the fields separator.
+ * @param Pointer_Pointer_String On input, point to the number first digit. On output, point to the next field first character, or to the line end.
+ * @param Pointer_Value On output, contain the number value.
+ * @param Is_Last_Field Set to 1 if the line can end right after the number, set to 0 if the separator is mandatory.
+ * @return -1 if the field is invalid,
+ * @return 0 on success.
+ */
+static inline int FileManagerParseChunkHeaderField(char **Pointer_Pointer_String, unsigned int *Pointer_Value, int Is_Last_Field)
+{
+	char *Pointer_String = *Pointer_Pointer_String;
+	unsigned int Value = 0;
+
+	// There must be at least one digit, and the number must fit in an integer
+	if ((*Pointer_String < '0') || (*Pointer_String > '9')) return -1;
+	do
+	{
+		if (Value > (UINT_MAX - 9) / 10) return -1;
+		Value = Value * 10 + (unsigned int) (*Pointer_String - '0');
+		Pointer_String++;
+	} while ((*Pointer_String >= '0') && (*Pointer_String <= '9'));
+
+	// The phone puts a space after each comma
+	if (*Pointer_String == ',')
+	{
+		Pointer_String++;
+		while (*Pointer_String == ' ') Pointer_String++;
+	}
+	else if (!Is_Last_Field || (*Pointer_String != 0)) return -1;
+
+	*Pointer_Pointer_String = Pointer_String;
+	*Pointer_Value = Value;
+	return 0;
+}
+
+/** Decode a "+EFSR" file chunk answer line in a single pass : the header fields are validated, then the quoted payload is converted from hexadecimal straight to the output buffer.
+ * @param Pointer_String_Line The answer line, it looks like "+EFSR: 1, 0, 200, "0102..."".
+ * @param Pointer_Data On output, contain the chunk data. The buffer must be FILE_MANAGER_DOWNLOAD_MAXIMUM_CHUNK_SIZE bytes large.
+ * @return -1 if an error occurred,
+ * @return The chunk size in bytes on success.
+ */
+static int FileManagerDecodeChunkLine(char *Pointer_String_Line, unsigned char *Pointer_Data)
+{
+	char *Pointer_String = &Pointer_String_Line[7]; // Bypass the "+EFSR: " prefix, which has already been checked by the caller
+	unsigned int Fields[3], Size, Invalid_Character_Offset;
+	int i;
+
+	// Extract chunk information, the meaningful field is the last one that tells the chunk size
+	for (i = 0; i < (int) UTILITY_ARRAY_SIZE(Fields); i++)
+	{
+		if (FileManagerParseChunkHeaderField(&Pointer_String, &Fields[i], i == (int) UTILITY_ARRAY_SIZE(Fields) - 1) != 0)
+		{
+			LOG("Error : could not extract file chunk information.\n");
+			return -1;
+		}
+	}
+	Size = Fields[2];
+	LOG_DEBUG(FILE_MANAGER_IS_DEBUG_ENABLED, "Chunk payload size : %u.\n", Size * 2);
+
+	// An empty chunk may have no payload at all (like "+EFSR: 0, 1, 0"), there is nothing to decode
+	if ((Size == 0) && (*Pointer_String == 0)) return 0;
+
+	// Make sure the chunk size won't exceed the destination buffer, and that the announced payload fits in the line buffer (the decoder may read all announced characters before noticing the end of the line)
+	if ((Size > FILE_MANAGER_DOWNLOAD_MAXIMUM_CHUNK_SIZE) || ((size_t) (Pointer_String - Pointer_String_Line) + Size * 2 + 2 > FILE_MANAGER_DOWNLOAD_LINE_SIZE))
+	{
+		LOG("Error : the chunk payload size is too big.\n");
+		return -1;
+	}
+
+	// Convert the payload to binary, the conversion stops on the first non-hexadecimal character, so the closing double quote is found without scanning the payload twice
+	if (*Pointer_String != '"')
+	{
+		LOG("Error : failed to extract the payload from the file chunk.\n");
+		return -1;
+	}
+	Pointer_String++;
+	ATCommandConvertHexadecimalCharactersToBinary(Pointer_String, Size * 2, Pointer_Data, FILE_MANAGER_DOWNLOAD_MAXIMUM_CHUNK_SIZE, &Invalid_Character_Offset);
+	if (Invalid_Character_Offset != Size * 2)
+	{
+		LOG("Error : could not convert file chunk payload from hexadecimal to binary.\n");
+		return -1;
+	}
+	if ((Pointer_String[Invalid_Character_Offset] != '"') || (Pointer_String[Invalid_Character_Offset + 1] != 0))
+	{
+		LOG("Error : unexpected data found after the %u bytes of the file chunk payload.\n", Size);
+		return -1;
+	}
+	return (int) Size;
+}
+
+/** The download pipeline first stage : only drain the link into answer lines, so the phone is never held back by the decoding or the sink.
+ * @param Pointer_Parameters The download pipeline.
+ * @return Always NULL.
+ */
+static void *FileManagerDownloadReaderThread(void *Pointer_Parameters)
+{
+	TFileManagerDownloadPipeline *Pointer_Pipeline = Pointer_Parameters;
+	TFileManagerDownloadItem *Pointer_Item;
+	int Is_Last;
+
+	// Wait for a download command to be sent, the requests queue is closed when the pipeline is destroyed
+	while (QueuePop(&Pointer_Pipeline->Queue_Download_Requests) != NULL)
+	{
+		do
+		{
+			// Wait for a free item, a wait here means that the next stages can't keep up with the link
+			Pointer_Item = QueuePop(&Pointer_Pipeline->Queue_Free_Items);
+			if (Pointer_Item == NULL) goto Exit; // The pipeline is being destroyed
+			if (File_Manager_Is_Interruption_Requested) goto Exit; // Do not wait for the phone anymore, the pipeline will be destroyed
+
+			// Receive the next answer line, the download ends with the final "OK" or on the first error
+			Pointer_Item->Result = ATCommandReceiveAnswerLine(Pointer_Pipeline->Serial_Port_ID, Pointer_Item->String_Line, sizeof(Pointer_Item->String_Line));
+			Pointer_Item->Is_Last = (Pointer_Item->Result < 0) || (strcmp(Pointer_Item->String_Line, "OK") == 0);
+			Is_Last = Pointer_Item->Is_Last; // The item belongs to the next stage as soon as it is pushed
+			if (QueuePush(&Pointer_Pipeline->Queue_Received_Lines, Pointer_Item) != 0) goto Exit;
+		} while (!Is_Last);
+	}
+
+Exit:
+	QueueClose(&Pointer_Pipeline->Queue_Received_Lines);
+	return NULL;
+}
+
+/** The download pipeline second stage : convert the received file chunks to binary.
+ * @param Pointer_Parameters The download pipeline.
+ * @return Always NULL.
+ */
+static void *FileManagerDownloadDecoderThread(void *Pointer_Parameters)
+{
+	TFileManagerDownloadPipeline *Pointer_Pipeline = Pointer_Parameters;
+	TFileManagerDownloadItem *Pointer_Item;
+
+	// The decoder does not need to know where a download ends, it stops when the pipeline is destroyed
+	while (1)
+	{
+		Pointer_Item = QueuePop(&Pointer_Pipeline->Queue_Received_Lines);
+		if (Pointer_Item == NULL) break;
+
+		// Only the chunk lines contain data, the other lines are forwarded as-is, so the writer knows when the download is finished
+		Pointer_Item->Data_Size = 0;
+		if (!Pointer_Item->Is_Last && (strncmp(Pointer_Item->String_Line, "+EFSR: ", 7) == 0))
+		{
+			Pointer_Item->Data_Size = FileManagerDecodeChunkLine(Pointer_Item->String_Line, Pointer_Item->Data);
+			if (Pointer_Item->Data_Size < 0)
+			{
+				Pointer_Item->Data_Size = 0;
+				Pointer_Item->Result = -1;
+				Pointer_Item->Is_Last = 1;
+			}
+		}
+		if (QueuePush(&Pointer_Pipeline->Queue_Decoded_Chunks, Pointer_Item) != 0) break;
+	}
+
+	QueueClose(&Pointer_Pipeline->Queue_Decoded_Chunks);
+	return NULL;
+}
+
+/** Stop the download pipeline stages and free all the pipeline resources.
+ * @param Pointer_Pipeline The pipeline to destroy, its threads may be in the middle of a download.
+ */
+static void FileManagerDestroyDownloadPipeline(TFileManagerDownloadPipeline *Pointer_Pipeline)
+{
+	struct timespec Deadline;
+
+	// Wake up all stages, they stop as soon as they notice that their queues are closed
+	if (Pointer_Pipeline->Queues_Count > 3) QueueClose(&Pointer_Pipeline->Queue_Decoded_Chunks);
+	if (Pointer_Pipeline->Queues_Count > 2) QueueClose(&Pointer_Pipeline->Queue_Received_Lines);
+	if (Pointer_Pipeline->Queues_Count > 1) QueueClose(&Pointer_Pipeline->Queue_Free_Items);
+	if (Pointer_Pipeline->Queues_Count > 0) QueueClose(&Pointer_Pipeline->Queue_Download_Requests);
+	if (Pointer_Pipeline->Is_Reader_Started)
+	{
+		// When the user interrupted the download, the reader may be waiting for a stalled phone until the line timeout expires, so abort its wait (the signal is sent again in case it was received right before the reader started waiting)
+		if (File_Manager_Is_Interruption_Requested)
+		{
+			do
+			{
+				pthread_kill(Pointer_Pipeline->Reader_Thread, SIGINT);
+				clock_gettime(CLOCK_REALTIME, &Deadline);
+				Deadline.tv_nsec += 10000000L;
+				if (Deadline.tv_nsec >= 1000000000L)
+				{
+					Deadline.tv_sec++;
+					Deadline.tv_nsec -= 1000000000L;
+				}
+			} while (pthread_timedjoin_np(Pointer_Pipeline->Reader_Thread, NULL, &Deadline) == ETIMEDOUT);
+		}
+		else pthread_join(Pointer_Pipeline->Reader_Thread, NULL);
+	}
+	if (Pointer_Pipeline->Is_Decoder_Started) pthread_join(Pointer_Pipeline->Decoder_Thread, NULL);
+
+	// Accumulate the pipeline statistics, all threads are stopped so the queues can be read safely
+	if (Pointer_Pipeline->Queues_Count > 3)
+	{
+		File_Manager_Download_Statistics.Reader_Stalls_Count += Pointer_Pipeline->Queue_Free_Items.Pop_Waits_Count;
+		File_Manager_Download_Statistics.Reader_Stall_Time += Pointer_Pipeline->Queue_Free_Items.Pop_Wait_Time;
+		File_Manager_Download_Statistics.Writer_Waits_Count += Pointer_Pipeline->Queue_Decoded_Chunks.Pop_Waits_Count;
+		File_Manager_Download_Statistics.Writer_Wait_Time += Pointer_Pipeline->Queue_Decoded_Chunks.Pop_Wait_Time;
+		if (Pointer_Pipeline->Queue_Decoded_Chunks.Maximum_Items_Count > File_Manager_Download_Statistics.Maximum_Pending_Chunks_Count) File_Manager_Download_Statistics.Maximum_Pending_Chunks_Count = Pointer_Pipeline->Queue_Decoded_Chunks.Maximum_Items_Count;
+	}
+
+	if (Pointer_Pipeline->Queues_Count > 3) QueueRelease(&Pointer_Pipeline->Queue_Decoded_Chunks);
+	if (Pointer_Pipeline->Queues_Count > 2) QueueRelease(&Pointer_Pipeline->Queue_Received_Lines);
+	if (Pointer_Pipeline->Queues_Count > 1) QueueRelease(&Pointer_Pipeline->Queue_Free_Items);
+	if (Pointer_Pipeline->Queues_Count > 0) QueueRelease(&Pointer_Pipeline->Queue_Download_Requests);
+	free(Pointer_Pipeline->Pointer_Items);
+	free(Pointer_Pipeline);
+}
+
+/** Allocate the download pipeline items and start its stages.
+ * @param Serial_Port_ID The phone serial port.
+ * @return NULL if an error occurred,
+ * @return The pipeline on success, its stages are waiting for a download.
+ */
+static TFileManagerDownloadPipeline *FileManagerCreateDownloadPipeline(TSerialPortID Serial_Port_ID)
+{
+	TFileManagerDownloadPipeline *Pointer_Pipeline;
+	int i;
+	sigset_t Signals_Mask, Previous_Signals_Mask;
+
+	Pointer_Pipeline = calloc(1, sizeof(TFileManagerDownloadPipeline));
+	if (Pointer_Pipeline == NULL)
+	{
+		LOG("Error : could not allocate the download pipeline.\n");
+		return NULL;
+	}
+	Pointer_Pipeline->Serial_Port_ID = Serial_Port_ID;
+
+	// Allocate all items once, they are recycled through the pipeline
+	Pointer_Pipeline->Pointer_Items = malloc(FILE_MANAGER_DOWNLOAD_PIPELINE_ITEMS_COUNT * sizeof(TFileManagerDownloadItem));
+	if (Pointer_Pipeline->Pointer_Items == NULL)
+	{
+		LOG("Error : could not allocate the download pipeline items.\n");
+		goto Exit_Error;
+	}
+	if (QueueInitialize(&Pointer_Pipeline->Queue_Download_Requests, 1) != 0) goto Exit_Error; // Only one download can be running at a time
+	Pointer_Pipeline->Queues_Count++;
+	if (QueueInitialize(&Pointer_Pipeline->Queue_Free_Items, FILE_MANAGER_DOWNLOAD_PIPELINE_ITEMS_COUNT) != 0) goto Exit_Error;
+	Pointer_Pipeline->Queues_Count++;
+	if (QueueInitialize(&Pointer_Pipeline->Queue_Received_Lines, FILE_MANAGER_DOWNLOAD_PIPELINE_ITEMS_COUNT) != 0) goto Exit_Error;
+	Pointer_Pipeline->Queues_Count++;
+	if (QueueInitialize(&Pointer_Pipeline->Queue_Decoded_Chunks, FILE_MANAGER_DOWNLOAD_PIPELINE_ITEMS_COUNT) != 0) goto Exit_Error;
+	Pointer_Pipeline->Queues_Count++;
+	for (i = 0; i < FILE_MANAGER_DOWNLOAD_PIPELINE_ITEMS_COUNT; i++) QueuePush(&Pointer_Pipeline->Queue_Free_Items, &Pointer_Pipeline->Pointer_Items[i]); // The queue is big enough for all items, so this can't fail
+
+	// Start the reader stage, it receives SIGINT like the calling thread, so the user interruption also aborts a wait for the phone
+	Pointer_Pipeline->Is_Reader_Started = pthread_create(&Pointer_Pipeline->Reader_Thread, NULL, FileManagerDownloadReaderThread, Pointer_Pipeline) == 0;
+	if (!Pointer_Pipeline->Is_Reader_Started)
+	{
+		LOG("Error : could not start the download pipeline reader thread.\n");
+		goto Exit_Error;
+	}
+
+	// Start the decoder stage, it has nothing to abort, so keep SIGINT for the other threads
+	sigemptyset(&Signals_Mask);
+	sigaddset(&Signals_Mask, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &Signals_Mask, &Previous_Signals_Mask);
+	Pointer_Pipeline->Is_Decoder_Started = pthread_create(&Pointer_Pipeline->Decoder_Thread, NULL, FileManagerDownloadDecoderThread, Pointer_Pipeline) == 0;
+	pthread_sigmask(SIG_SETMASK, &Previous_Signals_Mask, NULL);
+	if (!Pointer_Pipeline->Is_Decoder_Started)
+	{
+		LOG("Error : could not start the download pipeline decoder thread.\n");
+		goto Exit_Error;
+	}
+
+	return Pointer_Pipeline;
+
+Exit_Error:
+	FileManagerDestroyDownloadPipeline(Pointer_Pipeline);
+	return NULL;
+}
+
+/** Create the AT command that writes a chunk of data to the file opened on the phone.
+ * @param Pointer_Data The chunk data.
+ * @param Size The chunk size in bytes.
+ * @param Is_Last_Chunk Set to 1 if this is the last chunk of the file, set to 0 otherwise.
+ * @param Pointer_String_Command On output, contain the command. The buffer must be able to store twice the chunk size plus FILE_MANAGER_CHUNK_COMMAND_HEADER_MAXIMUM_SIZE characters.
+ * @param Command_Size The size in bytes of the command buffer.
+ */
+static void FileManagerCreateChunkCommand(unsigned char *Pointer_Data, unsigned int Size, int Is_Last_Chunk, char *Pointer_String_Command, size_t Command_Size)
+{
+	int Length;
+
+	Length = snprintf(Pointer_String_Command, Command_Size, "AT+EFSW=2,%d,%u,\"", Is_Last_Chunk, Size);
+	Length += ATCommandConvertBinaryToHexadecimal(Pointer_Data, Size, &Pointer_String_Command[Length], Command_Size - Length - 1); // The file payload is expected to be sent in hexadecimal, encode it right after the command header and keep room for the closing double quote (the command buffer is sized for the biggest chunk, so the conversion can't fail)
+	strcpy(&Pointer_String_Command[Length], "\"");
+}
+
+/** Receive all chunks of a file whose download has been requested. The link is drained by a dedicated thread and the chunks are decoded by another one, while the calling thread writes the data to the sink.
+ * @param Pointer_Session The session the download pipeline belongs to, the pipeline must be running.
+ * @param Pointer_String_Absolute_Phone_Path The downloaded file, it is used for error messages only.
+ * @param Pointer_Sink Where to write the file content.
+ * @return -2 if the phone did not answer in time or if the serial port could not be read,
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int FileManagerRunDownloadPipeline(TFileManagerSession *Pointer_Session, char *Pointer_String_Absolute_Phone_Path, TFileManagerSink *Pointer_Sink)
+{
+	TFileManagerDownloadPipeline *Pointer_Pipeline = Pointer_Session->Pointer_Download_Pipeline;
+	TFileManagerDownloadItem *Pointer_Item;
+	int Return_Value = -1, Result;
+	unsigned int Read_Bytes_Count = 0;
+
+	// Tell the reader that the answer can be drained
+	QueuePush(&Pointer_Pipeline->Queue_Download_Requests, Pointer_Pipeline); // Any pointer can be used as request, the queue is empty between two downloads so this can't fail
+
+	// Write the decoded chunks
+	while (1)
+	{
+		// Do not wait for the next line to notice a user interruption, the phone may be stalled
+		Result = QueueTimedPop(&Pointer_Pipeline->Queue_Decoded_Chunks, FILE_MANAGER_DOWNLOAD_INTERRUPTION_CHECK_PERIOD, (void **) &Pointer_Item);
+		if (FileManagerIsInterrupted()) goto Exit;
+		if (Result == -2) continue;
+		if (Result != 0)
+		{
+			LOG("Error : the download pipeline stopped unexpectedly.\n");
+			goto Exit;
+		}
+
+		// Stop on the first error
+		if (Pointer_Item->Result < 0)
+		{
+			if (Pointer_Item->Result == -2) LOG("Error : the specified path \"%s\" does not exist.\n", Pointer_String_Absolute_Phone_Path);
+			else if (FileManagerIsLinkError(Pointer_Item->Result)) Return_Value = -2;
+			goto Exit;
+		}
+		if (Pointer_Item->Is_Last)
+		{
+			QueuePush(&Pointer_Pipeline->Queue_Free_Items, Pointer_Item);
+			break;
+		}
+
+		// Append the data to the sink
+		if (Pointer_Item->Data_Size > 0)
+		{
+			if (FileManagerWriteToSink(Pointer_Sink, Pointer_Item->Data, Pointer_Item->Data_Size) != 0) goto Exit;
+			Read_Bytes_Count += Pointer_Item->Data_Size;
+			File_Manager_Download_Statistics.Chunks_Count++;
+
+			// Display progress for user
+			printf("Progress : %u bytes.\r", Read_Bytes_Count);
+		}
+
+		// Give the item back to the reader
+		QueuePush(&Pointer_Pipeline->Queue_Free_Items, Pointer_Item);
+	}
+
+	// Write the last block
+	if (FileManagerFlushSink(Pointer_Sink) != 0) goto Exit;
+
+	// Everything went fine
+	Return_Value = 0;
+
+Exit:
+	File_Manager_Download_Statistics.Downloads_Count++;
+	File_Manager_Download_Statistics.Bytes_Count += Read_Bytes_Count;
+
+	// The stages may still be receiving the failed download answer, destroy the pipeline so the next download starts from a clean state
+	if (Return_Value != 0)
+	{
+		FileManagerDestroyDownloadPipeline(Pointer_Pipeline);
+		Pointer_Session->Pointer_Download_Pipeline = NULL;
+	}
+	return Return_Value;
+}
+
+/** Allow access to the phone file manager.
+ * @param Serial_Port_ID The serial port the phone is connected to.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int FileManagerEnableAccess(TSerialPortID Serial_Port_ID)
+{
+	char String_Answer[64];
+
+	if (ATCommandSendCommand(Serial_Port_ID, "AT+ESUO=3") != 0) return -1;
+	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Answer, sizeof(String_Answer)) < 0) return -1; // Wait for "OK"
+	if (strcmp(String_Answer, "OK") != 0)
+	{
+		LOG("Error : failed to send the AT command that enables the file manager.\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Disable the phone file manager access, this seems mandatory to avoid hanging the whole AT communication (phone needs to be rebooted if this command is not issued, otherwise the AT communication is stuck).
+ * @param Serial_Port_ID The serial port the phone is connected to.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int FileManagerDisableAccess(TSerialPortID Serial_Port_ID)
+{
+	char String_Answer[1024];
+	int Result;
+
+	if (ATCommandSendCommand(Serial_Port_ID, "AT+ESUO=4") != 0) return -1;
+
+	// Wait for "OK", discarding the remaining answer lines of an interrupted operation if any
+	while (1)
+	{
+		Result = ATCommandReceiveAnswerLine(Serial_Port_ID, String_Answer, sizeof(String_Answer));
+		if ((Result == 0) && (strcmp(String_Answer, "OK") == 0)) return 0;
+		if ((Result != 0) && (Result != -3)) return -1; // Lines that are too long can only be the interrupted operation data
+	}
+}
+
+/** Bring the communication with the phone back after a failed operation, then enable the file manager again, so the session can go on.
+ * @param Pointer_Session The session to recover.
+ * @return -1 if the phone did not answer,
+ * @return 0 on success.
+ */
+static int FileManagerRecoverSession(TFileManagerSession *Pointer_Session)
+{
+	printf("Recovering the communication with the phone...\n");
+
+	// Leaving the file manager also resets any file operation the phone was doing
+	if ((ATCommandRecoverLink(Pointer_Session->Serial_Port_ID) != 0) || (FileManagerDisableAccess(Pointer_Session->Serial_Port_ID) != 0) || (FileManagerEnableAccess(Pointer_Session->Serial_Port_ID) != 0))
+	{
+		LOG("Error : could not recover the communication with the phone.\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Download a file of a directory being downloaded.
+ * @param Pointer_Session An opened file manager session.
+ * @param Pointer_String_Absolute_Phone_Path The file to download.
+ * @param Pointer_String_Destination_PC_Path The output file.
+ * @param Is_Mirror_Enabled Set to 1 to keep the previous output file if the download fails, set to 0 to directly overwrite the output file.
+ * @return -2 if the communication with the phone failed,
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int FileManagerDownloadDirectoryFile(TFileManagerSession *Pointer_Session, char *Pointer_String_Absolute_Phone_Path, char *Pointer_String_Destination_PC_Path, int Is_Mirror_Enabled)
+{
+	char String_Temporary_File_Name[520];
+	int Result;
+
+	if (!Is_Mirror_Enabled) return FileManagerDownloadFile(Pointer_Session, Pointer_String_Absolute_Phone_Path, Pointer_String_Destination_PC_Path);
+
+	// Download the file to a temporary file, so the previous copy is kept if the download fails
+	snprintf(String_Temporary_File_Name, sizeof(String_Temporary_File_Name), "%s.part", Pointer_String_Destination_PC_Path);
+	Result = FileManagerDownloadFile(Pointer_Session, Pointer_String_Absolute_Phone_Path, String_Temporary_File_Name);
+	if (Result == 0)
+	{
+		Result = rename(String_Temporary_File_Name, Pointer_String_Destination_PC_Path);
+		if (Result != 0) LOG("Error : could not rename the file \"%s\" to \"%s\" (%s).\n", String_Temporary_File_Name, Pointer_String_Destination_PC_Path, strerror(errno));
+	}
+	if (Result != 0) unlink(String_Temporary_File_Name);
+
+	return Result;
+}
+
 //-------------------------------------------------------------------------------------------------
 // Public functions
 //-------------------------------------------------------------------------------------------------
+int FileManagerOpenSession(TSerialPortID Serial_Port_ID, TFileManagerSession *Pointer_Session)
+{
+	struct sigaction Signal_Action;
+
+	Pointer_Session->Serial_Port_ID = Serial_Port_ID;
+	Pointer_Session->Is_Opened = 0;
+	Pointer_Session->Pointer_Download_Pipeline = NULL;
+
+	// Allow access to file manager
+	if (FileManagerEnableAccess(Serial_Port_ID) != 0) return -1;
+	Pointer_Session->Is_Opened = 1;
+
+	// Catch the user interruption request, so the file manager can always be disabled before exiting (SA_RESTART is not set, so a blocking serial port read is interrupted too)
+	File_Manager_Is_Interruption_Requested = 0;
+	memset(&Signal_Action, 0, sizeof(Signal_Action));
+	Signal_Action.sa_handler = FileManagerHandleInterruptionSignal;
+	sigemptyset(&Signal_Action.sa_mask);
+	if (sigaction(SIGINT, &Signal_Action, &File_Manager_Previous_Signal_Action) != 0) LOG("Warning : could not install the SIGINT handler (%s), interrupting the program could hang the phone.\n", strerror(errno));
+
+	return 0;
+}
+
+int FileManagerCloseSession(TFileManagerSession *Pointer_Session)
+{
+	int Return_Value = -1;
+
+	// Nothing to do if the file manager has not been enabled
+	if (!Pointer_Session->Is_Opened) return 0;
+	Pointer_Session->Is_Opened = 0;
+
+	// The download pipeline stages are waiting for the next download, stop them
+	if (Pointer_Session->Pointer_Download_Pipeline != NULL)
+	{
+		FileManagerDestroyDownloadPipeline(Pointer_Session->Pointer_Download_Pipeline);
+		Pointer_Session->Pointer_Download_Pipeline = NULL;
+	}
+
+	// Disable file manager access, if the phone does not answer (it can be stuck in an interrupted operation), bring the communication back and force the file manager disabling
+	if (FileManagerDisableAccess(Pointer_Session->Serial_Port_ID) != 0)
+	{
+		printf("Recovering the communication with the phone...\n");
+		if ((ATCommandRecoverLink(Pointer_Session->Serial_Port_ID) != 0) || (FileManagerDisableAccess(Pointer_Session->Serial_Port_ID) != 0))
+		{
+			LOG("Error : failed to send the AT command that disables the file manager.\n");
+			goto Exit;
+		}
+	}
+
+	// Everything went fine
+	Return_Value = 0;
+
+Exit:
+	sigaction(SIGINT, &File_Manager_Previous_Signal_Action, NULL);
+	return Return_Value;
+}
+
 void FileManagerListAddFile(TList *Pointer_List, char *Pointer_String_File_Name, unsigned File_Size, int Flags)
 {
 	TFileManagerFileListItem *Pointer_Item;
@@ -42,21 +1070,13 @@ void FileManagerListAddFile(TList *Pointer_List, char *Pointer_String_File_Name,
 	ListAddItem(Pointer_List, Pointer_Item);
 }
 
-int FileManagerListDrives(TSerialPortID Serial_Port_ID, TList *Pointer_List)
+int FileManagerListDrives(TFileManagerSession *Pointer_Session, TList *Pointer_List)
 {
+	TSerialPortID Serial_Port_ID = Pointer_Session->Serial_Port_ID;
 	unsigned char Buffer[128];
 	char String_Temporary[sizeof(Buffer) * 2], String_Drive_Name[sizeof(Buffer) * 2]; // Twice more characters are needed as bytes are converted to hexadecimal characters
 	int Size, Return_Value = -1, Result;
 
-	// Allow access to file manager
-	if (ATCommandSendCommand(Serial_Port_ID, "AT+ESUO=3") != 0) return -1;
-	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) return -1; // Wait for "OK"
-	if (strcmp(String_Temporary, "OK") != 0)
-	{
-		LOG("Error : failed to send the AT command that enables the file manager.\n");
-		return -1;
-	}
-
 	// Send the command
 	if (ATCommandSendCommand(Serial_Port_ID, "AT+EFSL") < 0) goto Exit;
 
@@ -103,28 +1123,18 @@ int FileManagerListDrives(TSerialPortID Serial_Port_ID, TList *Pointer_List)
 	Return_Value = 0;
 
 Exit:
-	// Disable file manager access, this seems mandatory to avoid hanging the whole AT communication (phone needs to be rebooted if this command is not issued, otherwise the AT communication is stuck)
-	if (ATCommandSendCommand(Serial_Port_ID, "AT+ESUO=4") != 0) return -1;
-	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) return -1; // Wait for "OK"
-	if (strcmp(String_Temporary, "OK") != 0) LOG("Error : failed to send the AT command that disables the file manager.\n");
 	return Return_Value;
 }
 
-int FileManagerListDirectory(TSerialPortID Serial_Port_ID, char *Pointer_String_Absolute_Path, TList *Pointer_List)
+int FileManagerListDirectory(TFileManagerSession *Pointer_Session, char *Pointer_String_Absolute_Path, TList *Pointer_List)
 {
+	TSerialPortID Serial_Port_ID = Pointer_Session->Serial_Port_ID;
 	unsigned char Buffer[512];
 	char String_Temporary[sizeof(Buffer) * 2], String_File_Name[sizeof(Buffer) * 2]; // Twice more characters are needed as bytes are converted to hexadecimal characters
 	int Size, Return_Value = -1, Result, Flags;
 	unsigned int File_Size;
 
-	// Allow access to file manager
-	if (ATCommandSendCommand(Serial_Port_ID, "AT+ESUO=3") != 0) return -1;
-	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) return -1; // Wait for "OK"
-	if (strcmp(String_Temporary, "OK") != 0)
-	{
-		LOG("Error : failed to send the AT command that enables the file manager.\n");
-		return -1;
-	}
+	ListInitialize(Pointer_List);
 
 	// Convert the provided path to the character encoding the phone is expecting
 	Size = UtilityConvertString(Pointer_String_Absolute_Path, Buffer, UTILITY_CHARACTER_SET_UTF8, UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN, 0, sizeof(Buffer));
@@ -136,17 +1146,26 @@ int FileManagerListDirectory(TSerialPortID Serial_Port_ID, char *Pointer_String_
 
 	// Send the command
 	strcpy(String_Temporary, "AT+EFSL=\"");
-	ATCommandConvertBinaryToHexadecimal(Buffer, Size, &String_Temporary[9]); // Concatenate the converted path right after the command
-	strcat(String_Temporary, "\"");
-	if (ATCommandSendCommand(Serial_Port_ID, String_Temporary) < 0) goto Exit;
+	Size = ATCommandConvertBinaryToHexadecimal(Buffer, Size, &String_Temporary[9], sizeof(String_Temporary) - 10); // Concatenate the converted path right after the command, keeping room for the closing double quote
+	if (Size < 0)
+	{
+		LOG("Error : the path \"%s\" is too long to fit in the command.\n", Pointer_String_Absolute_Path);
+		goto Exit;
+	}
+	strcpy(&String_Temporary[9 + Size], "\"");
+	if (ATCommandSendCommand(Serial_Port_ID, String_Temporary) < 0)
+	{
+		Return_Value = -2;
+		goto Exit;
+	}
 
 	// Wait for all file names to be received
-	ListInitialize(Pointer_List);
 	do
 	{
 		// Wait for a file information string
 		Result = ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary));
 		if (Result == -2) LOG("Error : the specified path \"%s\" does not exist.\n", Pointer_String_Absolute_Path);
+		else if (FileManagerIsLinkError(Result)) Return_Value = -2;
 		if (Result < 0) goto Exit;
 
 		// Is this a file record ?
@@ -183,10 +1202,7 @@ int FileManagerListDirectory(TSerialPortID Serial_Port_ID, char *Pointer_String_
 	Return_Value = 0;
 
 Exit:
-	// Disable file manager access, this seems mandatory to avoid hanging the whole AT communication (phone needs to be rebooted if this command is not issued, otherwise the AT communication is stuck)
-	if (ATCommandSendCommand(Serial_Port_ID, "AT+ESUO=4") != 0) return -1;
-	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) return -1; // Wait for "OK"
-	if (strcmp(String_Temporary, "OK") != 0) LOG("Error : failed to send the AT command that disables the file manager.\n");
+	if (Return_Value != 0) ListClear(Pointer_List); // Do not give a partial listing to the caller
 	return Return_Value;
 }
 
@@ -232,19 +1248,52 @@ void FileManagerDisplayDirectoryListing(TList *Pointer_List)
 	}
 }
 
-int FileManagerDownloadFile(TSerialPortID Serial_Port_ID, char *Pointer_String_Absolute_Phone_Path, char *Pointer_String_Destination_PC_Path)
+void FileManagerInitializeFileDescriptorSink(TFileManagerSink *Pointer_Sink, int File_Descriptor)
+{
+	memset(Pointer_Sink, 0, sizeof(TFileManagerSink));
+	Pointer_Sink->Type = FILE_MANAGER_SINK_TYPE_FILE_DESCRIPTOR;
+	Pointer_Sink->File_Descriptor = File_Descriptor;
+}
+
+void FileManagerInitializeMemorySink(TFileManagerSink *Pointer_Sink)
+{
+	memset(Pointer_Sink, 0, sizeof(TFileManagerSink));
+	Pointer_Sink->Type = FILE_MANAGER_SINK_TYPE_MEMORY;
+	Pointer_Sink->File_Descriptor = -1;
+}
+
+void FileManagerInitializeCallbackSink(TFileManagerSink *Pointer_Sink, TFileManagerSinkCallback Callback, void *Pointer_Callback_Context)
+{
+	memset(Pointer_Sink, 0, sizeof(TFileManagerSink));
+	Pointer_Sink->Type = FILE_MANAGER_SINK_TYPE_CALLBACK;
+	Pointer_Sink->File_Descriptor = -1;
+	Pointer_Sink->Callback = Callback;
+	Pointer_Sink->Pointer_Callback_Context = Pointer_Callback_Context;
+}
+
+void FileManagerReleaseSink(TFileManagerSink *Pointer_Sink)
+{
+	free(Pointer_Sink->Pointer_Buffer);
+	Pointer_Sink->Pointer_Buffer = NULL;
+	Pointer_Sink->Buffer_Size = 0;
+	Pointer_Sink->Data_Size = 0;
+}
+
+int FileManagerDownloadFileToSink(TFileManagerSession *Pointer_Session, char *Pointer_String_Absolute_Phone_Path, TFileManagerSink *Pointer_Sink)
 {
+	TSerialPortID Serial_Port_ID = Pointer_Session->Serial_Port_ID;
 	unsigned char Buffer[512];
-	char String_Temporary[512], String_Payload[512];
-	int File_Descriptor = -1, Return_Value = -1, Size, Result, Read_Index;
-	unsigned int Read_Bytes_Count = 0;
+	char String_Temporary[512];
+	int Size;
 
-	// Try to create the output file first to make sure it can be accessed
-	File_Descriptor = open(Pointer_String_Destination_PC_Path, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-	if (File_Descriptor == -1)
+	// A memory sink only contains the file being downloaded
+	if (Pointer_Sink->Type == FILE_MANAGER_SINK_TYPE_MEMORY) Pointer_Sink->Data_Size = 0;
+
+	// Start the download pipeline before sending the command, so the answer can't be left unread
+	if (Pointer_Session->Pointer_Download_Pipeline == NULL)
 	{
-		LOG("Error : could not create the output file \"%s\" (%s).\n", Pointer_String_Destination_PC_Path, strerror(errno));
-		goto Exit;
+		Pointer_Session->Pointer_Download_Pipeline = FileManagerCreateDownloadPipeline(Serial_Port_ID);
+		if (Pointer_Session->Pointer_Download_Pipeline == NULL) return -1;
 	}
 
 	// Convert the provided path to the character encoding the phone is expecting
@@ -252,104 +1301,68 @@ int FileManagerDownloadFile(TSerialPortID Serial_Port_ID, char *Pointer_String_A
 	if (Size == -1)
 	{
 		LOG("Error : could not convert the path \"%s\" to UTF-16.\n", Pointer_String_Absolute_Phone_Path);
-		goto Exit;
-	}
-
-	// Allow access to file manager
-	if (ATCommandSendCommand(Serial_Port_ID, "AT+ESUO=3") != 0) goto Exit;
-	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) goto Exit; // Wait for "OK"
-	if (strcmp(String_Temporary, "OK") != 0)
-	{
-		LOG("Error : failed to send the AT command that enables the file manager.\n");
-		goto Exit;
+		return -1;
 	}
 
 	// Send the command
 	strcpy(String_Temporary, "AT+EFSR=\"");
-	ATCommandConvertBinaryToHexadecimal(Buffer, Size, &String_Temporary[9]); // Concatenate the converted path right after the command
-	strcat(String_Temporary, "\"");
-	if (ATCommandSendCommand(Serial_Port_ID, String_Temporary) < 0) goto Exit;
-
-	// Receive all file chunks
-	do
+	Size = ATCommandConvertBinaryToHexadecimal(Buffer, Size, &String_Temporary[9], sizeof(String_Temporary) - 10); // Concatenate the converted path right after the command, keeping room for the closing double quote
+	if (Size < 0)
 	{
-		// Wait for a file chunk string
-		Result = ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary));
-		if (Result == -2) LOG("Error : the specified path \"%s\" does not exist.\n", Pointer_String_Absolute_Phone_Path);
-		if (Result < 0) goto Exit;
-
-		// Is this a chunk ?
-		if (strncmp(String_Temporary, "+EFSR: ", 7) == 0)
-		{
-			// Extract chunk information
-			if (sscanf(String_Temporary, "+EFSR: %*d, %*d, %d, %n", &Size, &Read_Index) != 1) // The scanf() 'n' modifier does not increase the count returned by the function
-			{
-				LOG("Error : could not extract file chunk information.\n");
-				goto Exit;
-			}
-
-			// Make sure the chunk size won't exceed the destination buffer
-			Read_Bytes_Count += Size; // Update the read bytes variable just before modifying the Size variable
-			Size *= 2; // The chunk size represents the final size in bytes, however each byte is encoded by two hexadecimal characters, so take this into account
-			if (Size > (int) sizeof(String_Payload))
-			{
-				LOG("Error : the chunk payload size is too big.\n");
-				goto Exit;
-			}
-			LOG_DEBUG(FILE_MANAGER_IS_DEBUG_ENABLED, "Chunk payload size : %d.\n", Size);
-			if (Size <= 0) continue;
-
-			// Retrieve the payload
-			if (sscanf(&String_Temporary[Read_Index], "\"%[0-9A-F]\"", String_Payload) != 1)
-			{
-				LOG("Error : failed to extract the payload from the file chunk.\n");
-				goto Exit;
-			}
-
-			// Convert the payload to binary
-			Size = ATCommandConvertHexadecimalToBinary(String_Payload, Buffer, sizeof(Buffer));
-			if (Size < 0)
-			{
-				LOG("Error : could not convert file chunk payload from hexadecimal to binary.\n");
-				goto Exit;
-			}
+		LOG("Error : the path \"%s\" is too long to fit in the command.\n", Pointer_String_Absolute_Phone_Path);
+		return -1;
+	}
+	strcpy(&String_Temporary[9 + Size], "\"");
+	if (ATCommandSendCommand(Serial_Port_ID, String_Temporary) < 0) return -2;
 
-			// Append the data to the file
-			if (write(File_Descriptor, Buffer, Size) != Size)
-			{
-				LOG("Error : could not write the file chunk payload to the output file (%s).\n", strerror(errno));
-				goto Exit;
-			}
+	// Receive all file chunks through the pipeline, this thread is the last stage that writes the data to the sink, so the sink callback is called from the caller thread
+	return FileManagerRunDownloadPipeline(Pointer_Session, Pointer_String_Absolute_Phone_Path, Pointer_Sink);
+}
 
-			// Display progress for user
-			printf("Progress : %u bytes.\r", Read_Bytes_Count);
-		}
-	} while (strcmp(String_Temporary, "OK") != 0);
+int FileManagerDownloadFile(TFileManagerSession *Pointer_Session, char *Pointer_String_Absolute_Phone_Path, char *Pointer_String_Destination_PC_Path)
+{
+	TFileManagerSink Sink;
+	int File_Descriptor, Return_Value;
 
-	// Everything went fine
-	Return_Value = 0;
+	// Try to create the output file first to make sure it can be accessed
+	File_Descriptor = open(Pointer_String_Destination_PC_Path, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (File_Descriptor == -1)
+	{
+		LOG("Error : could not create the output file \"%s\" (%s).\n", Pointer_String_Destination_PC_Path, strerror(errno));
+		return -1;
+	}
 
-Exit:
-	if (File_Descriptor != -1) close(File_Descriptor);
+	FileManagerInitializeFileDescriptorSink(&Sink, File_Descriptor);
+	Return_Value = FileManagerDownloadFileToSink(Pointer_Session, Pointer_String_Absolute_Phone_Path, &Sink);
+	FileManagerReleaseSink(&Sink);
 
-	// Disable file manager access, this seems mandatory to avoid hanging the whole AT communication (phone needs to be rebooted if this command is not issued, otherwise the AT communication is stuck)
-	if (ATCommandSendCommand(Serial_Port_ID, "AT+ESUO=4") != 0) return -1;
-	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) return -1; // Wait for "OK"
-	if (strcmp(String_Temporary, "OK") != 0) LOG("Error : failed to send the AT command that disables the file manager.\n");
+	close(File_Descriptor);
 	return Return_Value;
 }
 
-int FileManagerDownloadDirectory(TSerialPortID Serial_Port_ID, char *Pointer_String_Absolute_Phone_Path, char *Pointer_String_Destination_PC_Path)
+int FileManagerDownloadDirectory(TFileManagerSession *Pointer_Session, char *Pointer_String_Absolute_Phone_Path, char *Pointer_String_Destination_PC_Path, int Flags)
 {
-	TList List_Files;
-	TListItem *Pointer_Item;
+	TList List_Files, List_Manifest;
+	TFileManagerManifestIndex Manifest_Index = {NULL, 0, 0};
+	TListItem *Pointer_Item, *Pointer_Next_Item;
 	TFileManagerFileListItem *Pointer_File_List_Item;
-	int Return_Value = -1;
+	TFileManagerManifestEntry *Pointer_Manifest_Entry = NULL;
+	int Return_Value = -1, Result, i;
 	char String_Source_File_Name[512], String_Output_File_Name[512];
+	long long Current_Time;
 
-	// Find all directories and files located in this directory
+	// Removing the stale files needs the manifest
+	if (Flags & FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_PRUNE) Flags |= FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_MIRROR;
+
+	// Find all directories and files located in this directory, retrying after a communication glitch (the other errors would happen again)
 	LOG_DEBUG(FILE_MANAGER_IS_DEBUG_ENABLED, "Listing directory \"%s\" :\n", Pointer_String_Absolute_Phone_Path);
-	if (FileManagerListDirectory(Serial_Port_ID, Pointer_String_Absolute_Phone_Path, &List_Files) != 0)
+	Result = FileManagerListDirectory(Pointer_Session, Pointer_String_Absolute_Phone_Path, &List_Files);
+	for (i = 0; (Result == -2) && (i < FILE_MANAGER_MAXIMUM_RECOVERY_ATTEMPTS_COUNT); i++)
+	{
+		if (FileManagerIsInterrupted() || (FileManagerRecoverSession(Pointer_Session) != 0)) break;
+		Result = FileManagerListDirectory(Pointer_Session, Pointer_String_Absolute_Phone_Path, &List_Files);
+	}
+	if (Result != 0)
 	{
 		LOG("Error : could not list the directory \"%s\".\n", Pointer_String_Absolute_Phone_Path);
 		return -1;
@@ -357,19 +1370,25 @@ int FileManagerDownloadDirectory(TSerialPortID Serial_Port_ID, char *Pointer_Str
 	#if FILE_MANAGER_IS_DEBUG_ENABLED
 		FileManagerDisplayDirectoryListing(&List_Files);
 	#endif
+	ListInitialize(&List_Manifest);
+	Current_Time = time(NULL);
 
 	// Create the output directory
 	if (UtilityCreateDirectory(Pointer_String_Destination_PC_Path) != 0)
 	{
 		LOG("Error : could not create the output directory \"%s\".\n", Pointer_String_Destination_PC_Path);
-		goto Exit_Free_List;
+		goto Exit_Free_Lists;
 	}
 
+	// Retrieve the files downloaded by the previous mirror operations
+	if ((Flags & FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_MIRROR) && ((FileManagerLoadManifest(Pointer_String_Destination_PC_Path, &List_Manifest) != 0) || (FileManagerCreateManifestIndex(&Manifest_Index, &List_Manifest) != 0))) goto Exit_Free_Lists;
+
 	// Process each file
 	Pointer_Item = List_Files.Pointer_Head;
 	while (Pointer_Item != NULL)
 	{
 		Pointer_File_List_Item = Pointer_Item->Pointer_Data;
+		if (FileManagerIsInterrupted()) goto Exit_Save_Manifest;
 
 		// Display the processed file for debugging purpose
 		LOG_DEBUG(FILE_MANAGER_IS_DEBUG_ENABLED, "Processing the %s \"%s\".\n", FILE_MANAGER_ATTRIBUTE_IS_DIRECTORY(Pointer_File_List_Item) ? "directory" : "file", Pointer_File_List_Item->String_File_Name);
@@ -386,49 +1405,130 @@ int FileManagerDownloadDirectory(TSerialPortID Serial_Port_ID, char *Pointer_Str
 		snprintf(String_Output_File_Name, sizeof(String_Output_File_Name), "%s/%s", Pointer_String_Destination_PC_Path, Pointer_File_List_Item->String_File_Name);
 		LOG_DEBUG(FILE_MANAGER_IS_DEBUG_ENABLED, "Output file path : \"%s\".\n", String_Output_File_Name);
 
+		// Tell that this file still exists on the phone
+		if (Flags & FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_MIRROR)
+		{
+			Pointer_Manifest_Entry = FileManagerFindManifestEntry(&Manifest_Index, Pointer_File_List_Item->String_File_Name);
+			if (Pointer_Manifest_Entry != NULL) Pointer_Manifest_Entry->Is_Found = 1;
+		}
+
 		// Download the file if this is the case
 		if (!FILE_MANAGER_ATTRIBUTE_IS_DIRECTORY(Pointer_File_List_Item))
 		{
-			// Try to download the file
+			// Do not download again a file that is already up to date
+			if ((Flags & FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_MIRROR) && FileManagerIsMirroredFileUnchanged(Pointer_Manifest_Entry, Pointer_File_List_Item, String_Output_File_Name))
+			{
+				LOG_DEBUG(FILE_MANAGER_IS_DEBUG_ENABLED, "The file \"%s\" did not change, skipping it.\n", String_Source_File_Name);
+				Pointer_Manifest_Entry->Last_Seen_Time = Current_Time;
+				goto Next_File;
+			}
+
+			// Try to download the file, the download resumes from this file if the communication with the phone needs to be recovered
 			printf("Downloading the file \"%s\"...\n", String_Source_File_Name);
-			if (FileManagerDownloadFile(Serial_Port_ID, String_Source_File_Name, String_Output_File_Name) != 0)
+			Result = FileManagerDownloadDirectoryFile(Pointer_Session, String_Source_File_Name, String_Output_File_Name, Flags & FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_MIRROR);
+			for (i = 0; (Result == -2) && (i < FILE_MANAGER_MAXIMUM_RECOVERY_ATTEMPTS_COUNT); i++)
+			{
+				if (FileManagerIsInterrupted() || (FileManagerRecoverSession(Pointer_Session) != 0)) break;
+				printf("Resuming the download with the file \"%s\"...\n", String_Source_File_Name);
+				Result = FileManagerDownloadDirectoryFile(Pointer_Session, String_Source_File_Name, String_Output_File_Name, Flags & FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_MIRROR);
+			}
+			if (Result != 0)
 			{
 				LOG("Error : failed to download the file \"%s\".\n", String_Source_File_Name);
-				goto Exit_Free_List;
+				goto Exit_Save_Manifest;
 			}
 		}
 		// Recurse into the directory if this is the case
 		else
 		{
 			printf("Scanning the directory \"%s\"...\n", String_Source_File_Name);
-			if (FileManagerDownloadDirectory(Serial_Port_ID, String_Source_File_Name, String_Output_File_Name) != 0)
+			if (FileManagerDownloadDirectory(Pointer_Session, String_Source_File_Name, String_Output_File_Name, Flags) != 0)
 			{
 				LOG("Error : failed to scan the directory \"%s\".\n", String_Source_File_Name);
-				goto Exit_Free_List;
+				goto Exit_Save_Manifest;
+			}
+		}
+
+		// Remember the downloaded file or directory
+		if (Flags & FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_MIRROR)
+		{
+			if (Pointer_Manifest_Entry == NULL)
+			{
+				Pointer_Manifest_Entry = malloc(sizeof(TFileManagerManifestEntry));
+				if (Pointer_Manifest_Entry == NULL)
+				{
+					LOG("Error : could not allocate a manifest entry.\n");
+					goto Exit_Save_Manifest;
+				}
+				Pointer_Manifest_Entry->Is_Found = 1;
+				memcpy(&Pointer_Manifest_Entry->File, Pointer_File_List_Item, sizeof(TFileManagerFileListItem));
+				ListAddItem(&List_Manifest, Pointer_Manifest_Entry);
+				if (FileManagerAddManifestIndexEntry(&Manifest_Index, Pointer_Manifest_Entry) != 0) goto Exit_Save_Manifest;
 			}
+			else memcpy(&Pointer_Manifest_Entry->File, Pointer_File_List_Item, sizeof(TFileManagerFileListItem));
+			Pointer_Manifest_Entry->Last_Seen_Time = Current_Time;
 		}
 
 Next_File:
 		Pointer_Item = Pointer_Item->Pointer_Next_Item;
 	}
 
+	// Remove the local copy of the files and directories that have been removed from the phone
+	if (Flags & FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_PRUNE)
+	{
+		FileManagerReleaseManifestIndex(&Manifest_Index); // The index must not reference the entries freed below
+
+		Pointer_Item = List_Manifest.Pointer_Head;
+		while (Pointer_Item != NULL)
+		{
+			Pointer_Next_Item = Pointer_Item->Pointer_Next_Item; // The item may be removed
+			Pointer_Manifest_Entry = Pointer_Item->Pointer_Data;
+			if (!Pointer_Manifest_Entry->Is_Found)
+			{
+				snprintf(String_Output_File_Name, sizeof(String_Output_File_Name), "%s/%s", Pointer_String_Destination_PC_Path, Pointer_Manifest_Entry->File.String_File_Name);
+				if (FILE_MANAGER_ATTRIBUTE_IS_DIRECTORY((&Pointer_Manifest_Entry->File)))
+				{
+					printf("Removing the directory \"%s\" that does not exist anymore on the phone...\n", String_Output_File_Name);
+					Result = UtilityRemoveDirectory(String_Output_File_Name);
+				}
+				else
+				{
+					printf("Removing the file \"%s\" that does not exist anymore on the phone...\n", String_Output_File_Name);
+					Result = unlink(String_Output_File_Name);
+					if ((Result != 0) && (errno == ENOENT)) Result = 0; // The file has already been removed by the user
+					if (Result != 0) LOG("Error : could not remove the file \"%s\" (%s).\n", String_Output_File_Name, strerror(errno));
+				}
+				if (Result != 0) goto Exit_Save_Manifest;
+				ListClearItem(&List_Manifest, Pointer_Item);
+			}
+			Pointer_Item = Pointer_Next_Item;
+		}
+	}
+
 	// Everything went fine
 	Return_Value = 0;
 
-Exit_Free_List:
+Exit_Save_Manifest:
+	// Save the manifest even if an error occurred, so the already downloaded files won't be downloaded again
+	if ((Flags & FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_MIRROR) && (FileManagerSaveManifest(Pointer_String_Destination_PC_Path, &List_Manifest) != 0)) Return_Value = -1;
+
+Exit_Free_Lists:
+	FileManagerReleaseManifestIndex(&Manifest_Index);
+	ListClear(&List_Manifest);
 	ListClear(&List_Files);
 
 	return Return_Value;
 }
 
-int FileManagerSendFile(TSerialPortID Serial_Port_ID, char *Pointer_String_Source_PC_Path, char *Pointer_String_Absolute_Phone_Path)
+int FileManagerSendFile(TFileManagerSession *Pointer_Session, char *Pointer_String_Source_PC_Path, char *Pointer_String_Absolute_Phone_Path)
 {
-	int File_Descriptor = -1, Return_Value = -1, Size, Is_End_Of_File_Reached;
-	unsigned int Chunk_Size_Bytes;
-	char String_Temporary[512], String_Chunk_Command[1024];
-	unsigned char Buffer[512];
-	ssize_t Bytes_Count;
-	size_t Written_Bytes_Count = 0;
+	TSerialPortID Serial_Port_ID = Pointer_Session->Serial_Port_ID;
+	int File_Descriptor = -1, Return_Value = -1, Size, Is_Last_Chunk, Is_Last_Chunk_Sent, Command_Buffer_Index = 0;
+	unsigned int Chunk_Size_Bytes, Bytes_Count;
+	unsigned char Buffer[512], *Pointer_File_Content = MAP_FAILED;
+	char String_Temporary[512], *Pointer_Strings_Chunk_Commands[2] = {NULL, NULL};
+	size_t Written_Bytes_Count = 0, File_Size = 0, Command_Size;
+	struct stat File_Status;
 
 	// Try to open the file to send to make sure it is existing
 	File_Descriptor = open(Pointer_String_Source_PC_Path, O_RDONLY);
@@ -438,14 +1538,28 @@ int FileManagerSendFile(TSerialPortID Serial_Port_ID, char *Pointer_String_Sourc
 		return -1;
 	}
 
-	// Allow access to file manager
-	if (ATCommandSendCommand(Serial_Port_ID, "AT+ESUO=3") != 0) goto Exit;
-	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) goto Exit; // Wait for "OK"
-	if (strcmp(String_Temporary, "OK") != 0)
+	// Map the whole file in memory, so the chunks can be encoded straight from the page cache without copying them first
+	if (fstat(File_Descriptor, &File_Status) != 0)
 	{
-		LOG("Error : failed to send the AT command that enables the file manager.\n");
+		LOG("Error : could not retrieve the source file \"%s\" size (%s).\n", Pointer_String_Source_PC_Path, strerror(errno));
+		goto Exit;
+	}
+	if (!S_ISREG(File_Status.st_mode))
+	{
+		LOG("Error : the source file \"%s\" is not a regular file.\n", Pointer_String_Source_PC_Path);
 		goto Exit;
 	}
+	File_Size = (size_t) File_Status.st_size;
+	if (File_Size > 0) // An empty mapping can't be created
+	{
+		Pointer_File_Content = mmap(NULL, File_Size, PROT_READ, MAP_PRIVATE, File_Descriptor, 0);
+		if (Pointer_File_Content == MAP_FAILED)
+		{
+			LOG("Error : could not map the source file \"%s\" in memory (%s).\n", Pointer_String_Source_PC_Path, strerror(errno));
+			goto Exit;
+		}
+		madvise(Pointer_File_Content, File_Size, MADV_SEQUENTIAL); // This is only a hint, there is no need to check the result
+	}
 
 	// Retrieve the maximum transfer chunk size
 	if (ATCommandSendCommand(Serial_Port_ID, "AT+EFSW?") != 0) goto Exit;
@@ -455,13 +1569,35 @@ int FileManagerSendFile(TSerialPortID Serial_Port_ID, char *Pointer_String_Sourc
 		LOG("Error : could not convert the transfer chunk size to a number.\n");
 		goto Exit;
 	}
+	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) goto Exit; // Wait for the empty line before "OK"
+	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) goto Exit; // Wait for "OK"
+	if (strcmp(String_Temporary, "OK") != 0)
+	{
+		LOG("Error : failed to send the AT command that retrieves the transfer chunk size.\n");
+		goto Exit;
+	}
 	Chunk_Size_Bytes /= 2; // The command returns the raw data size, where each byte is encoded by two hexadecimal characters, so divide by two to get the real payload size in bytes
 	LOG_DEBUG(FILE_MANAGER_IS_DEBUG_ENABLED, "Transfer chunk size in bytes : %u.\n", Chunk_Size_Bytes);
-	// Make sure the chunk transfer size won't overflow the internal buffer
-	if (Chunk_Size_Bytes > sizeof(Buffer))
+	if (Chunk_Size_Bytes == 0)
+	{
+		LOG("Error : the transfer chunk size of %u bytes is not supported.\n", Chunk_Size_Bytes);
+		goto Exit;
+	}
+	if (Chunk_Size_Bytes > FILE_MANAGER_MAXIMUM_CHUNK_SIZE)
+	{
+		// Smaller chunks are always accepted by the phone
+		Chunk_Size_Bytes = FILE_MANAGER_MAXIMUM_CHUNK_SIZE;
+		LOG_DEBUG(FILE_MANAGER_IS_DEBUG_ENABLED, "Transfer chunk size is greater than the maximum supported one, limiting it to %u bytes.\n", Chunk_Size_Bytes);
+	}
+
+	// Use the full chunk size the phone accepts, two commands are allocated so the next one can be created while the phone processes the current one
+	Command_Size = Chunk_Size_Bytes * 2 + FILE_MANAGER_CHUNK_COMMAND_HEADER_MAXIMUM_SIZE; // Twice more characters are needed as bytes are converted to hexadecimal characters, also keep room for the command header
+	Pointer_Strings_Chunk_Commands[0] = malloc(Command_Size);
+	Pointer_Strings_Chunk_Commands[1] = malloc(Command_Size);
+	if ((Pointer_Strings_Chunk_Commands[0] == NULL) || (Pointer_Strings_Chunk_Commands[1] == NULL))
 	{
-		Chunk_Size_Bytes = sizeof(Buffer);
-		LOG_DEBUG(FILE_MANAGER_IS_DEBUG_ENABLED, "Transfer chunk size is greater than the internal buffer, limiting it to %zu bytes.\n", sizeof(Buffer));
+		LOG("Error : could not allocate the chunk command buffers.\n");
+		goto Exit;
 	}
 
 	// Convert the provided path to the character encoding the phone is expecting
@@ -474,8 +1610,13 @@ int FileManagerSendFile(TSerialPortID Serial_Port_ID, char *Pointer_String_Sourc
 
 	// Try to create and open the target file on the phone
 	strcpy(String_Temporary, "AT+EFSW=0,\"");
-	ATCommandConvertBinaryToHexadecimal(Buffer, Size, &String_Temporary[11]); // Concatenate the converted path right after the command
-	strcat(String_Temporary, "\"");
+	Size = ATCommandConvertBinaryToHexadecimal(Buffer, Size, &String_Temporary[11], sizeof(String_Temporary) - 12); // Concatenate the converted path right after the command, keeping room for the closing double quote
+	if (Size < 0)
+	{
+		LOG("Error : the path \"%s\" is too long to fit in the command.\n", Pointer_String_Absolute_Phone_Path);
+		goto Exit;
+	}
+	strcpy(&String_Temporary[11 + Size], "\"");
 	if (ATCommandSendCommand(Serial_Port_ID, String_Temporary) < 0) goto Exit;
 	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) goto Exit; // Wait for "OK"
 	if (strcmp(String_Temporary, "OK") != 0)
@@ -484,24 +1625,33 @@ int FileManagerSendFile(TSerialPortID Serial_Port_ID, char *Pointer_String_Sourc
 		goto Exit;
 	}
 
+	// Prepare the first chunk, a chunk smaller than the chunk size tells the end of the file, so an empty chunk is sent if the file size is a multiple of the chunk size
+	if (File_Size < Chunk_Size_Bytes) Bytes_Count = (unsigned int) File_Size;
+	else Bytes_Count = Chunk_Size_Bytes;
+	Is_Last_Chunk = Bytes_Count < Chunk_Size_Bytes;
+	FileManagerCreateChunkCommand(Pointer_File_Content, Bytes_Count, Is_Last_Chunk, Pointer_Strings_Chunk_Commands[0], Command_Size);
+
 	// Send the file content
 	do
 	{
-		// Read a chunk from the source file
-		Bytes_Count = read(File_Descriptor, Buffer, Chunk_Size_Bytes);
-		if (Bytes_Count == -1)
+		if (FileManagerIsInterrupted()) goto Exit;
+
+		// Send the prepared chunk
+		Is_Last_Chunk_Sent = Is_Last_Chunk;
+		if (ATCommandSendCommand(Serial_Port_ID, Pointer_Strings_Chunk_Commands[Command_Buffer_Index]) < 0) goto Exit;
+		Written_Bytes_Count += Bytes_Count;
+
+		// Create the next chunk command while the phone is writing the current chunk, so the link does not stay idle between two chunks
+		if (!Is_Last_Chunk_Sent)
 		{
-			LOG("Error : failed to read a chunk of data from the source file (%s).\n", strerror(errno));
-			goto Exit;
+			Command_Buffer_Index ^= 1;
+			if (File_Size - Written_Bytes_Count < Chunk_Size_Bytes) Bytes_Count = (unsigned int) (File_Size - Written_Bytes_Count);
+			else Bytes_Count = Chunk_Size_Bytes;
+			Is_Last_Chunk = Bytes_Count < Chunk_Size_Bytes;
+			FileManagerCreateChunkCommand(&Pointer_File_Content[Written_Bytes_Count], Bytes_Count, Is_Last_Chunk, Pointer_Strings_Chunk_Commands[Command_Buffer_Index], Command_Size);
 		}
-		Written_Bytes_Count += Bytes_Count;
 
-		// Send a chunk of data
-		if (Bytes_Count < Chunk_Size_Bytes) Is_End_Of_File_Reached = 1;
-		else Is_End_Of_File_Reached = 0;
-		ATCommandConvertBinaryToHexadecimal(Buffer, Bytes_Count, String_Temporary); // The file payload is expected to be sent in hexadecimal
-		snprintf(String_Chunk_Command, sizeof(String_Chunk_Command), "AT+EFSW=2,%d,%zd,\"%s\"", Is_End_Of_File_Reached, Bytes_Count, String_Temporary);
-		if (ATCommandSendCommand(Serial_Port_ID, String_Chunk_Command) < 0) goto Exit;
+		// Wait for the phone to acknowledge the sent chunk
 		if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) goto Exit; // Wait for "OK"
 		if (strcmp(String_Temporary, "OK") != 0)
 		{
@@ -511,7 +1661,7 @@ int FileManagerSendFile(TSerialPortID Serial_Port_ID, char *Pointer_String_Sourc
 
 		// Display progress for user
 		printf("Progress : %zu bytes.\r", Written_Bytes_Count);
-	} while (Bytes_Count == Chunk_Size_Bytes);
+	} while (!Is_Last_Chunk_Sent);
 
 	// Close the file
 	if (ATCommandSendCommand(Serial_Port_ID, "AT+EFSW=1") != 0) goto Exit;
@@ -526,11 +1676,20 @@ int FileManagerSendFile(TSerialPortID Serial_Port_ID, char *Pointer_String_Sourc
 	Return_Value = 0;
 
 Exit:
+	free(Pointer_Strings_Chunk_Commands[0]);
+	free(Pointer_Strings_Chunk_Commands[1]);
+	if (Pointer_File_Content != MAP_FAILED) munmap(Pointer_File_Content, File_Size);
 	if (File_Descriptor != -1) close(File_Descriptor);
-
-	// Disable file manager access, this seems mandatory to avoid hanging the whole AT communication (phone needs to be rebooted if this command is not issued, otherwise the AT communication is stuck)
-	if (ATCommandSendCommand(Serial_Port_ID, "AT+ESUO=4") != 0) return -1;
-	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) return -1; // Wait for "OK"
-	if (strcmp(String_Temporary, "OK") != 0) LOG("Error : failed to send the AT command that disables the file manager.\n");
 	return Return_Value;
 }
+
+void FileManagerDisplayStatistics(FILE *Pointer_File)
+{
+	TFileManagerDownloadStatistics *Pointer_Statistics = &File_Manager_Download_Statistics;
+
+	fprintf(Pointer_File, "File download pipeline statistics :\n");
+	fprintf(Pointer_File, "  Downloads : %llu, chunks : %llu, bytes : %llu\n", Pointer_Statistics->Downloads_Count, Pointer_Statistics->Chunks_Count, Pointer_Statistics->Bytes_Count);
+	fprintf(Pointer_File, "  Link reader stalled by a full pipeline : %llu times, %.3f ms\n", Pointer_Statistics->Reader_Stalls_Count, Pointer_Statistics->Reader_Stall_Time / 1e6);
+	fprintf(Pointer_File, "  Writer waiting for data : %llu times, %.3f ms\n", Pointer_Statistics->Writer_Waits_Count, Pointer_Statistics->Writer_Wait_Time / 1e6);
+	fprintf(Pointer_File, "  Maximum chunks waiting to be written : %u/%d\n", Pointer_Statistics->Maximum_Pending_Chunks_Count, FILE_MANAGER_DOWNLOAD_PIPELINE_ITEMS_COUNT);
+}
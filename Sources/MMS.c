@@ -2,19 +2,18 @@
  * See MMS.h for description.
  * @author Adrien RICCIARDI
  */
-#include <arpa/inet.h>
 #include <AT_Command.h>
 #include <errno.h>
-#include <fcntl.h>
 #include <File_Manager.h>
 #include <Log.h>
+#include <Message_Index.h>
 #include <MMS.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
-#include <unistd.h>
 #include <Utility.h>
 
 //-------------------------------------------------------------------------------------------------
@@ -23,10 +22,8 @@
 /** Allow to turn on or off debug messages. */
 #define MMS_IS_DEBUG_ENABLED 0
 
-/** The local file name and path of the MMS database file. */
-#define MMS_DATABASE_FILE_NAME "Output/MMS/Database.db"
-/** The local file name of a downloaded but not yet processed MMS file. */
-#define MMS_RAW_MMS_FILE_NAME "Output/MMS/MMS.tmp"
+/** The index of the messages already extracted to the output directories. */
+#define MMS_INDEX_FILE_PATH "Output/MMS/Index.txt"
 
 //-------------------------------------------------------------------------------------------------
 // Private types
@@ -68,6 +65,75 @@ typedef struct __attribute__((packed))
 	char String_Phone_Number[80]; //!< The string is zero-terminated.
 } TMMSDatabaseRecord;
 
+/** Where the messages of a storage location and device combination are stored. */
+typedef struct
+{
+	int Messages_Count;
+	char String_Messages_Payload_Directory[128];
+	char String_Database_File[128];
+} TMMSStorageInformation;
+
+/** A bounds-checked read position in a MMS PDU stored in memory. The PDU is never modified, so several PDUs can be decoded at the same time. */
+typedef struct
+{
+	unsigned char *Pointer_Data; //!< The PDU first byte.
+	size_t Size; //!< The PDU size in bytes.
+	size_t Offset; //!< The next byte to read.
+} TMMSCursor;
+
+/** The data types a WSP value can be encoded with, the value first byte tells which one is used (see WAP-230-WSP-20010705-a chapter 8.4.1.2). */
+typedef enum
+{
+	MMS_VALUE_TYPE_SHORT_INTEGER, //!< A single byte with the bit 7 set, the value is stored in the 7 remaining bits.
+	MMS_VALUE_TYPE_TEXT, //!< A zero-terminated string.
+	MMS_VALUE_TYPE_DATA //!< A length followed by that amount of bytes (a Long-integer, an Encoded-string-value with a character set, a Content-general-form...).
+} TMMSValueType;
+
+/** A WSP value, pointing in the PDU. */
+typedef struct
+{
+	TMMSValueType Type;
+	unsigned int Short_Integer; //!< Only valid for a short integer value.
+	unsigned char *Pointer_Data; //!< The string (without its quote character) or the data first byte.
+	size_t Size; //!< The data size in bytes, or the string length without the terminating zero.
+} TMMSValue;
+
+/** Describe a multipart entry, or the whole body when the message is not a multipart one. All strings point in the PDU or in constant tables, so nothing is copied. */
+typedef struct
+{
+	const char *Pointer_String_Content_Type; //!< The media type, like "image/jpeg".
+	unsigned int Charset; //!< The text character set IANA MIBenum, or 0 if it is not specified.
+	const char *Pointer_String_Name; //!< The Name or Filename parameter of the content type or of the content disposition, NULL if there is none.
+	const char *Pointer_String_Content_ID; //!< NULL if there is none.
+	const char *Pointer_String_Content_Location; //!< NULL if there is none.
+	unsigned char *Pointer_Data; //!< The entry content.
+	size_t Data_Size; //!< The entry content size in bytes.
+} TMMSPart;
+
+/** The message header fields needed to store the message. */
+typedef struct
+{
+	TMMSMessageType Message_Type;
+	time_t Date; //!< A Unix timestamp.
+	char String_Sender_Phone_Number[32];
+	TMMSPart Body; //!< The body content type, and the content itself for a message that is not a multipart one.
+} TMMSMessageHeaders;
+
+/** Store a message header field value.
+ * @param Pointer_Value The field value.
+ * @param Pointer_Headers The headers to update.
+ * @return -1 if the value is invalid,
+ * @return 0 on success.
+ */
+typedef int (*TMMSHeaderFieldDecoder)(TMMSValue *Pointer_Value, TMMSMessageHeaders *Pointer_Headers);
+
+/** Tell how to handle a message header field. */
+typedef struct
+{
+	char *Pointer_String_Name; //!< The field name, for logging purpose.
+	TMMSHeaderFieldDecoder Decoder; //!< Set to NULL when the field is not needed, its value is skipped in this case.
+} TMMSHeaderField;
+
 //-------------------------------------------------------------------------------------------------
 // Private functions
 //-------------------------------------------------------------------------------------------------
@@ -152,56 +218,45 @@ static int MMSGetStorageInformation(TSerialPortID Serial_Port_ID, TMMSStorageLoc
 	return 0;
 }
 
-/** TODO
- * Designed for Encoded-string-value
+/** Read the next PDU byte.
+ * @param Pointer_Cursor The PDU read position, it is advanced by one byte on success.
+ * @param Pointer_Byte On output, contain the read byte.
+ * @return -1 if the PDU end has been reached,
+ * @return 0 on success.
  */
-static int MMSReadStringField(FILE *Pointer_File, char *Pointer_String_Output, unsigned int Buffer_Size)
+static inline int MMSCursorReadByte(TMMSCursor *Pointer_Cursor, unsigned char *Pointer_Byte)
 {
-	unsigned char Byte;
-
-	// Is the first byte the Value-length ?
-	if (fread(&Byte, 1, 1, Pointer_File) != 1) return -1;
-	if (Byte == 31)
-	{
-		// Discard Value-length value (TODO handle uintvar)
-		if (fread(&Byte, 1, 1, Pointer_File) != 1) return -1;
-		// Discard Char-set value
-		if (fread(&Byte, 1, 1, Pointer_File) != 1) return -1;
-	}
-	else
-	{
-		// Store the byte as a regular character into the string
-		*Pointer_String_Output = Byte;
-		if (Byte == 0) return 0;
-		Pointer_String_Output++;
-		Buffer_Size--;
-	}
+	if (Pointer_Cursor->Offset >= Pointer_Cursor->Size) return -1;
 
-	// Read characters without overflowing the output buffer
-	while (Buffer_Size > 0)
-	{
-		// Read next character
-		if (fread(Pointer_String_Output, 1, 1, Pointer_File) != 1)
-		{
-			LOG("Error : unexpected file end or read error (%s).\n", strerror(errno));
-			return -1;
-		}
+	*Pointer_Byte = Pointer_Cursor->Pointer_Data[Pointer_Cursor->Offset];
+	Pointer_Cursor->Offset++;
+	return 0;
+}
 
-		// Is the string end reached ?
-		if (*Pointer_String_Output == 0) return 0;
+/** Access the next PDU bytes without copying them.
+ * @param Pointer_Cursor The PDU read position, it is advanced by the requested amount of bytes on success.
+ * @param Size How many bytes to access.
+ * @return NULL if the PDU does not contain enough remaining bytes,
+ * @return A pointer on the first byte inside the PDU on success.
+ */
+static inline unsigned char *MMSCursorReadBytes(TMMSCursor *Pointer_Cursor, size_t Size)
+{
+	unsigned char *Pointer_Bytes;
 
-		// Get next character
-		Pointer_String_Output++;
-		Buffer_Size--;
-	}
+	if (Size > Pointer_Cursor->Size - Pointer_Cursor->Offset) return NULL;
 
-	// There is not enough room in the output buffer
-	LOG("Error : the output buffer size is smaller than the string size.\n");
-	return -1;
+	Pointer_Bytes = &Pointer_Cursor->Pointer_Data[Pointer_Cursor->Offset];
+	Pointer_Cursor->Offset += Size;
+	return Pointer_Bytes;
 }
 
-/** TODO */
-static int MMSReadWAPVariableLengthUnsignedInteger(FILE *Pointer_File, unsigned int *Pointer_Unsigned_Integer)
+/** Decode an uintvar (see WAP-230-WSP-20010705-a chapter 8.1.2).
+ * @param Pointer_Cursor The PDU read position.
+ * @param Pointer_Unsigned_Integer On output, contain the decoded value.
+ * @return -1 if the value is invalid or truncated,
+ * @return 0 on success.
+ */
+static int MMSReadWAPVariableLengthUnsignedInteger(TMMSCursor *Pointer_Cursor, unsigned int *Pointer_Unsigned_Integer)
 {
 	unsigned char Byte;
 	unsigned int Temporary_Unsigned_Integer = 0;
@@ -211,12 +266,12 @@ static int MMSReadWAPVariableLengthUnsignedInteger(FILE *Pointer_File, unsigned
 	for (i = 0; i < 5; i++)
 	{
 		// Read the next byte
-		if (fread(&Byte, 1, 1, Pointer_File) != 1) return -1;
+		if (MMSCursorReadByte(Pointer_Cursor, &Byte) != 0) return -1;
 
 		// Extract the byte payload
 		Temporary_Unsigned_Integer |= Byte & 0x7F;
 
-		// The number is complete when the but 7 is cleared
+		// The number is complete when the bit 7 is cleared
 		if (!(Byte & 0x80))
 		{
 			*Pointer_Unsigned_Integer = Temporary_Unsigned_Integer;
@@ -231,237 +286,416 @@ static int MMSReadWAPVariableLengthUnsignedInteger(FILE *Pointer_File, unsigned
 	return -1;
 }
 
-/** TODO */
-static int MMSReadWAPIntegerValue(FILE *Pointer_File, int *Pointer_Value)
+/** Read any WSP field value. All WSP values use one of three encodings that can be told apart by their first byte (see WAP-230-WSP-20010705-a chapter 8.4.1.2), so a value can always be skipped even if its meaning is not known.
+ * @param Pointer_Cursor The PDU read position, it is advanced after the value.
+ * @param Pointer_Value On output, contain the value type and a pointer on its data in the PDU.
+ * @return -1 if the value is truncated,
+ * @return 0 on success.
+ */
+static int MMSReadWAPValue(TMMSCursor *Pointer_Cursor, TMMSValue *Pointer_Value)
 {
-	unsigned char Byte;
+	unsigned char Byte, *Pointer_String_End;
+	unsigned int Length;
 
-	// The first byte tells whether this is a Short-integer or a Long-integer data type (see WAP-230-WSP-20010705-a specification chapter 8.4.2.3)
-	if (fread(&Byte, 1, 1, Pointer_File) != 1) return -1;
+	if (MMSCursorReadByte(Pointer_Cursor, &Byte) != 0) return -1;
 
-	// A Short-integer has the most significant bit set and store its data on the 7 remaining bits
-	if (Byte & 0x80) *Pointer_Value = Byte & 0x7F;
-	else
+	// Short-integer
+	if (Byte >= 128)
 	{
-		LOG("TODO\n");
-		return -1;
+		Pointer_Value->Type = MMS_VALUE_TYPE_SHORT_INTEGER;
+		Pointer_Value->Short_Integer = Byte & 0x7F;
+		return 0;
 	}
 
-	LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Integer value : %d.\n", *Pointer_Value);
+	// Text-string, Token-text or Quoted-string (a zero byte is an empty string or the No-value token)
+	if ((Byte >= 32) || (Byte == 0))
+	{
+		if ((Byte != 127) && (Byte != '"')) Pointer_Cursor->Offset--; // The Quote and the quotation mark characters are not part of the string
+		Pointer_Value->Type = MMS_VALUE_TYPE_TEXT;
+		Pointer_Value->Pointer_Data = &Pointer_Cursor->Pointer_Data[Pointer_Cursor->Offset];
+		Pointer_String_End = memchr(Pointer_Value->Pointer_Data, 0, Pointer_Cursor->Size - Pointer_Cursor->Offset);
+		if (Pointer_String_End == NULL)
+		{
+			LOG("Error : unexpected PDU end while reading a string.\n");
+			return -1;
+		}
+		Pointer_Value->Size = Pointer_String_End - Pointer_Value->Pointer_Data;
+		Pointer_Cursor->Offset += Pointer_Value->Size + 1; // Bypass the terminating zero
+		return 0;
+	}
 
+	// Value-length, made of a Short-length or of a Length-quote followed by an uintvar
+	if (Byte < 31) Length = Byte;
+	else if (MMSReadWAPVariableLengthUnsignedInteger(Pointer_Cursor, &Length) != 0)
+	{
+		LOG("Error : could not read the value length.\n");
+		return -1;
+	}
+	Pointer_Value->Type = MMS_VALUE_TYPE_DATA;
+	Pointer_Value->Pointer_Data = MMSCursorReadBytes(Pointer_Cursor, Length);
+	if (Pointer_Value->Pointer_Data == NULL)
+	{
+		LOG("Error : the value length (%u bytes) exceeds the PDU end.\n", Length);
+		return -1;
+	}
+	Pointer_Value->Size = Length;
 	return 0;
 }
 
-/** TODO */
-static int MMSReadWAPValueLength(FILE *Pointer_File, unsigned int *Pointer_Length)
+/** Decode an Integer-value, which is either a Short-integer or a Long-integer (see WAP-230-WSP-20010705-a chapter 8.4.2.3).
+ * @param Pointer_Value The value read by MMSReadWAPValue().
+ * @param Pointer_Integer On output, contain the integer.
+ * @return -1 if the value is not an integer,
+ * @return 0 on success.
+ */
+static int MMSDecodeWAPInteger(TMMSValue *Pointer_Value, unsigned long long *Pointer_Integer)
 {
-	unsigned char Byte;
+	size_t i;
 
-	// First byte is the short length
-	if (fread(&Byte, 1, 1, Pointer_File) != 1) return -1;
-	if (Byte < 31)
+	if (Pointer_Value->Type == MMS_VALUE_TYPE_SHORT_INTEGER)
 	{
-		*Pointer_Length = Byte;
+		*Pointer_Integer = Pointer_Value->Short_Integer;
 		return 0;
 	}
 
-	// The specification does not tell what to do if the value is not 31, returning a length of 0 seems to be fine
-	if (Byte != 31)
+	// A Long-integer is a big endian Multi-octet-integer preceded by its Short-length, larger integers than 64 bits are not used by MMS
+	if ((Pointer_Value->Type != MMS_VALUE_TYPE_DATA) || (Pointer_Value->Size == 0) || (Pointer_Value->Size > sizeof(unsigned long long))) return -1;
+	*Pointer_Integer = 0;
+	for (i = 0; i < Pointer_Value->Size; i++) *Pointer_Integer = (*Pointer_Integer << 8) | Pointer_Value->Pointer_Data[i];
+
+	return 0;
+}
+
+/** Decode an Encoded-string-value (see OMA-TS-MMS_ENC-V1_3 chapter 7.2.9). The string is not converted to UTF-8, as all seen strings are either ASCII or UTF-8.
+ * @param Pointer_Value The value read by MMSReadWAPValue().
+ * @param Pointer_Pointer_String On output, point on the zero-terminated string in the PDU.
+ * @return -1 if the value is not an Encoded-string-value,
+ * @return 0 on success.
+ */
+static int MMSDecodeWAPEncodedString(TMMSValue *Pointer_Value, const char **Pointer_Pointer_String)
+{
+	TMMSCursor Cursor;
+	TMMSValue Value;
+
+	if (Pointer_Value->Type == MMS_VALUE_TYPE_TEXT)
 	{
-		LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Warning: the WAP \"Length-quote\" octet should be 31 here, but it is %d.\n", Byte);
-		*Pointer_Length = 0;
+		*Pointer_Pointer_String = (const char *) Pointer_Value->Pointer_Data;
 		return 0;
 	}
+	if (Pointer_Value->Type != MMS_VALUE_TYPE_DATA) return -1;
 
-	// Get the length stored as uintvar
-	if (MMSReadWAPVariableLengthUnsignedInteger(Pointer_File, Pointer_Length) != 0)
-	{
-		LOG("Error : could not read uintvar.\n");
-		return -1;
-	}
+	// The string is preceded by its character set
+	Cursor.Pointer_Data = Pointer_Value->Pointer_Data;
+	Cursor.Size = Pointer_Value->Size;
+	Cursor.Offset = 0;
+	if (MMSReadWAPValue(&Cursor, &Value) != 0) return -1; // Discard the character set
+	if (MMSReadWAPValue(&Cursor, &Value) != 0) return -1;
+	if (Value.Type != MMS_VALUE_TYPE_TEXT) return -1;
 
+	*Pointer_Pointer_String = (const char *) Value.Pointer_Data;
 	return 0;
 }
 
-/** TODO
- * For now the content type data are discarded.
+/** Convert a media type value to a string.
+ * @param Pointer_Value The value read by MMSReadWAPValue().
+ * @return The media type string, it points either in the PDU or in a constant table.
  */
-static int MMSReadWAPContentType(FILE *Pointer_File, unsigned int *Pointer_Length)
+static const char *MMSDecodeWAPMediaType(TMMSValue *Pointer_Value)
 {
-	unsigned char Byte, Buffer[256];
-
-	// This field is encoded according to WSP protocol, see WAP-230-WSP-20010705-a specification chapter 8.4.2.24
-	if (fread(&Byte, 1, 1, Pointer_File) != 1) // Get the field value as named in chapter 8.4.1.2
+	// See WAP-230-WSP-20010705-a table 40 and the OMA WSP content type codes registry
+	static const char *Pointer_Strings_Well_Known_Media[] =
 	{
-		LOG("Error : could not read the field value byte (%s).\n", strerror(errno));
-		return -1;
-	}
-	LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Content type field value byte : %d.\n", Byte);
+		"*/*", "text/*", "text/html", "text/plain", "text/x-hdml", "text/x-ttml", "text/x-vCalendar", "text/x-vCard",
+		"text/vnd.wap.wml", "text/vnd.wap.wmlscript", "text/vnd.wap.wta-event", "multipart/*", "multipart/mixed", "multipart/form-data", "multipart/byterantes", "multipart/alternative",
+		"application/*", "application/java-vm", "application/x-www-form-urlencoded", "application/x-hdmlc", "application/vnd.wap.wmlc", "application/vnd.wap.wmlscriptc", "application/vnd.wap.wta-eventc", "application/vnd.wap.uaprof",
+		"application/vnd.wap.wtls-ca-certificate", "application/vnd.wap.wtls-user-certificate", "application/x-x509-ca-cert", "application/x-x509-user-cert", "image/*", "image/gif", "image/jpeg", "image/tiff",
+		"image/png", "image/vnd.wap.wbmp", "application/vnd.wap.multipart.*", "application/vnd.wap.multipart.mixed", "application/vnd.wap.multipart.form-data", "application/vnd.wap.multipart.byteranges", "application/vnd.wap.multipart.alternative", "application/xml",
+		"text/xml", "application/vnd.wap.wbxml", "application/x-x968-cross-cert", "application/x-x968-ca-cert", "application/x-x968-user-cert", "text/vnd.wap.si", "application/vnd.wap.sic", "text/vnd.wap.sl",
+		"application/vnd.wap.slc", "text/vnd.wap.co", "application/vnd.wap.coc", "application/vnd.wap.multipart.related", "application/vnd.wap.sia", "text/vnd.wap.connectivity-xml", "application/vnd.wap.connectivity-wbxml", "application/pkcs7-mime",
+		"application/vnd.wap.hashed-certificate", "application/vnd.wap.signed-certificate", "application/vnd.wap.cert-response", "application/xhtml+xml", "application/wml+xml", "text/css", "application/vnd.wap.mms-message", "application/vnd.wap.rollover-certificate",
+		"application/vnd.wap.locc+wbxml", "application/vnd.wap.loc+xml", "application/vnd.syncml.dm+wbxml", "application/vnd.syncml.dm+xml", "application/vnd.syncml.notification", "application/vnd.wap.xhtml+xml", "application/vnd.wv.csp.cir", "application/vnd.oma.dd+xml",
+		"application/vnd.oma.drm.message", "application/vnd.oma.drm.content", "application/vnd.oma.drm.rights+xml", "application/vnd.oma.drm.rights+wbxml"
+	};
+	unsigned long long Media_Code;
+
+	if (Pointer_Value->Type == MMS_VALUE_TYPE_TEXT) return (const char *) Pointer_Value->Pointer_Data;
 
-	if (Byte < 32)
+	if ((MMSDecodeWAPInteger(Pointer_Value, &Media_Code) == 0) && (Media_Code < UTILITY_ARRAY_SIZE(Pointer_Strings_Well_Known_Media))) return Pointer_Strings_Well_Known_Media[Media_Code];
+
+	LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Unknown well-known media value.\n");
+	return "application/octet-stream";
+}
+
+/** Decode all parameters of a content type or of a content disposition (see WAP-230-WSP-20010705-a chapter 8.4.2.4). Only the parameters describing the part are kept, the other ones are skipped.
+ * @param Pointer_Cursor The parameters read position, its size must end with the last parameter.
+ * @param Pointer_Part On output, the character set and the name are filled if they are present.
+ * @return -1 if a parameter is invalid,
+ * @return 0 on success.
+ */
+static int MMSDecodeWAPParameters(TMMSCursor *Pointer_Cursor, TMMSPart *Pointer_Part)
+{
+	TMMSValue Parameter, Value;
+	unsigned long long Integer;
+	unsigned int Q_Value;
+
+	while (Pointer_Cursor->Offset < Pointer_Cursor->Size)
 	{
-		// The field value is part of the value length data, so go back one byte to allow MMSReadWAPValueLength() to read the correct data
-		if (fseek(Pointer_File, -1, SEEK_CUR) != 0)
-		{
-			LOG("Error : could not set file position (%s).\n", strerror(errno));
-			return -1;
-		}
+		if (MMSReadWAPValue(Pointer_Cursor, &Parameter) != 0) return -1;
 
-		// Get the media type field length
-		if (MMSReadWAPValueLength(Pointer_File, Pointer_Length) != 0)
+		// Typed-parameter, identified by a well-known parameter token (see WAP-230-WSP-20010705-a table 38)
+		if (Parameter.Type == MMS_VALUE_TYPE_SHORT_INTEGER)
 		{
-			LOG("Error : could not read media type field length.\n");
-			return -1;
-		}
-		LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Content type length : %u bytes.\n", *Pointer_Length);
+			// The Q-value is an uintvar, which can't be read as a regular value
+			if (Parameter.Short_Integer == 0x00)
+			{
+				if (MMSReadWAPVariableLengthUnsignedInteger(Pointer_Cursor, &Q_Value) != 0) return -1;
+				continue;
+			}
 
-		// Read the data if any and discard it for now
-		if (*Pointer_Length > 0)
-		{
-			// Make sure there is enough place in the destination buffer
-			if (*Pointer_Length > sizeof(Buffer))
+			if (MMSReadWAPValue(Pointer_Cursor, &Value) != 0) return -1;
+			switch (Parameter.Short_Integer)
 			{
-				LOG("Error : the content type length is too big (%u bytes).\n", *Pointer_Length);
-				return -1;
+				// Charset
+				case 0x01:
+					if (MMSDecodeWAPInteger(&Value, &Integer) == 0) Pointer_Part->Charset = (unsigned int) Integer;
+					break;
+
+				// Name and Filename, the deprecated and the current encodings
+				case 0x05:
+				case 0x06:
+				case 0x17:
+				case 0x18:
+					if ((Value.Type == MMS_VALUE_TYPE_TEXT) && (Value.Size > 0)) Pointer_Part->Pointer_String_Name = (const char *) Value.Pointer_Data;
+					break;
+
+				default:
+					LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Skipping the parameter 0x%02X.\n", Parameter.Short_Integer);
+					break;
 			}
-			if (fread(Buffer, *Pointer_Length, 1, Pointer_File) != 1) return -1;
 		}
-	}
-	else if (Byte < 128)
-	{
-		if (MMSReadStringField(Pointer_File, (char *) Buffer, sizeof(Buffer)) != 0) return -1;
-		*Pointer_Length = strlen((char *) Buffer);
-		LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Content type length : %u bytes, Content type string : \"%s\"\n", *Pointer_Length, (char *) Buffer);
-	}
-	else
-	{
-		if (fread(&Byte, 1, 1, Pointer_File) != 1)
+		// Untyped-parameter, made of the parameter name and of its value
+		else if (Parameter.Type == MMS_VALUE_TYPE_TEXT)
+		{
+			if (MMSReadWAPValue(Pointer_Cursor, &Value) != 0) return -1;
+			if (((strcasecmp((char *) Parameter.Pointer_Data, "name") == 0) || (strcasecmp((char *) Parameter.Pointer_Data, "filename") == 0)) && (Value.Type == MMS_VALUE_TYPE_TEXT) && (Value.Size > 0)) Pointer_Part->Pointer_String_Name = (const char *) Value.Pointer_Data;
+		}
+		else
 		{
-			LOG("Error : could not read the well known media value (%s).\n", strerror(errno));
+			LOG("Error : invalid content type parameter.\n");
 			return -1;
 		}
-		LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Well known media value : %d.\n", Byte);
 	}
 
 	return 0;
 }
 
-/** TODO
- * @note This function assumes for now that only Application/vnd.wap.multipart.* are found in messages.
- * @note See WAP-230-WSP-20010705-a chapter 8.5 for more information about headers.
+/** Decode a Content-type-value (see WAP-230-WSP-20010705-a chapter 8.4.2.24).
+ * @param Pointer_Value The value read by MMSReadWAPValue().
+ * @param Pointer_Part On output, the content type, the character set and the name are filled.
+ * @return -1 if the content type is invalid,
+ * @return 0 on success.
  */
-int MMSExtractAttachedFile(FILE *Pointer_File, char *Pointer_String_Output_Directory_Path)
+static int MMSDecodeWAPContentType(TMMSValue *Pointer_Value, TMMSPart *Pointer_Part)
 {
-	static unsigned char Buffer[4096]; // This buffer is too big to be stored on stack
-	unsigned int Headers_Length, Data_Length, Length, i;
-	char String_File_Name[256], String_Temporary[512];
-	FILE *Pointer_File_Output = NULL;
-	int Return_Value = -1;
-	size_t Chunk_Size;
-	long Position_Before_Content_Type, Position_After_Content_Type;
-
-	// Retrieve header length (this the length of the headers + the length of the data)
-	if (MMSReadWAPVariableLengthUnsignedInteger(Pointer_File, &Headers_Length) != 0)
-	{
-		LOG("Error : could not read headers length.\n");
-		return -1;
-	}
-	LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Headers + content type length : %u.\n", Headers_Length);
+	TMMSCursor Cursor;
+	TMMSValue Media_Value;
 
-	// Extract attached file length
-	if (MMSReadWAPVariableLengthUnsignedInteger(Pointer_File, &Data_Length) != 0)
+	// Constrained-media, there is no parameter
+	if (Pointer_Value->Type != MMS_VALUE_TYPE_DATA)
 	{
-		LOG("Error : could not read data length.\n");
-		return -1;
+		Pointer_Part->Pointer_String_Content_Type = MMSDecodeWAPMediaType(Pointer_Value);
+		return 0;
 	}
-	LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Data length : %u.\n", Data_Length);
 
-	// Keep the file position before reading the content type, so the total amount of read bytes for the content type can be determined
-	Position_Before_Content_Type = ftell(Pointer_File);
-	if (Position_Before_Content_Type < 0)
-	{
-		LOG("Error : could not get the file position before reading the content type field (%s).\n", strerror(errno));
-		return -1;
-	}
-	// Extract content type
-	if (MMSReadWAPContentType(Pointer_File, &Length) != 0)
+	// Content-general-form, the media type is followed by parameters
+	Cursor.Pointer_Data = Pointer_Value->Pointer_Data;
+	Cursor.Size = Pointer_Value->Size;
+	Cursor.Offset = 0;
+	if (MMSReadWAPValue(&Cursor, &Media_Value) != 0) return -1;
+	Pointer_Part->Pointer_String_Content_Type = MMSDecodeWAPMediaType(&Media_Value);
+
+	return MMSDecodeWAPParameters(&Cursor, Pointer_Part);
+}
+
+/** Decode the headers of a multipart entry (see WAP-230-WSP-20010705-a chapter 8.4.2.6 and table 39). Unknown headers are skipped.
+ * @param Pointer_Cursor The headers read position, its size must end with the last header.
+ * @param Pointer_Part On output, the Content-ID, the Content-Location and the disposition name are filled if they are present.
+ * @return -1 if a header is invalid,
+ * @return 0 on success.
+ */
+static int MMSDecodePartHeaders(TMMSCursor *Pointer_Cursor, TMMSPart *Pointer_Part)
+{
+	TMMSCursor Cursor;
+	TMMSValue Name, Value;
+	unsigned char Byte;
+
+	while (Pointer_Cursor->Offset < Pointer_Cursor->Size)
 	{
-		LOG("Error : could not read content type.\n");
-		return -1;
+		if (MMSCursorReadByte(Pointer_Cursor, &Byte) != 0) return -1;
+
+		// Well-known-header, the field name is encoded on the 7 lower bits
+		if (Byte >= 128)
+		{
+			if (MMSReadWAPValue(Pointer_Cursor, &Value) != 0) return -1;
+			switch (Byte & 0x7F)
+			{
+				// Content-Location
+				case 0x0E:
+					if (Value.Type == MMS_VALUE_TYPE_TEXT) Pointer_Part->Pointer_String_Content_Location = (const char *) Value.Pointer_Data;
+					break;
+
+				// Content-Disposition, the deprecated and the current encodings
+				case 0x2E:
+				case 0x45:
+					if (Value.Type != MMS_VALUE_TYPE_DATA) break;
+					Cursor.Pointer_Data = Value.Pointer_Data;
+					Cursor.Size = Value.Size;
+					Cursor.Offset = 0;
+					if (MMSReadWAPValue(&Cursor, &Value) != 0) return -1; // Discard the disposition type ("form-data", "attachment" or "inline")
+					if (MMSDecodeWAPParameters(&Cursor, Pointer_Part) != 0) return -1;
+					break;
+
+				// Content-ID
+				case 0x40:
+					if (Value.Type == MMS_VALUE_TYPE_TEXT) Pointer_Part->Pointer_String_Content_ID = (const char *) Value.Pointer_Data;
+					break;
+
+				default:
+					LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Skipping the part header 0x%02X.\n", Byte & 0x7F);
+					break;
+			}
+		}
+		// Shift-delimiter followed by the code page, or Short-cut-shift-delimiter, only the default code page is used by MMS
+		else if (Byte == 127)
+		{
+			if (MMSCursorReadByte(Pointer_Cursor, &Byte) != 0) return -1;
+		}
+		else if (Byte < 32) continue;
+		// Application-header, both the field name and the value are strings
+		else
+		{
+			Pointer_Cursor->Offset--;
+			if (MMSReadWAPValue(Pointer_Cursor, &Name) != 0) return -1;
+			if (MMSReadWAPValue(Pointer_Cursor, &Value) != 0) return -1;
+			if ((Name.Type != MMS_VALUE_TYPE_TEXT) || (Value.Type != MMS_VALUE_TYPE_TEXT)) continue;
+
+			if (strcasecmp((char *) Name.Pointer_Data, "Content-ID") == 0) Pointer_Part->Pointer_String_Content_ID = (const char *) Value.Pointer_Data;
+			else if (strcasecmp((char *) Name.Pointer_Data, "Content-Location") == 0) Pointer_Part->Pointer_String_Content_Location = (const char *) Value.Pointer_Data;
+		}
 	}
-	// Get the file position after reading the content type
-	Position_After_Content_Type = ftell(Pointer_File);
-	if (Position_After_Content_Type < 0)
+
+	return 0;
+}
+
+/** Decode a multipart entry (see WAP-230-WSP-20010705-a chapter 8.5.3).
+ * @param Pointer_Cursor The PDU read position, it is advanced after the entry.
+ * @param Pointer_Part On output, contain the entry information and content.
+ * @return -1 if the entry is truncated, the following entries can't be found in this case,
+ * @return 0 on success.
+ */
+static int MMSDecodePart(TMMSCursor *Pointer_Cursor, TMMSPart *Pointer_Part)
+{
+	unsigned int Headers_Length, Data_Length;
+	size_t Content_Type_Length;
+	TMMSCursor Headers_Cursor;
+	TMMSValue Value;
+
+	memset(Pointer_Part, 0, sizeof(TMMSPart));
+
+	// Retrieve the length of the content type + the headers, then the length of the data
+	if ((MMSReadWAPVariableLengthUnsignedInteger(Pointer_Cursor, &Headers_Length) != 0) || (MMSReadWAPVariableLengthUnsignedInteger(Pointer_Cursor, &Data_Length) != 0))
 	{
-		LOG("Error : could not get the file position after reading the content type field (%s).\n", strerror(errno));
+		LOG("Error : could not read the entry lengths.\n");
 		return -1;
 	}
+	LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Headers + content type length : %u, data length : %u.\n", Headers_Length, Data_Length);
 
-	// Extract headers
-	Length = Headers_Length - (Position_After_Content_Type - Position_Before_Content_Type);
-	LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Computed headers length : %u.\n", Length);
-	if (Length > sizeof(Buffer))
+	// Access the content type and headers
+	Headers_Cursor.Pointer_Data = MMSCursorReadBytes(Pointer_Cursor, Headers_Length);
+	if (Headers_Cursor.Pointer_Data == NULL)
 	{
-		LOG("Error : the headers are too big to fit in the buffer (length : %u).\n", Length);
+		LOG("Error : the entry headers are truncated (length : %u).\n", Headers_Length);
 		return -1;
 	}
-	if (fread(Buffer, Length, 1, Pointer_File) != 1)
+	Headers_Cursor.Size = Headers_Length;
+	Headers_Cursor.Offset = 0;
+
+	// Access the data
+	Pointer_Part->Pointer_Data = MMSCursorReadBytes(Pointer_Cursor, Data_Length);
+	if (Pointer_Part->Pointer_Data == NULL)
 	{
-		LOG("Error : could not read headers.\n");
+		LOG("Error : the entry data is truncated (%u bytes are expected).\n", Data_Length);
 		return -1;
 	}
+	Pointer_Part->Data_Size = Data_Length;
 
-	// Search for a specific tag that precedes the file name TODO better when the headers specs is found
-	for (i = 0; i < Length; i++)
+	// The data can still be extracted when the headers are invalid, so do not consider this as an error
+	if ((MMSReadWAPValue(&Headers_Cursor, &Value) != 0) || (MMSDecodeWAPContentType(&Value, Pointer_Part) != 0))
 	{
-		if (Buffer[i] == 0x8E)
-		{
-			i++; // Bypass the tag byte
-			break;
-		}
+		LOG("Warning : could not decode the entry content type.\n");
+		return 0;
 	}
-	if (i == Length)
+	Content_Type_Length = Headers_Cursor.Offset;
+	if (MMSDecodePartHeaders(&Headers_Cursor, Pointer_Part) != 0) LOG("Warning : could not decode the entry headers.\n");
+	LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Content type : \"%s\" (%zu bytes), charset : %u, name : \"%s\", Content-ID : \"%s\", Content-Location : \"%s\".\n", Pointer_Part->Pointer_String_Content_Type, Content_Type_Length, Pointer_Part->Charset,
+		Pointer_Part->Pointer_String_Name == NULL ? "" : Pointer_Part->Pointer_String_Name,
+		Pointer_Part->Pointer_String_Content_ID == NULL ? "" : Pointer_Part->Pointer_String_Content_ID,
+		Pointer_Part->Pointer_String_Content_Location == NULL ? "" : Pointer_Part->Pointer_String_Content_Location);
+	(void) Content_Type_Length; // Avoid a warning when the debug logs are disabled
+
+	return 0;
+}
+
+/** Write a part content to a file. The file name is the part name, the Content-Location or the Content-ID, whichever is found first.
+ * @param Pointer_Part The part to write.
+ * @param Pointer_String_Output_Directory_Path The directory to create the file in.
+ * @param Part_Index The part number, used to name the file when the part has no name.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int MMSWritePart(TMMSPart *Pointer_Part, char *Pointer_String_Output_Directory_Path, int Part_Index)
+{
+	char String_File_Name[256], String_Temporary[512], *Pointer_String_Character;
+	const char *Pointer_String_Name;
+	FILE *Pointer_File;
+	int Return_Value = 0;
+
+	// Choose the best available name
+	if (Pointer_Part->Pointer_String_Name != NULL) Pointer_String_Name = Pointer_Part->Pointer_String_Name;
+	else if (Pointer_Part->Pointer_String_Content_Location != NULL) Pointer_String_Name = Pointer_Part->Pointer_String_Content_Location;
+	else if (Pointer_Part->Pointer_String_Content_ID != NULL) Pointer_String_Name = Pointer_Part->Pointer_String_Content_ID;
+	else Pointer_String_Name = "";
+	if (*Pointer_String_Name == '<') Pointer_String_Name++; // A Content-ID is usually enclosed in angle brackets
+	snprintf(String_File_Name, sizeof(String_File_Name), "%s", Pointer_String_Name);
+	Pointer_String_Character = strchr(String_File_Name, '>');
+	if (Pointer_String_Character != NULL) *Pointer_String_Character = 0;
+
+	// Do not allow the name to reference another directory
+	for (Pointer_String_Character = String_File_Name; *Pointer_String_Character != 0; Pointer_String_Character++)
 	{
-		LOG("Error : no file name could be found.\n");
-		return -1;
+		if ((*Pointer_String_Character == '/') || (*Pointer_String_Character == '\\')) *Pointer_String_Character = '_';
 	}
-	// Adjust length to the file name string length
-	Length -= i;
-	// Get file name
-	strncpy(String_File_Name, (char *) &Buffer[i], Length - 1); // Make room for the terminating zero
-	String_File_Name[Length - 1] = 0; // Make sure string is terminated
+	if ((String_File_Name[0] == 0) || (strcmp(String_File_Name, ".") == 0) || (strcmp(String_File_Name, "..") == 0)) snprintf(String_File_Name, sizeof(String_File_Name), "Part_%d", Part_Index);
 	LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Attached file name : \"%s\".\n", String_File_Name);
 
 	// Try to create the output file
 	snprintf(String_Temporary, sizeof(String_Temporary), "%s/%s", Pointer_String_Output_Directory_Path, String_File_Name);
 	LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Attached file output path : \"%s\".\n", String_Temporary);
-	Pointer_File_Output = fopen(String_Temporary, "w");
-	if (Pointer_File_Output == NULL)
+	Pointer_File = fopen(String_Temporary, "w");
+	if (Pointer_File == NULL)
 	{
-		LOG("Error : failed to create the attached file \"%s\".\n", String_Temporary);
+		LOG("Error : failed to create the attached file \"%s\" (%s).\n", String_Temporary, strerror(errno));
 		return -1;
 	}
 
-	// Copy the attached file content to the output file
-	while (Data_Length > 0)
+	// Write the attached file content straight from the PDU
+	if ((Pointer_Part->Data_Size > 0) && (fwrite(Pointer_Part->Pointer_Data, Pointer_Part->Data_Size, 1, Pointer_File) != 1))
 	{
-		// Read no more bytes than the buffer size, but when the attached file end has been reached
-		if (Data_Length >= sizeof(Buffer)) Chunk_Size = sizeof(Buffer);
-		else Chunk_Size = Data_Length;
-
-		// Copy a chunk of data
-		if (fread(Buffer, Chunk_Size, 1, Pointer_File) != 1) goto Exit;
-		if (fwrite(Buffer, Chunk_Size, 1, Pointer_File_Output) != 1) goto Exit;
-
-		// Prepare for next chunk
-		Data_Length -= Chunk_Size;
+		LOG("Error : failed to write the attached file \"%s\" (%s).\n", String_Temporary, strerror(errno));
+		Return_Value = -1;
 	}
 
-	// Everything went fine
-	Return_Value = 0;
-
-Exit:
-	if (Pointer_File_Output != NULL) fclose(Pointer_File_Output);
+	if (fclose(Pointer_File) != 0) Return_Value = -1;
 	return Return_Value;
 }
 
@@ -491,529 +725,265 @@ static void MMSFormatPhoneNumber(char *Pointer_String_Phone_Number)
 	}
 }
 
-/** Parse all fields of a MMS PDU and extract all attached files.
- * @param Pointer_String_Raw_MMS_File_Path The absolute file name of the MMS PDU.
- * @param Pointer_String_Output_Directory_Path Create this output directory and store all extracted message content to it.
- * @return -1 if an error occurred,
- * @return 0 on success.
- */
-static int MMSProcessMessage(char *Pointer_String_Raw_MMS_File_Path, char *Pointer_String_Output_Directory_Path)
+/** Store the X-Mms-Message-Type header field. */
+static int MMSDecodeMessageTypeField(TMMSValue *Pointer_Value, TMMSMessageHeaders *Pointer_Headers)
 {
-	FILE *Pointer_File = NULL;
-	unsigned char Byte, Buffer[256]; // A field size is stored on one byte, with 256 bytes even an invalid size can't overflow the buffer
-	size_t Read_Bytes_Count;
-	char String_Temporary[256], String_Sender_Phone_Number[32];
-	int Return_Value = -1, *Pointer_Integer, i, Attached_Files_Count, Integer;
-	struct tm *Pointer_Broken_Down_Time;
-	time_t Unix_Timestamp;
-	unsigned int Length;
-	TMMSMessageType Message_Type;
-
-	// Try to open the file
-	Pointer_File = fopen(Pointer_String_Raw_MMS_File_Path, "r");
-	if (Pointer_File == NULL)
-	{
-		LOG("Error : failed to open the MMS file \"%s\" (%s).\n", Pointer_String_Raw_MMS_File_Path, strerror(errno));
-		return -1;
-	}
-
-	// Extract some useful data from the header
-	while (1)
-	{
-		// Retrieve next byte
-		Read_Bytes_Count = fread(&Byte, 1, 1, Pointer_File);
-		if (Read_Bytes_Count == 0) break; // Exit when the end of the file is reached
-		if (Read_Bytes_Count != 1)
-		{
-			LOG("Error : failed to read the MMS file \"%s\" (%s).\n", Pointer_String_Raw_MMS_File_Path, strerror(errno));
-			break;
-		}
-
-		// This byte should be a field ID (the values come from the )
-		Byte &= 0x7F; // Field IDs use only the last 7 bits
-		switch (Byte)
-		{
-			// Bcc
-			case 0x01:
-				if (MMSReadStringField(Pointer_File, String_Temporary, sizeof(String_Temporary)) != 0) goto Exit;
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Bcc record : \"%s\".\n", String_Temporary);
-				break;
-
-			// Cc
-			case 0x02:
-				if (MMSReadStringField(Pointer_File, String_Temporary, sizeof(String_Temporary)) != 0) goto Exit;
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Cc record : \"%s\".\n", String_Temporary);
-				break;
-
-			// Content location
-			case 0x03:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Content location record.\n");
-				// TODO
-				goto Exit;
-
-			// Content type
-			case 0x04:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Content type record.\n");
-				if (MMSReadWAPContentType(Pointer_File, &Length) != 0)
-				{
-					LOG("Error : failed to read content type.\n");
-					goto Exit;
-				}
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Content type length : %u bytes.\n", Length);
-				goto Parse_Attached_Files;
-
-			// Date
-			case 0x05:
-				// Get the field size
-				if (fread(&Byte, 1, 1, Pointer_File) != 1) goto Exit;
-				// Get the date data
-				if (fread(Buffer, Byte, 1, Pointer_File) != 1) goto Exit;
-				// Date is a classic Unix timestamp stored in big endian
-				Pointer_Integer = (int *) Buffer;
-				Unix_Timestamp = (time_t) ntohl(*Pointer_Integer);
-				Pointer_Broken_Down_Time = gmtime(&Unix_Timestamp);
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Date record : %04d-%02d-%02d %02d:%02d:%02d.\n",
-					Pointer_Broken_Down_Time->tm_year + 1900,
-					Pointer_Broken_Down_Time->tm_mon + 1,
-					Pointer_Broken_Down_Time->tm_wday + 1,
-					Pointer_Broken_Down_Time->tm_hour,
-					Pointer_Broken_Down_Time->tm_min,
-					Pointer_Broken_Down_Time->tm_sec);
-				break;
-
-			// Delivery report
-			case 0x06:
-				if (fread(&Byte, 1, 1, Pointer_File) != 1) goto Exit;
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Delivery report record : %d.\n", Byte);
-				break;
-
-			// Delivery time
-			case 0x07:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Delivery time record.\n");
-				// TODO
-				goto Exit;
-
-			// Expiry
-			case 0x08:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Expiry record.\n");
-				// TODO
-				goto Exit;
-
-			// From
-			case 0x09:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found From record.\n");
-				// Get Value-length field
-				if (MMSReadWAPValueLength(Pointer_File, &Length) != 0) goto Exit;
-				if (Length >= sizeof(String_Temporary))
-				{
-					LOG("Error : the From address size is too big.\n");
-					goto Exit;
-				}
-				// Next byte can be Address-present-token (in this case the address is provided), or Insert-address-token (no address is provided)
-				if (fread(&Byte, 1, 1, Pointer_File) != 1) goto Exit;
-				if (Byte == 128)
-				{
-					if (MMSReadStringField(Pointer_File, String_Sender_Phone_Number, sizeof(String_Sender_Phone_Number)) != 0) goto Exit;
-					MMSFormatPhoneNumber(String_Sender_Phone_Number);
-					LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Phone number is provided in From record : \"%s\".\n", String_Sender_Phone_Number);
-				}
-				else
-				{
-					strcpy(String_Sender_Phone_Number, "No_Number");
-					LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "The From record does not contain a phone number.\n");
-				}
-				break;
+	if (Pointer_Value->Type != MMS_VALUE_TYPE_SHORT_INTEGER) return -1;
 
-			// Message class
-			case 0x0A:
-				if (fread(&Byte, 1, 1, Pointer_File) != 1) goto Exit;
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Message class record : %d.\n", Byte);
-				break;
-
-			// Message ID
-			case 0x0B:
-				if (MMSReadStringField(Pointer_File, String_Temporary, sizeof(String_Temporary)) != 0) goto Exit;
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Message ID record : \"%s\".\n", String_Temporary);
-				break;
-
-			// Message type
-			case 0x0C:
-				if (fread(&Byte, 1, 1, Pointer_File) != 1) goto Exit;
-				Message_Type = Byte;
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Message type record : %d.\n", Byte);
-				break;
-
-			// MMS version
-			case 0x0D:
-				if (fread(&Byte, 1, 1, Pointer_File) != 1) goto Exit;
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found MMS version record : %d.\n", Byte);
-				break;
-
-			// Message size
-			case 0x0E:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Message size record.\n");
-				// TODO
-				goto Exit;
-
-			// Priority
-			case 0x0F:
-				if (fread(&Byte, 1, 1, Pointer_File) != 1) goto Exit;
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Priority record : %d.\n", Byte);
-				break;
-
-			// Read report
-			case 0x10:
-				if (fread(&Byte, 1, 1, Pointer_File) != 1) goto Exit;
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Read report record : %d.\n", Byte);
-				break;
-
-			// Report allowed
-			case 0x11:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Report allowed record.\n");
-				// TODO
-				goto Exit;
-
-			// Response status
-			case 0x12:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Response status record.\n");
-				// TODO
-				goto Exit;
-
-			// Response text
-			case 0x13:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Response text record.\n");
-				// TODO
-				goto Exit;
-
-			// Sender visibility
-			case 0x14:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Sender visibility record.\n");
-				// TODO
-				goto Exit;
-
-			// Status
-			case 0x15:
-				if (fread(&Byte, 1, 1, Pointer_File) != 1) goto Exit;
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Status record : %d.\n", Byte);
-				break;
-
-			// Subject
-			case 0x16:
-				if (MMSReadStringField(Pointer_File, String_Temporary, sizeof(String_Temporary)) != 0) goto Exit;
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Subject record : \"%s\".\n", String_Temporary);
-				break;
-
-			// To
-			case 0x17:
-				if (MMSReadStringField(Pointer_File, String_Temporary, sizeof(String_Temporary)) != 0) goto Exit;
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found To record : \"%s\".\n", String_Temporary);
-				break;
-
-			// Transaction ID
-			case 0x18:
-				if (MMSReadStringField(Pointer_File, String_Temporary, sizeof(String_Temporary)) != 0) goto Exit;
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Transaction ID record : \"%s\".\n", String_Temporary);
-				break;
-
-			// Retrieve status
-			case 0x19:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Retrieve status record.\n");
-				// TODO
-				goto Exit;
-
-			// Retrieve text
-			case 0x1A:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Retrieve text record.\n");
-				// TODO
-				goto Exit;
-
-			// Read status
-			case 0x1B:
-				if (fread(&Byte, 1, 1, Pointer_File) != 1) goto Exit;
-				if ((Byte < 128) || (Byte > 129))
-				{
-					LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found invalid Read status record : %d.\n", Byte);
-					goto Exit;
-				}
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Read status record : %s.\n", Byte == 128 ? "message has been read" : "message has been deleted without being read");
-				break;
-
-			// Reply charging
-			case 0x1C:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Reply charging record.\n");
-				// TODO
-				break;
-
-			// Reply charging deadline
-			case 0x1D:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Reply charging deadline record.\n");
-				// TODO
-				goto Exit;
-
-			// Reply charging ID
-			case 0x1E:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Reply charging ID record.\n");
-				// TODO
-				goto Exit;
-
-			// Reply charging size
-			case 0x1F:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Reply charging size record.\n");
-				// TODO
-				goto Exit;
-
-			// Previously sent by
-			case 0x20:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Previously sent by record.\n");
-				// TODO
-				goto Exit;
-
-			// Previously sent date
-			case 0x21:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Previously sent date record.\n");
-				// TODO
-				goto Exit;
-
-			// Store
-			case 0x22:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Store record.\n");
-				// TODO
-				goto Exit;
-
-			// MM state
-			case 0x23:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found MM state record.\n");
-				// TODO
-				goto Exit;
-
-			// MM flags
-			case 0x24:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found MM flags record.\n");
-				// TODO
-				goto Exit;
-
-			// Store status
-			case 0x25:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Store status record.\n");
-				// TODO
-				goto Exit;
-
-			// Store status text
-			case 0x26:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Store status text record.\n");
-				// TODO
-				goto Exit;
-
-			// Stored
-			case 0x27:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Stored record.\n");
-				// TODO
-				goto Exit;
-
-			// Attributes
-			case 0x28:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Attributes record.\n");
-				// TODO
-				goto Exit;
-
-			// Totals
-			case 0x29:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Totals record.\n");
-				// TODO
-				goto Exit;
-
-			// Mbox totals
-			case 0x2A:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Mbox totals record.\n");
-				// TODO
-				goto Exit;
-
-			// Quotas
-			case 0x2B:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Quotas record.\n");
-				// TODO
-				goto Exit;
-
-			// Mbox quotas
-			case 0x2C:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Mbox quotas record.\n");
-				// TODO
-				goto Exit;
-
-			// Message count
-			case 0x2D:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Message count record.\n");
-				// TODO
-				goto Exit;
-
-			// Content
-			case 0x2E:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Content record.\n");
-				// TODO
-				goto Exit;
-
-			// Start
-			case 0x2F:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Start record.\n");
-				// TODO
-				goto Exit;
-
-			// Additional headers
-			case 0x30:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Additional headers record.\n");
-				// TODO
-				goto Exit;
-
-			// Distribution indicator
-			case 0x31:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Distribution indicator record.\n");
-				// TODO
-				goto Exit;
+	Pointer_Headers->Message_Type = Pointer_Value->Short_Integer | 0x80;
+	return 0;
+}
 
-			// Element descriptor
-			case 0x32:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Element descriptor record.\n");
-				// TODO
-				goto Exit;
+/** Store the Date header field, it is a Long-integer containing a Unix timestamp. */
+static int MMSDecodeDateField(TMMSValue *Pointer_Value, TMMSMessageHeaders *Pointer_Headers)
+{
+	unsigned long long Integer;
 
-			// Limit
-			case 0x33:
-				if (MMSReadWAPIntegerValue(Pointer_File, &Integer) != 0) goto Exit;
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Limit record : %d.\n", Integer);
-				// TODO
-				break;
+	if (MMSDecodeWAPInteger(Pointer_Value, &Integer) != 0) return -1;
 
-			// Recommended retrieval mode
-			case 0x34:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Recommended retrieval mode record.\n");
-				// TODO
-				goto Exit;
+	Pointer_Headers->Date = (time_t) Integer;
+	return 0;
+}
 
-			// Recommended retrieval mode text
-			case 0x35:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Recommended retrieval mode text record.\n");
-				// TODO
-				goto Exit;
+/** Store the From header field, which tells whether an address is provided (Address-present-token) or not (Insert-address-token). */
+static int MMSDecodeFromField(TMMSValue *Pointer_Value, TMMSMessageHeaders *Pointer_Headers)
+{
+	TMMSCursor Cursor;
+	TMMSValue Value;
+	const char *Pointer_String_Address;
 
-			// Status text
-			case 0x36:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Status text record.\n");
-				// TODO
-				goto Exit;
+	if ((Pointer_Value->Type != MMS_VALUE_TYPE_DATA) || (Pointer_Value->Size == 0)) return -1;
+	if (Pointer_Value->Pointer_Data[0] != 128) return 0; // Keep the default value
 
-			// Applic ID
-			case 0x37:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Applic ID record.\n");
-				// TODO
-				goto Exit;
+	Cursor.Pointer_Data = Pointer_Value->Pointer_Data;
+	Cursor.Size = Pointer_Value->Size;
+	Cursor.Offset = 1; // Bypass the Address-present-token
+	if (MMSReadWAPValue(&Cursor, &Value) != 0) return -1;
+	if (MMSDecodeWAPEncodedString(&Value, &Pointer_String_Address) != 0) return -1;
 
-			// Reply applic ID
-			case 0x38:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Reply applic ID record.\n");
-				// TODO
-				goto Exit;
+	snprintf(Pointer_Headers->String_Sender_Phone_Number, sizeof(Pointer_Headers->String_Sender_Phone_Number), "%s", Pointer_String_Address);
+	MMSFormatPhoneNumber(Pointer_Headers->String_Sender_Phone_Number);
+	return 0;
+}
 
-			// Aux applic info
-			case 0x39:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Aux applic info record.\n");
-				// TODO
-				goto Exit;
+/** Decode the message header fields, until the Content-Type field which is always the last one (see OMA-TS-MMS_ENC-V1_3 chapter 6). The fields that are not needed are skipped, whatever their content is.
+ * @param Pointer_Cursor The PDU read position, on output it is located at the message body beginning.
+ * @param Pointer_Headers On output, contain the decoded fields.
+ * @return -1 if the headers are invalid,
+ * @return 0 on success.
+ */
+static int MMSDecodeMessageHeaders(TMMSCursor *Pointer_Cursor, TMMSMessageHeaders *Pointer_Headers)
+{
+	// Indexed by the field code (see OMA-TS-MMS_ENC-V1_3 table 12)
+	static TMMSHeaderField Header_Fields[] =
+	{
+		[0x01] = { "Bcc", NULL },
+		[0x02] = { "Cc", NULL },
+		[0x03] = { "Content location", NULL },
+		[0x04] = { "Content type", NULL }, // Handled separately because it ends the headers
+		[0x05] = { "Date", MMSDecodeDateField },
+		[0x06] = { "Delivery report", NULL },
+		[0x07] = { "Delivery time", NULL },
+		[0x08] = { "Expiry", NULL },
+		[0x09] = { "From", MMSDecodeFromField },
+		[0x0A] = { "Message class", NULL },
+		[0x0B] = { "Message ID", NULL },
+		[0x0C] = { "Message type", MMSDecodeMessageTypeField },
+		[0x0D] = { "MMS version", NULL },
+		[0x0E] = { "Message size", NULL },
+		[0x0F] = { "Priority", NULL },
+		[0x10] = { "Read report", NULL },
+		[0x11] = { "Report allowed", NULL },
+		[0x12] = { "Response status", NULL },
+		[0x13] = { "Response text", NULL },
+		[0x14] = { "Sender visibility", NULL },
+		[0x15] = { "Status", NULL },
+		[0x16] = { "Subject", NULL },
+		[0x17] = { "To", NULL },
+		[0x18] = { "Transaction ID", NULL },
+		[0x19] = { "Retrieve status", NULL },
+		[0x1A] = { "Retrieve text", NULL },
+		[0x1B] = { "Read status", NULL },
+		[0x1C] = { "Reply charging", NULL },
+		[0x1D] = { "Reply charging deadline", NULL },
+		[0x1E] = { "Reply charging ID", NULL },
+		[0x1F] = { "Reply charging size", NULL },
+		[0x20] = { "Previously sent by", NULL },
+		[0x21] = { "Previously sent date", NULL },
+		[0x22] = { "Store", NULL },
+		[0x23] = { "MM state", NULL },
+		[0x24] = { "MM flags", NULL },
+		[0x25] = { "Store status", NULL },
+		[0x26] = { "Store status text", NULL },
+		[0x27] = { "Stored", NULL },
+		[0x28] = { "Attributes", NULL },
+		[0x29] = { "Totals", NULL },
+		[0x2A] = { "Mbox totals", NULL },
+		[0x2B] = { "Quotas", NULL },
+		[0x2C] = { "Mbox quotas", NULL },
+		[0x2D] = { "Message count", NULL },
+		[0x2E] = { "Content", NULL },
+		[0x2F] = { "Start", NULL },
+		[0x30] = { "Additional headers", NULL },
+		[0x31] = { "Distribution indicator", NULL },
+		[0x32] = { "Element descriptor", NULL },
+		[0x33] = { "Limit", NULL },
+		[0x34] = { "Recommended retrieval mode", NULL },
+		[0x35] = { "Recommended retrieval mode text", NULL },
+		[0x36] = { "Status text", NULL },
+		[0x37] = { "Applic ID", NULL },
+		[0x38] = { "Reply applic ID", NULL },
+		[0x39] = { "Aux applic info", NULL },
+		[0x3A] = { "Content class", NULL },
+		[0x3B] = { "DRM content", NULL },
+		[0x3C] = { "Adaptation allowed", NULL },
+		[0x3D] = { "Replace ID", NULL },
+		[0x3E] = { "Cancel ID", NULL },
+		[0x3F] = { "Cancel status", NULL }
+	};
+	TMMSHeaderField *Pointer_Header_Field;
+	TMMSValue Name, Value;
+	unsigned char Byte;
 
-			// Content class
-			case 0x3A:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Content class record.\n");
-				// TODO
-				goto Exit;
+	while (MMSCursorReadByte(Pointer_Cursor, &Byte) == 0)
+	{
+		// Application-header, both the field name and the value are strings
+		if (Byte < 128)
+		{
+			Pointer_Cursor->Offset--;
+			if ((MMSReadWAPValue(Pointer_Cursor, &Name) != 0) || (MMSReadWAPValue(Pointer_Cursor, &Value) != 0)) return -1;
+			LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Skipping the application header \"%s\".\n", Name.Type == MMS_VALUE_TYPE_TEXT ? (char *) Name.Pointer_Data : "");
+			continue;
+		}
 
-			// DRM content
-			case 0x3B:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found DRM content record.\n");
-				// TODO
-				goto Exit;
+		// All other values are well-known fields
+		if (MMSReadWAPValue(Pointer_Cursor, &Value) != 0) return -1;
+		Byte &= 0x7F;
+		if (Byte < UTILITY_ARRAY_SIZE(Header_Fields)) Pointer_Header_Field = &Header_Fields[Byte];
+		else Pointer_Header_Field = NULL; // The field code can be up to 0x7F, but the table stops at the last field defined by the standard
+		LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found %s record (type %d).\n", (Pointer_Header_Field == NULL) || (Pointer_Header_Field->Pointer_String_Name == NULL) ? "unknown" : Pointer_Header_Field->Pointer_String_Name, Value.Type);
 
-			// Adaptation allowed
-			case 0x3C:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Adaptation allowed record.\n");
-				// TODO
-				goto Exit;
+		// The message body follows the content type
+		if (Byte == 0x04) return MMSDecodeWAPContentType(&Value, &Pointer_Headers->Body);
 
-			// Replace ID
-			case 0x3D:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Replace ID record.\n");
-				// TODO
-				goto Exit;
+		if ((Pointer_Header_Field != NULL) && (Pointer_Header_Field->Decoder != NULL) && (Pointer_Header_Field->Decoder(&Value, Pointer_Headers) != 0))
+		{
+			LOG("Error : the %s field value is invalid.\n", Pointer_Header_Field->Pointer_String_Name);
+			return -1;
+		}
+	}
 
-			// Cancel ID
-			case 0x3E:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Cancel ID record.\n");
-				// TODO
-				goto Exit;
+	// There is no body
+	return 0;
+}
 
-			// Cancel status
-			case 0x3F:
-				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Found Cancel status record.\n");
-				// TODO
-				goto Exit;
+/** Parse all fields of a MMS PDU and extract all attached files.
+ * @param Pointer_PDU The MMS PDU content.
+ * @param PDU_Size The MMS PDU size in bytes.
+ * @param Pointer_String_Output_Directory_Path Create this output directory and store all extracted message content to it.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int MMSProcessMessage(unsigned char *Pointer_PDU, size_t PDU_Size, char *Pointer_String_Output_Directory_Path)
+{
+	TMMSCursor Cursor;
+	TMMSMessageHeaders Headers;
+	TMMSPart Part;
+	char String_Temporary[256];
+	unsigned int i, Attached_Files_Count;
+	struct tm Broken_Down_Time;
+	const char *Pointer_String_Content_Type;
+
+	// All reads are checked against the PDU size
+	Cursor.Pointer_Data = Pointer_PDU;
+	Cursor.Size = PDU_Size;
+	Cursor.Offset = 0;
 
-			default:
-				LOG("Unknown field : %d.\n", Byte);
-				goto Exit;
-		}
+	// Extract some useful data from the header
+	memset(&Headers, 0, sizeof(Headers));
+	strcpy(Headers.String_Sender_Phone_Number, "No_Number");
+	if (MMSDecodeMessageHeaders(&Cursor, &Headers) != 0)
+	{
+		LOG("Error : could not decode the message headers.\n");
+		return -1;
 	}
+	gmtime_r(&Headers.Date, &Broken_Down_Time); // Do not use gmtime(), so several messages can be decoded at the same time
+	LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Message type : %d, date : %04d-%02d-%02d %02d:%02d:%02d, sender : \"%s\".\n", Headers.Message_Type, Broken_Down_Time.tm_year + 1900, Broken_Down_Time.tm_mon + 1, Broken_Down_Time.tm_mday, Broken_Down_Time.tm_hour, Broken_Down_Time.tm_min, Broken_Down_Time.tm_sec, Headers.String_Sender_Phone_Number);
 
 	// Do not parse indication messages, they do not embed any attachment
-	if ((Message_Type == MMS_MESSAGE_TYPE_DELIVERY_INDICATION) || (Message_Type == MMS_MESSAGE_TYPE_READ_ORIGINATING_INDICATION))
+	if (Headers.Message_Type == MMS_MESSAGE_TYPE_DELIVERY_INDICATION)
 	{
-		// Display the appropriate message type
-		switch (Message_Type)
-		{
-			case MMS_MESSAGE_TYPE_DELIVERY_INDICATION:
-				printf("This message is a delivery indication, ignoring it.\n");
-				break;
-
-			case MMS_MESSAGE_TYPE_READ_ORIGINATING_INDICATION:
-				printf("This message is a read originating indication, ignoring it.\n");
-				break;
-
-			default:
-				LOG("Unknown message type %d.\n", Message_Type);
-				goto Parse_Attached_Files;
-		}
-		Return_Value = 0;
-		goto Exit;
+		printf("This message is a delivery indication, ignoring it.\n");
+		return 0;
+	}
+	if (Headers.Message_Type == MMS_MESSAGE_TYPE_READ_ORIGINATING_INDICATION)
+	{
+		printf("This message is a read originating indication, ignoring it.\n");
+		return 0;
+	}
+	if (Headers.Body.Pointer_String_Content_Type == NULL)
+	{
+		LOG("Error : the message has no content type.\n");
+		return -1;
 	}
 
-Parse_Attached_Files:
 	// Create the directory to which the extracted attached files will be saved
-	sprintf(String_Temporary, "%s/%s_%04d-%02d-%02d_%02d-%02d-%02d",
+	snprintf(String_Temporary, sizeof(String_Temporary), "%s/%s_%04d-%02d-%02d_%02d-%02d-%02d",
 		Pointer_String_Output_Directory_Path,
-		String_Sender_Phone_Number,
-		Pointer_Broken_Down_Time->tm_year + 1900,
-		Pointer_Broken_Down_Time->tm_mon + 1,
-		Pointer_Broken_Down_Time->tm_wday + 1,
-		Pointer_Broken_Down_Time->tm_hour,
-		Pointer_Broken_Down_Time->tm_min,
-		Pointer_Broken_Down_Time->tm_sec);
-	if (UtilityCreateDirectory(String_Temporary) != 0) goto Exit;
+		Headers.String_Sender_Phone_Number,
+		Broken_Down_Time.tm_year + 1900,
+		Broken_Down_Time.tm_mon + 1,
+		Broken_Down_Time.tm_mday,
+		Broken_Down_Time.tm_hour,
+		Broken_Down_Time.tm_min,
+		Broken_Down_Time.tm_sec);
+	if (UtilityCreateDirectory(String_Temporary) != 0) return -1;
+
+	// A message that is not a multipart one has a single content
+	Pointer_String_Content_Type = Headers.Body.Pointer_String_Content_Type;
+	if ((strncmp(Pointer_String_Content_Type, "multipart/", 10) != 0) && (strncmp(Pointer_String_Content_Type, "application/vnd.wap.multipart.", 30) != 0))
+	{
+		LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Single part message of type \"%s\".\n", Pointer_String_Content_Type);
+		Headers.Body.Pointer_Data = &Cursor.Pointer_Data[Cursor.Offset];
+		Headers.Body.Data_Size = Cursor.Size - Cursor.Offset;
+		return MMSWritePart(&Headers.Body, String_Temporary, 1);
+	}
 
 	// Get the amount of attached files
-	if (fread(&Byte, 1, 1, Pointer_File) != 1) goto Exit;
-	Attached_Files_Count = Byte; // See WAP-230-WSP-20010705-a chapter 8.5.1 for details about multipart header
-	LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Attached files count : %d.\n", Attached_Files_Count);
+	if (MMSReadWAPVariableLengthUnsignedInteger(&Cursor, &Attached_Files_Count) != 0) return -1; // See WAP-230-WSP-20010705-a chapter 8.5.1 for details about multipart header
+	LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Attached files count : %u.\n", Attached_Files_Count);
 
 	// Retrieve each file content
 	for (i = 0; i < Attached_Files_Count; i++)
 	{
-		LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Processing file %d/%d...\n", i + 1, Attached_Files_Count);
-		if (MMSExtractAttachedFile(Pointer_File, String_Temporary) != 0) goto Exit;
+		LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "Processing file %u/%u...\n", i + 1, Attached_Files_Count);
+		if (MMSDecodePart(&Cursor, &Part) != 0) return -1;
+		if (MMSWritePart(&Part, String_Temporary, i + 1) != 0) return -1;
 	}
 
-	// Everything went fine
-	Return_Value = 0;
+	return 0;
+}
 
-Exit:
-	if (Pointer_File != NULL) fclose(Pointer_File);
-	return Return_Value;
+/** Keep the raw PDU of a message that could not be decoded, so it can be decoded later without downloading it again.
+ * @param Pointer_PDU The message PDU.
+ * @param PDU_Size The PDU size in bytes.
+ * @param Pointer_String_Output_Directory_Path The directory to store the PDU in.
+ * @param Pointer_String_File_Name The PDU file name on the phone.
+ */
+static void MMSSaveUndecodedMessage(unsigned char *Pointer_PDU, size_t PDU_Size, char *Pointer_String_Output_Directory_Path, char *Pointer_String_File_Name)
+{
+	char String_Path[512];
+	FILE *Pointer_File;
+
+	snprintf(String_Path, sizeof(String_Path), "%s/Undecoded_%s", Pointer_String_Output_Directory_Path, Pointer_String_File_Name);
+	Pointer_File = fopen(String_Path, "w");
+	if (Pointer_File == NULL)
+	{
+		LOG("Error : could not create the file \"%s\" to save the undecoded message (%s).\n", String_Path, strerror(errno));
+		return;
+	}
+	if ((PDU_Size > 0) && (fwrite(Pointer_PDU, PDU_Size, 1, Pointer_File) != 1)) LOG("Error : could not save the undecoded message to \"%s\" (%s).\n", String_Path, strerror(errno));
+	fclose(Pointer_File);
 }
 
 /** Remove the "." and ".." entries from the provided list. This avoids adding additional code in the functions to handle those special cases.
@@ -1084,7 +1054,7 @@ static void MMSFilterArchivedMessagesList(char *Pointer_String_Drive, TList *Poi
 //-------------------------------------------------------------------------------------------------
 // Public functions
 //-------------------------------------------------------------------------------------------------
-int MMSDownloadAll(TSerialPortID Serial_Port_ID)
+int MMSDownloadAll(TSerialPortID Serial_Port_ID, int Is_Incremental_Mode_Enabled)
 {
 	static TMMSStorageLocation Storage_Location_Lookup_Table[] =
 	{
@@ -1112,15 +1082,19 @@ int MMSDownloadAll(TSerialPortID Serial_Port_ID)
 		"phone",
 		"SD card"
 	};
-	int Messages_Count, File_Descriptor, i, Return_Value = -1;
+	int i, Return_Value = -1, Undecoded_Messages_Count = 0, Result, Skipped_Messages_Count = 0;
 	unsigned int Location_Index, Device_Index;
-	char String_Messages_Payload_Directory[128], String_Database_File[128], String_Temporary[768];
+	char String_Temporary[768], String_Output_Directory_Path[64];
 	TMMSStorageLocation Storage_Location;
 	TMMSStorageDevice Storage_Device;
 	TMMSDatabaseRecord Database_Record;
 	TList List_Processed_MMS_Files, List_Drives, List_Found_MMS_Files;
 	TListItem *Pointer_List_Item_Drive, *Pointer_List_Item;
 	TFileManagerFileListItem *Pointer_File_List_Item_Drive, *Pointer_File_List_Item;
+	TMMSStorageInformation Storage_Information[UTILITY_ARRAY_SIZE(Storage_Device_Lookup_Table)][UTILITY_ARRAY_SIZE(Storage_Location_Lookup_Table)], *Pointer_Storage_Information;
+	TFileManagerSession File_Manager_Session;
+	TFileManagerSink Database_Sink, Message_Sink;
+	TMessageIndex Index;
 
 	// Create output directories
 	if (UtilityCreateDirectory("Output/MMS") != 0) return -1;
@@ -1136,75 +1110,103 @@ int MMSDownloadAll(TSerialPortID Serial_Port_ID)
 	// Archived messages are handled separately, so the output directory must be created by hand
 	if (UtilityCreateDirectory("Output/MMS/Archives") != 0) return -1;
 
+	// Find the messages extracted by the previous runs, each message is stored in its own directory, so there is no need to rebuild the output from scratch when the index is missing
+	if (MessageIndexLoad(&Index, MMS_INDEX_FILE_PATH) != 0) return -1;
+
+	// Determine whether some messages are stored in each possible messages storage combination, this must be done before accessing the file manager
+	for (Device_Index = 0; Device_Index < UTILITY_ARRAY_SIZE(Storage_Device_Lookup_Table); Device_Index++)
+	{
+		for (Location_Index = 0; Location_Index < UTILITY_ARRAY_SIZE(Storage_Location_Lookup_Table); Location_Index++)
+		{
+			Pointer_Storage_Information = &Storage_Information[Device_Index][Location_Index];
+			if (MMSGetStorageInformation(Serial_Port_ID, Storage_Location_Lookup_Table[Location_Index], Storage_Device_Lookup_Table[Device_Index], &Pointer_Storage_Information->Messages_Count, Pointer_Storage_Information->String_Messages_Payload_Directory, Pointer_Storage_Information->String_Database_File) != 0)
+			{
+				MessageIndexRelease(&Index);
+				return -1;
+			}
+			printf("Found %d message(s) in %s \"%s\" location.\n", Pointer_Storage_Information->Messages_Count, Pointer_Strings_Storage_Device_Names[Device_Index], Pointer_Strings_Storage_Location_Names[Location_Index]);
+		}
+	}
+
 	ListInitialize(&List_Processed_MMS_Files);
+	File_Manager_Session.Is_Opened = 0; // Tell the exit code that no file manager session has been opened yet
+	// Databases and messages are downloaded to RAM and parsed from there, the buffers are reused for all downloads
+	FileManagerInitializeMemorySink(&Database_Sink);
+	FileManagerInitializeMemorySink(&Message_Sink);
+
+	// Download all messages in a single file manager session
+	if (FileManagerOpenSession(Serial_Port_ID, &File_Manager_Session) != 0)
+	{
+		LOG("Error : could not access the phone file manager.\n");
+		goto Exit;
+	}
 
 	// Try all possible messages storage combinations
 	for (Device_Index = 0; Device_Index < UTILITY_ARRAY_SIZE(Storage_Device_Lookup_Table); Device_Index++)
 	{
 		for (Location_Index = 0; Location_Index < UTILITY_ARRAY_SIZE(Storage_Location_Lookup_Table); Location_Index++)
 		{
-			// Determine whether some messages are stored in this location
+			// Nothing to do is no message is stored in this location
 			Storage_Location = Storage_Location_Lookup_Table[Location_Index];
 			Storage_Device = Storage_Device_Lookup_Table[Device_Index];
-			if (MMSGetStorageInformation(Serial_Port_ID, Storage_Location, Storage_Device, &Messages_Count, String_Messages_Payload_Directory, String_Database_File) != 0) return -1;
-			printf("Found %d message(s) in %s \"%s\" location.\n", Messages_Count, Pointer_Strings_Storage_Device_Names[Device_Index], Pointer_Strings_Storage_Location_Names[Location_Index]);
-
-			// Nothing to do is no message is stored in this location
-			if (Messages_Count == 0) continue;
+			Pointer_Storage_Information = &Storage_Information[Device_Index][Location_Index];
+			if (Pointer_Storage_Information->Messages_Count == 0) continue;
 
 			// Retrieve the database file
-			if (FileManagerDownloadFile(Serial_Port_ID, String_Database_File, MMS_DATABASE_FILE_NAME) != 0)
+			if (FileManagerDownloadFileToSink(&File_Manager_Session, Pointer_Storage_Information->String_Database_File, &Database_Sink) != 0)
 			{
-				LOG("Error : could not download the MMS database file \"%s\" (storage location = %d, storage device = %d).\n", String_Database_File, Storage_Location, Storage_Device);
-				goto Exit;
-			}
-
-			// Try to open the database file
-			File_Descriptor = open(MMS_DATABASE_FILE_NAME, O_RDONLY);
-			if (File_Descriptor == -1)
-			{
-				LOG("Error : failed to open MMS database file \"%s\" (storage location = %d, storage device = %d, %s).\n", String_Database_File, Storage_Location, Storage_Device, strerror(errno));
+				LOG("Error : could not download the MMS database file \"%s\" (storage location = %d, storage device = %d).\n", Pointer_Storage_Information->String_Database_File, Storage_Location, Storage_Device);
 				goto Exit;
 			}
 
 			// Extract each message information from the database
-			for (i = 1; i <= Messages_Count; i++) // Start from 1, so the 'i ' value can be displayed as-is
+			for (i = 1; i <= Pointer_Storage_Information->Messages_Count; i++) // Start from 1, so the 'i ' value can be displayed as-is
 			{
 				// Retrieve next record
-				if (read(File_Descriptor, &Database_Record, sizeof(Database_Record)) != sizeof(Database_Record))
+				if ((size_t) i * sizeof(Database_Record) > Database_Sink.Data_Size)
 				{
-					LOG("Error : could not read MMS database record %d (database file = \"%s\", storage location = %d, storage device = %d, %s).\n", i, String_Database_File, Storage_Location, Storage_Device, strerror(errno));
+					LOG("Error : could not read MMS database record %d, the database is too small (database file = \"%s\", storage location = %d, storage device = %d).\n", i, Pointer_Storage_Information->String_Database_File, Storage_Location, Storage_Device);
 					goto Exit;
 				}
+				memcpy(&Database_Record, &Database_Sink.Pointer_Buffer[(i - 1) * sizeof(Database_Record)], sizeof(Database_Record));
 
-				// Retrieve the MMS file
-				printf("Retrieving message %d/%d (%u bytes)...\n", i, Messages_Count, Database_Record.File_Size);
-				sprintf(String_Temporary, "%s\\%s", String_Messages_Payload_Directory, Database_Record.String_File_Name);
+				// Do not retrieve again a message that has already been extracted
+				sprintf(String_Temporary, "%s\\%s", Pointer_Storage_Information->String_Messages_Payload_Directory, Database_Record.String_File_Name);
 				FileManagerListAddFile(&List_Processed_MMS_Files, String_Temporary, 0, 0); // Reuse the File Manager list items as we are dealing with files
-				if (FileManagerDownloadFile(Serial_Port_ID, String_Temporary, MMS_RAW_MMS_FILE_NAME) != 0)
+				Result = MessageIndexUpdateEntry(&Index, String_Temporary, Database_Record.File_Size);
+				if (Result < 0) goto Exit;
+				if (Is_Incremental_Mode_Enabled && (Result == 1))
+				{
+					LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "The MMS file \"%s\" has already been extracted.\n", String_Temporary);
+					Skipped_Messages_Count++;
+					continue;
+				}
+
+				// Retrieve the MMS file
+				printf("Retrieving message %d/%d (%u bytes)...\n", i, Pointer_Storage_Information->Messages_Count, Database_Record.File_Size);
+				if (FileManagerDownloadFileToSink(&File_Manager_Session, String_Temporary, &Message_Sink) != 0)
 				{
 					LOG("Error : could not download the MMS file \"%s\" (storage location = %d, storage device = %d).\n", String_Temporary, Storage_Location, Storage_Device);
 					goto Exit;
 				}
 
 				// Extract payload from MMS
-				sprintf(String_Temporary, "Output/MMS/%s", Pointer_Strings_Storage_Location_Names[Location_Index]);
-				if (MMSProcessMessage(MMS_RAW_MMS_FILE_NAME, String_Temporary) != 0)
+				snprintf(String_Output_Directory_Path, sizeof(String_Output_Directory_Path), "Output/MMS/%s", Pointer_Strings_Storage_Location_Names[Location_Index]);
+				if (MMSProcessMessage(Message_Sink.Pointer_Buffer, Message_Sink.Data_Size, String_Output_Directory_Path) != 0)
 				{
-					LOG("Error : could not process the MMS file \"%s\" (storage location = %d, storage device = %d).\n", Database_Record.String_File_Name, Storage_Location, Storage_Device);
-					goto Exit;
+					// Go on with the other messages, downloading them again would take too much time
+					LOG("Warning : could not process the MMS file \"%s\" (storage location = %d, storage device = %d), saving its raw content.\n", Database_Record.String_File_Name, Storage_Location, Storage_Device);
+					MMSSaveUndecodedMessage(Message_Sink.Pointer_Buffer, Message_Sink.Data_Size, String_Output_Directory_Path, Database_Record.String_File_Name);
+					MessageIndexDiscardEntry(&Index, String_Temporary); // Retry during the next run
+					Undecoded_Messages_Count++;
 				}
 			}
-
-			// Stop accessing the database file but do not remove it, as it will be overwritten by another one
-			close(File_Descriptor);
-			File_Descriptor = -1;
 		}
 	}
 
 	// Retrieve archived MMS, they are not referenced in the database files but they are stored in the MMS directories
 	// Start by retrieving all existing drives on the phone
-	if (FileManagerListDrives(Serial_Port_ID, &List_Drives) != 0)
+	if (FileManagerListDrives(&File_Manager_Session, &List_Drives) != 0)
 	{
 		LOG("Error : failed to retrieve the existing drives.\n");
 		goto Exit;
@@ -1220,7 +1222,7 @@ int MMSDownloadAll(TSerialPortID Serial_Port_ID)
 
 		// Find all existing MMS files in this drive
 		snprintf(String_Temporary, sizeof(String_Temporary), "%s\\@mms\\mms_pdu", Pointer_File_List_Item_Drive->String_File_Name);
-		if (FileManagerListDirectory(Serial_Port_ID, String_Temporary, &List_Found_MMS_Files) != 0)
+		if (FileManagerListDirectory(&File_Manager_Session, String_Temporary, &List_Found_MMS_Files) != 0)
 		{
 			ListClear(&List_Drives);
 			LOG("Error : could not retrieve the existing files in the directory \"%s\".\n", String_Temporary);
@@ -1240,25 +1242,41 @@ int MMSDownloadAll(TSerialPortID Serial_Port_ID)
 			Pointer_File_List_Item = Pointer_List_Item->Pointer_Data;
 
 			// Create the name of the file to retrieve
-			printf("Retrieving message %d/%d...\n", i, List_Found_MMS_Files.Items_Count);
 			snprintf(String_Temporary, sizeof(String_Temporary), "%s\\@mms\\mms_pdu\\%s", Pointer_File_List_Item_Drive->String_File_Name, Pointer_File_List_Item->String_File_Name);
-			if (FileManagerDownloadFile(Serial_Port_ID, String_Temporary, MMS_RAW_MMS_FILE_NAME) != 0)
+
+			// Do not retrieve again a message that has already been extracted
+			Result = MessageIndexUpdateEntry(&Index, String_Temporary, Pointer_File_List_Item->File_Size);
+			if (Result < 0)
 			{
 				ListClear(&List_Drives);
 				ListClear(&List_Found_MMS_Files);
-				LOG("Error : could not download the archived MMS file \"%s\".\n", String_Temporary);
 				goto Exit;
 			}
-
-			// Extract payload from MMS
-			if (MMSProcessMessage(MMS_RAW_MMS_FILE_NAME, "Output/MMS/Archives") != 0)
+			if (Is_Incremental_Mode_Enabled && (Result == 1))
+			{
+				LOG_DEBUG(MMS_IS_DEBUG_ENABLED, "The archived MMS file \"%s\" has already been extracted.\n", String_Temporary);
+				Skipped_Messages_Count++;
+				goto Next_Archived_Message;
+			}
+			printf("Retrieving message %d/%d...\n", i, List_Found_MMS_Files.Items_Count);
+			if (FileManagerDownloadFileToSink(&File_Manager_Session, String_Temporary, &Message_Sink) != 0)
 			{
 				ListClear(&List_Drives);
 				ListClear(&List_Found_MMS_Files);
-				LOG("Error : could not process the archived MMS file \"%s\".\n", String_Temporary);
+				LOG("Error : could not download the archived MMS file \"%s\".\n", String_Temporary);
 				goto Exit;
 			}
 
+			// Extract payload from MMS
+			if (MMSProcessMessage(Message_Sink.Pointer_Buffer, Message_Sink.Data_Size, "Output/MMS/Archives") != 0)
+			{
+				LOG("Warning : could not process the archived MMS file \"%s\", saving its raw content.\n", String_Temporary);
+				MMSSaveUndecodedMessage(Message_Sink.Pointer_Buffer, Message_Sink.Data_Size, "Output/MMS/Archives", Pointer_File_List_Item->String_File_Name);
+				MessageIndexDiscardEntry(&Index, String_Temporary); // Retry during the next run
+				Undecoded_Messages_Count++;
+			}
+
+Next_Archived_Message:
 			i++;
 			Pointer_List_Item = Pointer_List_Item->Pointer_Next_Item;
 		}
@@ -1267,15 +1285,20 @@ int MMSDownloadAll(TSerialPortID Serial_Port_ID)
 		Pointer_List_Item_Drive = Pointer_List_Item_Drive->Pointer_Next_Item;
 	}
 	ListClear(&List_Drives);
+	if (Is_Incremental_Mode_Enabled) printf("%d message(s) had already been extracted by a previous run.\n", Skipped_Messages_Count);
+	if (Undecoded_Messages_Count > 0) printf("Warning : %d message(s) could not be decoded, their raw content has been saved to \"Undecoded_*\" files.\n", Undecoded_Messages_Count);
 
 	// Everything went fine
 	Return_Value = 0;
 
 Exit:
+	if (FileManagerCloseSession(&File_Manager_Session) != 0) Return_Value = -1;
 	ListClear(&List_Processed_MMS_Files);
-	if (File_Descriptor != -1) close(File_Descriptor);
-	unlink(MMS_DATABASE_FILE_NAME);
-	unlink(MMS_RAW_MMS_FILE_NAME);
+	FileManagerReleaseSink(&Database_Sink);
+	FileManagerReleaseSink(&Message_Sink);
+	// Update the index only when all messages have been extracted, otherwise the next run would miss some of them
+	if ((Return_Value == 0) && (MessageIndexSave(&Index) != 0)) Return_Value = -1;
+	MessageIndexRelease(&Index);
 
 	return Return_Value;
 }
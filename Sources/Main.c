@@ -7,6 +7,7 @@
 #include <List.h>
 #include <MMS.h>
 #include <Serial_Port.h>
+#include <signal.h>
 #include <SMS.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,7 +17,7 @@
 //-------------------------------------------------------------------------------------------------
 // Private types
 //-------------------------------------------------------------------------------------------------
-/** All available command line interface commands. */
+/** All available command line interface commands. The file commands must be kept first, they need a file manager session. */
 typedef enum
 {
 	MAIN_COMMAND_LIST_DRIVES,
@@ -29,15 +30,36 @@ typedef enum
 	MAIN_COMMANDS_COUNT
 } TMainCommand;
 
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** Set by the SIGINT handler when the user asks to stop the program outside of a file manager session. */
+static volatile sig_atomic_t Main_Is_Interruption_Requested = 0;
+
 //-------------------------------------------------------------------------------------------------
 // Private functions
 //-------------------------------------------------------------------------------------------------
+/** Record the user request to stop the program and make the operation in progress fail as soon as it needs the phone, so the phone settings can be restored before exiting.
+ * @param Signal_Number The received signal (only SIGINT is handled).
+ */
+static void MainHandleInterruptionSignal(int Signal_Number)
+{
+	(void) Signal_Number;
+	Main_Is_Interruption_Requested = 1;
+	ATCommandSetInterruptionRequest(1);
+}
+
 /** Display the usage message.
  * @param Pointer_String_Program_Name The program name as invoked by the user.
  */
 static void MainDisplayUsage(char *Pointer_String_Program_Name)
 {
-	printf("Usage : %s Serial_Port Command [Parameter_1] [Parameter_2]...\n"
+	printf("Usage : %s Serial_Port Command [Parameter_1] [Parameter_2]... [Options]\n"
+		"Options :\n"
+		"  --stats[=<file>] : display the statistics of all AT commands sent to the phone and of the file downloads when the program exits, or write them to the specified file\n"
+		"  --mirror : make get-directory download only the files that are new or changed since the previous run to the same output directory\n"
+		"  --prune : same as --mirror, but also remove the local files and directories that do not exist anymore on the phone\n"
+		"  --incremental : make get-all-mms and get-all-sms retrieve only the messages that are new or changed since the previous run, and append them to the previous output\n"
 		"File commands :\n"
 		"  list-drives\n"
 		"  list-directory <absolute path>\n"
@@ -55,11 +77,14 @@ static void MainDisplayUsage(char *Pointer_String_Program_Name)
 //-------------------------------------------------------------------------------------------------
 int main(int argc, char *argv[])
 {
-	char *Pointer_String_Serial_Port_Device, *Pointer_String_Argument_1 = NULL, *Pointer_String_Argument_2 = NULL, String_Date[12]; // The GCC standard tells that the date string is always 11-character long
+	char *Pointer_String_Serial_Port_Device, *Pointer_String_Argument_1 = NULL, *Pointer_String_Argument_2 = NULL, String_Date[12], *Pointer_String_Statistics_File = NULL; // The GCC standard tells that the date string is always 11-character long
 	TSerialPortID Serial_Port_ID = SERIAL_PORT_INVALID_ID;
-	int Return_Value = EXIT_FAILURE, i;
+	int Return_Value = EXIT_FAILURE, i, j, Is_Statistics_Display_Enabled = 0, Download_Directory_Flags = 0, Is_Incremental_Mode_Enabled = 0;
+	FILE *Pointer_Statistics_File;
 	TMainCommand Command = MAIN_COMMANDS_COUNT; // This value is invalid, this allows to detect if no known command was provided by the user
 	TList List;
+	TFileManagerSession File_Manager_Session;
+	struct sigaction Signal_Action;
 
 	// Display the program banner
 	strcpy(String_Date, __DATE__); // Get a copy of the literal date string, so it is easy to get an offset from the copy
@@ -68,6 +93,39 @@ int main(int argc, char *argv[])
 		"| (C) 2022-%s Adrien RICCIARDI |\n"
 		"+--------------------------------+\n", &String_Date[7]); // The year field is the last part of the date string, so there is no need to extract the year field from the string
 
+	// Extract the options, they can be located anywhere on the command line
+	j = 1;
+	for (i = 1; i < argc; i++)
+	{
+		if ((strncmp(argv[i], "--stats", 7) == 0) && ((argv[i][7] == 0) || (argv[i][7] == '=')))
+		{
+			Is_Statistics_Display_Enabled = 1;
+			if (argv[i][7] == '=') Pointer_String_Statistics_File = &argv[i][8];
+			continue;
+		}
+		if (strcmp(argv[i], "--mirror") == 0)
+		{
+			Download_Directory_Flags |= FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_MIRROR;
+			continue;
+		}
+		if (strcmp(argv[i], "--prune") == 0)
+		{
+			Download_Directory_Flags |= FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_MIRROR | FILE_MANAGER_DOWNLOAD_DIRECTORY_FLAG_PRUNE;
+			continue;
+		}
+
+		if (strcmp(argv[i], "--incremental") == 0)
+		{
+			Is_Incremental_Mode_Enabled = 1;
+			continue;
+		}
+
+		// Keep the regular arguments
+		argv[j] = argv[i];
+		j++;
+	}
+	argc = j;
+
 	// Check parameters
 	if (argc < 3)
 	{
@@ -201,6 +259,8 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	File_Manager_Session.Is_Opened = 0; // Tell the exit code that no file manager session has been opened yet
+
 	// Try to open serial port
 	if (SerialPortOpen(Pointer_String_Serial_Port_Device, 115200, SERIAL_PORT_PARITY_NONE, &Serial_Port_ID) != 0)
 	{
@@ -211,11 +271,34 @@ int main(int argc, char *argv[])
 	// Try to create the root destination directory
 	if (UtilityCreateDirectory("Output") != 0) goto Exit;
 
+	// Do not let an interruption kill the program, the phone command echo must be restored before exiting (SA_RESTART is not set, so a blocking serial port read is interrupted and the current operation fails), the file manager sessions install their own handler
+	memset(&Signal_Action, 0, sizeof(Signal_Action));
+	Signal_Action.sa_handler = MainHandleInterruptionSignal;
+	sigemptyset(&Signal_Action.sa_mask);
+	if (sigaction(SIGINT, &Signal_Action, NULL) != 0) printf("Warning : could not install the SIGINT handler, interrupting the program could leave the phone command echo disabled.\n");
+
+	// Stop the phone from echoing the commands, this almost halves the amount of bytes transferred when sending files (if the phone does not answer, it may still be sending the data of an operation interrupted by a previous program run, so try to recover the communication)
+	if ((ATCommandEnableLeanLinkProfile(Serial_Port_ID) != 0) && ((ATCommandRecoverLink(Serial_Port_ID) != 0) || (ATCommandEnableLeanLinkProfile(Serial_Port_ID) != 0)))
+	{
+		printf("Error : failed to communicate with the phone.\n");
+		goto Exit;
+	}
+
+	// All file commands are run in a single file manager session
+	if (Command <= MAIN_COMMAND_GET_DIRECTORY)
+	{
+		if (FileManagerOpenSession(Serial_Port_ID, &File_Manager_Session) != 0)
+		{
+			printf("Error : failed to access the phone file manager.\n");
+			goto Exit;
+		}
+	}
+
 	// Run the command
 	switch (Command)
 	{
 		case MAIN_COMMAND_LIST_DRIVES:
-			if (FileManagerListDrives(Serial_Port_ID, &List) != 0)
+			if (FileManagerListDrives(&File_Manager_Session, &List) != 0)
 			{
 				printf("Error : failed to list the drives.\n");
 				goto Exit;
@@ -225,7 +308,7 @@ int main(int argc, char *argv[])
 			break;
 
 		case MAIN_COMMAND_LIST_DIRECTORY:
-			if (FileManagerListDirectory(Serial_Port_ID, Pointer_String_Argument_1, &List) != 0)
+			if (FileManagerListDirectory(&File_Manager_Session, Pointer_String_Argument_1, &List) != 0)
 			{
 				printf("Error : failed to list the directory \"%s\".\n", Pointer_String_Argument_1);
 				goto Exit;
@@ -236,7 +319,7 @@ int main(int argc, char *argv[])
 
 		case MAIN_COMMAND_GET_FILE:
 			printf("Downloading the file \"%s\" from the phone...\n", Pointer_String_Argument_1);
-			if (FileManagerDownloadFile(Serial_Port_ID, Pointer_String_Argument_1, Pointer_String_Argument_2) != 0)
+			if (FileManagerDownloadFile(&File_Manager_Session, Pointer_String_Argument_1, Pointer_String_Argument_2) != 0)
 			{
 				printf("Error : could not get the file \"%s\".\n", Pointer_String_Argument_1);
 				goto Exit;
@@ -246,7 +329,7 @@ int main(int argc, char *argv[])
 
 		case MAIN_COMMAND_SEND_FILE:
 			printf("Sending the file \"%s\" to the phone...\n", Pointer_String_Argument_1);
-			if (FileManagerSendFile(Serial_Port_ID, Pointer_String_Argument_1, Pointer_String_Argument_2) != 0)
+			if (FileManagerSendFile(&File_Manager_Session, Pointer_String_Argument_1, Pointer_String_Argument_2) != 0)
 			{
 				printf("Error : could not send the file \"%s\".\n", Pointer_String_Argument_1);
 				goto Exit;
@@ -255,7 +338,7 @@ int main(int argc, char *argv[])
 			break;
 
 		case MAIN_COMMAND_GET_DIRECTORY:
-			if (FileManagerDownloadDirectory(Serial_Port_ID, Pointer_String_Argument_1, Pointer_String_Argument_2) != 0)
+			if (FileManagerDownloadDirectory(&File_Manager_Session, Pointer_String_Argument_1, Pointer_String_Argument_2, Download_Directory_Flags) != 0)
 			{
 				printf("Error : could not get the directory \"%s\".\n", Pointer_String_Argument_1);
 				goto Exit;
@@ -264,7 +347,7 @@ int main(int argc, char *argv[])
 			break;
 
 		case MAIN_COMMAND_GET_ALL_MMS:
-			if (MMSDownloadAll(Serial_Port_ID) != 0)
+			if (MMSDownloadAll(Serial_Port_ID, Is_Incremental_Mode_Enabled) != 0)
 			{
 				printf("Error : failed to download MMS.\n");
 				goto Exit;
@@ -273,7 +356,7 @@ int main(int argc, char *argv[])
 			break;
 
 		case MAIN_COMMAND_GET_ALL_SMS:
-			if (SMSDownloadAll(Serial_Port_ID) != 0)
+			if (SMSDownloadAll(Serial_Port_ID, Is_Incremental_Mode_Enabled) != 0)
 			{
 				printf("Error : failed to download SMS.\n");
 				goto Exit;
@@ -290,6 +373,47 @@ int main(int argc, char *argv[])
 	Return_Value = EXIT_SUCCESS;
 
 Exit:
-	if (Serial_Port_ID != SERIAL_PORT_INVALID_ID) SerialPortClose(Serial_Port_ID);
+	// The phone is needed again to leave the file manager and to restore the command echo
+	if (Main_Is_Interruption_Requested)
+	{
+		if (Return_Value != EXIT_SUCCESS) printf("Error : the operation has been interrupted by the user.\n");
+		ATCommandSetInterruptionRequest(0);
+	}
+	if (FileManagerCloseSession(&File_Manager_Session) != 0)
+	{
+		printf("Error : failed to leave the phone file manager, the phone may need to be rebooted.\n");
+		Return_Value = EXIT_FAILURE;
+	}
+	if (Serial_Port_ID != SERIAL_PORT_INVALID_ID)
+	{
+		// Always restore the command echo, even if the command failed, otherwise the next run would take the disabled echo for the user setting (if the phone does not answer, it may still be sending the data of the failed operation, so try to recover the communication)
+		if ((ATCommandRestoreLinkProfile(Serial_Port_ID) != 0) && ((ATCommandRecoverLink(Serial_Port_ID) != 0) || (ATCommandRestoreLinkProfile(Serial_Port_ID) != 0)))
+		{
+			printf("Error : failed to restore the phone command echo.\n");
+			Return_Value = EXIT_FAILURE;
+		}
+		SerialPortClose(Serial_Port_ID);
+	}
+
+	// Display the AT commands statistics if requested
+	if (Is_Statistics_Display_Enabled)
+	{
+		if (Pointer_String_Statistics_File == NULL)
+		{
+			ATCommandDisplayStatistics(stdout);
+			FileManagerDisplayStatistics(stdout);
+		}
+		else
+		{
+			Pointer_Statistics_File = fopen(Pointer_String_Statistics_File, "w");
+			if (Pointer_Statistics_File == NULL) printf("Error : could not create the statistics file \"%s\".\n", Pointer_String_Statistics_File);
+			else
+			{
+				ATCommandDisplayStatistics(Pointer_Statistics_File);
+				FileManagerDisplayStatistics(Pointer_Statistics_File);
+				fclose(Pointer_Statistics_File);
+			}
+		}
+	}
 	return Return_Value;
 }
@@ -0,0 +1,348 @@
+/** @file Message_Index.c
+ * See Message_Index.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <errno.h>
+#include <Log.h>
+#include <Message_Index.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** The hash table slot does not reference any entry. */
+#define MESSAGE_INDEX_ENTRY_NONE -1
+/** How many entries the entries table can hold when it is first allocated. */
+#define MESSAGE_INDEX_INITIAL_ENTRIES_COUNT 64
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** A message known by the index. */
+struct TMessageIndexEntry
+{
+	char String_Key[512]; //!< Where the message is stored on the phone.
+	unsigned int Hash; //!< The key hash, it allows to skip most of the string comparisons and to rebuild the hash table without hashing the keys again.
+	unsigned long long Fingerprint; //!< The message content fingerprint.
+	int Is_Updated; //!< Tell whether the message has been found on the phone since the index was loaded.
+};
+
+/** A slot of the index hash table. */
+struct TMessageIndexSlot
+{
+	unsigned int Hash; //!< The key hash of the referenced entry.
+	int Entry_Index; //!< The entries table index, or MESSAGE_INDEX_ENTRY_NONE if the slot is free.
+};
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Compute the FNV-1a hash of a key.
+ * @param Pointer_String_Key The key to hash.
+ * @return The key hash.
+ */
+static unsigned int MessageIndexHashKey(char *Pointer_String_Key)
+{
+	unsigned int Hash = 2166136261U;
+
+	while (*Pointer_String_Key != 0)
+	{
+		Hash ^= (unsigned char) *Pointer_String_Key;
+		Hash *= 16777619U;
+		Pointer_String_Key++;
+	}
+	return Hash;
+}
+
+/** Find the hash table slot of a key, using linear probing.
+ * @param Pointer_Index The index, its hash table must be allocated.
+ * @param Pointer_String_Key The message key.
+ * @param Hash The key hash.
+ * @return The slot referencing the key entry, or the free slot where the key entry must be stored if the key is not in the index.
+ */
+static TMessageIndexSlot *MessageIndexFindSlot(TMessageIndex *Pointer_Index, char *Pointer_String_Key, unsigned int Hash)
+{
+	unsigned int Slot_Index;
+	TMessageIndexSlot *Pointer_Slot;
+
+	Slot_Index = Hash & (Pointer_Index->Slots_Count - 1);
+	while (1)
+	{
+		Pointer_Slot = &Pointer_Index->Pointer_Slots[Slot_Index];
+		if (Pointer_Slot->Entry_Index == MESSAGE_INDEX_ENTRY_NONE) return Pointer_Slot;
+		if ((Pointer_Slot->Hash == Hash) && (strcmp(Pointer_Index->Pointer_Entries[Pointer_Slot->Entry_Index].String_Key, Pointer_String_Key) == 0)) return Pointer_Slot;
+		Slot_Index = (Slot_Index + 1) & (Pointer_Index->Slots_Count - 1);
+	}
+}
+
+/** Search a message in the index.
+ * @param Pointer_Index The index.
+ * @param Pointer_String_Key The message key.
+ * @return NULL if the message is not in the index,
+ * @return The message entry if it was found.
+ */
+static TMessageIndexEntry *MessageIndexFindEntry(TMessageIndex *Pointer_Index, char *Pointer_String_Key)
+{
+	TMessageIndexSlot *Pointer_Slot;
+
+	if (Pointer_Index->Entries_Count == 0) return NULL; // The hash table is not allocated yet
+
+	Pointer_Slot = MessageIndexFindSlot(Pointer_Index, Pointer_String_Key, MessageIndexHashKey(Pointer_String_Key));
+	if (Pointer_Slot->Entry_Index == MESSAGE_INDEX_ENTRY_NONE) return NULL;
+	return &Pointer_Index->Pointer_Entries[Pointer_Slot->Entry_Index];
+}
+
+/** Make sure one more entry can be added to the index, growing the entries table and the hash table if needed.
+ * @param Pointer_Index The index.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int MessageIndexReserveEntry(TMessageIndex *Pointer_Index)
+{
+	int i, Allocated_Entries_Count;
+	unsigned int Slots_Count;
+	TMessageIndexEntry *Pointer_Entries;
+	TMessageIndexSlot *Pointer_Slots, *Pointer_Slot;
+
+	// Grow the entries table, doubling its size keeps the amount of reallocations low
+	if (Pointer_Index->Entries_Count == Pointer_Index->Allocated_Entries_Count)
+	{
+		if (Pointer_Index->Allocated_Entries_Count == 0) Allocated_Entries_Count = MESSAGE_INDEX_INITIAL_ENTRIES_COUNT;
+		else Allocated_Entries_Count = Pointer_Index->Allocated_Entries_Count * 2;
+		Pointer_Entries = realloc(Pointer_Index->Pointer_Entries, Allocated_Entries_Count * sizeof(TMessageIndexEntry));
+		if (Pointer_Entries == NULL)
+		{
+			LOG("Error : could not allocate %d message index entries.\n", Allocated_Entries_Count);
+			return -1;
+		}
+		Pointer_Index->Pointer_Entries = Pointer_Entries;
+		Pointer_Index->Allocated_Entries_Count = Allocated_Entries_Count;
+	}
+
+	// Keep the hash table at most half full to make the probe sequences short, use a power of two to compute the slot index with a mask
+	if ((unsigned int) (Pointer_Index->Entries_Count + 1) * 2 <= Pointer_Index->Slots_Count) return 0;
+	Slots_Count = Pointer_Index->Slots_Count;
+	if (Slots_Count == 0) Slots_Count = MESSAGE_INDEX_INITIAL_ENTRIES_COUNT * 2;
+	else Slots_Count *= 2;
+	Pointer_Slots = malloc(Slots_Count * sizeof(TMessageIndexSlot));
+	if (Pointer_Slots == NULL)
+	{
+		LOG("Error : could not allocate the message index hash table.\n");
+		return -1;
+	}
+	for (i = 0; i < (int) Slots_Count; i++) Pointer_Slots[i].Entry_Index = MESSAGE_INDEX_ENTRY_NONE;
+	free(Pointer_Index->Pointer_Slots);
+	Pointer_Index->Pointer_Slots = Pointer_Slots;
+	Pointer_Index->Slots_Count = Slots_Count;
+
+	// Store all existing entries again, the keys are all different so there is no need to compare them
+	for (i = 0; i < Pointer_Index->Entries_Count; i++)
+	{
+		Pointer_Slot = &Pointer_Slots[Pointer_Index->Pointer_Entries[i].Hash & (Slots_Count - 1)];
+		while (Pointer_Slot->Entry_Index != MESSAGE_INDEX_ENTRY_NONE)
+		{
+			Pointer_Slot++;
+			if (Pointer_Slot == &Pointer_Slots[Slots_Count]) Pointer_Slot = Pointer_Slots;
+		}
+		Pointer_Slot->Hash = Pointer_Index->Pointer_Entries[i].Hash;
+		Pointer_Slot->Entry_Index = i;
+	}
+
+	return 0;
+}
+
+/** Add a message to the index. The message must not be in the index yet.
+ * @param Pointer_Index The index.
+ * @param Pointer_String_Key The message key.
+ * @param Fingerprint The message fingerprint.
+ * @return NULL if an error occurred,
+ * @return The added entry on success.
+ */
+static TMessageIndexEntry *MessageIndexAddEntry(TMessageIndex *Pointer_Index, char *Pointer_String_Key, unsigned long long Fingerprint)
+{
+	TMessageIndexEntry *Pointer_Entry;
+	TMessageIndexSlot *Pointer_Slot;
+	unsigned int Hash;
+
+	// Make sure the key can be stored
+	if (strlen(Pointer_String_Key) >= sizeof(Pointer_Entry->String_Key))
+	{
+		LOG("Error : the message index key \"%s\" is too long.\n", Pointer_String_Key);
+		return NULL;
+	}
+	if (MessageIndexReserveEntry(Pointer_Index) != 0) return NULL;
+
+	// Fill the entry
+	Hash = MessageIndexHashKey(Pointer_String_Key);
+	Pointer_Entry = &Pointer_Index->Pointer_Entries[Pointer_Index->Entries_Count];
+	strcpy(Pointer_Entry->String_Key, Pointer_String_Key);
+	Pointer_Entry->Hash = Hash;
+	Pointer_Entry->Fingerprint = Fingerprint;
+	Pointer_Entry->Is_Updated = 0;
+
+	// Reference it from the hash table
+	Pointer_Slot = MessageIndexFindSlot(Pointer_Index, Pointer_String_Key, Hash);
+	Pointer_Slot->Hash = Hash;
+	Pointer_Slot->Entry_Index = Pointer_Index->Entries_Count;
+	Pointer_Index->Entries_Count++;
+
+	return Pointer_Entry;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+int MessageIndexLoad(TMessageIndex *Pointer_Index, char *Pointer_String_File_Path)
+{
+	FILE *Pointer_File;
+	char String_Line[600];
+	unsigned long long Fingerprint;
+	int Key_Index, Return_Value = -1;
+
+	snprintf(Pointer_Index->String_File_Path, sizeof(Pointer_Index->String_File_Path), "%s", Pointer_String_File_Path);
+	Pointer_Index->Pointer_Entries = NULL;
+	Pointer_Index->Entries_Count = 0;
+	Pointer_Index->Allocated_Entries_Count = 0;
+	Pointer_Index->Pointer_Slots = NULL;
+	Pointer_Index->Slots_Count = 0;
+	Pointer_Index->Is_Loaded = 0;
+
+	// Try to open the index
+	Pointer_File = fopen(Pointer_String_File_Path, "r");
+	if (Pointer_File == NULL)
+	{
+		if (errno == ENOENT) return 0; // No message has been exported yet
+		LOG("Error : could not open the message index file \"%s\" (%s).\n", Pointer_String_File_Path, strerror(errno));
+		return -1;
+	}
+
+	// Each line is "<fingerprint> <key>", the key is stored last because it can contain spaces
+	while (fgets(String_Line, sizeof(String_Line), Pointer_File) != NULL)
+	{
+		String_Line[strcspn(String_Line, "\n")] = 0;
+		if ((sscanf(String_Line, "%llx %n", &Fingerprint, &Key_Index) != 1) || (String_Line[Key_Index] == 0)) // The scanf() 'n' modifier does not increase the count returned by the function
+		{
+			LOG("Warning : ignoring the invalid line \"%s\" of the message index file \"%s\".\n", String_Line, Pointer_String_File_Path);
+			continue;
+		}
+		if (MessageIndexFindEntry(Pointer_Index, &String_Line[Key_Index]) != NULL)
+		{
+			LOG("Warning : ignoring the duplicate key \"%s\" of the message index file \"%s\".\n", &String_Line[Key_Index], Pointer_String_File_Path);
+			continue;
+		}
+		if (MessageIndexAddEntry(Pointer_Index, &String_Line[Key_Index], Fingerprint) == NULL) goto Exit;
+	}
+
+	// Everything went fine
+	Pointer_Index->Is_Loaded = 1;
+	Return_Value = 0;
+
+Exit:
+	fclose(Pointer_File);
+	if (Return_Value != 0) MessageIndexRelease(Pointer_Index);
+	return Return_Value;
+}
+
+int MessageIndexUpdateEntry(TMessageIndex *Pointer_Index, char *Pointer_String_Key, unsigned long long Fingerprint)
+{
+	TMessageIndexEntry *Pointer_Entry;
+	int Is_Unchanged;
+
+	Pointer_Entry = MessageIndexFindEntry(Pointer_Index, Pointer_String_Key);
+	if (Pointer_Entry == NULL)
+	{
+		Pointer_Entry = MessageIndexAddEntry(Pointer_Index, Pointer_String_Key, Fingerprint);
+		if (Pointer_Entry == NULL) return -1;
+		Is_Unchanged = 0;
+	}
+	else
+	{
+		// A key found several times during the same run is considered new each time, this way the message is not lost
+		Is_Unchanged = !Pointer_Entry->Is_Updated && (Pointer_Entry->Fingerprint == Fingerprint);
+		Pointer_Entry->Fingerprint = Fingerprint;
+	}
+	Pointer_Entry->Is_Updated = 1;
+
+	return Is_Unchanged;
+}
+
+void MessageIndexDiscardEntry(TMessageIndex *Pointer_Index, char *Pointer_String_Key)
+{
+	TMessageIndexEntry *Pointer_Entry;
+
+	// The entry is kept in the tables, it is just not saved
+	Pointer_Entry = MessageIndexFindEntry(Pointer_Index, Pointer_String_Key);
+	if (Pointer_Entry != NULL) Pointer_Entry->Is_Updated = 0;
+}
+
+int MessageIndexSave(TMessageIndex *Pointer_Index)
+{
+	char String_Temporary_Path[264];
+	FILE *Pointer_File;
+	TMessageIndexEntry *Pointer_Entry;
+	int i, Return_Value = -1;
+
+	// Write to a temporary file that replaces the previous index, so an interrupted write can't lose the index
+	snprintf(String_Temporary_Path, sizeof(String_Temporary_Path), "%s.tmp", Pointer_Index->String_File_Path);
+	Pointer_File = fopen(String_Temporary_Path, "w");
+	if (Pointer_File == NULL)
+	{
+		LOG("Error : could not create the message index file \"%s\" (%s).\n", String_Temporary_Path, strerror(errno));
+		return -1;
+	}
+
+	// Keep only the messages still present on the phone
+	for (i = 0; i < Pointer_Index->Entries_Count; i++)
+	{
+		Pointer_Entry = &Pointer_Index->Pointer_Entries[i];
+		if (Pointer_Entry->Is_Updated && (fprintf(Pointer_File, "%016llx %s\n", Pointer_Entry->Fingerprint, Pointer_Entry->String_Key) < 0))
+		{
+			LOG("Error : could not write to the message index file \"%s\" (%s).\n", String_Temporary_Path, strerror(errno));
+			goto Exit;
+		}
+	}
+
+	// Everything went fine
+	Return_Value = 0;
+
+Exit:
+	if (fclose(Pointer_File) != 0) Return_Value = -1;
+	if (Return_Value == 0)
+	{
+		if (rename(String_Temporary_Path, Pointer_Index->String_File_Path) != 0)
+		{
+			LOG("Error : could not replace the message index file \"%s\" (%s).\n", Pointer_Index->String_File_Path, strerror(errno));
+			Return_Value = -1;
+		}
+	}
+	else unlink(String_Temporary_Path);
+	return Return_Value;
+}
+
+void MessageIndexRelease(TMessageIndex *Pointer_Index)
+{
+	free(Pointer_Index->Pointer_Entries);
+	Pointer_Index->Pointer_Entries = NULL;
+	Pointer_Index->Entries_Count = 0;
+	Pointer_Index->Allocated_Entries_Count = 0;
+	free(Pointer_Index->Pointer_Slots);
+	Pointer_Index->Pointer_Slots = NULL;
+	Pointer_Index->Slots_Count = 0;
+}
+
+unsigned long long MessageIndexComputeFingerprint(const void *Pointer_Data, size_t Size)
+{
+	const unsigned char *Pointer_Byte = Pointer_Data;
+	unsigned long long Hash = 14695981039346656037ULL;
+	size_t i;
+
+	for (i = 0; i < Size; i++)
+	{
+		Hash ^= Pointer_Byte[i];
+		Hash *= 1099511628211ULL;
+	}
+	return Hash;
+}
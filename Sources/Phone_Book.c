@@ -5,6 +5,8 @@
 #include <AT_Command.h>
 #include <Log.h>
 #include <Phone_Book.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <Utility.h>
 
@@ -17,6 +19,47 @@
 /** The maximum amount of phone book entries that can be handled by the program. */
 #define PHONE_BOOK_MAXIMUM_ENTRIES 500
 
+/** How many slots the phone number hash tables have. This must be a power of two, keep the tables at most half full to make the probe sequences short. */
+#define PHONE_BOOK_INDEX_SLOTS_COUNT 1024
+/** Mask a hash value to get a slot index. */
+#define PHONE_BOOK_INDEX_SLOTS_MASK (PHONE_BOOK_INDEX_SLOTS_COUNT - 1)
+
+/** A free index slot. */
+#define PHONE_BOOK_INDEX_ENTRY_NONE -1
+/** A suffix index slot shared by several different numbers, it can't be used to identify a contact. */
+#define PHONE_BOOK_INDEX_ENTRY_AMBIGUOUS -2
+
+/** How many trailing digits are compared when the national significant numbers do not match exactly. */
+#define PHONE_BOOK_SUFFIX_DIGITS_COUNT 8
+
+/** Bare digits numbers (without "+" nor "00" prefix) with at least this amount of digits are considered as starting with a country code. This is the case of the international numbers provided by the SMS PDUs. */
+#define PHONE_BOOK_BARE_INTERNATIONAL_NUMBER_MINIMUM_DIGITS_COUNT 11
+
+//-------------------------------------------------------------------------------------------------
+// Private types
+//-------------------------------------------------------------------------------------------------
+/** What is known about a phone book entry after the ranged read. */
+typedef enum
+{
+	PHONE_BOOK_ENTRY_STATE_NOT_RECEIVED, //!< The entry was not part of the answer, it is empty unless the answer was incomplete.
+	PHONE_BOOK_ENTRY_STATE_RECEIVED, //!< The entry was successfully read.
+	PHONE_BOOK_ENTRY_STATE_FAILED //!< The entry was part of the answer but it could not be parsed.
+} TPhoneBookEntryState;
+
+/** A slot of the national significant number hash table. */
+typedef struct
+{
+	unsigned int Hash; //!< The full key hash, it allows to skip most of the string comparisons.
+	int Entry_Index; //!< The phone book entries table index, or PHONE_BOOK_INDEX_ENTRY_NONE if the slot is free.
+} TPhoneBookNumberIndexSlot;
+
+/** A slot of the number suffix hash table. */
+typedef struct
+{
+	unsigned int Suffix; //!< The last digits of the number, as an integer.
+	int Entry_Index; //!< The phone book entries table index, PHONE_BOOK_INDEX_ENTRY_NONE if the slot is free or PHONE_BOOK_INDEX_ENTRY_AMBIGUOUS if the suffix does not designate a single number.
+} TPhoneBookSuffixIndexSlot;
+
 //-------------------------------------------------------------------------------------------------
 // Private variables
 //-------------------------------------------------------------------------------------------------
@@ -25,50 +68,50 @@ static TPhoneBookEntry Phone_Book_Entries[PHONE_BOOK_MAXIMUM_ENTRIES];
 /** How many entries are stored in the phone book entries table. All these entries are valid and start from index 0. */
 static int Phone_Book_Entries_Count;
 
+/** The canonical form of each phone book entry number, it is the key of the number index. */
+static char Phone_Book_Entries_Keys[PHONE_BOOK_MAXIMUM_ENTRIES][sizeof(((TPhoneBookEntry *) 0)->String_Number)];
+/** Find an entry from its canonical number. */
+static TPhoneBookNumberIndexSlot Phone_Book_Number_Index[PHONE_BOOK_INDEX_SLOTS_COUNT];
+/** Find an entry from the last digits of its number, when the canonical numbers do not match because a country code could not be recognized. */
+static TPhoneBookSuffixIndexSlot Phone_Book_Suffix_Index[PHONE_BOOK_INDEX_SLOTS_COUNT];
+/** Tell whether the indexes match the phone book entries table content. */
+static int Is_Phone_Book_Index_Built = 0;
+
+/** Tell, for each country code first digit, which second digits make a two-digit country code (bit n is set when the second digit is n). The country codes starting with 1 or 7 have a single digit, all remaining ones have three digits (see ITU-T E.164 assigned country codes list). */
+static const unsigned short Phone_Book_Two_Digits_Country_Codes[10] =
+{
+	0x0000, // 0x : not a country code
+	0x0000, // 1 : single digit country code
+	0x0081, // 20, 27
+	0x025F, // 30, 31, 32, 33, 34, 36, 39
+	0x03FB, // 40, 41, 43, 44, 45, 46, 47, 48, 49
+	0x01FE, // 51, 52, 53, 54, 55, 56, 57, 58
+	0x007F, // 60, 61, 62, 63, 64, 65, 66
+	0x0000, // 7 : single digit country code
+	0x0056, // 81, 82, 84, 86
+	0x013F // 90, 91, 92, 93, 94, 95, 98
+};
+
 //-------------------------------------------------------------------------------------------------
 // Private functions
 //-------------------------------------------------------------------------------------------------
-/** Read a single phone book entry from the preselected phone book.
- * @param Serial_Port_ID The phone serial port.
- * @param Entry_Index The ID of the phone book entry to read.
+/** Extract the phone number and the name from a "+CPBR:" answer line.
+ * @param Pointer_String_Answer The answer line.
+ * @param Entry_Index The ID of the phone book entry, it is used only by the error messages.
  * @param Pointer_Entry On output, contain the relevant phone book entry data.
- * @return -1 if an error occurred,
- * @return 0 if the entry is empty,
- * @return 1 if the entry contains valid data.
+ * @return -1 if the answer is malformed,
+ * @return 0 on success.
  */
-static int PhoneBookReadSingleEntry(TSerialPortID Serial_Port_ID, int Entry_Index, TPhoneBookEntry *Pointer_Entry)
+static int PhoneBookParseEntry(char *Pointer_String_Answer, int Entry_Index, TPhoneBookEntry *Pointer_Entry)
 {
-	char String_Temporary[512], String_Name[448], *Pointer_String_Answer, Character;
+	char String_Temporary[512], String_Name[448], Character;
 	size_t i;
 	int Length;
 
-	// Send the entry reading command
-	sprintf(String_Temporary, "AT+CPBR=%d", Entry_Index);
-	if (ATCommandSendCommand(Serial_Port_ID, String_Temporary) != 0)
-	{
-		LOG("Error : failed to send the read phone entry %d command.\n", Entry_Index);
-		return -1;
-	}
-
-	// Does the entry contain data ?
-	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) return -1;
-	if (strcmp(String_Temporary, "OK") == 0)
-	{
-		LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "The entry %d is empty.\n", Entry_Index);
-		return 0;
-	}
-	// Is this the expected answer ?
-	if (strncmp("+CPBR:", String_Temporary, 6) != 0)
-	{
-		LOG("Error : unknown answer string when reading entry %d. Answer string : \"%s\".\n", Entry_Index, String_Temporary);
-		return -1;
-	}
-
 	// Extract the phone number (if any)
-	LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "Raw CPBR AT answer : \"%s\".\n", String_Temporary);
+	LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "Raw CPBR AT answer : \"%s\".\n", Pointer_String_Answer);
 
 	// Go up to the first opening double quote
-	Pointer_String_Answer = String_Temporary;
 	do
 	{
 		Character = *Pointer_String_Answer;
@@ -150,6 +193,44 @@ static int PhoneBookReadSingleEntry(TSerialPortID Serial_Port_ID, int Entry_Inde
 	}
 	LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "Converted phone book name string : \"%s\".\n", Pointer_Entry->String_Name);
 
+	return 0;
+}
+
+/** Read a single phone book entry from the preselected phone book.
+ * @param Serial_Port_ID The phone serial port.
+ * @param Entry_Index The ID of the phone book entry to read.
+ * @param Pointer_Entry On output, contain the relevant phone book entry data.
+ * @return -1 if an error occurred,
+ * @return 0 if the entry is empty,
+ * @return 1 if the entry contains valid data.
+ */
+static int PhoneBookReadSingleEntry(TSerialPortID Serial_Port_ID, int Entry_Index, TPhoneBookEntry *Pointer_Entry)
+{
+	char String_Temporary[512];
+
+	// Send the entry reading command
+	sprintf(String_Temporary, "AT+CPBR=%d", Entry_Index);
+	if (ATCommandSendCommand(Serial_Port_ID, String_Temporary) != 0)
+	{
+		LOG("Error : failed to send the read phone entry %d command.\n", Entry_Index);
+		return -1;
+	}
+
+	// Does the entry contain data ?
+	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) return -1;
+	if (strcmp(String_Temporary, "OK") == 0)
+	{
+		LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "The entry %d is empty.\n", Entry_Index);
+		return 0;
+	}
+	// Is this the expected answer ?
+	if (strncmp("+CPBR:", String_Temporary, 6) != 0)
+	{
+		LOG("Error : unknown answer string when reading entry %d. Answer string : \"%s\".\n", Entry_Index, String_Temporary);
+		return -1;
+	}
+	if (PhoneBookParseEntry(String_Temporary, Entry_Index, Pointer_Entry) != 0) return -1;
+
 	// Wait for the line separator
 	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) return -1;
 	if (String_Temporary[0] != 0)
@@ -169,22 +250,311 @@ static int PhoneBookReadSingleEntry(TSerialPortID Serial_Port_ID, int Entry_Inde
 	return 1;
 }
 
-/** Search for a phone number string in the whole phone book.
+/** Append an entry to the phone book table.
+ * @param Pointer_Entry The entry to append.
+ * @return -1 if the table is full,
+ * @return 0 on success.
+ */
+static int PhoneBookAddEntry(TPhoneBookEntry *Pointer_Entry)
+{
+	memcpy(&Phone_Book_Entries[Phone_Book_Entries_Count], Pointer_Entry, sizeof(TPhoneBookEntry));
+	Phone_Book_Entries_Count++;
+
+	if (Phone_Book_Entries_Count >= PHONE_BOOK_MAXIMUM_ENTRIES)
+	{
+		LOG("Error : the program can store only %d valid phone book entries but the phone contains more valid entries. Increase the program maximum value and retry.\n", PHONE_BOOK_MAXIMUM_ENTRIES);
+		return -1;
+	}
+	return 0;
+}
+
+/** Read a range of phone book entries with a single command. The phone sends all non-empty entries of the range in the same answer, so the entries are parsed on the fly and appended to the phone book table.
+ * @param Serial_Port_ID The phone serial port.
+ * @param First_Index The first entry of the range.
+ * @param Last_Index The last entry of the range (it is included in the range).
+ * @param Pointer_Entry_States On output, tell for each entry of the range whether it has been received. This array must have (Last_Index - First_Index + 1) cells initialized to PHONE_BOOK_ENTRY_STATE_NOT_RECEIVED.
+ * @param Pointer_Is_Answer_Incomplete On output, is set to 1 if some lines of the answer could not be understood, so entries that are not flagged as received might not be empty.
+ * @return -2 if the phone book table is full,
+ * @return -1 if the phone does not support the ranged command or if a communication error occurred,
+ * @return 0 on success.
+ */
+static int PhoneBookReadEntriesRange(TSerialPortID Serial_Port_ID, int First_Index, int Last_Index, unsigned char *Pointer_Entry_States, int *Pointer_Is_Answer_Incomplete)
+{
+	char String_Temporary[512];
+	int Result, Entry_Index, Is_First_Line = 1;
+	TPhoneBookEntry Phone_Book_Entry;
+
+	*Pointer_Is_Answer_Incomplete = 0;
+
+	// Request all entries at once
+	sprintf(String_Temporary, "AT+CPBR=%d,%d", First_Index, Last_Index);
+	if (ATCommandSendCommand(Serial_Port_ID, String_Temporary) != 0)
+	{
+		LOG("Error : failed to send the read phone entries %d to %d command.\n", First_Index, Last_Index);
+		return -1;
+	}
+
+	// Parse all answer lines up to the final "OK"
+	while (1)
+	{
+		Result = ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary));
+		if (Result == -2)
+		{
+			// Phones that do not support the ranged form immediately answer an error, the caller can still read the entries one by one
+			if (Is_First_Line) LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "The phone does not support the ranged phone book read command.\n");
+			else LOG("Error : the phone reported an error while sending the phone book entries %d to %d.\n", First_Index, Last_Index);
+			return -1;
+		}
+		if ((Result < 0) && (Result != -3)) return -1; // Also stop when the phone does not answer in time, the last received line would be parsed again otherwise
+		Is_First_Line = 0;
+		if (Result == -3)
+		{
+			// The end of the line will be received as another line, which will be discarded as well
+			LOG("Warning : a phone book entry is too long to be received, it will be read again alone.\n");
+			*Pointer_Is_Answer_Incomplete = 1;
+			continue;
+		}
+
+		// Skip the line separators
+		if (String_Temporary[0] == 0) continue;
+		if (strcmp(String_Temporary, "OK") == 0) break;
+
+		// Is this an entry ?
+		if ((sscanf(String_Temporary, "+CPBR: %d,", &Entry_Index) != 1) || (Entry_Index < First_Index) || (Entry_Index > Last_Index))
+		{
+			LOG("Warning : unknown answer string when reading the phone book entries %d to %d. Answer string : \"%s\".\n", First_Index, Last_Index, String_Temporary);
+			*Pointer_Is_Answer_Incomplete = 1;
+			continue;
+		}
+
+		// Keep the entry only if it is valid, it will be read again later otherwise
+		if (PhoneBookParseEntry(String_Temporary, Entry_Index, &Phone_Book_Entry) != 0)
+		{
+			Pointer_Entry_States[Entry_Index - First_Index] = PHONE_BOOK_ENTRY_STATE_FAILED;
+			continue;
+		}
+		if (Pointer_Entry_States[Entry_Index - First_Index] == PHONE_BOOK_ENTRY_STATE_RECEIVED) continue; // Do not add twice an entry that the phone would have repeated
+		Pointer_Entry_States[Entry_Index - First_Index] = PHONE_BOOK_ENTRY_STATE_RECEIVED;
+		if (PhoneBookAddEntry(&Phone_Book_Entry) != 0) return -2;
+	}
+
+	return 0;
+}
+
+/** Get the amount of digits of the country code a number starts with.
+ * @param Pointer_String_Digits The international number digits, without any "+" or "00" prefix.
+ * @return The country code length in digits.
+ */
+static int PhoneBookGetCountryCodeLength(char *Pointer_String_Digits)
+{
+	int First_Digit, Second_Digit;
+
+	First_Digit = Pointer_String_Digits[0] - '0';
+	if ((First_Digit == 1) || (First_Digit == 7)) return 1;
+
+	Second_Digit = Pointer_String_Digits[1] - '0';
+	if ((Second_Digit >= 0) && (Second_Digit <= 9) && (Phone_Book_Two_Digits_Country_Codes[First_Digit] & (1 << Second_Digit))) return 2;
+	return 3;
+}
+
+/** Convert a phone number to the national significant number, which is the same for the "+33612345678", "0033612345678", "33612345678" and "0612345678" forms.
+ * @param Pointer_String_Number The number to convert. Spaces, dots, dashes and parenthesis are ignored.
+ * @param Pointer_String_Key On output, contain the national significant number. If the number contains other characters (like an alphanumeric sender name), the number is copied as-is. The string must be as large as a phone book entry number.
+ * @param Pointer_Digits_Count On output, contain the amount of digits of the national significant number, or 0 if the number is not made of digits.
+ */
+static void PhoneBookGetNumberKey(char *Pointer_String_Number, char *Pointer_String_Key, int *Pointer_Digits_Count)
+{
+	char String_Digits[sizeof(((TPhoneBookEntry *) 0)->String_Number)], *Pointer_String_Digits, Character;
+	int Digits_Count = 0, Is_International = 0, i;
+
+	// Keep only the digits
+	for (i = 0; Pointer_String_Number[i] != 0; i++)
+	{
+		Character = Pointer_String_Number[i];
+		if ((Character >= '0') && (Character <= '9'))
+		{
+			if (Digits_Count >= (int) sizeof(String_Digits) - 1) goto Exit_Not_A_Number;
+			String_Digits[Digits_Count] = Character;
+			Digits_Count++;
+		}
+		else if ((Character == '+') && (Digits_Count == 0)) Is_International = 1;
+		else if ((Character != ' ') && (Character != '.') && (Character != '-') && (Character != '(') && (Character != ')')) goto Exit_Not_A_Number;
+	}
+	String_Digits[Digits_Count] = 0;
+	if (Digits_Count == 0) goto Exit_Not_A_Number;
+	Pointer_String_Digits = String_Digits;
+
+	// Find which kind of prefix the number starts with
+	if (!Is_International)
+	{
+		if ((Pointer_String_Digits[0] == '0') && (Pointer_String_Digits[1] == '0'))
+		{
+			// International call prefix
+			Pointer_String_Digits += 2;
+			Is_International = 1;
+		}
+		else if (Pointer_String_Digits[0] == '0') Pointer_String_Digits++; // National trunk prefix
+		else if (Digits_Count >= PHONE_BOOK_BARE_INTERNATIONAL_NUMBER_MINIMUM_DIGITS_COUNT) Is_International = 1;
+	}
+
+	// Remove the country code
+	if (Is_International && (Pointer_String_Digits[0] != 0)) Pointer_String_Digits += PhoneBookGetCountryCodeLength(Pointer_String_Digits);
+
+	// Keep the full number if it only contains prefixes
+	if (*Pointer_String_Digits == 0) Pointer_String_Digits = String_Digits;
+	strcpy(Pointer_String_Key, Pointer_String_Digits);
+	*Pointer_Digits_Count = (int) strlen(Pointer_String_Key);
+	return;
+
+Exit_Not_A_Number:
+	strncpy(Pointer_String_Key, Pointer_String_Number, sizeof(String_Digits) - 1);
+	Pointer_String_Key[sizeof(String_Digits) - 1] = 0;
+	*Pointer_Digits_Count = 0;
+}
+
+/** Compute the FNV-1a hash of a string.
+ * @param Pointer_String The string to hash.
+ * @return The string hash.
+ */
+static unsigned int PhoneBookHashString(char *Pointer_String)
+{
+	unsigned int Hash = 2166136261U;
+
+	while (*Pointer_String != 0)
+	{
+		Hash ^= (unsigned char) *Pointer_String;
+		Hash *= 16777619U;
+		Pointer_String++;
+	}
+	return Hash;
+}
+
+/** Convert the last digits of a national significant number to the suffix index key.
+ * @param Pointer_String_Key The national significant number.
+ * @param Digits_Count The national significant number length, it must be at least PHONE_BOOK_SUFFIX_DIGITS_COUNT.
+ * @return The suffix value.
+ */
+static unsigned int PhoneBookGetSuffix(char *Pointer_String_Key, int Digits_Count)
+{
+	unsigned int Suffix = 0;
+	int i;
+
+	for (i = Digits_Count - PHONE_BOOK_SUFFIX_DIGITS_COUNT; i < Digits_Count; i++) Suffix = Suffix * 10 + (unsigned int) (Pointer_String_Key[i] - '0');
+	return Suffix;
+}
+
+/** Get the suffix index slot to start probing at.
+ * @param Suffix The suffix to look for.
+ * @return The first slot index.
+ */
+static inline unsigned int PhoneBookGetSuffixSlotIndex(unsigned int Suffix)
+{
+	return ((Suffix * 2654435761U) >> 16) & PHONE_BOOK_INDEX_SLOTS_MASK; // Multiplicative hashing, the middle bits are better mixed than the lowest ones
+}
+
+/** Fill the number and suffix hash tables with all the phone book entries. */
+static void PhoneBookBuildIndexes(void)
+{
+	int i, Digits_Count;
+	unsigned int Hash, Slot_Index, Suffix;
+	char *Pointer_String_Key;
+
+	// Empty the tables
+	for (i = 0; i < PHONE_BOOK_INDEX_SLOTS_COUNT; i++)
+	{
+		Phone_Book_Number_Index[i].Entry_Index = PHONE_BOOK_INDEX_ENTRY_NONE;
+		Phone_Book_Suffix_Index[i].Entry_Index = PHONE_BOOK_INDEX_ENTRY_NONE;
+	}
+
+	for (i = 0; i < Phone_Book_Entries_Count; i++)
+	{
+		Pointer_String_Key = Phone_Book_Entries_Keys[i];
+		PhoneBookGetNumberKey(Phone_Book_Entries[i].String_Number, Pointer_String_Key, &Digits_Count);
+		if (Pointer_String_Key[0] == 0) continue; // Entries without number can't be found
+
+		// Add the number to the number index, the first entry wins if the same number is present several times
+		Hash = PhoneBookHashString(Pointer_String_Key);
+		Slot_Index = Hash & PHONE_BOOK_INDEX_SLOTS_MASK;
+		while (Phone_Book_Number_Index[Slot_Index].Entry_Index != PHONE_BOOK_INDEX_ENTRY_NONE)
+		{
+			if ((Phone_Book_Number_Index[Slot_Index].Hash == Hash) && (strcmp(Phone_Book_Entries_Keys[Phone_Book_Number_Index[Slot_Index].Entry_Index], Pointer_String_Key) == 0)) break;
+			Slot_Index = (Slot_Index + 1) & PHONE_BOOK_INDEX_SLOTS_MASK;
+		}
+		if (Phone_Book_Number_Index[Slot_Index].Entry_Index == PHONE_BOOK_INDEX_ENTRY_NONE)
+		{
+			Phone_Book_Number_Index[Slot_Index].Hash = Hash;
+			Phone_Book_Number_Index[Slot_Index].Entry_Index = i;
+		}
+
+		// Add the number last digits to the suffix index
+		if (Digits_Count < PHONE_BOOK_SUFFIX_DIGITS_COUNT) continue;
+		Suffix = PhoneBookGetSuffix(Pointer_String_Key, Digits_Count);
+		Slot_Index = PhoneBookGetSuffixSlotIndex(Suffix);
+		while (Phone_Book_Suffix_Index[Slot_Index].Entry_Index != PHONE_BOOK_INDEX_ENTRY_NONE)
+		{
+			if (Phone_Book_Suffix_Index[Slot_Index].Suffix == Suffix) break;
+			Slot_Index = (Slot_Index + 1) & PHONE_BOOK_INDEX_SLOTS_MASK;
+		}
+		if (Phone_Book_Suffix_Index[Slot_Index].Entry_Index == PHONE_BOOK_INDEX_ENTRY_NONE)
+		{
+			Phone_Book_Suffix_Index[Slot_Index].Suffix = Suffix;
+			Phone_Book_Suffix_Index[Slot_Index].Entry_Index = i;
+		}
+		// Different numbers ending the same way can't be told apart by their suffix
+		else if ((Phone_Book_Suffix_Index[Slot_Index].Entry_Index != PHONE_BOOK_INDEX_ENTRY_AMBIGUOUS) && (strcmp(Phone_Book_Entries_Keys[Phone_Book_Suffix_Index[Slot_Index].Entry_Index], Pointer_String_Key) != 0)) Phone_Book_Suffix_Index[Slot_Index].Entry_Index = PHONE_BOOK_INDEX_ENTRY_AMBIGUOUS;
+	}
+	Is_Phone_Book_Index_Built = 1;
+}
+
+/** Search for a phone number in the phone book indexes.
  * @param Pointer_String_Number The number to search for.
  * @return -1 if the number was not found,
  * @return 0 or a positive number if the number was found, corresponding to the number index in the phone book.
- * @note This function is looking for an exact match.
  */
 static int PhoneBookSearchNumber(char *Pointer_String_Number)
 {
-	int i;
+	char String_Key[sizeof(((TPhoneBookEntry *) 0)->String_Number)];
+	int Digits_Count, Entry_Index;
+	unsigned int Hash, Slot_Index, Suffix;
 
-	for (i = 0; i < Phone_Book_Entries_Count; i++)
+	if (!Is_Phone_Book_Index_Built) return -1;
+	PhoneBookGetNumberKey(Pointer_String_Number, String_Key, &Digits_Count);
+
+	// Look for the exact national significant number
+	Hash = PhoneBookHashString(String_Key);
+	Slot_Index = Hash & PHONE_BOOK_INDEX_SLOTS_MASK;
+	while (1)
 	{
-		if (strcmp(Pointer_String_Number, Phone_Book_Entries[i].String_Number) == 0) return i;
+		Entry_Index = Phone_Book_Number_Index[Slot_Index].Entry_Index;
+		if (Entry_Index == PHONE_BOOK_INDEX_ENTRY_NONE) break;
+		if ((Phone_Book_Number_Index[Slot_Index].Hash == Hash) && (strcmp(Phone_Book_Entries_Keys[Entry_Index], String_Key) == 0))
+		{
+			LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "The number \"%s\" has been found with the key \"%s\" at index %d of the phone book table.\n", Pointer_String_Number, String_Key, Entry_Index);
+			return Entry_Index;
+		}
+		Slot_Index = (Slot_Index + 1) & PHONE_BOOK_INDEX_SLOTS_MASK;
 	}
 
-	return -1;
+	// The country code might not have been recognized, try with the last digits only
+	if (Digits_Count < PHONE_BOOK_SUFFIX_DIGITS_COUNT) return -1;
+	Suffix = PhoneBookGetSuffix(String_Key, Digits_Count);
+	Slot_Index = PhoneBookGetSuffixSlotIndex(Suffix);
+	while (1)
+	{
+		Entry_Index = Phone_Book_Suffix_Index[Slot_Index].Entry_Index;
+		if (Entry_Index == PHONE_BOOK_INDEX_ENTRY_NONE) return -1;
+		if (Phone_Book_Suffix_Index[Slot_Index].Suffix == Suffix) break;
+		Slot_Index = (Slot_Index + 1) & PHONE_BOOK_INDEX_SLOTS_MASK;
+	}
+	if (Entry_Index == PHONE_BOOK_INDEX_ENTRY_AMBIGUOUS)
+	{
+		LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "The last digits of the number \"%s\" match several phone book entries.\n", Pointer_String_Number);
+		return -1;
+	}
+	// Numbers of the same length would have matched exactly if they were the same, so only accept numbers with an additional prefix
+	if ((int) strlen(Phone_Book_Entries_Keys[Entry_Index]) == Digits_Count) return -1;
+	LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "The number \"%s\" has been found from its last digits at index %d of the phone book table.\n", Pointer_String_Number, Entry_Index);
+	return Entry_Index;
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -193,8 +563,9 @@ static int PhoneBookSearchNumber(char *Pointer_String_Number)
 int PhoneBookReadAllEntries(TSerialPortID Serial_Port_ID)
 {
 	char String_Answer[256];
-	int First_Index, Last_Index, i, Result, Failures_Count;
+	int First_Index, Last_Index, i, Result, Failures_Count, Is_Answer_Incomplete, Return_Value = -1;
 	TPhoneBookEntry Phone_Book_Entry;
+	unsigned char *Pointer_Entry_States = NULL;
 
 	// Select the phone internal memory phone book
 	if (ATCommandSendCommand(Serial_Port_ID, "AT+CPBS=\"ME\"") != 0)
@@ -234,12 +605,46 @@ int PhoneBookReadAllEntries(TSerialPortID Serial_Port_ID)
 		LOG("Error : failed to retrieve the phone book first and last indexes.\n");
 		return -1;
 	}
+	// Wait for the empty line before "OK"
+	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Answer, sizeof(String_Answer)) < 0) return -1;
+	// Wait for "OK"
+	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Answer, sizeof(String_Answer)) < 0) return -1;
+	if (strcmp(String_Answer, "OK") != 0)
+	{
+		LOG("Error : failed to receive the ending \"OK\" answer when retrieving the phone book indexes.\n");
+		return -1;
+	}
 	LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "First index : %d, last index : %d.\n", First_Index, Last_Index);
 
-	// Try to read all entries
+	// Allocate the entries state table
+	if (Last_Index < First_Index)
+	{
+		LOG("Error : the phone book last index %d is lower than the first index %d.\n", Last_Index, First_Index);
+		return -1;
+	}
+	Pointer_Entry_States = calloc(Last_Index - First_Index + 1, sizeof(unsigned char)); // All entries are initialized to PHONE_BOOK_ENTRY_STATE_NOT_RECEIVED
+	if (Pointer_Entry_States == NULL)
+	{
+		LOG("Error : failed to allocate the phone book entries state table.\n");
+		return -1;
+	}
+
+	// The indexes will be built again when all entries are known
+	Is_Phone_Book_Index_Built = 0;
+
+	// Try to read all entries with a single command, this is way faster than reading each entry because empty entries are not sent
 	Phone_Book_Entries_Count = 0;
-	for (i = First_Index; i < Last_Index; i++)
+	Result = PhoneBookReadEntriesRange(Serial_Port_ID, First_Index, Last_Index, Pointer_Entry_States, &Is_Answer_Incomplete);
+	if (Result == -2) goto Exit;
+	if (Result == -1) Is_Answer_Incomplete = 1; // Nothing can be told about the entries that were not received, so read them all again
+	LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "The ranged read returned %d entries, the answer is %s.\n", Phone_Book_Entries_Count, Is_Answer_Incomplete ? "incomplete" : "complete");
+
+	// Read again one by one the entries that could not be retrieved by the ranged read
+	for (i = First_Index; i <= Last_Index; i++)
 	{
+		if (Pointer_Entry_States[i - First_Index] == PHONE_BOOK_ENTRY_STATE_RECEIVED) continue;
+		if ((Pointer_Entry_States[i - First_Index] == PHONE_BOOK_ENTRY_STATE_NOT_RECEIVED) && !Is_Answer_Incomplete) continue; // The entry is empty
+
 		// Sometimes the reading of an entry fails, so retry several times before giving up
 		for (Failures_Count = 0; Failures_Count < 3; Failures_Count++)
 		{
@@ -249,34 +654,29 @@ int PhoneBookReadAllEntries(TSerialPortID Serial_Port_ID)
 		if (Failures_Count == 3)
 		{
 			LOG("Error : failed to retrieve the phone book entry of index %d.\n", i);
-			return -1;
+			goto Exit;
 		}
 
 		// Ignore the entry if it is empty
-		if (Result == 1)
-		{
-			memcpy(&Phone_Book_Entries[Phone_Book_Entries_Count], &Phone_Book_Entry, sizeof(TPhoneBookEntry));
-			Phone_Book_Entries_Count++;
-
-			if (Phone_Book_Entries_Count >= PHONE_BOOK_MAXIMUM_ENTRIES)
-			{
-				LOG("Error : the program can store only %d valid phone book entries but the phone contains more valid entries. Increase the program maximum value and retry.\n", PHONE_BOOK_MAXIMUM_ENTRIES);
-				return -1;
-			}
-		}
+		if ((Result == 1) && (PhoneBookAddEntry(&Phone_Book_Entry) != 0)) goto Exit;
 	}
 
 	// Dump the entries table in debug mode
 	LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "Phone book entries table contains %d entries :\n", Phone_Book_Entries_Count);
 	for (i = 0; i < Phone_Book_Entries_Count; i++) LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "Entry %d : number=\"%s\", name=\"%s\".\n", i, Phone_Book_Entries[i].String_Number, Phone_Book_Entries[i].String_Name);
 
-	return 0;
+	// Allow to find a contact name without scanning the whole table
+	PhoneBookBuildIndexes();
+	Return_Value = 0;
+
+Exit:
+	free(Pointer_Entry_States);
+	return Return_Value;
 }
 
 int PhoneBookGetNameFromNumber(char *Pointer_String_Number, char *Pointer_String_Name)
 {
 	int Index;
-	char String_Temporary[256];
 
 	// Make sure the provided number is not empty
 	if (Pointer_String_Number[0] == 0)
@@ -285,23 +685,9 @@ int PhoneBookGetNameFromNumber(char *Pointer_String_Number, char *Pointer_String
 		goto Exit_Number_Not_Found;
 	}
 
-	// Try to find the number as-is
+	// Try to find the number whatever its prefix is
 	Index = PhoneBookSearchNumber(Pointer_String_Number);
-	if (Index >= 0)
-	{
-		LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "The number has been found as-is at index %d of the phone book table.\n", Index);
-		goto Exit_Number_Found;
-	}
-
-	// Number was not found, try without the country prefix
-	strcpy(String_Temporary, &Pointer_String_Number[1]); // Copy the number discarding the first digit of the country code
-	String_Temporary[0] = '0'; // Replace what was the second digit of the country code by the zero character
-	Index = PhoneBookSearchNumber(String_Temporary);
-	if (Index >= 0)
-	{
-		LOG_DEBUG(PHONE_BOOK_IS_DEBUG_ENABLED, "The number has been found after removing the country code at index %d of the phone book table.\n", Index);
-		goto Exit_Number_Found;
-	}
+	if (Index >= 0) goto Exit_Number_Found;
 
 Exit_Number_Not_Found:
 	// No matching number was found, so provide the phone number as the name
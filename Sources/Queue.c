@@ -0,0 +1,176 @@
+/** @file Queue.c
+ * See Queue.h for description.
+ * @author Adrien RICCIARDI
+ */
+#include <Log.h>
+#include <Queue.h>
+#include <stdlib.h>
+#include <time.h>
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Get a monotonic timestamp.
+ * @return The current time in nanoseconds.
+ */
+static unsigned long long QueueGetTime(void)
+{
+	struct timespec Time;
+
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	return (unsigned long long) Time.tv_sec * 1000000000ULL + (unsigned long long) Time.tv_nsec;
+}
+
+/** Remove the oldest item from a queue that is not empty. The queue mutex must be locked.
+ * @param Pointer_Queue The queue.
+ * @return The oldest item.
+ */
+static void *QueueRemoveItem(TQueue *Pointer_Queue)
+{
+	void *Pointer_Item;
+
+	Pointer_Item = Pointer_Queue->Pointer_Items[Pointer_Queue->Read_Index];
+	Pointer_Queue->Read_Index = (Pointer_Queue->Read_Index + 1) % Pointer_Queue->Capacity;
+	Pointer_Queue->Items_Count--;
+
+	pthread_cond_signal(&Pointer_Queue->Condition_Not_Full);
+	return Pointer_Item;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Public functions
+//-------------------------------------------------------------------------------------------------
+int QueueInitialize(TQueue *Pointer_Queue, unsigned int Capacity)
+{
+	pthread_condattr_t Condition_Attributes;
+
+	Pointer_Queue->Pointer_Items = malloc(Capacity * sizeof(void *));
+	if (Pointer_Queue->Pointer_Items == NULL)
+	{
+		LOG("Error : could not allocate a queue of %u items.\n", Capacity);
+		return -1;
+	}
+	Pointer_Queue->Capacity = Capacity;
+	Pointer_Queue->Read_Index = 0;
+	Pointer_Queue->Items_Count = 0;
+	Pointer_Queue->Is_Closed = 0;
+	Pointer_Queue->Push_Waits_Count = 0;
+	Pointer_Queue->Push_Wait_Time = 0;
+	Pointer_Queue->Pop_Waits_Count = 0;
+	Pointer_Queue->Pop_Wait_Time = 0;
+	Pointer_Queue->Maximum_Items_Count = 0;
+	pthread_mutex_init(&Pointer_Queue->Mutex, NULL);
+	// The timed pops use the monotonic clock, so they are not disturbed by a system time change
+	pthread_condattr_init(&Condition_Attributes);
+	pthread_condattr_setclock(&Condition_Attributes, CLOCK_MONOTONIC);
+	pthread_cond_init(&Pointer_Queue->Condition_Not_Empty, &Condition_Attributes);
+	pthread_condattr_destroy(&Condition_Attributes);
+	pthread_cond_init(&Pointer_Queue->Condition_Not_Full, NULL);
+
+	return 0;
+}
+
+void QueueRelease(TQueue *Pointer_Queue)
+{
+	pthread_cond_destroy(&Pointer_Queue->Condition_Not_Full);
+	pthread_cond_destroy(&Pointer_Queue->Condition_Not_Empty);
+	pthread_mutex_destroy(&Pointer_Queue->Mutex);
+	free(Pointer_Queue->Pointer_Items);
+}
+
+int QueuePush(TQueue *Pointer_Queue, void *Pointer_Item)
+{
+	unsigned long long Start_Time;
+
+	pthread_mutex_lock(&Pointer_Queue->Mutex);
+
+	// Wait for some room, measuring how long the producer is held back by the consumer
+	if ((Pointer_Queue->Items_Count == Pointer_Queue->Capacity) && !Pointer_Queue->Is_Closed)
+	{
+		Start_Time = QueueGetTime();
+		while ((Pointer_Queue->Items_Count == Pointer_Queue->Capacity) && !Pointer_Queue->Is_Closed) pthread_cond_wait(&Pointer_Queue->Condition_Not_Full, &Pointer_Queue->Mutex);
+		Pointer_Queue->Push_Waits_Count++;
+		Pointer_Queue->Push_Wait_Time += QueueGetTime() - Start_Time;
+	}
+	if (Pointer_Queue->Is_Closed)
+	{
+		pthread_mutex_unlock(&Pointer_Queue->Mutex);
+		return -1;
+	}
+
+	// Append the item
+	Pointer_Queue->Pointer_Items[(Pointer_Queue->Read_Index + Pointer_Queue->Items_Count) % Pointer_Queue->Capacity] = Pointer_Item;
+	Pointer_Queue->Items_Count++;
+	if (Pointer_Queue->Items_Count > Pointer_Queue->Maximum_Items_Count) Pointer_Queue->Maximum_Items_Count = Pointer_Queue->Items_Count;
+
+	pthread_cond_signal(&Pointer_Queue->Condition_Not_Empty);
+	pthread_mutex_unlock(&Pointer_Queue->Mutex);
+	return 0;
+}
+
+void *QueuePop(TQueue *Pointer_Queue)
+{
+	void *Pointer_Item;
+	unsigned long long Start_Time;
+
+	pthread_mutex_lock(&Pointer_Queue->Mutex);
+
+	// Wait for an item, measuring how long the consumer is starved by the producer
+	if ((Pointer_Queue->Items_Count == 0) && !Pointer_Queue->Is_Closed)
+	{
+		Start_Time = QueueGetTime();
+		while ((Pointer_Queue->Items_Count == 0) && !Pointer_Queue->Is_Closed) pthread_cond_wait(&Pointer_Queue->Condition_Not_Empty, &Pointer_Queue->Mutex);
+		Pointer_Queue->Pop_Waits_Count++;
+		Pointer_Queue->Pop_Wait_Time += QueueGetTime() - Start_Time;
+	}
+	if (Pointer_Queue->Items_Count == 0) // The queue has been closed
+	{
+		pthread_mutex_unlock(&Pointer_Queue->Mutex);
+		return NULL;
+	}
+
+	Pointer_Item = QueueRemoveItem(Pointer_Queue);
+	pthread_mutex_unlock(&Pointer_Queue->Mutex);
+	return Pointer_Item;
+}
+
+int QueueTimedPop(TQueue *Pointer_Queue, unsigned int Timeout, void **Pointer_Pointer_Item)
+{
+	unsigned long long Start_Time, Deadline;
+	struct timespec Deadline_Time;
+	int Is_Timeout_Expired = 0;
+
+	pthread_mutex_lock(&Pointer_Queue->Mutex);
+
+	// Wait for an item, measuring how long the consumer is starved by the producer
+	if ((Pointer_Queue->Items_Count == 0) && !Pointer_Queue->Is_Closed)
+	{
+		Start_Time = QueueGetTime();
+		Deadline = Start_Time + (unsigned long long) Timeout * 1000000ULL;
+		Deadline_Time.tv_sec = (time_t) (Deadline / 1000000000ULL);
+		Deadline_Time.tv_nsec = (long) (Deadline % 1000000000ULL);
+		while ((Pointer_Queue->Items_Count == 0) && !Pointer_Queue->Is_Closed && !Is_Timeout_Expired) Is_Timeout_Expired = pthread_cond_timedwait(&Pointer_Queue->Condition_Not_Empty, &Pointer_Queue->Mutex, &Deadline_Time) != 0;
+		if (Pointer_Queue->Items_Count > 0) Is_Timeout_Expired = 0; // An item may have been queued right when the timeout expired
+		if (!Is_Timeout_Expired) Pointer_Queue->Pop_Waits_Count++; // A wait that spans several timeouts is counted only once
+		Pointer_Queue->Pop_Wait_Time += QueueGetTime() - Start_Time;
+	}
+	if (Pointer_Queue->Items_Count == 0)
+	{
+		pthread_mutex_unlock(&Pointer_Queue->Mutex);
+		if (Is_Timeout_Expired) return -2;
+		return -1; // The queue has been closed
+	}
+
+	*Pointer_Pointer_Item = QueueRemoveItem(Pointer_Queue);
+	pthread_mutex_unlock(&Pointer_Queue->Mutex);
+	return 0;
+}
+
+void QueueClose(TQueue *Pointer_Queue)
+{
+	pthread_mutex_lock(&Pointer_Queue->Mutex);
+	Pointer_Queue->Is_Closed = 1;
+	pthread_cond_broadcast(&Pointer_Queue->Condition_Not_Empty);
+	pthread_cond_broadcast(&Pointer_Queue->Condition_Not_Full);
+	pthread_mutex_unlock(&Pointer_Queue->Mutex);
+}
@@ -6,12 +6,16 @@
 #include <errno.h>
 #include <File_Manager.h>
 #include <Log.h>
+#include <Message_Index.h>
 #include <Phone_Book.h>
 #include <SMS.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 #include <Utility.h>
+#if defined(__x86_64__)
+	#include <immintrin.h>
+#endif
 
 //-------------------------------------------------------------------------------------------------
 // Private constants
@@ -19,16 +23,27 @@
 /** Allow to turn on or off debug messages. */
 #define SMS_IS_DEBUG_ENABLED 0
 
+/** Tell whether the BMI2 septets unpacker can be built for the target architecture (the PDEP instruction is 64-bit only). */
+#if defined(__x86_64__)
+	#define SMS_IS_X86_BMI2_AVAILABLE 1
+#else
+	#define SMS_IS_X86_BMI2_AVAILABLE 0
+#endif
+
 /** The size in bytes of the buffer holding a SMS text. */
 #define SMS_TEXT_STRING_MAXIMUM_SIZE 512
 
-/** How many records to read from the phone. */
-#define SMS_RECORDS_MAXIMUM_COUNT 450 // This value is reported by the command AT+EQSI, it is set to 20 for the SIM storage and 450 for the mobile equipment storage
+/** How many records to read from the phone when the storage capacity can't be retrieved. */
+#define SMS_RECORDS_DEFAULT_COUNT 450 // This value is reported by the command AT+EQSI, it is set to 20 for the SIM storage and 450 for the mobile equipment storage
 
 /** The hardcoded path of the directory containing the archived SMS files. */
 #define SMS_ARCHIVED_MESSAGES_DIRECTORY_PATH "C:\\SMSArch"
-/** The temporary file used to store each archived message. */
-#define SMS_ARCHIVED_MESSAGE_TEMPORARY_FILE_PATH "Output/SMS/Archive.tmp"
+
+/** Replace the text of the parts of a concatenated message that were not found. */
+#define SMS_MISSING_PART_TEXT "[...]"
+
+/** The index of the messages already written to the output files. */
+#define SMS_INDEX_FILE_PATH "Output/SMS/Index.txt"
 
 //-------------------------------------------------------------------------------------------------
 // Private types
@@ -57,101 +72,229 @@ typedef struct
 	int Time_Hour;
 	int Time_Minutes;
 	int Time_Seconds;
+	unsigned long long Fingerprint; //!< Identify the record content, so the index can tell whether it changed since the previous run.
+	int Is_Already_Exported; //!< Tell whether the record content has already been written to the output files by a previous run.
 } TSMSRecord;
 
+/** Gather the parts of a concatenated message. All parts of a message share the same reference ID, storage location, phone number and parts count. */
+typedef struct
+{
+	TSMSRecord *Pointer_First_Received_Part; //!< The first part found for this message, it holds the key of the message. NULL if the reassembly table slot is free.
+	TSMSRecord *Pointer_Last_Received_Part; //!< The last part found for this message, the message is written when this record is reached, so the messages keep the records order.
+	unsigned int Hash; //!< The key hash, it allows to skip most of the full key comparisons.
+	TSMSRecord **Pointer_Parts; //!< Each part is stored at the index of its number minus one, missing parts are NULL.
+	int Received_Parts_Count; //!< How many different parts have been found.
+	int Is_Written; //!< Tell whether the message has already been written to the output file.
+	int Is_New_Part_Found; //!< Tell whether at least one part has not been exported by a previous run, otherwise the message must not be written again.
+	int Is_Exported_Part_Found; //!< Tell whether at least one part has already been exported by a previous run.
+} TSMSReassemblyEntry;
+
+/** Unpack groups of 8 septets, each group being stored in 7 bytes.
+ * @param Pointer_Packed_Septets The packed septets. 8 bytes must be readable from the byte holding the first bit of each group.
+ * @param Bit_Offset The offset in bits of the first septet from the beginning of the packed septets.
+ * @param Groups_Count How many groups of 8 septets to unpack.
+ * @param Pointer_Septets On output, contain one septet per byte.
+ */
+typedef void (*TSMSSeptetsUnpacker)(const unsigned char *Pointer_Packed_Septets, unsigned int Bit_Offset, unsigned int Groups_Count, unsigned char *Pointer_Septets);
+
 //-------------------------------------------------------------------------------------------------
 // Private functions
 //-------------------------------------------------------------------------------------------------
-/** Uncompress 7-bit encoded SMS text.
- * @param Pointer_Compressed_Text The compressed text received from the phone.
- * @param Bytes_Count The uncompressed text length.
- * @param Pointer_String_Uncompressed_Text On output, contain the uncompressed text converted to 8-bit ASCII. Make sure the provided string is large enough.
+/** Read 8 bytes as a little-endian 64-bit word, which is the order the septets are packed in.
+ * @param Pointer_Bytes The bytes to read, they do not need to be aligned.
+ * @return The 64-bit word.
  */
-static void SMSUncompress7BitText(unsigned char *Pointer_Compressed_Text, int Bytes_Count, char *Pointer_String_Uncompressed_Text)
+static inline unsigned long long SMSLoadLittleEndian64(const unsigned char *Pointer_Bytes)
 {
-	int i, Index = 7;
-	unsigned char Byte, Mask = 0x7F, Leftover_Bits = 0;
-	char *Pointer_String_Uncompressed_Text_Initial_Value = Pointer_String_Uncompressed_Text;
-	
-	// Go through all compressed bytes, stopping in case the message is wrong and does not include the terminating character
-	for (i = 0; i < Bytes_Count; i++)
-	{
-		// Retrieve the most significant bits
-		Byte = *Pointer_Compressed_Text & Mask;
-		// Adjust their position
-		Byte <<= 7 - Index;
-		// Append the least significant bits from the previous byte
-		Byte |= Leftover_Bits;
-		// Make sure bit 7 is not set
-		Byte &= 0x7F;
-		// Is the end of the text string reached ?
-		if (Byte == 0) break;
-
-		// Keep the next byte least significant bits
-		Leftover_Bits = *Pointer_Compressed_Text & ~Mask;
-		Leftover_Bits >>= Index;
-
-		// Append the decoded character to the output string
-		Pointer_Compressed_Text++;
-		*Pointer_String_Uncompressed_Text = (char) Byte;
-		Pointer_String_Uncompressed_Text++;
-
-		// 7 bytes encode 8 characters, so reset the state machine when 7 input bytes have been processed
-		if (Index <= 1)
-		{
-			// When 7 input bytes have been processed, a whole character is still contained in the leftover bits, handle it here
-			Byte = Leftover_Bits & 0x7F;
-			if (Byte == 0) break; // Is the end of the text string reached ?
-			*Pointer_String_Uncompressed_Text = Byte;
-			Pointer_String_Uncompressed_Text++;
-
-			Index = 7;
-			Mask = 0x7F;
-			Leftover_Bits = 0;
-		}
-		else
+	unsigned long long Word;
+
+	memcpy(&Word, Pointer_Bytes, sizeof(Word));
+	#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		Word = __builtin_bswap64(Word);
+	#endif
+	return Word;
+}
+
+/** Unpack 8 septets at a time with 64-bit shifts. See TSMSSeptetsUnpacker for the description. */
+static void SMSUnpackSeptetsScalar(const unsigned char *Pointer_Packed_Septets, unsigned int Bit_Offset, unsigned int Groups_Count, unsigned char *Pointer_Septets)
+{
+	unsigned long long Word;
+	unsigned int i, j;
+
+	for (i = 0; i < Groups_Count; i++)
+	{
+		// A group is 56-bit long, so at least 57 meaningful bits remain once the word is aligned on the first septet
+		Word = SMSLoadLittleEndian64(&Pointer_Packed_Septets[Bit_Offset / 8]) >> (Bit_Offset % 8);
+		for (j = 0; j < 8; j++) Pointer_Septets[j] = (unsigned char) ((Word >> (7 * j)) & 0x7F);
+
+		Bit_Offset += 56;
+		Pointer_Septets += 8;
+	}
+}
+
+#if SMS_IS_X86_BMI2_AVAILABLE
+	/** Unpack 8 septets at a time with a single bits deposit instruction. See TSMSSeptetsUnpacker for the description. */
+	__attribute__((target("bmi2"))) static void SMSUnpackSeptetsBMI2(const unsigned char *Pointer_Packed_Septets, unsigned int Bit_Offset, unsigned int Groups_Count, unsigned char *Pointer_Septets)
+	{
+		unsigned long long Word;
+		unsigned int i;
+
+		for (i = 0; i < Groups_Count; i++)
 		{
-			Index--;
-			Mask >>= 1;
+			// Spread each septet to its own byte, x86 is little-endian so the bytes can be stored as-is
+			Word = SMSLoadLittleEndian64(&Pointer_Packed_Septets[Bit_Offset / 8]) >> (Bit_Offset % 8);
+			Word = _pdep_u64(Word, 0x7F7F7F7F7F7F7F7FULL);
+			memcpy(Pointer_Septets, &Word, sizeof(Word));
+
+			Bit_Offset += 56;
+			Pointer_Septets += 8;
 		}
 	}
+#endif
 
-	// Terminate the output string
-	Pointer_String_Uncompressed_Text_Initial_Value[Bytes_Count] = 0;
+/** Select the fastest septets unpacker supported by the processor on first use, then forward the call to it. See TSMSSeptetsUnpacker for the description. */
+static void SMSUnpackSeptetsFirstCall(const unsigned char *Pointer_Packed_Septets, unsigned int Bit_Offset, unsigned int Groups_Count, unsigned char *Pointer_Septets);
+
+/** The septets unpacker to use. */
+static TSMSSeptetsUnpacker SMSUnpackSeptets = SMSUnpackSeptetsFirstCall;
+
+static void SMSUnpackSeptetsFirstCall(const unsigned char *Pointer_Packed_Septets, unsigned int Bit_Offset, unsigned int Groups_Count, unsigned char *Pointer_Septets)
+{
+	TSMSSeptetsUnpacker Unpacker = SMSUnpackSeptetsScalar;
+
+	#if SMS_IS_X86_BMI2_AVAILABLE
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("bmi2")) Unpacker = SMSUnpackSeptetsBMI2;
+	#endif
+	SMSUnpackSeptets = Unpacker;
+
+	Unpacker(Pointer_Packed_Septets, Bit_Offset, Groups_Count, Pointer_Septets);
 }
 
-/** Replace custom character set character values by standard ones and convert the text to UTF-8.
- * @param Pointer_String_Custom_Character_Set_Text The decoded text from the phone. This string will be modified by this function (special characters value will be changed, but string length will remain the same).
- * @param Pointer_String_Converted_Text On output, contain the text converted to UTF-8. Make sure the provided string is large enough.
+/** Unpack 7-bit encoded SMS text (see GSM 03.38 version 5.3.0 chapter 6.1.2.1.1).
+ * @param Pointer_Packed_Septets The packed septets received from the phone.
+ * @param Packed_Bytes_Count How many bytes can be read from the packed septets buffer.
+ * @param Bit_Offset The offset in bits of the first septet from the beginning of the packed septets buffer, it allows to skip the User Data Header fill bits.
+ * @param Septets_Count How many septets to unpack.
+ * @param Pointer_Septets On output, contain one septet per byte. Make sure the provided buffer can hold Septets_Count bytes.
+ * @return The amount of unpacked septets, it is lower than the requested amount if the packed buffer is too small.
  */
-static void SMSConvert7BitExtendedASCII(char *Pointer_String_Custom_Character_Set_Text, char *Pointer_String_Converted_Text)
+static int SMSUnpack7BitSeptets(const unsigned char *Pointer_Packed_Septets, int Packed_Bytes_Count, int Bit_Offset, int Septets_Count, unsigned char *Pointer_Septets)
 {
-	static unsigned char Extended_ASCII_Conversion_Table[256] = // Look-up table that converts SMS extended characters to Windows CP1252 extended characters, the default SMS alphabet is described in the GSM 03.38 Version 5.3.0 document section 6.2.1 (see also https://www.developershome.com/sms/gsmAlphabet.asp)
-	{
-		 '@', 0xA3,  '$', 0xA5, 0xE8, 0xE9, 0xF9, 0xEC, 0xF2, 0xC7, '\n', 0xD8, 0xF8, '\r', 0xC5, 0xE5,
-		0x86,  '_', 0x86, 0x86, 0x86, 0x86, 0x86, 0x86, 0x86, 0x86, 0x86, 0x86, 0xC6, 0xE6, 0xDF, 0xC9,
-		 ' ',  '!',  '"',  '#', 0xA4,  '%',  '&', '\'',  '(',  ')',  '*',  '+',  ',',  '-',  '.',  '/',
-		 '0',  '1',  '2',  '3',  '4',  '5',  '6',  '7',  '8',  '9',  ':',  ';',  '<',  '=',  '>',  '?',
-		0xA1,  'A',  'B',  'C',  'D',  'E',  'F',  'G',  'H',  'I',  'J',  'K',  'L',  'M',  'N',  'O',
-		 'P',  'Q',  'R',  'S',  'T',  'U',  'V',  'W',  'X',  'Y',  'Z', 0xC4, 0xD6, 0xD1, 0xDC, 0xA7,
-		0xBF,  'a',  'b',  'c',  'd',  'e',  'f',  'g',  'h',  'i',  'j',  'k',  'l',  'm',  'n',  'o',
-		 'p',  'q',  'r',  's',  't',  'u',  'v',  'w',  'x',  'y',  'z', 0xE4, 0xF6, 0xF1, 0xFC, 0xE0
+	unsigned char Group_Bytes[8], Group_Septets[8];
+	int Available_Septets_Count, Groups_Count, Unpacked_Septets_Count, Bytes_Count, Byte_Index;
+
+	// Do not read past the end of the buffer
+	Available_Septets_Count = (Packed_Bytes_Count * 8 - Bit_Offset) / 7;
+	if (Available_Septets_Count < 0) Available_Septets_Count = 0;
+	if (Septets_Count > Available_Septets_Count) Septets_Count = Available_Septets_Count;
+
+	// Unpack the full groups that can be loaded directly from the buffer, the last group starting byte is at (Bit_Offset + 56 * (Groups_Count - 1)) / 8 and 8 bytes must be readable from there
+	Groups_Count = Septets_Count / 8;
+	while ((Groups_Count > 0) && ((Bit_Offset + 56 * (Groups_Count - 1)) / 8 + 8 > Packed_Bytes_Count)) Groups_Count--;
+	SMSUnpackSeptets(Pointer_Packed_Septets, (unsigned int) Bit_Offset, (unsigned int) Groups_Count, Pointer_Septets);
+	Unpacked_Septets_Count = Groups_Count * 8;
+	Bit_Offset += Groups_Count * 56;
+
+	// Unpack the remaining septets from a zero-padded copy of the buffer end
+	while (Unpacked_Septets_Count < Septets_Count)
+	{
+		Byte_Index = Bit_Offset / 8;
+		Bytes_Count = Packed_Bytes_Count - Byte_Index;
+		if (Bytes_Count > (int) sizeof(Group_Bytes)) Bytes_Count = sizeof(Group_Bytes);
+		memset(Group_Bytes, 0, sizeof(Group_Bytes));
+		memcpy(Group_Bytes, &Pointer_Packed_Septets[Byte_Index], Bytes_Count);
+		SMSUnpackSeptetsScalar(Group_Bytes, (unsigned int) (Bit_Offset % 8), 1, Group_Septets);
+
+		Bytes_Count = Septets_Count - Unpacked_Septets_Count; // Recycle the variable to tell how many septets to keep
+		if (Bytes_Count > 8) Bytes_Count = 8;
+		memcpy(&Pointer_Septets[Unpacked_Septets_Count], Group_Septets, Bytes_Count);
+		Unpacked_Septets_Count += Bytes_Count;
+		Bit_Offset += 56;
+	}
+
+	return Unpacked_Septets_Count;
+}
+
+/** Convert 7-bit default alphabet text to UTF-8, including the characters of the escape extension table.
+ * @param Pointer_Septets The unpacked text, one septet per byte.
+ * @param Septets_Count How many septets to convert.
+ * @param Pointer_String_Converted_Text On output, contain the text converted to UTF-8. The string is always terminated, the text is truncated on a character boundary if it does not fit.
+ * @param Converted_Text_Size The size in bytes of the output string.
+ * @return The length in bytes of the converted text.
+ */
+static int SMSConvert7BitToUTF8(const unsigned char *Pointer_Septets, int Septets_Count, char *Pointer_String_Converted_Text, int Converted_Text_Size)
+{
+	static const unsigned short Default_Alphabet_Table[128] = // Unicode code point of each default alphabet character, see GSM 03.38 Version 5.3.0 document section 6.2.1 (the escape character is displayed as a non-breaking space, like the standard mandates for reserved characters)
+	{
+		0x0040, 0x00A3, 0x0024, 0x00A5, 0x00E8, 0x00E9, 0x00F9, 0x00EC, 0x00F2, 0x00C7, 0x000A, 0x00D8, 0x00F8, 0x000D, 0x00C5, 0x00E5,
+		0x0394, 0x005F, 0x03A6, 0x0393, 0x039B, 0x03A9, 0x03A0, 0x03A8, 0x03A3, 0x0398, 0x039E, 0x00A0, 0x00C6, 0x00E6, 0x00DF, 0x00C9,
+		0x0020, 0x0021, 0x0022, 0x0023, 0x00A4, 0x0025, 0x0026, 0x0027, 0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+		0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037, 0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+		0x00A1, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047, 0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+		0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057, 0x0058, 0x0059, 0x005A, 0x00C4, 0x00D6, 0x00D1, 0x00DC, 0x00A7,
+		0x00BF, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067, 0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+		0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077, 0x0078, 0x0079, 0x007A, 0x00E4, 0x00F6, 0x00F1, 0x00FC, 0x00E0
 	};
-	unsigned char Byte;
-	char *Pointer_String_Temporary;
+	static const unsigned short Escape_Extension_Table[128] = // Unicode code point of the characters following the escape character, 0 means that the character is not defined so the default alphabet character is used instead (see GSM 03.38 Version 5.3.0 document section 6.2.1.1)
+	{
+		[0x0A] = 0x000C, // Page break
+		[0x14] = 0x005E, // ^
+		[0x28] = 0x007B, // {
+		[0x29] = 0x007D, // }
+		[0x2F] = 0x005C, // Backslash
+		[0x3C] = 0x005B, // [
+		[0x3D] = 0x007E, // ~
+		[0x3E] = 0x005D, // ]
+		[0x40] = 0x007C, // |
+		[0x65] = 0x20AC // Euro sign
+	};
+	unsigned short Code_Point;
+	unsigned char Septet;
+	int i, Length = 0;
 
-	// Process each character through the look-up table
-	Pointer_String_Temporary = Pointer_String_Custom_Character_Set_Text;
-	while (*Pointer_String_Temporary != 0)
+	Converted_Text_Size--; // Keep room for the terminating zero
+	for (i = 0; i < Septets_Count; i++)
 	{
-		Byte = *Pointer_String_Temporary;
-		*Pointer_String_Temporary = Extended_ASCII_Conversion_Table[Byte]; // Use a non-signed variable as array index to avoid a compiler warning
-		Pointer_String_Temporary++;
+		Septet = Pointer_Septets[i] & 0x7F;
+
+		// Find the character code point
+		if ((Septet == 0x1B) && (i + 1 < Septets_Count))
+		{
+			i++;
+			Septet = Pointer_Septets[i] & 0x7F;
+			Code_Point = Escape_Extension_Table[Septet];
+			if (Code_Point == 0) Code_Point = Default_Alphabet_Table[Septet];
+		}
+		else Code_Point = Default_Alphabet_Table[Septet];
+
+		// Encode it to UTF-8, all code points are in the Basic Multilingual Plane
+		if (Code_Point < 0x80)
+		{
+			if (Length + 1 > Converted_Text_Size) break;
+			Pointer_String_Converted_Text[Length] = (char) Code_Point;
+			Length++;
+		}
+		else if (Code_Point < 0x800)
+		{
+			if (Length + 2 > Converted_Text_Size) break;
+			Pointer_String_Converted_Text[Length] = (char) (0xC0 | (Code_Point >> 6));
+			Pointer_String_Converted_Text[Length + 1] = (char) (0x80 | (Code_Point & 0x3F));
+			Length += 2;
+		}
+		else
+		{
+			if (Length + 3 > Converted_Text_Size) break;
+			Pointer_String_Converted_Text[Length] = (char) (0xE0 | (Code_Point >> 12));
+			Pointer_String_Converted_Text[Length + 1] = (char) (0x80 | ((Code_Point >> 6) & 0x3F));
+			Pointer_String_Converted_Text[Length + 2] = (char) (0x80 | (Code_Point & 0x3F));
+			Length += 3;
+		}
 	}
-	LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "Text converted to Windows 1252 characters set : \"%s\".\n", Pointer_String_Custom_Character_Set_Text);
 
-	// Convert text to UTF-8
-	UtilityConvertString(Pointer_String_Custom_Character_Set_Text, Pointer_String_Converted_Text, UTILITY_CHARACTER_SET_WINDOWS_1252, UTILITY_CHARACTER_SET_UTF8, 0, SMS_TEXT_STRING_MAXIMUM_SIZE);
+	// Terminate the output string
+	Pointer_String_Converted_Text[Length] = 0;
+	return Length;
 }
 
 /** Extract the phone number from an ETSI GSM 03.38 version 5.3.0 address field (see paragraph 9.1.2.5).
@@ -222,15 +365,16 @@ static void SMSExtractHeaderPhoneNumber(unsigned char **Pointer_Pointer_Message_
  * @param Pointer_Message_Buffer The raw message, as downloaded from the phone.
  * @param Pointer_SMS_Record On output, fill most of the information of the decoded SMS record.
  * @param Pointer_Is_Wide_Character_Encoding On output, tell whether the message text uses UTF-16 encoding (if set to 1) or 7-bit characters (if set to 0).
- * @param Pointer_Text_Bytes_Count On output, contain the size in bytes of the decoded text.
+ * @param Pointer_Text_Bytes_Count On output, contain the size in bytes of the UTF-16 text, or the amount of septets of the 7-bit text.
+ * @param Pointer_Septet_Padding_Bits_Count On output, contain the amount of fill bits inserted after the User Data Header to make the 7-bit text start on a septet boundary.
  * @return -1 on error,
  * @return On success, a positive number indicating the offset of the text payload in the message buffer.
  * @note The SMS format is specified by ETSI GSM 03.40 version 5.3.0 document.
  */
-static int SMSDecodeRecordHeader(unsigned char *Pointer_Message_Buffer, TSMSRecord *Pointer_SMS_Record, int *Pointer_Is_Wide_Character_Encoding, int *Pointer_Text_Bytes_Count)
+static int SMSDecodeRecordHeader(unsigned char *Pointer_Message_Buffer, TSMSRecord *Pointer_SMS_Record, int *Pointer_Is_Wide_Character_Encoding, int *Pointer_Text_Bytes_Count, int *Pointer_Septet_Padding_Bits_Count)
 {
 	unsigned char Byte, First_Message_Byte;
-	int Text_Payload_Offset = 0, Is_SMS_Deliver_Message_Type, Validity_Period_Format = 0;
+	int Text_Payload_Offset = 0, Is_SMS_Deliver_Message_Type, Validity_Period_Format = 0, User_Data_Offset, User_Data_Header_Size = 0, User_Data_Header_Bits_Count;
 
 	// Bypass the SMSC information if this is a SMS-DELIVER message (see http://www.gsm-modem.de/sms-pdu-mode.html)
 	Byte = *Pointer_Message_Buffer;
@@ -327,17 +471,19 @@ static int SMSDecodeRecordHeader(unsigned char *Pointer_Message_Buffer, TSMSReco
 		}
 	}
 
-	// Retrieve the text size in bytes (User-Data-Length)
+	// Retrieve the text size in bytes or in septets (User-Data-Length)
 	*Pointer_Text_Bytes_Count = *Pointer_Message_Buffer;
 	Pointer_Message_Buffer++;
 	Text_Payload_Offset++;
+	User_Data_Offset = Text_Payload_Offset;
 
 	// Is the User-Data-Header-Indicator present (see ETSI GSM 03.40 version 5.3.0 chapter 9.2.3.23 and https://en.wikipedia.org/wiki/User_Data_Header) ?
 	if (First_Message_Byte & 0x40)
 	{
 		LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "SMS User-Data-Header-Indicator is present.\n");
 
-		// Bypass the User Data Header Length field, the parser will rely only on each Information Element Identifier length
+		// Retrieve the User Data Header Length field, the text starts right after the header
+		User_Data_Header_Size = *Pointer_Message_Buffer + 1; // Also take into account the User Data Header Length field
 		Pointer_Message_Buffer++;
 		Text_Payload_Offset++;
 
@@ -345,7 +491,6 @@ static int SMSDecodeRecordHeader(unsigned char *Pointer_Message_Buffer, TSMSReco
 		Byte = *Pointer_Message_Buffer;
 		Pointer_Message_Buffer++;
 		Text_Payload_Offset++;
-		*Pointer_Text_Bytes_Count -= 2; // Also take into account the User Data Header Length field
 		switch (Byte)
 		{
 			// This is the concatenated short messages facility with 8-bit reference numbers (see ETSI GSM 03.40 version 5.3.0 chapter 9.2.3.24.1)
@@ -366,11 +511,6 @@ static int SMSDecodeRecordHeader(unsigned char *Pointer_Message_Buffer, TSMSReco
 				Pointer_SMS_Record->Records_Count = Pointer_Message_Buffer[1];
 				Pointer_SMS_Record->Record_Number = Pointer_Message_Buffer[2];
 				LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "Record ID : 0x%02X, records count : %d, record number : %d.\n", Pointer_SMS_Record->Record_ID, Pointer_SMS_Record->Records_Count, Pointer_SMS_Record->Record_Number);
-				Pointer_Message_Buffer += 3;
-				Text_Payload_Offset += 3;
-
-				// Adjust the data length accordingly
-				*Pointer_Text_Bytes_Count -= 4;
 				break;
 
 			// This is the concatenated short messages facility with 16-bit reference numbers (see https://en.wikipedia.org/wiki/User_Data_Header and https://en.wikipedia.org/wiki/Concatenated_SMS)
@@ -391,11 +531,6 @@ static int SMSDecodeRecordHeader(unsigned char *Pointer_Message_Buffer, TSMSReco
 				Pointer_SMS_Record->Records_Count = Pointer_Message_Buffer[2];
 				Pointer_SMS_Record->Record_Number = Pointer_Message_Buffer[3];
 				LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "Record ID : 0x%04X, records count : %d, record number : %d.\n", Pointer_SMS_Record->Record_ID, Pointer_SMS_Record->Records_Count, Pointer_SMS_Record->Record_Number);
-				Pointer_Message_Buffer += 4;
-				Text_Payload_Offset += 4;
-
-				// Adjust the data length accordingly
-				*Pointer_Text_Bytes_Count -= 5;
 				break;
 
 			default:
@@ -410,6 +545,25 @@ static int SMSDecodeRecordHeader(unsigned char *Pointer_Message_Buffer, TSMSReco
 		Pointer_SMS_Record->Record_Number = 1; // Record numbers start from 1
 	}
 
+	// The User-Data-Length includes the header, which is followed by fill bits up to the next septet boundary when the text is 7-bit encoded (see ETSI GSM 03.40 version 5.3.0 chapter 9.2.3.16)
+	Text_Payload_Offset = User_Data_Offset + User_Data_Header_Size;
+	if (*Pointer_Is_Wide_Character_Encoding)
+	{
+		*Pointer_Text_Bytes_Count -= User_Data_Header_Size;
+		*Pointer_Septet_Padding_Bits_Count = 0;
+	}
+	else
+	{
+		User_Data_Header_Bits_Count = User_Data_Header_Size * 8;
+		*Pointer_Septet_Padding_Bits_Count = (7 - User_Data_Header_Bits_Count % 7) % 7;
+		*Pointer_Text_Bytes_Count -= (User_Data_Header_Bits_Count + *Pointer_Septet_Padding_Bits_Count) / 7;
+	}
+	if (*Pointer_Text_Bytes_Count < 0)
+	{
+		LOG("Error : the User Data Header is longer than the whole User Data.\n");
+		return -1;
+	}
+
 	LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "Data length : %d bytes.\n", *Pointer_Text_Bytes_Count);
 	LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "Text payload offset : %d.\n", Text_Payload_Offset);
 
@@ -427,8 +581,7 @@ static int SMSDownloadSingleRecord(TSerialPortID Serial_Port_ID, int SMS_Number,
 	static char String_Temporary[2048];
 	static unsigned char Temporary_Buffer[2048];
 	char String_Command[64];
-	unsigned char Current_Byte, Next_Byte;
-	int Text_Payload_Offset, Is_Wide_Character_Encoding, Text_Payload_Bytes_Count, Septet_Padding_Bits_Count, i;
+	int Text_Payload_Offset, Is_Wide_Character_Encoding, Text_Payload_Bytes_Count, Septet_Padding_Bits_Count, Message_Size, Septets_Count;
 	TSMSStorageLocation Message_Storage_Location;
 
 	// Send the command
@@ -461,7 +614,7 @@ static int SMSDownloadSingleRecord(TSerialPortID Serial_Port_ID, int SMS_Number,
 
 		default:
 			LOG("Error : unsupported message storage location %d.\n", Pointer_SMS_Record->Message_Storage_Location);
-			return -3;
+			return -2;
 	}
 
 	// Wait for the message content
@@ -474,11 +627,13 @@ static int SMSDownloadSingleRecord(TSerialPortID Serial_Port_ID, int SMS_Number,
 	if (strcmp(String_Command, "OK") != 0) return -1;
 
 	// Convert all characters to their binary representation to allow processing them
-	if (ATCommandConvertHexadecimalToBinary(String_Temporary, Temporary_Buffer, sizeof(Temporary_Buffer)) < 0) return -1;
+	Message_Size = ATCommandConvertHexadecimalToBinary(String_Temporary, Temporary_Buffer, sizeof(Temporary_Buffer));
+	if (Message_Size < 0) return -1;
+	Pointer_SMS_Record->Fingerprint = MessageIndexComputeFingerprint(Temporary_Buffer, Message_Size) ^ (unsigned long long) Message_Storage_Location; // The storage location is not part of the PDU
 
 	// Retrieve all useful information from the message header
-	Text_Payload_Offset = SMSDecodeRecordHeader(Temporary_Buffer, Pointer_SMS_Record, &Is_Wide_Character_Encoding, &Text_Payload_Bytes_Count);
-	if (Text_Payload_Offset < 0) return -1;
+	Text_Payload_Offset = SMSDecodeRecordHeader(Temporary_Buffer, Pointer_SMS_Record, &Is_Wide_Character_Encoding, &Text_Payload_Bytes_Count, &Septet_Padding_Bits_Count);
+	if ((Text_Payload_Offset < 0) || (Text_Payload_Offset > Message_Size)) return -1;
 
 	// Decode text
 	if (Is_Wide_Character_Encoding)
@@ -488,45 +643,57 @@ static int SMSDownloadSingleRecord(TSerialPortID Serial_Port_ID, int SMS_Number,
 	}
 	else
 	{
-		// Concatenated messages with 7-bit characters have a header that must be a multiple of septets
-		if (Pointer_SMS_Record->Records_Count > 1)
-		{
-			Septet_Padding_Bits_Count = 1; // The Concatenated Short Messages user header is 6-byte long, so it is 48-bit long. To align on a septet, 1 padding bit must be added TODO support more user headers if needed by providing the padding bits count as a SMSDecodeRecordHeader() parameter
-			Text_Payload_Bytes_Count--; // TODO Is this needed because of the 1-bit padding ?
+		// Extract the septets, the fill bits following the User Data Header are skipped by starting from the first septet bit
+		Septets_Count = SMSUnpack7BitSeptets(&Temporary_Buffer[Text_Payload_Offset], Message_Size - Text_Payload_Offset, Septet_Padding_Bits_Count, Text_Payload_Bytes_Count, (unsigned char *) String_Temporary);
+		LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "Unpacked %d septets.\n", Septets_Count);
 
-			// Shift all message bytes by the needed amount of bits
-			for (i = 0; i < Text_Payload_Bytes_Count; i++)
-			{
-				// Shift the current byte by the padding bits amount
-				Current_Byte = Temporary_Buffer[Text_Payload_Offset + i];
-				Current_Byte >>= Septet_Padding_Bits_Count;
+		// Convert the default alphabet to UTF-8
+		SMSConvert7BitToUTF8((unsigned char *) String_Temporary, Septets_Count, Pointer_SMS_Record->String_Text, sizeof(Pointer_SMS_Record->String_Text));
+	}
+	LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "Text converted to UTF-8 : \"%s\".\n", Pointer_SMS_Record->String_Text);
 
-				// Make sure not to overflow the reception buffer by trying to access one more byte at the end of the message
-				if (i < Text_Payload_Bytes_Count - 1)
-				{
-					// Retrieve the remaining current byte bits in the next byte
-					Next_Byte = Temporary_Buffer[Text_Payload_Offset + i + 1];
-					Next_Byte <<= 8 - Septet_Padding_Bits_Count;
-					Current_Byte |= Next_Byte;
-				}
+	// Tell that record contains data
+	Pointer_SMS_Record->Is_Data_Present = 1;
 
-				// Update the data buffer so it can be passed as-is to the uncompression function
-				Temporary_Buffer[Text_Payload_Offset + i] = Current_Byte;
-			}
-		}
+	return 0;
+}
 
-		// Extract the text content with the custom character set for extended ASCII
-		SMSUncompress7BitText(&Temporary_Buffer[Text_Payload_Offset], Text_Payload_Bytes_Count, String_Temporary);
-		LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "Uncompressed text (may miss some SMS custom characters) : \"%s\".\n", String_Temporary);
+/** Retrieve how many messages are stored in the storage the messages are read from, and how many messages this storage can hold.
+ * @param Serial_Port_ID The phone serial port.
+ * @param Pointer_Used_Records_Count On output, contain the amount of non-empty records.
+ * @param Pointer_Total_Records_Count On output, contain the amount of records the storage can hold.
+ * @return -1 if an error occurred or if the phone does not support this command,
+ * @return 0 on success.
+ */
+static int SMSGetStorageOccupancy(TSerialPortID Serial_Port_ID, int *Pointer_Used_Records_Count, int *Pointer_Total_Records_Count)
+{
+	char String_Temporary[256];
 
-		// Convert custom character set to UTF-8
-		SMSConvert7BitExtendedASCII(String_Temporary, Pointer_SMS_Record->String_Text);
+	// The answer tells the usage of the storages used for reading, writing and receiving messages, only the reading one matters
+	if (ATCommandSendCommand(Serial_Port_ID, "AT+CPMS?") != 0)
+	{
+		LOG("Error : failed to send the command to retrieve the SMS storage occupancy.\n");
+		return -1;
+	}
+	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) return -1;
+	LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "AT command answer : \"%s\".\n", String_Temporary);
+	if (sscanf(String_Temporary, "+CPMS: \"%*[^\"]\",%d,%d", Pointer_Used_Records_Count, Pointer_Total_Records_Count) != 2)
+	{
+		LOG("Error : unknown SMS storage occupancy answer \"%s\".\n", String_Temporary);
+		return -1;
 	}
-	LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "Text converted to UTF-8 : \"%s\".\n", Pointer_SMS_Record->String_Text);
 
-	// Tell that record contains data
-	Pointer_SMS_Record->Is_Data_Present = 1;
+	// Wait for the standard OK
+	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) return -1; // Wait for empty line before "OK"
+	if (ATCommandReceiveAnswerLine(Serial_Port_ID, String_Temporary, sizeof(String_Temporary)) < 0) return -1;
+	if (strcmp(String_Temporary, "OK") != 0) return -1;
 
+	// Make sure the values are consistent
+	if ((*Pointer_Total_Records_Count <= 0) || (*Pointer_Used_Records_Count < 0) || (*Pointer_Used_Records_Count > *Pointer_Total_Records_Count))
+	{
+		LOG("Error : inconsistent SMS storage occupancy (%d used records out of %d).\n", *Pointer_Used_Records_Count, *Pointer_Total_Records_Count);
+		return -1;
+	}
 	return 0;
 }
 
@@ -572,204 +739,411 @@ static int SMSWriteOutputMessageInformation(FILE *Pointer_Output_File, TSMSRecor
 	return 0;
 }
 
-/** Parse a archived SMS file (with a .a file extension) located at the path SMS_ARCHIVED_MESSAGE_TEMPORARY_FILE_PATH to extract the message content.
- * @param Pointer_String_Converted_Text On output, contain the message text converted to UTF-8. Make sure to provide a buffer big enough, otherwise some data may be truncated.
- * @param Converted_Text_String_Length The size in bytes of the output string.
+/** Select the output file matching a message storage location.
+ * @param Message_Storage_Location The message storage location.
+ * @param Pointer_File_Inbox The inbox messages file.
+ * @param Pointer_File_Sent The sent messages file.
+ * @param Pointer_File_Draft The draft messages file.
+ * @return NULL if the storage location is unknown,
+ * @return The file to write the message to.
+ */
+static FILE *SMSSelectOutputFile(TSMSStorageLocation Message_Storage_Location, FILE *Pointer_File_Inbox, FILE *Pointer_File_Sent, FILE *Pointer_File_Draft)
+{
+	switch (Message_Storage_Location)
+	{
+		case SMS_STORAGE_LOCATION_INBOX:
+			return Pointer_File_Inbox;
+
+		case SMS_STORAGE_LOCATION_SENT:
+			return Pointer_File_Sent;
+
+		case SMS_STORAGE_LOCATION_DRAFT:
+			return Pointer_File_Draft;
+
+		default:
+			printf("Error : unknown storage location %d.\n", Message_Storage_Location);
+			return NULL;
+	}
+}
+
+/** Compute the hash of the key identifying the message a concatenated message part belongs to.
+ * @param Pointer_SMS_Record The message part.
+ * @return The FNV-1a hash of the key.
+ */
+static unsigned int SMSHashReassemblyKey(TSMSRecord *Pointer_SMS_Record)
+{
+	unsigned int Hash = 2166136261U, Values[3];
+	unsigned char *Pointer_Byte;
+	char *Pointer_String;
+	size_t i;
+
+	// Hash the numerical fields
+	Values[0] = (unsigned int) Pointer_SMS_Record->Record_ID;
+	Values[1] = (unsigned int) Pointer_SMS_Record->Message_Storage_Location;
+	Values[2] = (unsigned int) Pointer_SMS_Record->Records_Count;
+	Pointer_Byte = (unsigned char *) Values;
+	for (i = 0; i < sizeof(Values); i++)
+	{
+		Hash ^= Pointer_Byte[i];
+		Hash *= 16777619U;
+	}
+
+	// Hash the phone number
+	for (Pointer_String = Pointer_SMS_Record->String_Phone_Number; *Pointer_String != 0; Pointer_String++)
+	{
+		Hash ^= (unsigned char) *Pointer_String;
+		Hash *= 16777619U;
+	}
+	return Hash;
+}
+
+/** Tell whether two concatenated message parts belong to the same message.
+ * @param Pointer_SMS_Record_1 The first message part.
+ * @param Pointer_SMS_Record_2 The second message part.
+ * @return 0 if the parts belong to different messages,
+ * @return 1 if the parts belong to the same message.
+ */
+static int SMSIsSameReassemblyKey(TSMSRecord *Pointer_SMS_Record_1, TSMSRecord *Pointer_SMS_Record_2)
+{
+	// The reference ID is stored on one byte only by most phones and this can lead to collisions pretty fast, so other fields are used to tell messages apart
+	if (Pointer_SMS_Record_1->Record_ID != Pointer_SMS_Record_2->Record_ID) return 0;
+	if (Pointer_SMS_Record_1->Message_Storage_Location != Pointer_SMS_Record_2->Message_Storage_Location) return 0;
+	if (Pointer_SMS_Record_1->Records_Count != Pointer_SMS_Record_2->Records_Count) return 0;
+	if (strncmp(Pointer_SMS_Record_1->String_Phone_Number, Pointer_SMS_Record_2->String_Phone_Number, sizeof(Pointer_SMS_Record_1->String_Phone_Number)) != 0) return 0;
+	return 1;
+}
+
+/** Find the reassembly table slot of the message a concatenated message part belongs to, using linear probing.
+ * @param Pointer_Entries The reassembly table.
+ * @param Slots_Count The reassembly table size, it must be a power of two.
+ * @param Pointer_SMS_Record The message part.
+ * @param Pointer_Hash On output, contain the message key hash.
+ * @return The message entry, or the free slot where the message must be stored if no part of this message has been found yet.
+ */
+static TSMSReassemblyEntry *SMSFindReassemblyEntry(TSMSReassemblyEntry *Pointer_Entries, int Slots_Count, TSMSRecord *Pointer_SMS_Record, unsigned int *Pointer_Hash)
+{
+	unsigned int Hash, Slot_Index;
+	TSMSReassemblyEntry *Pointer_Entry;
+
+	Hash = SMSHashReassemblyKey(Pointer_SMS_Record);
+	*Pointer_Hash = Hash;
+	Slot_Index = Hash & (Slots_Count - 1);
+	while (1)
+	{
+		Pointer_Entry = &Pointer_Entries[Slot_Index];
+		if (Pointer_Entry->Pointer_First_Received_Part == NULL) return Pointer_Entry;
+		if ((Pointer_Entry->Hash == Hash) && SMSIsSameReassemblyKey(Pointer_Entry->Pointer_First_Received_Part, Pointer_SMS_Record)) return Pointer_Entry;
+		Slot_Index = (Slot_Index + 1) & (Slots_Count - 1);
+	}
+}
+
+/** Write a concatenated message to its output file. Missing parts are replaced by SMS_MISSING_PART_TEXT.
+ * @param Pointer_Output_File The output file to write to.
+ * @param Pointer_Entry The message parts.
  * @return -1 if an error occurred,
  * @return 0 on success.
  */
-static int SMSExtractArchivedMessageText(char *Pointer_String_Converted_Text, size_t Converted_Text_String_Length)
+static int SMSWriteConcatenatedMessage(FILE *Pointer_Output_File, TSMSReassemblyEntry *Pointer_Entry)
 {
-	static unsigned char Buffer[16386]; // Should be enough for any SMS content, store the variable in the DATA section due to its size
-	FILE *Pointer_File;
-	int Return_Value = -1;
-	size_t Data_Size;
+	TSMSRecord *Pointer_SMS_Record;
+	int i;
+
+	// Use the first part information if it is available, as it is the one displayed by the phone
+	Pointer_SMS_Record = Pointer_Entry->Pointer_Parts[0];
+	if (Pointer_SMS_Record == NULL) Pointer_SMS_Record = Pointer_Entry->Pointer_First_Received_Part;
+	if (SMSWriteOutputMessageInformation(Pointer_Output_File, Pointer_SMS_Record) != 0) return -1;
 
-	// Try to open the file
-	Pointer_File = fopen(SMS_ARCHIVED_MESSAGE_TEMPORARY_FILE_PATH, "r");
-	if (Pointer_File == NULL)
+	// Append all parts text in order
+	for (i = 0; i < Pointer_Entry->Pointer_First_Received_Part->Records_Count; i++)
 	{
-		LOG("Error : failed to open the archived SMS temporary file \"%s\" (%s).\n", SMS_ARCHIVED_MESSAGE_TEMPORARY_FILE_PATH, strerror(errno));
-		return -1;
+		Pointer_SMS_Record = Pointer_Entry->Pointer_Parts[i];
+		if (Pointer_SMS_Record == NULL) fprintf(Pointer_Output_File, "%s", SMS_MISSING_PART_TEXT);
+		else fprintf(Pointer_Output_File, "%s", Pointer_SMS_Record->String_Text);
 	}
+	fprintf(Pointer_Output_File, "\n\n");
+
+	Pointer_Entry->Is_Written = 1;
+	return 0;
+}
+
+/** Parse a archived SMS file (with a .a file extension) content to extract the message text.
+ * @param Pointer_File_Data The archived SMS file content.
+ * @param File_Size The archived SMS file size in bytes.
+ * @param Pointer_String_Converted_Text On output, contain the message text converted to UTF-8. Make sure to provide a buffer big enough, otherwise some data may be truncated.
+ * @param Converted_Text_String_Length The size in bytes of the output string.
+ * @return -1 if an error occurred,
+ * @return 0 on success.
+ */
+static int SMSExtractArchivedMessageText(unsigned char *Pointer_File_Data, size_t File_Size, char *Pointer_String_Converted_Text, size_t Converted_Text_String_Length)
+{
+	size_t Data_Size;
 
 	// Discard the first byte because it is unknown yet, the following two bytes contain the data size
-	if (fread(Buffer, 1, 3, Pointer_File) != 3)
+	if (File_Size < 3)
 	{
-		LOG("Error : failed to read the initial 3 bytes of the archived SMS file (%s).\n", strerror(errno));
-		goto Exit;
+		LOG("Error : the archived SMS file is too small (%zu bytes) to contain the data size.\n", File_Size);
+		return -1;
 	}
-	Data_Size = (Buffer[2] << 8) | Buffer[1];
+	Data_Size = (Pointer_File_Data[2] << 8) | Pointer_File_Data[1];
 	Data_Size += 2; // There are always 2 zeroed bytes at the end of the file (which are not taken into account by this data size value), it's pretty sure that their use is to provide an UTF-16 string ending zero character
 	LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "Data size = %zu bytes.\n", Data_Size);
 
-	// Make sure there is enough room to load the data in RAM
-	if (Data_Size > sizeof(Buffer))
-	{
-		LOG("Error : the archived SMS data size (%zu) is too big to fit in memory (%zu).\n", Data_Size, sizeof(Buffer));
-		goto Exit;
-	}
-
-	// Load the data
-	if (fread(Buffer, 1, Data_Size, Pointer_File) != Data_Size)
+	// Make sure the whole data has been downloaded
+	if (Data_Size > File_Size - 3)
 	{
-		LOG("Error : failed to read the data of the archived SMS file (%s).\n", strerror(errno));
-		goto Exit;
+		LOG("Error : the archived SMS data size (%zu) is bigger than the file content (%zu).\n", Data_Size, File_Size - 3);
+		return -1;
 	}
 
 	// Convert the string to more standard UTF-8
-	if (UtilityConvertString(Buffer, Pointer_String_Converted_Text, UTILITY_CHARACTER_SET_UTF16_LITTLE_ENDIAN, UTILITY_CHARACTER_SET_UTF8, sizeof(Buffer), Converted_Text_String_Length) < 0)
+	if (UtilityConvertString(&Pointer_File_Data[3], Pointer_String_Converted_Text, UTILITY_CHARACTER_SET_UTF16_LITTLE_ENDIAN, UTILITY_CHARACTER_SET_UTF8, Data_Size, Converted_Text_String_Length) < 0)
 	{
 		LOG("Error : could not convert the string to UTF-8.\n");
-		goto Exit;
+		return -1;
 	}
 
-	// Everything went fine
-	Return_Value = 0;
-
-Exit:
-	fclose(Pointer_File);
-	return Return_Value;
+	return 0;
 }
 
 //-------------------------------------------------------------------------------------------------
 // Public functions
 //-------------------------------------------------------------------------------------------------
-int SMSDownloadAll(TSerialPortID Serial_Port_ID)
+int SMSDownloadAll(TSerialPortID Serial_Port_ID, int Is_Incremental_Mode_Enabled)
 {
-	static TSMSRecord SMS_Records[SMS_RECORDS_MAXIMUM_COUNT];
 	static char String_Temporary[16384]; // Should be enough for any SMS content, store the variable in the DATA section due to its size
-	int i, Return_Value = -1, j, Current_Record_Number, Archived_SMS_Count;
+	int i, Return_Value = -1, Archived_SMS_Count, Used_Records_Count, Total_Records_Count, Read_Records_Count, Found_Records_Count = 0, Result, Reassembly_Slots_Count = 0, New_Records_Count = 0, New_Archived_SMS_Count = 0;
+	unsigned int Hash;
+	char String_Index_Key[32], *Pointer_String_Open_Mode;
 	FILE *Pointer_File_Inbox = NULL, *Pointer_File_Sent = NULL, *Pointer_File_Draft = NULL, *Pointer_File_Archives = NULL, *Pointer_File;
-	TSMSRecord *Pointer_SMS_Record, *Pointer_Searched_SMS_Record;
+	TSMSRecord *Pointer_SMS_Records = NULL, *Pointer_SMS_Record;
+	TSMSReassemblyEntry *Pointer_Reassembly_Entries = NULL, *Pointer_Reassembly_Entry;
 	TList List;
 	TListItem *Pointer_List_Item;
 	TFileManagerFileListItem *Pointer_File_List_Item;
+	TFileManagerSession File_Manager_Session;
+	TFileManagerSink Archived_Message_Sink;
+	TMessageIndex Index;
+
+	// Find the messages written by the previous runs
+	if (MessageIndexLoad(&Index, SMS_INDEX_FILE_PATH) != 0) return -1;
+	if (Is_Incremental_Mode_Enabled && !Index.Is_Loaded)
+	{
+		printf("No SMS index has been found, all messages will be retrieved.\n");
+		Is_Incremental_Mode_Enabled = 0; // Rebuild the output files from scratch, as they may contain messages that are not referenced by the index
+	}
+	Pointer_String_Open_Mode = Is_Incremental_Mode_Enabled ? "a" : "w"; // Append the new messages to the previous ones in incremental mode
+
+	File_Manager_Session.Is_Opened = 0; // Tell the exit code that no file manager session has been opened yet
+	FileManagerInitializeMemorySink(&Archived_Message_Sink); // Archived messages are downloaded to RAM, reusing the same buffer for all of them
 
 	printf("Retrieving phone book information to match with SMS phone numbers...\n");
 	if (PhoneBookReadAllEntries(Serial_Port_ID) < 0) goto Exit;
 
-	// Read all possible records
+	// Find how many records must be read, so the scan can stop as soon as the last message has been found
+	if (SMSGetStorageOccupancy(Serial_Port_ID, &Used_Records_Count, &Total_Records_Count) != 0)
+	{
+		LOG("Warning : the SMS storage occupancy could not be retrieved, all %d records will be read.\n", SMS_RECORDS_DEFAULT_COUNT);
+		Used_Records_Count = SMS_RECORDS_DEFAULT_COUNT;
+		Total_Records_Count = SMS_RECORDS_DEFAULT_COUNT;
+	}
+	LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "The SMS storage contains %d records out of %d.\n", Used_Records_Count, Total_Records_Count);
+	Pointer_SMS_Records = calloc(Total_Records_Count, sizeof(TSMSRecord));
+	if (Pointer_SMS_Records == NULL)
+	{
+		LOG("Error : failed to allocate the memory to store %d SMS records.\n", Total_Records_Count);
+		goto Exit;
+	}
+
+	// Read all used records
 	printf("Retrieving all SMS records...\n");
-	for (i = 1; i <= SMS_RECORDS_MAXIMUM_COUNT; i++)
+	for (i = 1; (i <= Total_Records_Count) && (Found_Records_Count < Used_Records_Count); i++)
 	{
-		LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "SMS record number = %d/%d.\n", i, SMS_RECORDS_MAXIMUM_COUNT);
-		if (SMSDownloadSingleRecord(Serial_Port_ID, i, &SMS_Records[i - 1]) == 0) LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "Record contains data.\n"); // Record array is zero-based
+		LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "SMS record number = %d/%d.\n", i, Total_Records_Count);
+		Pointer_SMS_Record = &Pointer_SMS_Records[i - 1]; // Record array is zero-based
+		Result = SMSDownloadSingleRecord(Serial_Port_ID, i, Pointer_SMS_Record);
+		if (Result == -1)
+		{
+			// Do not go on, the next records would be read while a used record is not counted, so the last used records could be missed
+			LOG("Error : failed to read the SMS record %d.\n", i);
+			goto Exit;
+		}
+		if (Result != -3) Found_Records_Count++; // Records with an unsupported format still use a storage slot
+		if (Result == 0)
+		{
+			LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "Record contains data.\n");
+
+			// The record still needs to be read to confirm that it did not change, but it won't be written again
+			snprintf(String_Index_Key, sizeof(String_Index_Key), "Record %d", i);
+			Result = MessageIndexUpdateEntry(&Index, String_Index_Key, Pointer_SMS_Record->Fingerprint);
+			if (Result < 0) goto Exit;
+			Pointer_SMS_Record->Is_Already_Exported = Is_Incremental_Mode_Enabled && (Result == 1);
+			if (!Pointer_SMS_Record->Is_Already_Exported) New_Records_Count++;
+		}
 		else LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "Record is empty.\n");
 		LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "\n");
 	}
+	Read_Records_Count = i - 1;
+
+	// Create the concatenated messages reassembly table, there can't be more messages than records
+	for (Reassembly_Slots_Count = 1; Reassembly_Slots_Count < 2 * Read_Records_Count; Reassembly_Slots_Count <<= 1); // Use a power of two to compute the slot index with a mask, keep the table at most half full to make the probe sequences short
+	Pointer_Reassembly_Entries = calloc(Reassembly_Slots_Count, sizeof(TSMSReassemblyEntry));
+	if (Pointer_Reassembly_Entries == NULL)
+	{
+		LOG("Error : failed to allocate the concatenated messages reassembly table.\n");
+		goto Exit;
+	}
+
+	// Gather the parts of the concatenated messages
+	for (i = 0; i < Read_Records_Count; i++)
+	{
+		// Keep only the valid parts of the concatenated messages
+		Pointer_SMS_Record = &Pointer_SMS_Records[i];
+		if (!Pointer_SMS_Record->Is_Data_Present || (Pointer_SMS_Record->Records_Count <= 1)) continue;
+		if ((Pointer_SMS_Record->Record_Number < 1) || (Pointer_SMS_Record->Record_Number > Pointer_SMS_Record->Records_Count)) continue;
+
+		// Find the message this part belongs to
+		Pointer_Reassembly_Entry = SMSFindReassemblyEntry(Pointer_Reassembly_Entries, Reassembly_Slots_Count, Pointer_SMS_Record, &Hash);
+
+		// This is the first found part of the message
+		if (Pointer_Reassembly_Entry->Pointer_First_Received_Part == NULL)
+		{
+			Pointer_Reassembly_Entry->Pointer_Parts = calloc(Pointer_SMS_Record->Records_Count, sizeof(TSMSRecord *));
+			if (Pointer_Reassembly_Entry->Pointer_Parts == NULL)
+			{
+				LOG("Error : failed to allocate the parts table of a concatenated message.\n");
+				goto Exit;
+			}
+			Pointer_Reassembly_Entry->Pointer_First_Received_Part = Pointer_SMS_Record;
+			Pointer_Reassembly_Entry->Hash = Hash;
+		}
+
+		// Store the part
+		if (Pointer_Reassembly_Entry->Pointer_Parts[Pointer_SMS_Record->Record_Number - 1] != NULL)
+		{
+			LOG("Warning : the part %d of a concatenated message has been found several times, only the first one is kept.\n", Pointer_SMS_Record->Record_Number);
+			continue;
+		}
+		Pointer_Reassembly_Entry->Pointer_Parts[Pointer_SMS_Record->Record_Number - 1] = Pointer_SMS_Record;
+		Pointer_Reassembly_Entry->Pointer_Last_Received_Part = Pointer_SMS_Record;
+		Pointer_Reassembly_Entry->Received_Parts_Count++;
+		if (Pointer_SMS_Record->Is_Already_Exported) Pointer_Reassembly_Entry->Is_Exported_Part_Found = 1;
+		else Pointer_Reassembly_Entry->Is_New_Part_Found = 1;
+	}
+
+	// A message some parts of which have already been exported was written by a previous run (with its missing parts replaced by a placeholder), appending it again would duplicate it in the output files
+	if (Is_Incremental_Mode_Enabled)
+	{
+		for (i = 0; i < Reassembly_Slots_Count; i++)
+		{
+			if (Pointer_Reassembly_Entries[i].Is_New_Part_Found && Pointer_Reassembly_Entries[i].Is_Exported_Part_Found) break;
+		}
+		if (i < Reassembly_Slots_Count)
+		{
+			printf("Some concatenated messages written by a previous run received new parts, all messages will be retrieved again.\n");
+			Is_Incremental_Mode_Enabled = 0; // Rebuild the output files from scratch, so each message is written only once
+			Pointer_String_Open_Mode = "w";
+			for (i = 0; i < Read_Records_Count; i++) Pointer_SMS_Records[i].Is_Already_Exported = 0;
+			for (i = 0; i < Reassembly_Slots_Count; i++) Pointer_Reassembly_Entries[i].Is_New_Part_Found = 1;
+		}
+	}
 
 	// Create output directories
 	if (UtilityCreateDirectory("Output/SMS") != 0) goto Exit;
 
 	// Create all needed files
 	// Inbox
-	Pointer_File_Inbox = fopen("Output/SMS/Inbox.txt", "w");
+	Pointer_File_Inbox = fopen("Output/SMS/Inbox.txt", Pointer_String_Open_Mode);
 	if (Pointer_File_Inbox == NULL)
 	{
 		LOG("Error : could not create the SMS \"Inbox.txt\" file (%s).\n", strerror(errno));
 		goto Exit;
 	}
 	// Sent
-	Pointer_File_Sent = fopen("Output/SMS/Sent.txt", "w");
+	Pointer_File_Sent = fopen("Output/SMS/Sent.txt", Pointer_String_Open_Mode);
 	if (Pointer_File_Sent == NULL)
 	{
 		LOG("Error : could not create the SMS \"Sent.txt\" file (%s).\n", strerror(errno));
 		goto Exit;
 	}
 	// Draft
-	Pointer_File_Draft = fopen("Output/SMS/Draft.txt", "w");
+	Pointer_File_Draft = fopen("Output/SMS/Draft.txt", Pointer_String_Open_Mode);
 	if (Pointer_File_Draft == NULL)
 	{
 		LOG("Error : could not create the SMS \"Draft.txt\" file (%s).\n", strerror(errno));
 		goto Exit;
 	}
 	// Archives
-	Pointer_File_Archives = fopen("Output/SMS/Archives.txt", "w");
+	Pointer_File_Archives = fopen("Output/SMS/Archives.txt", Pointer_String_Open_Mode);
 	if (Pointer_File_Archives == NULL)
 	{
 		LOG("Error : could not create the SMS \"Archives.txt\" file (%s).\n", strerror(errno));
 		goto Exit;
 	}
 
-	// Store all records to the appropriate files
-	for (i = 0; i < SMS_RECORDS_MAXIMUM_COUNT; i++)
+	// Store all records to the appropriate files, in a single pass
+	for (i = 0; i < Read_Records_Count; i++)
 	{
 		// Cache record access
-		Pointer_SMS_Record = &SMS_Records[i];
+		Pointer_SMS_Record = &Pointer_SMS_Records[i];
 
 		// Is the record empty ?
 		if (!Pointer_SMS_Record->Is_Data_Present) continue;
 
 		// Select the correct output file
-		switch (Pointer_SMS_Record->Message_Storage_Location)
-		{
-			case SMS_STORAGE_LOCATION_INBOX:
-				Pointer_File = Pointer_File_Inbox;
-				break;
-
-			case SMS_STORAGE_LOCATION_SENT:
-				Pointer_File = Pointer_File_Sent;
-				break;
+		Pointer_File = SMSSelectOutputFile(Pointer_SMS_Record->Message_Storage_Location, Pointer_File_Inbox, Pointer_File_Sent, Pointer_File_Draft);
+		if (Pointer_File == NULL) goto Exit;
 
-			case SMS_STORAGE_LOCATION_DRAFT:
-				Pointer_File = Pointer_File_Draft;
-				break;
-
-			default:
-				printf("Error : unknown storage location %d.\n", Pointer_SMS_Record->Message_Storage_Location);
-				goto Exit;
+		// This message is stored on a single record, write the record content to the appropriate file
+		if (Pointer_SMS_Record->Records_Count <= 1)
+		{
+			if (Pointer_SMS_Record->Is_Already_Exported) continue;
+			if (SMSWriteOutputMessageInformation(Pointer_File, Pointer_SMS_Record) != 0) goto Exit;
+			fprintf(Pointer_File, "%s\n\n", Pointer_SMS_Record->String_Text);
+			continue;
 		}
 
-		// Handle messages split in multiple parts
-		if (Pointer_SMS_Record->Records_Count > 1)
+		// Make sure the part can be stored
+		if ((Pointer_SMS_Record->Record_Number < 1) || (Pointer_SMS_Record->Record_Number > Pointer_SMS_Record->Records_Count))
 		{
-			// Ignore the record if it is not the initial record (all message records will be processed when the initial record will be found)
-			if (Pointer_SMS_Record->Record_Number > 1) continue;
-
-			// This is the initial record, write its content to the appropriate file
-			if (SMSWriteOutputMessageInformation(Pointer_File, Pointer_SMS_Record) != 0) return -1;
-			fprintf(Pointer_File, "%s", Pointer_SMS_Record->String_Text);
+			if (Pointer_SMS_Record->Is_Already_Exported) continue;
+			LOG("Warning : the SMS record %d is the part %d of a message made of %d parts, which is not possible. Its content is written as a single message.\n", i + 1, Pointer_SMS_Record->Record_Number, Pointer_SMS_Record->Records_Count);
+			if (SMSWriteOutputMessageInformation(Pointer_File, Pointer_SMS_Record) != 0) goto Exit;
+			fprintf(Pointer_File, "%s\n\n", Pointer_SMS_Record->String_Text);
+			continue;
+		}
 
-			// Search for the next record
-			Current_Record_Number = 2; // Start searching from record 2 as record 1 has already been written to the file
-			for (j = 0; j < SMS_RECORDS_MAXIMUM_COUNT; j++)
-			{
-				// Cache searched record access
-				Pointer_Searched_SMS_Record = &SMS_Records[j];
+		// Wait for the last found part of the message, all parts have been gathered by now
+		Pointer_Reassembly_Entry = SMSFindReassemblyEntry(Pointer_Reassembly_Entries, Reassembly_Slots_Count, Pointer_SMS_Record, &Hash);
+		if (Pointer_Reassembly_Entry->Pointer_Last_Received_Part != Pointer_SMS_Record) continue;
 
-				// Find the message next record
-				if ((Pointer_Searched_SMS_Record->Records_Count > 1) && (Pointer_Searched_SMS_Record->Record_ID == Pointer_SMS_Record->Record_ID) && (Pointer_Searched_SMS_Record->Record_Number == Current_Record_Number))
-				{
-					// Add some more checks because the record ID is stored on one byte only and this can lead to collisions pretty fast
-					// The message storage location must be identical
-					if (Pointer_Searched_SMS_Record->Message_Storage_Location != Pointer_SMS_Record->Message_Storage_Location) continue;
-					// The phone number must be identical
-					if (strncmp(Pointer_Searched_SMS_Record->String_Phone_Number, Pointer_SMS_Record->String_Phone_Number, sizeof(Pointer_Searched_SMS_Record->String_Phone_Number)) != 0) continue;
-
-					// Append the next record text
-					fprintf(Pointer_File, "%s", Pointer_Searched_SMS_Record->String_Text);
-					Current_Record_Number++;
-
-					// Was it the last record ?
-					if (Current_Record_Number > Pointer_SMS_Record->Records_Count)
-					{
-						fprintf(Pointer_File, "\n\n");
-						break;
-					}
-				}
-			}
-		}
-		// This message is stored on a single record, write the record content to the appropriate file
-		else
+		// Write the message if it is complete
+		if (Pointer_Reassembly_Entry->Received_Parts_Count == Pointer_SMS_Record->Records_Count)
 		{
-			if (SMSWriteOutputMessageInformation(Pointer_File, Pointer_SMS_Record) != 0) return -1;
-			fprintf(Pointer_File, "%s\n\n", Pointer_SMS_Record->String_Text);
+			if (!Pointer_Reassembly_Entry->Is_New_Part_Found) Pointer_Reassembly_Entry->Is_Written = 1; // Tell the missing parts handling code that this message has already been processed
+			else if (SMSWriteConcatenatedMessage(Pointer_File, Pointer_Reassembly_Entry) != 0) goto Exit;
 		}
 	}
 
-	// Retrieve archive files
-	if (FileManagerListDirectory(Serial_Port_ID, SMS_ARCHIVED_MESSAGES_DIRECTORY_PATH, &List) != 0)
+	// Write the messages some parts of which are missing, so no text is lost
+	for (i = 0; i < Reassembly_Slots_Count; i++)
+	{
+		Pointer_Reassembly_Entry = &Pointer_Reassembly_Entries[i];
+		if ((Pointer_Reassembly_Entry->Pointer_First_Received_Part == NULL) || Pointer_Reassembly_Entry->Is_Written || !Pointer_Reassembly_Entry->Is_New_Part_Found) continue;
+
+		Pointer_SMS_Record = Pointer_Reassembly_Entry->Pointer_First_Received_Part;
+		LOG("Warning : only %d parts out of %d were found for the message with reference ID 0x%04X and phone number \"%s\", the missing parts are replaced by \"" SMS_MISSING_PART_TEXT "\".\n", Pointer_Reassembly_Entry->Received_Parts_Count, Pointer_SMS_Record->Records_Count, Pointer_SMS_Record->Record_ID, Pointer_SMS_Record->String_Phone_Number);
+		Pointer_File = SMSSelectOutputFile(Pointer_SMS_Record->Message_Storage_Location, Pointer_File_Inbox, Pointer_File_Sent, Pointer_File_Draft);
+		if (Pointer_File == NULL) goto Exit;
+		if (SMSWriteConcatenatedMessage(Pointer_File, Pointer_Reassembly_Entry) != 0) goto Exit;
+	}
+
+	// Retrieve archive files, all of them are downloaded in a single file manager session
+	if (FileManagerOpenSession(Serial_Port_ID, &File_Manager_Session) != 0)
+	{
+		LOG("Error : could not access the phone file manager.\n");
+		goto Exit;
+	}
+	if (FileManagerListDirectory(&File_Manager_Session, SMS_ARCHIVED_MESSAGES_DIRECTORY_PATH, &List) != 0)
 	{
 		LOG("Error : could not list the content of the archived SMS directory.\n");
 		goto Exit;
@@ -788,19 +1162,30 @@ int SMSDownloadAll(TSerialPortID Serial_Port_ID)
 		if (strcmp(Pointer_File_List_Item->String_File_Name, ".") == 0) goto Next_Archived_File;
 		if (strcmp(Pointer_File_List_Item->String_File_Name, "..") == 0) goto Next_Archived_File;
 
+		// The file name and size are the only information available without downloading the file
+		snprintf(String_Temporary, sizeof(String_Temporary), SMS_ARCHIVED_MESSAGES_DIRECTORY_PATH "\\%s", Pointer_File_List_Item->String_File_Name);
+		Result = MessageIndexUpdateEntry(&Index, String_Temporary, Pointer_File_List_Item->File_Size);
+		if (Result < 0) goto Exit_Clear_List;
+		if (Is_Incremental_Mode_Enabled && (Result == 1))
+		{
+			LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "The archived SMS file \"%s\" has already been retrieved.\n", String_Temporary);
+			i++;
+			goto Next_Archived_File;
+		}
+
 		// Retrieve the file
 		printf("Retrieving the archived SMS %d/%d...\n", i, Archived_SMS_Count);
 		i++;
-		snprintf(String_Temporary, sizeof(String_Temporary), SMS_ARCHIVED_MESSAGES_DIRECTORY_PATH "\\%s", Pointer_File_List_Item->String_File_Name);
+		New_Archived_SMS_Count++;
 		LOG_DEBUG(SMS_IS_DEBUG_ENABLED, "File to retrieve : \"%s\".\n", String_Temporary);
-		if (FileManagerDownloadFile(Serial_Port_ID, String_Temporary, SMS_ARCHIVED_MESSAGE_TEMPORARY_FILE_PATH) != 0)
+		if (FileManagerDownloadFileToSink(&File_Manager_Session, String_Temporary, &Archived_Message_Sink) != 0)
 		{
 			LOG("Error : failed to retrieve the SMS file \"%s\".\n", String_Temporary);
 			goto Exit_Clear_List;
 		}
 
 		// Retrieve the message content
-		if (SMSExtractArchivedMessageText(String_Temporary, sizeof(String_Temporary)) != 0)
+		if (SMSExtractArchivedMessageText(Archived_Message_Sink.Pointer_Buffer, Archived_Message_Sink.Data_Size, String_Temporary, sizeof(String_Temporary)) != 0)
 		{
 			LOG("Error : failed to extract the SMS message content.\n");
 			goto Exit_Clear_List;
@@ -813,6 +1198,8 @@ Next_Archived_File:
 		Pointer_List_Item = Pointer_List_Item->Pointer_Next_Item;
 	}
 
+	if (Is_Incremental_Mode_Enabled) printf("Found %d new or changed SMS record(s) and %d new archived SMS.\n", New_Records_Count, New_Archived_SMS_Count);
+
 	// Everything went fine
 	Return_Value = 0;
 	Pointer_File = NULL; // Tell the exit code that this file has already been closed
@@ -821,10 +1208,20 @@ Exit_Clear_List:
 	ListClear(&List);
 
 Exit:
-	unlink(SMS_ARCHIVED_MESSAGE_TEMPORARY_FILE_PATH);
+	if (FileManagerCloseSession(&File_Manager_Session) != 0) Return_Value = -1;
+	FileManagerReleaseSink(&Archived_Message_Sink);
 	if (Pointer_File_Inbox != NULL) fclose(Pointer_File_Inbox);
 	if (Pointer_File_Sent != NULL) fclose(Pointer_File_Sent);
 	if (Pointer_File_Draft != NULL) fclose(Pointer_File_Draft);
 	if (Pointer_File_Archives != NULL) fclose(Pointer_File_Archives);
+	// Update the index only when all messages have been written, otherwise the next run would miss some of them
+	if ((Return_Value == 0) && (MessageIndexSave(&Index) != 0)) Return_Value = -1;
+	MessageIndexRelease(&Index);
+	if (Pointer_Reassembly_Entries != NULL)
+	{
+		for (i = 0; i < Reassembly_Slots_Count; i++) free(Pointer_Reassembly_Entries[i].Pointer_Parts);
+		free(Pointer_Reassembly_Entries);
+	}
+	free(Pointer_SMS_Records);
 	return Return_Value;
 }
@@ -2,7 +2,10 @@
  * See Utility.h for description.
  * @author Adrien RICCIARDI
  */
+#define _XOPEN_SOURCE 700 // Needed by nftw()
+#define _DEFAULT_SOURCE
 #include <errno.h>
+#include <ftw.h>
 #include <iconv.h>
 #include <Log.h>
 #include <stdio.h>
@@ -11,6 +14,418 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <Utility.h>
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+//-------------------------------------------------------------------------------------------------
+// Private constants
+//-------------------------------------------------------------------------------------------------
+/** Returned by the character decoding and encoding functions when the input is not valid. */
+#define UTILITY_CONVERSION_ERROR_INVALID_CHARACTER -1
+/** Returned by the character encoding functions when there is not enough room in the output buffer. */
+#define UTILITY_CONVERSION_ERROR_BUFFER_TOO_SMALL -2
+/** Returned by the character encoding functions when the character set can't represent the character. */
+#define UTILITY_CONVERSION_ERROR_NOT_REPRESENTABLE -3
+
+//-------------------------------------------------------------------------------------------------
+// Private variables
+//-------------------------------------------------------------------------------------------------
+/** Give the Unicode code point of the Windows-1252 characters 0x80 to 0x9F, 0 means that the character is not defined. The other characters have the same value than their code point. */
+static const unsigned short Utility_Windows_1252_Table[32] =
+{
+	0x20AC, 0, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0, 0x017D, 0,
+	0, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0, 0x017E, 0x0178
+};
+
+/** The iconv names of the character sets, in the same order than TUtilityCharacterSet. */
+static char *Pointer_String_Utility_Character_Set_Names[UTILITY_CHARACTER_SETS_COUNT] =
+{
+	// UTILITY_CHARACTER_SET_WINDOWS_1252
+	"WINDOWS-1252",
+	// UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN
+	"UTF-16BE",
+	// UTILITY_CHARACTER_SET_UTF16_LITTLE_ENDIAN
+	"UTF-16LE",
+	// UTILITY_CHARACTER_SET_UTF8
+	"UTF-8"
+};
+
+//-------------------------------------------------------------------------------------------------
+// Private functions
+//-------------------------------------------------------------------------------------------------
+/** Decode the next character of a string.
+ * @param Character_Set The string character set.
+ * @param Pointer_Pointer_Source On input, the character to decode. On output, the next character.
+ * @param Pointer_Source_End Where the string ends.
+ * @param Pointer_Code_Point On output, contain the character Unicode code point.
+ * @return UTILITY_CONVERSION_ERROR_INVALID_CHARACTER if the character is malformed or truncated,
+ * @return 0 on success.
+ */
+static int UtilityDecodeCharacter(TUtilityCharacterSet Character_Set, const unsigned char **Pointer_Pointer_Source, const unsigned char *Pointer_Source_End, unsigned int *Pointer_Code_Point)
+{
+	const unsigned char *Pointer_Source = *Pointer_Pointer_Source;
+	unsigned int Code_Point, Low_Surrogate, Minimum_Code_Point;
+	int Continuation_Bytes_Count, i;
+
+	switch (Character_Set)
+	{
+		case UTILITY_CHARACTER_SET_WINDOWS_1252:
+			Code_Point = *Pointer_Source;
+			if ((Code_Point >= 0x80) && (Code_Point <= 0x9F))
+			{
+				Code_Point = Utility_Windows_1252_Table[Code_Point - 0x80];
+				if (Code_Point == 0) return UTILITY_CONVERSION_ERROR_INVALID_CHARACTER;
+			}
+			Pointer_Source++;
+			break;
+
+		case UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN:
+		case UTILITY_CHARACTER_SET_UTF16_LITTLE_ENDIAN:
+			if (Pointer_Source_End - Pointer_Source < 2) return UTILITY_CONVERSION_ERROR_INVALID_CHARACTER;
+			if (Character_Set == UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN) Code_Point = (Pointer_Source[0] << 8) | Pointer_Source[1];
+			else Code_Point = (Pointer_Source[1] << 8) | Pointer_Source[0];
+			Pointer_Source += 2;
+
+			// Characters outside of the Basic Multilingual Plane are encoded with a high surrogate followed by a low surrogate
+			if ((Code_Point >= 0xDC00) && (Code_Point <= 0xDFFF)) return UTILITY_CONVERSION_ERROR_INVALID_CHARACTER;
+			if ((Code_Point >= 0xD800) && (Code_Point <= 0xDBFF))
+			{
+				if (Pointer_Source_End - Pointer_Source < 2) return UTILITY_CONVERSION_ERROR_INVALID_CHARACTER;
+				if (Character_Set == UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN) Low_Surrogate = (Pointer_Source[0] << 8) | Pointer_Source[1];
+				else Low_Surrogate = (Pointer_Source[1] << 8) | Pointer_Source[0];
+				if ((Low_Surrogate < 0xDC00) || (Low_Surrogate > 0xDFFF)) return UTILITY_CONVERSION_ERROR_INVALID_CHARACTER;
+				Pointer_Source += 2;
+				Code_Point = 0x10000 + ((Code_Point - 0xD800) << 10) + (Low_Surrogate - 0xDC00);
+			}
+			break;
+
+		case UTILITY_CHARACTER_SET_UTF8:
+			Code_Point = *Pointer_Source;
+			Pointer_Source++;
+			if (Code_Point < 0x80) break;
+
+			// Find the sequence length from the leading byte
+			if ((Code_Point & 0xE0) == 0xC0)
+			{
+				Code_Point &= 0x1F;
+				Continuation_Bytes_Count = 1;
+				Minimum_Code_Point = 0x80;
+			}
+			else if ((Code_Point & 0xF0) == 0xE0)
+			{
+				Code_Point &= 0x0F;
+				Continuation_Bytes_Count = 2;
+				Minimum_Code_Point = 0x800;
+			}
+			else if ((Code_Point & 0xF8) == 0xF0)
+			{
+				Code_Point &= 0x07;
+				Continuation_Bytes_Count = 3;
+				Minimum_Code_Point = 0x10000;
+			}
+			else return UTILITY_CONVERSION_ERROR_INVALID_CHARACTER;
+
+			// Append the continuation bytes
+			if (Pointer_Source_End - Pointer_Source < Continuation_Bytes_Count) return UTILITY_CONVERSION_ERROR_INVALID_CHARACTER;
+			for (i = 0; i < Continuation_Bytes_Count; i++)
+			{
+				if ((Pointer_Source[i] & 0xC0) != 0x80) return UTILITY_CONVERSION_ERROR_INVALID_CHARACTER;
+				Code_Point = (Code_Point << 6) | (Pointer_Source[i] & 0x3F);
+			}
+			Pointer_Source += Continuation_Bytes_Count;
+
+			// Reject the overlong sequences, the surrogates and the values beyond the last Unicode code point
+			if ((Code_Point < Minimum_Code_Point) || ((Code_Point >= 0xD800) && (Code_Point <= 0xDFFF)) || (Code_Point > 0x10FFFF)) return UTILITY_CONVERSION_ERROR_INVALID_CHARACTER;
+			break;
+
+		default:
+			return UTILITY_CONVERSION_ERROR_INVALID_CHARACTER;
+	}
+
+	*Pointer_Code_Point = Code_Point;
+	*Pointer_Pointer_Source = Pointer_Source;
+	return 0;
+}
+
+/** Encode a character.
+ * @param Character_Set The destination character set. Windows-1252 is not supported.
+ * @param Code_Point The character Unicode code point.
+ * @param Pointer_Pointer_Destination On input, where to write the character. On output, where to write the next character.
+ * @param Pointer_Destination_End Where the destination buffer ends.
+ * @return UTILITY_CONVERSION_ERROR_BUFFER_TOO_SMALL if the character does not fit in the destination buffer,
+ * @return UTILITY_CONVERSION_ERROR_NOT_REPRESENTABLE if the character set is not supported,
+ * @return 0 on success.
+ */
+static int UtilityEncodeCharacter(TUtilityCharacterSet Character_Set, unsigned int Code_Point, unsigned char **Pointer_Pointer_Destination, unsigned char *Pointer_Destination_End)
+{
+	unsigned char *Pointer_Destination = *Pointer_Pointer_Destination;
+	unsigned int Units[2];
+	int Units_Count = 1, i;
+
+	switch (Character_Set)
+	{
+		case UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN:
+		case UTILITY_CHARACTER_SET_UTF16_LITTLE_ENDIAN:
+			// Split the characters outside of the Basic Multilingual Plane in two surrogates
+			if (Code_Point >= 0x10000)
+			{
+				Units[0] = 0xD800 + ((Code_Point - 0x10000) >> 10);
+				Units[1] = 0xDC00 + ((Code_Point - 0x10000) & 0x3FF);
+				Units_Count = 2;
+			}
+			else Units[0] = Code_Point;
+			if (Pointer_Destination_End - Pointer_Destination < Units_Count * 2) return UTILITY_CONVERSION_ERROR_BUFFER_TOO_SMALL;
+
+			for (i = 0; i < Units_Count; i++)
+			{
+				if (Character_Set == UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN)
+				{
+					Pointer_Destination[0] = (unsigned char) (Units[i] >> 8);
+					Pointer_Destination[1] = (unsigned char) Units[i];
+				}
+				else
+				{
+					Pointer_Destination[0] = (unsigned char) Units[i];
+					Pointer_Destination[1] = (unsigned char) (Units[i] >> 8);
+				}
+				Pointer_Destination += 2;
+			}
+			break;
+
+		case UTILITY_CHARACTER_SET_UTF8:
+			if (Code_Point < 0x80)
+			{
+				if (Pointer_Destination_End - Pointer_Destination < 1) return UTILITY_CONVERSION_ERROR_BUFFER_TOO_SMALL;
+				*Pointer_Destination = (unsigned char) Code_Point;
+				Pointer_Destination++;
+			}
+			else if (Code_Point < 0x800)
+			{
+				if (Pointer_Destination_End - Pointer_Destination < 2) return UTILITY_CONVERSION_ERROR_BUFFER_TOO_SMALL;
+				Pointer_Destination[0] = (unsigned char) (0xC0 | (Code_Point >> 6));
+				Pointer_Destination[1] = (unsigned char) (0x80 | (Code_Point & 0x3F));
+				Pointer_Destination += 2;
+			}
+			else if (Code_Point < 0x10000)
+			{
+				if (Pointer_Destination_End - Pointer_Destination < 3) return UTILITY_CONVERSION_ERROR_BUFFER_TOO_SMALL;
+				Pointer_Destination[0] = (unsigned char) (0xE0 | (Code_Point >> 12));
+				Pointer_Destination[1] = (unsigned char) (0x80 | ((Code_Point >> 6) & 0x3F));
+				Pointer_Destination[2] = (unsigned char) (0x80 | (Code_Point & 0x3F));
+				Pointer_Destination += 3;
+			}
+			else
+			{
+				if (Pointer_Destination_End - Pointer_Destination < 4) return UTILITY_CONVERSION_ERROR_BUFFER_TOO_SMALL;
+				Pointer_Destination[0] = (unsigned char) (0xF0 | (Code_Point >> 18));
+				Pointer_Destination[1] = (unsigned char) (0x80 | ((Code_Point >> 12) & 0x3F));
+				Pointer_Destination[2] = (unsigned char) (0x80 | ((Code_Point >> 6) & 0x3F));
+				Pointer_Destination[3] = (unsigned char) (0x80 | (Code_Point & 0x3F));
+				Pointer_Destination += 4;
+			}
+			break;
+
+		default:
+			return UTILITY_CONVERSION_ERROR_NOT_REPRESENTABLE;
+	}
+
+	*Pointer_Pointer_Destination = Pointer_Destination;
+	return 0;
+}
+
+/** Convert the longest run of ASCII characters found at the beginning of an UTF-16 string to UTF-8.
+ * @param Is_Big_Endian Set to 1 if the source string is UTF-16 big endian, set to 0 if it is UTF-16 little endian.
+ * @param Pointer_Source The UTF-16 string.
+ * @param Units_Count How many UTF-16 code units can be read.
+ * @param Pointer_Destination On output, contain the converted characters. There must be room for Units_Count bytes.
+ * @return How many characters have been converted.
+ */
+static size_t UtilityConvertASCIIFromUTF16(int Is_Big_Endian, const unsigned char *Pointer_Source, size_t Units_Count, unsigned char *Pointer_Destination)
+{
+	size_t i = 0;
+	unsigned int Unit;
+
+	#ifdef __SSE2__
+		__m128i Units;
+
+		// Convert 8 characters at a time
+		for (; i + 8 <= Units_Count; i += 8)
+		{
+			Units = _mm_loadu_si128((const __m128i *) &Pointer_Source[i * 2]);
+			if (Is_Big_Endian) Units = _mm_or_si128(_mm_slli_epi16(Units, 8), _mm_srli_epi16(Units, 8));
+
+			// Let the scalar code find the first non-ASCII character
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(Units, _mm_set1_epi16((short) 0xFF80)), _mm_setzero_si128())) != 0xFFFF) break;
+			_mm_storel_epi64((__m128i *) &Pointer_Destination[i], _mm_packus_epi16(Units, Units));
+		}
+	#endif
+
+	// Convert the remaining characters
+	for (; i < Units_Count; i++)
+	{
+		if (Is_Big_Endian) Unit = (Pointer_Source[i * 2] << 8) | Pointer_Source[i * 2 + 1];
+		else Unit = (Pointer_Source[i * 2 + 1] << 8) | Pointer_Source[i * 2];
+		if (Unit >= 0x80) break;
+		Pointer_Destination[i] = (unsigned char) Unit;
+	}
+
+	return i;
+}
+
+/** Convert the longest run of ASCII characters found at the beginning of an UTF-8 or Windows-1252 string to UTF-16.
+ * @param Is_Big_Endian Set to 1 to convert to UTF-16 big endian, set to 0 to convert to UTF-16 little endian.
+ * @param Pointer_Source The 8-bit string.
+ * @param Characters_Count How many bytes can be read.
+ * @param Pointer_Destination On output, contain the converted characters. There must be room for Characters_Count code units.
+ * @return How many characters have been converted.
+ */
+static size_t UtilityConvertASCIIToUTF16(int Is_Big_Endian, const unsigned char *Pointer_Source, size_t Characters_Count, unsigned char *Pointer_Destination)
+{
+	size_t i = 0;
+
+	#ifdef __SSE2__
+		__m128i Characters, Zero = _mm_setzero_si128();
+
+		// Convert 16 characters at a time
+		for (; i + 16 <= Characters_Count; i += 16)
+		{
+			Characters = _mm_loadu_si128((const __m128i *) &Pointer_Source[i]);
+
+			// Let the scalar code find the first non-ASCII character
+			if (_mm_movemask_epi8(Characters) != 0) break;
+
+			// Interleave the characters with zero bytes, the zero comes first in big endian order
+			if (Is_Big_Endian)
+			{
+				_mm_storeu_si128((__m128i *) &Pointer_Destination[i * 2], _mm_unpacklo_epi8(Zero, Characters));
+				_mm_storeu_si128((__m128i *) &Pointer_Destination[i * 2 + 16], _mm_unpackhi_epi8(Zero, Characters));
+			}
+			else
+			{
+				_mm_storeu_si128((__m128i *) &Pointer_Destination[i * 2], _mm_unpacklo_epi8(Characters, Zero));
+				_mm_storeu_si128((__m128i *) &Pointer_Destination[i * 2 + 16], _mm_unpackhi_epi8(Characters, Zero));
+			}
+		}
+	#endif
+
+	// Convert the remaining characters
+	for (; i < Characters_Count; i++)
+	{
+		if (Pointer_Source[i] >= 0x80) break;
+		Pointer_Destination[i * 2 + Is_Big_Endian] = Pointer_Source[i];
+		Pointer_Destination[i * 2 + !Is_Big_Endian] = 0;
+	}
+
+	return i;
+}
+
+/** Convert a string with the built-in converter. See UtilityConvertString() for the parameters description.
+ * @return UTILITY_CONVERSION_ERROR_INVALID_CHARACTER if the source string is malformed,
+ * @return UTILITY_CONVERSION_ERROR_BUFFER_TOO_SMALL if the converted string does not fit in the destination buffer,
+ * @return UTILITY_CONVERSION_ERROR_NOT_REPRESENTABLE if the destination character set is not supported,
+ * @return A positive number on success, it indicates the destination string size in bytes.
+ */
+static int UtilityConvertStringBuiltIn(const unsigned char *Pointer_Source, unsigned char *Pointer_Destination, TUtilityCharacterSet Source_Character_Set, TUtilityCharacterSet Destination_Character_Set, size_t Source_String_Size, size_t Destination_String_Size)
+{
+	const unsigned char *Pointer_Source_End = Pointer_Source + Source_String_Size;
+	unsigned char *Pointer_Destination_Start = Pointer_Destination, *Pointer_Destination_End = Pointer_Destination + Destination_String_Size;
+	unsigned int Code_Point;
+	int Result, Is_Source_UTF16, Is_Destination_UTF16;
+	size_t Count, Maximum_Count;
+
+	Is_Source_UTF16 = (Source_Character_Set == UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN) || (Source_Character_Set == UTILITY_CHARACTER_SET_UTF16_LITTLE_ENDIAN);
+	Is_Destination_UTF16 = (Destination_Character_Set == UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN) || (Destination_Character_Set == UTILITY_CHARACTER_SET_UTF16_LITTLE_ENDIAN);
+
+	while (Pointer_Source < Pointer_Source_End)
+	{
+		// Most file names and contact names are mostly made of ASCII characters, convert them in bulk
+		if (Is_Source_UTF16 && (Destination_Character_Set == UTILITY_CHARACTER_SET_UTF8))
+		{
+			Maximum_Count = (size_t) (Pointer_Source_End - Pointer_Source) / 2;
+			if (Maximum_Count > (size_t) (Pointer_Destination_End - Pointer_Destination)) Maximum_Count = (size_t) (Pointer_Destination_End - Pointer_Destination);
+			Count = UtilityConvertASCIIFromUTF16(Source_Character_Set == UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN, Pointer_Source, Maximum_Count, Pointer_Destination);
+			Pointer_Source += Count * 2;
+			Pointer_Destination += Count;
+			if (Pointer_Source >= Pointer_Source_End) break;
+		}
+		else if (!Is_Source_UTF16 && Is_Destination_UTF16)
+		{
+			Maximum_Count = (size_t) (Pointer_Source_End - Pointer_Source);
+			if (Maximum_Count > (size_t) (Pointer_Destination_End - Pointer_Destination) / 2) Maximum_Count = (size_t) (Pointer_Destination_End - Pointer_Destination) / 2;
+			Count = UtilityConvertASCIIToUTF16(Destination_Character_Set == UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN, Pointer_Source, Maximum_Count, Pointer_Destination);
+			Pointer_Source += Count;
+			Pointer_Destination += Count * 2;
+			if (Pointer_Source >= Pointer_Source_End) break;
+		}
+
+		// Convert the next character, which is not an ASCII one or does not fit in the destination buffer
+		Result = UtilityDecodeCharacter(Source_Character_Set, &Pointer_Source, Pointer_Source_End, &Code_Point);
+		if (Result < 0) return Result;
+		Result = UtilityEncodeCharacter(Destination_Character_Set, Code_Point, &Pointer_Destination, Pointer_Destination_End);
+		if (Result < 0) return Result;
+	}
+
+	return (int) (Pointer_Destination - Pointer_Destination_Start);
+}
+
+/** Convert a string with iconv. See UtilityConvertString() for the parameters description.
+ * @return -1 if an error occurred,
+ * @return A positive number on success, it indicates the destination string size in bytes.
+ * @note This is only needed for the conversions to Windows-1252, that the program does not use, so the conversion descriptor is not kept between calls.
+ */
+static int UtilityConvertStringIconv(void *Pointer_String_Source, void *Pointer_String_Destination, TUtilityCharacterSet Source_Character_Set, TUtilityCharacterSet Destination_Character_Set, size_t Source_String_Size, size_t Destination_String_Size)
+{
+	iconv_t Conversion_Descriptor;
+	char *Pointer_String_Source_Characters, *Pointer_String_Destination_Characters;
+	size_t Destination_String_Available_Bytes;
+	int Return_Value = -1;
+
+	// Configure character sets
+	Conversion_Descriptor = iconv_open(Pointer_String_Utility_Character_Set_Names[Destination_Character_Set], Pointer_String_Utility_Character_Set_Names[Source_Character_Set]);
+	if (Conversion_Descriptor == (iconv_t) -1)
+	{
+		LOG("Error : failed to create the character set conversion descriptor, aborting text conversion.\n");
+		return -1;
+	}
+
+	// Do conversion
+	Pointer_String_Source_Characters = Pointer_String_Source;
+	Pointer_String_Destination_Characters = Pointer_String_Destination;
+	Destination_String_Available_Bytes = Destination_String_Size;
+	if (iconv(Conversion_Descriptor, &Pointer_String_Source_Characters, &Source_String_Size, &Pointer_String_Destination_Characters, &Destination_String_Available_Bytes) == (size_t) -1)
+	{
+		LOG("Error : text conversion failed (%s).\n", strerror(errno));
+		goto Exit;
+	}
+	Return_Value = (int) (Destination_String_Size - Destination_String_Available_Bytes); // Determine how many bytes of the destination buffer have been used
+
+Exit:
+	iconv_close(Conversion_Descriptor);
+	return Return_Value;
+}
+
+/** The nftw() callback used by UtilityRemoveDirectory(), it is called for the directory content before the directory itself.
+ * @param Pointer_String_Path The file or directory to remove.
+ * @param Pointer_Status Not used.
+ * @param Type_Flag Not used.
+ * @param Pointer_FTW Not used.
+ * @return 0 to continue the tree walk,
+ * @return -1 to stop the tree walk.
+ */
+static int UtilityRemoveDirectoryEntry(const char *Pointer_String_Path, const struct stat *Pointer_Status, int Type_Flag, struct FTW *Pointer_FTW)
+{
+	(void) Pointer_Status;
+	(void) Type_Flag;
+	(void) Pointer_FTW;
+
+	if (remove(Pointer_String_Path) != 0)
+	{
+		LOG("Error : could not remove \"%s\" (%s).\n", Pointer_String_Path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
 
 //-------------------------------------------------------------------------------------------------
 // Public functions
@@ -49,63 +464,54 @@ int UtilityCreateDirectory(char *Pointer_Directory_Name)
 	return 0;
 }
 
+int UtilityRemoveDirectory(char *Pointer_Directory_Name)
+{
+	// Remove the directory content first, without following the symbolic links
+	if (nftw(Pointer_Directory_Name, UtilityRemoveDirectoryEntry, 16, FTW_DEPTH | FTW_PHYS) != 0) return -1;
+	return 0;
+}
+
 int UtilityConvertString(void *Pointer_String_Source, void *Pointer_String_Destination, TUtilityCharacterSet Source_Character_Set, TUtilityCharacterSet Destination_Character_Set, size_t Source_String_Size, size_t Destination_String_Size)
 {
-	static char *Pointer_String_Character_Sets[] =
-	{
-		// UTILITY_CHARACTER_SET_WINDOWS_1252
-		"WINDOWS-1252",
-		// UTILITY_CHARACTER_SET_UTF16_BIG_ENDIAN
-		"UTF-16BE",
-		// UTILITY_CHARACTER_SET_UTF16_LITTLE_ENDIAN
-		"UTF-16LE",
-		// UTILITY_CHARACTER_SET_UTF8
-		"UTF-8"
-	};
-	iconv_t Conversion_Descriptor;
-	char *Pointer_String_Source_Character_Set, *Pointer_String_Destination_Character_Set, *Pointer_String_Source_Characters, *Pointer_String_Destination_Characters;
-	int Return_Value = -1;
-	size_t Destination_String_Available_Bytes;
+	int Return_Value;
 
-	// Select the correct character sets
+	// Make sure the character sets are known
 	if ((Source_Character_Set < 0) || (Source_Character_Set >= UTILITY_CHARACTER_SETS_COUNT))
 	{
 		LOG("Error : unknown source character set %d, aborting string conversion.\n", Source_Character_Set);
-		return Return_Value;
+		return -1;
 	}
-	Pointer_String_Source_Character_Set = Pointer_String_Character_Sets[Source_Character_Set];
 	if ((Destination_Character_Set < 0) || (Destination_Character_Set >= UTILITY_CHARACTER_SETS_COUNT))
 	{
 		LOG("Error : unknown destination character set %d, aborting string conversion.\n", Destination_Character_Set);
-		return Return_Value;
+		return -1;
 	}
-	Pointer_String_Destination_Character_Set = Pointer_String_Character_Sets[Destination_Character_Set];
-
-	// Configure character sets
-	Conversion_Descriptor = iconv_open(Pointer_String_Destination_Character_Set, Pointer_String_Source_Character_Set);
-	if (Conversion_Descriptor == (iconv_t) -1)
+	if (Destination_String_Size == 0)
 	{
-		LOG("Error : failed to create the character set conversion descriptor, aborting text conversion.\n");
-		return Return_Value;
+		LOG("Error : there is no room in the destination string, aborting string conversion.\n");
+		return -1;
 	}
+	Destination_String_Size--; // Keep room for the terminating zero
 
 	// Determine source string size if the size is not provided, make sure there are no trailing zero bytes in the string !
 	if (Source_String_Size == 0) Source_String_Size = strlen(Pointer_String_Source);
 
-	// Do conversion
-	Pointer_String_Source_Characters = Pointer_String_Source;
-	Pointer_String_Destination_Characters = Pointer_String_Destination;
-	Destination_String_Available_Bytes = Destination_String_Size;
-	if (iconv(Conversion_Descriptor, &Pointer_String_Source_Characters, &Source_String_Size, &Pointer_String_Destination_Characters, &Destination_String_Available_Bytes) == (size_t) -1) LOG("Error : text conversion failed (%s).\n", strerror(errno));
-	else Return_Value = (int) (Destination_String_Size - Destination_String_Available_Bytes); // Determine how many bytes of the destination buffer have been used
-	iconv_close(Conversion_Descriptor);
-
-	// Make sure the converted string is terminated
-	if (Return_Value >= 0)
+	// All conversions between UTF-16 and UTF-8 are done by the built-in converter, iconv is used only for the conversions to Windows-1252
+	Return_Value = UtilityConvertStringBuiltIn(Pointer_String_Source, Pointer_String_Destination, Source_Character_Set, Destination_Character_Set, Source_String_Size, Destination_String_Size);
+	if (Return_Value == UTILITY_CONVERSION_ERROR_NOT_REPRESENTABLE) Return_Value = UtilityConvertStringIconv(Pointer_String_Source, Pointer_String_Destination, Source_Character_Set, Destination_Character_Set, Source_String_Size, Destination_String_Size);
+	else if (Return_Value == UTILITY_CONVERSION_ERROR_INVALID_CHARACTER)
 	{
-		Pointer_String_Source_Characters = Pointer_String_Destination;
-		Pointer_String_Source_Characters[Return_Value] = 0;
+		LOG("Error : text conversion failed (%s).\n", strerror(EILSEQ));
+		return -1;
 	}
+	else if (Return_Value == UTILITY_CONVERSION_ERROR_BUFFER_TOO_SMALL)
+	{
+		LOG("Error : text conversion failed (%s).\n", strerror(E2BIG));
+		return -1;
+	}
+
+	// Make sure the converted string is terminated
+	if (Return_Value >= 0) ((char *) Pointer_String_Destination)[Return_Value] = 0;
 
 	return Return_Value;
 }